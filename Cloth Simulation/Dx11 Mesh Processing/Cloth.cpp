@@ -1,363 +1,218 @@
 #include "Cloth.h"
+#include "ClothFpContract.h"
 #include <iostream>
+#include <float.h>
+#include <math.h>
 #include "Source\CGVertexExt.h"
+#include "Source\buffers.h"
 
 using namespace std;
 using namespace CoreStructures;
 
+// The CPU solver writes its vertices straight into buffers read through the CGVertexExt input layout
+static_assert(sizeof(ClothVertex) == sizeof(CGVertexExt), "ClothVertex must be laid out as CGVertexExt");
+
 // Constructor
-Cloth::Cloth(ID3D11Device *device, ID3DBlob *vsBytecode, DWORD clothW, DWORD clothH)
+Cloth::Cloth(ID3D11Device *device, ID3DBlob *vsBytecode, DWORD clothW, DWORD clothH, ClothWorkerPool *cpuPool, const char *cacheDirectory)
 {
-	// Initialise variables
-	vertexBuffer		= NULL;
-	indexBuffer			= NULL;
-	inputLayout			= NULL;
-	constraintBuffer	= NULL;
-	anchorBuffer		= NULL;
+	init();
 
 	w = clothW;
 	h = clothH;
 
-	totalConstraints = ((((w - 2) * 4) + 5) * (h - 1)) + (w - 1);
+	// Call the buffer setup
+	setupBuffers(device, vsBytecode, nullptr, cpuPool, cacheDirectory);
 
-	clothForces			= nullptr;
-	clothConstraints	= nullptr;
-	clothAnchors		= nullptr;
+	// The CPU solver does not need the compute shaders
+	if (!solver)
+		compileClothShaders(device);
+}
 
-	anchorOn			= true;
+// Constructor
+Cloth::Cloth(ID3D11Device *device, ID3DBlob *vsBytecode, CGPolyMesh *mesh, ClothWorkerPool *cpuPool)
+{
+	init();
 
 	// Call the buffer setup
-	setupBuffers(device, vsBytecode);
-	compileClothShaders(device);
+	setupBuffers(device, vsBytecode, mesh, cpuPool, nullptr);
+
+	// The CPU solver does not need the compute shaders
+	if (!solver)
+		compileClothShaders(device);
 }
 
 // Destructor
 Cloth::~Cloth()
 {
+	if (solver)
+		delete solver;
+
+	if (constraintBatchSRV)
+	{
+		for (int i = 0; i < batchCount; i++)
+		{
+			if (constraintBatchSRV[i])
+				constraintBatchSRV[i]->Release();
+		}
+
+		free(constraintBatchSRV);
+	}
+
+	if (batchSize)
+		free(batchSize);
+
+	if (step_cbuffer)
+		step_cbuffer->Release();
+
+	if (stepConstants)
+		_aligned_free(stepConstants);
+
+	if (anchorSRV)
+		anchorSRV->Release();
+
+	if (anchorBuffer)
+		anchorBuffer->Release();
+
+	if (anchorSlotSRV)
+		anchorSlotSRV->Release();
+
+	if (anchorSlotBuffer)
+		anchorSlotBuffer->Release();
+
+	delete anchors;
+	free(restPositions);
+	free(anchorSlots);
+}
+
+// Initialise variables
+void Cloth::init()
+{
+	vertexBuffer		= NULL;
+	indexBuffer			= NULL;
+	inputLayout			= NULL;
+	constraintBuffer	= NULL;
+	anchorBuffer		= NULL;
+	anchorSlotBuffer	= NULL;
+	anchorSRV			= nullptr;
+	anchorSlotSRV		= nullptr;
+	step_cbuffer		= NULL;
+	stepConstants		= nullptr;
+	solver				= nullptr;
+	hashLog				= nullptr;
+	stepCount			= 0;
+	vertexStride		= sizeof(Particle);
+
+	anchors				= nullptr;
+	restPositions		= nullptr;
+	anchorSlots			= nullptr;
+	anchorSlotsStale	= false;
+	anchorCapacity		= 0;
+
+	w					= 0;
+	h					= 0;
+	totalConstraints	= 0;
+	particleCount		= 0;
+	indexCount			= 0;
+	batchCount			= 0;
+	batchSize			= nullptr;
+	constraintBatchSRV	= nullptr;
+
+	clothForces			= nullptr;
+	clothConstraints	= nullptr;
 
+	anchorOn			= true;
 }
 
 // Buffer setup
-void Cloth::setupBuffers(ID3D11Device *device, ID3DBlob *vsBytecode)
+void Cloth::setupBuffers(ID3D11Device *device, ID3DBlob *vsBytecode, CGPolyMesh *mesh, ClothWorkerPool *cpuPool, const char *cacheDirectory)
 {
 	// Setup basic terrain model buffers
 	Particle* vertices			= nullptr;
-	Constraint* constraints		= nullptr;
-	Anchor* anchors				= nullptr;
-	DWORD* indices				= nullptr;
+	ClothTopology* topology		= nullptr;
 	
 	try
 	{
 		if (!device || !vsBytecode)
 			throw("Invalid parameters for cloth model model instantiation");
 
+		// Constraints, batches and indices
+		if (mesh)
+			topology = new ClothTopology(mesh, cpuPool);
+		else
+			topology = new ClothTopology(w, h, cpuPool, cacheDirectory);
 
-		vertices = (Particle*)malloc(w * h * sizeof(Particle));
-		indices = (DWORD*)malloc((w-1) * (h-1) * 6 * sizeof(DWORD));
-		anchors = (Anchor*)malloc(sizeof(Anchor) * 3);
-		constraints = (Constraint*)malloc(sizeof(Constraint) * totalConstraints);
+		particleCount		= topology->particleCount;
+		indexCount			= topology->totalIndices;
+		totalConstraints	= topology->totalConstraints;
 
-		if (!vertices || !indices)
+		// CPU solver setup - the solver takes ownership of the topology
+		if (cpuPool)
 		{
-			throw("Cannot create cloth buffers");
-		}
+			ClothTopology* solverTopology = topology;
+			topology = nullptr;
 
-#pragma region Vertices Setup
-		// Setup vertices positions
-		Particle *vptr = vertices;
+			solver = new ClothSolver(solverTopology, cpuPool);
 
-		for (int j=0; j<int(h); ++j) 
-		{
-			for (int i = 0; i < int(w); ++i, ++vptr)
-			{
-				vptr->vertex.pos			= XMFLOAT3( ((float)i / (float)(w-1)), 0, ((float)j / (float)(h-1)));
-				vptr->prevPos				= vptr->vertex.pos;
-				vptr->vertex.normal			= XMFLOAT3(0, 0, 1);
-				vptr->vertex.texCoord		= XMFLOAT2((float)i / (float)(w-1), (float)j/(float)(h-1));
+			// Still regions of the cloth stop costing anything until disturbed
+			solver->setSleeping(true);
 
-				vptr->vertex.matDiffuse		= XMCOLOR(0.0f, 1.0f, 0.0f, 1.0f);
-				vptr->vertex.matSpecular	= XMCOLOR(0.0f, 0.0f, 0.0f, 0.0f);
-			}
+			setupCPUBuffers(device, vsBytecode);
+			return;
 		}
-#pragma endregion
 
-#pragma region Old Constraints Setup
-		/*
-		int constraintI = 0;
-		int index = 0;
-		GUVector3 distance;
+		vertices = (Particle*)malloc(particleCount * sizeof(Particle));
+		restPositions = (ClothFloat3*)malloc(particleCount * sizeof(ClothFloat3));
+		anchorSlots = (UINT*)malloc(particleCount * sizeof(UINT));
 
-		for (int j = 0; j < h; j++)
-		{
-			for (int i = 0; i < w; i++)
-			{
-				index = (j * w) + i;
-
-				// Vertical
-				if(j)
-				{
-					// Vertical structured constraint
-					constraints[constraintI].start	= index - w;
-					constraints[constraintI].end	= index;
-
-					// Calculate distance
-					distance = GUVector3(	vertices[index].vertex.pos.x - vertices[index-w].vertex.pos.x,
-											vertices[index].vertex.pos.y - vertices[index-w].vertex.pos.y,
-											vertices[index].vertex.pos.z - vertices[index-w].vertex.pos.z);
-
-					// Set the constraints length to the calculated length
-					constraints[constraintI].length = distance.length();
-
-					constraintI++;
-
-					if(i < (w -1))
-					{
-						// Up-right sheer constraint
-						constraints[constraintI].start	= index - (w-1);
-						constraints[constraintI].end	= index;
-
-						// Calculate distance between the two points
-						distance = GUVector3(	vertices[index].vertex.pos.x - vertices[index -(w-1)].vertex.pos.x,
-												vertices[index].vertex.pos.y - vertices[index -(w-1)].vertex.pos.y,
-												vertices[index].vertex.pos.z - vertices[index -(w-1)].vertex.pos.z);
-
-						// Set the constraints length to the calculated length
-						constraints[constraintI].length = distance.length();
-
-						// Increment constraint index
-						constraintI++;
-					}
-				}
-
-				// Horizontal
-				if(i)
-				{
-					// Horizontal structured constraint
-					constraints[constraintI].start	= index - 1;
-					constraints[constraintI].end	= index;
-
-					// Calculate distance
-					distance = GUVector3(	vertices[index].vertex.pos.x - vertices[index-1].vertex.pos.x,
-											vertices[index].vertex.pos.y - vertices[index-1].vertex.pos.y,
-											vertices[index].vertex.pos.z - vertices[index-1].vertex.pos.z);
-
-					// Set the constraints length to the calculated length
-					constraints[constraintI].length = distance.length();
-
-					//Increment constraint index
-					constraintI++;
-
-					if(j)
-					{
-						// Up-left sheer constraint
-						constraints[constraintI].start	= index - (w+1);
-						constraints[constraintI].end	= index;
-
-						// Calculate distance
-						distance = GUVector3(	vertices[index].vertex.pos.x - vertices[index-(w+1)].vertex.pos.x,
-												vertices[index].vertex.pos.y - vertices[index-(w+1)].vertex.pos.y,
-												vertices[index].vertex.pos.z - vertices[index-(w+1)].vertex.pos.z);
-
-						// Set the constraints length to the calculated length
-						constraints[constraintI].length = distance.length();
-
-						//Increment constraint index
-						constraintI++;
-					}
-				}
-			}
-		}
-		*/
+		batchCount = topology->batchCount;
+		batchSize = (int*)malloc(sizeof(int) * batchCount);
+		constraintBatchSRV = (ID3D11ShaderResourceView**)calloc(batchCount, sizeof(ID3D11ShaderResourceView*));
 
-#pragma endregion
+		// Same defaults as the CPU solver
+		stepConstants = (clothStepStruct*)_aligned_malloc(sizeof(clothStepStruct), 16);
 
-#pragma region New Batch Constraints Setup
-
-		int constraintI = 0;
-		int index = 0;
-		GUVector3 distance;
-
-		// Batch sizes setup
-		batchSize[0] = h * (w * 0.5);						// Horizontal Even
-		batchSize[1] = ((w - 1) * h) - batchSize[0];		// Horizontal Odd
-		batchSize[2] = w * (h * 0.5);						// Vertical Even
-		batchSize[3] = ((h - 1) * w) - batchSize[2];		// Vertical Odd
-		batchSize[4] = (w - 1) * (h * 0.5);					// Diagonal Even
-		batchSize[5] = ((w - 1) * (h - 1)) - batchSize[4];	// Diagonal Odd
-		batchSize[6] = batchSize[4];
-		batchSize[7] = batchSize[5];
-
-		constraintBatch[0] = 0;
-		constraintBatch[1] = batchSize[0];
-		constraintBatch[2] = constraintBatch[1] + batchSize[1];
-		constraintBatch[3] = constraintBatch[2] + batchSize[2];
-		constraintBatch[4] = constraintBatch[3] + batchSize[3];
-		constraintBatch[5] = constraintBatch[4] + batchSize[4];
-		constraintBatch[6] = constraintBatch[5] + batchSize[5];
-		constraintBatch[7] = constraintBatch[6] + batchSize[6];
-
-
-		// Even and odd booleans
-		bool oddHori = true;
-		bool oddVert = true;
-
-		for (int j = 0; j < h; j++)
+		if (!vertices || !restPositions || !anchorSlots || !batchSize || !constraintBatchSRV || !stepConstants)
 		{
-			// Vertical boolean flip
-			oddVert = !oddVert;
-
-			for (int i = 0; i < w; i++)
-			{
-				index = (j * w) + i;
-
-				// Horizontal boolean flip
-				oddHori = !oddHori;
-
-				// Horizontal constraints
-				if(i)
-				{
-					if(oddHori)
-					{
-						constraintI = constraintBatch[0];
-						constraintBatch[0]++;
-					}
-					else
-					{
-						constraintI = constraintBatch[1];
-						constraintBatch[1]++;
-					}
-
-					// Horizontal structured constraint
-					constraints[constraintI].start	= index - 1;
-					constraints[constraintI].end	= index;
-
-					// Calculate distance
-					distance = GUVector3(	vertices[index].vertex.pos.x - vertices[index-1].vertex.pos.x,
-											vertices[index].vertex.pos.y - vertices[index-1].vertex.pos.y,
-											vertices[index].vertex.pos.z - vertices[index-1].vertex.pos.z);
-
-					// Set the constraints length to the calculated length
-					constraints[constraintI].length = distance.length();
-
-					// Up and left shear constraints
-					if(j)
-					{
-						if(oddVert)
-						{
-							constraintI = constraintBatch[4];
-							constraintBatch[4]++;
-						}
-						else
-						{
-							constraintI = constraintBatch[5];
-							constraintBatch[5]++;
-						}
-
-						constraints[constraintI].start	= index - (w+1);
-						constraints[constraintI].end	= index;
-
-						// Calculate distance
-						distance = GUVector3(	vertices[index].vertex.pos.x - vertices[index-(w+1)].vertex.pos.x,
-												vertices[index].vertex.pos.y - vertices[index-(w+1)].vertex.pos.y,
-												vertices[index].vertex.pos.z - vertices[index-(w+1)].vertex.pos.z);
-
-						// Set the constraints length to the calculated length
-						constraints[constraintI].length = distance.length();
-					}
-				}
-
-				// Vertical constraints
-				if(j)
-				{
-					if(oddVert)
-					{
-						constraintI = constraintBatch[2];
-						constraintBatch[2]++;
-					}
-					else
-					{
-						constraintI = constraintBatch[3];
-						constraintBatch[3]++;
-					}
-
-					// Vertical structured constraint
-					constraints[constraintI].start	= index - w;
-					constraints[constraintI].end	= index;
-
-					// Calculate distance
-					distance = GUVector3(	vertices[index].vertex.pos.x - vertices[index-w].vertex.pos.x,
-											vertices[index].vertex.pos.y - vertices[index-w].vertex.pos.y,
-											vertices[index].vertex.pos.z - vertices[index-w].vertex.pos.z);
-
-					// Set the constraints length to the calculated length
-					constraints[constraintI].length = distance.length();
-
-					// Up and right shear constraint
-					if(i < (w -1))
-					{
-						if(oddVert)
-						{
-							constraintI = constraintBatch[6];
-							constraintBatch[6]++;
-						}
-						else
-						{
-							constraintI = constraintBatch[7];
-							constraintBatch[7]++;
-						}
-
-						// Up-right sheer constraint
-						constraints[constraintI].start	= index - (w-1);
-						constraints[constraintI].end	= index;
-
-						// Calculate distance between the two points
-						distance = GUVector3(	vertices[index].vertex.pos.x - vertices[index -(w-1)].vertex.pos.x,
-												vertices[index].vertex.pos.y - vertices[index -(w-1)].vertex.pos.y,
-												vertices[index].vertex.pos.z - vertices[index -(w-1)].vertex.pos.z);
-
-						// Set the constraints length to the calculated length
-						constraints[constraintI].length = distance.length();
-					}
-				}
-			}
+			throw("Cannot create cloth buffers");
 		}
 
-#pragma endregion
+		new (stepConstants)clothStepStruct();
 
-#pragma region Anchor Setup
-		// Anchors index setup
-		anchors[0].index = 0;
-		anchors[1].index = (DWORD)(w/2);
-		anchors[2].index = w-1;
+		stepConstants->gravity	= XMFLOAT4(0.0f, -9.81f, -9.81f, 0.0f);
+		stepConstants->timeStep	= scheduler.stepTime;
+		stepConstants->damping	= 0.99f;
+		stepConstants->anchorOn	= anchorOn ? 1 : 0;
 
-		// Anchors position setup
-		for(int i = 0; i<3; i++)
-			anchors[i].pos = vertices[anchors[i].index].vertex.pos;
-#pragma endregion
+		// Setup vertices positions
+		topology->buildParticles(vertices);
 
-#pragma region Indices Setup
-		// Setup index values
-		DWORD *iptr = indices;
+		for (int i = 0; i < particleCount; i++)
+			restPositions[i] = vertices[i].vertex.pos;
 
-		for (DWORD j=0; j<h-1; ++j) 
+		// Setup anchors - the cloth hangs from the anchors of its topology until they are replaced
+		Anchor hanging[CLOTH_ANCHOR_COUNT];
+		int hangingParticles[CLOTH_ANCHOR_COUNT];
+		ClothFloat3 hangingTargets[CLOTH_ANCHOR_COUNT];
+
+		topology->buildAnchors(hanging, vertices);
+
+		for (int i = 0; i < CLOTH_ANCHOR_COUNT; i++)
 		{
-			for (DWORD i=0; i<w-1; ++i, iptr+=6) 
-			{
-				DWORD a = w * j + i;
-				DWORD b = a + w;
-				DWORD c = b + 1;
-				DWORD d = a + 1;
-
-				iptr[0] = a;
-				iptr[1] = b;
-				iptr[2] = d;
-
-				iptr[3] = b;
-				iptr[4] = c;
-				iptr[5] = d;
-			}
+			hangingParticles[i]	= (int)hanging[i].index;
+			hangingTargets[i]	= hanging[i].pos;
 		}
-#pragma endregion
+
+		anchors = new ClothAnchors();
+		anchors->set(hangingParticles, hangingTargets, CLOTH_ANCHOR_COUNT);
+
+		for (int i = 0; i < particleCount; i++)
+			anchorSlots[i] = CLOTH_NO_ANCHOR;
+
+		for (int i = 0; i < CLOTH_ANCHOR_COUNT; i++)
+			anchorSlots[hangingParticles[i]] = i;
+
+		for (int i = 0; i < batchCount; i++)
+			batchSize[i] = topology->batchSize[i];
 
 #pragma region BUFFERS
 
@@ -373,7 +228,7 @@ void Cloth::setupBuffers(ID3D11Device *device, ID3DBlob *vsBytecode)
 		vertexDesc.MiscFlags			= D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
 		vertexDesc.StructureByteStride	= sizeof(Particle);
 		vertexDesc.Usage				= D3D11_USAGE_DEFAULT;
-		vertexDesc.ByteWidth			= sizeof(Particle) * w * h;
+		vertexDesc.ByteWidth			= sizeof(Particle) * particleCount;
 		vertexData.pSysMem				= vertices;
 
 		HRESULT hr = device->CreateBuffer(&vertexDesc, &vertexData, &vertexBuffer);
@@ -395,46 +250,47 @@ void Cloth::setupBuffers(ID3D11Device *device, ID3DBlob *vsBytecode)
 		constraintDesc.StructureByteStride	= sizeof(Constraint);
 		constraintDesc.Usage				= D3D11_USAGE_DEFAULT;
 		constraintDesc.ByteWidth			= sizeof(Constraint) * totalConstraints;
-		constraintData.pSysMem				= constraints;
+		constraintData.pSysMem				= topology->constraints;
 
 		hr = device->CreateBuffer(&constraintDesc, &constraintData, &constraintBuffer);
 
 		if (!SUCCEEDED(hr))
 			throw("Constraint buffer cannot be created");
 
-		// Setup Anchor buffer
-		D3D11_BUFFER_DESC anchorDesc;
-		D3D11_SUBRESOURCE_DATA anchorData;
+		// Setup anchor target buffer - rewritten from the CPU whenever the targets move
+		hr = createAnchorTargets(device, CLOTH_ANCHOR_COUNT);
+
+		if (!SUCCEEDED(hr))
+			throw("Anchor buffer cannot be created");
 
-		ZeroMemory(&anchorDesc, sizeof(D3D11_BUFFER_DESC));
-		ZeroMemory(&anchorData, sizeof(D3D11_SUBRESOURCE_DATA));
+		// Setup anchor slot buffer - rewritten only when the anchors are replaced
+		D3D11_BUFFER_DESC anchorSlotDesc;
+		D3D11_SUBRESOURCE_DATA anchorSlotData;
 
-		anchorDesc.BindFlags			= D3D11_BIND_UNORDERED_ACCESS | D3D11_BIND_SHADER_RESOURCE;
-		anchorDesc.CPUAccessFlags		= 0;
-		anchorDesc.MiscFlags			= D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
-		anchorDesc.StructureByteStride	= sizeof(Anchor);
-		anchorDesc.Usage				= D3D11_USAGE_DEFAULT;
-		anchorDesc.ByteWidth			= sizeof(Anchor) * 3;
-		anchorData.pSysMem				= anchors;
+		ZeroMemory(&anchorSlotDesc, sizeof(D3D11_BUFFER_DESC));
+		ZeroMemory(&anchorSlotData, sizeof(D3D11_SUBRESOURCE_DATA));
 
-		hr = device->CreateBuffer(&anchorDesc, &anchorData, &anchorBuffer);
+		anchorSlotDesc.BindFlags			= D3D11_BIND_SHADER_RESOURCE;
+		anchorSlotDesc.CPUAccessFlags		= 0;
+		anchorSlotDesc.MiscFlags			= D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+		anchorSlotDesc.StructureByteStride	= sizeof(UINT);
+		anchorSlotDesc.Usage				= D3D11_USAGE_DEFAULT;
+		anchorSlotDesc.ByteWidth			= sizeof(UINT) * particleCount;
+		anchorSlotData.pSysMem				= anchorSlots;
 
-		if (!SUCCEEDED(hr))
-			throw("Anchor buffer cannot be created");
+		hr = device->CreateBuffer(&anchorSlotDesc, &anchorSlotData, &anchorSlotBuffer);
 
-		// Setup index buffer
-		D3D11_BUFFER_DESC indexDesc;
-		D3D11_SUBRESOURCE_DATA indexData;
+		if (!SUCCEEDED(hr))
+			throw("Anchor slot buffer cannot be created");
 
-		ZeroMemory(&indexDesc, sizeof(D3D11_BUFFER_DESC));
-		ZeroMemory(&indexData, sizeof(D3D11_SUBRESOURCE_DATA));
+		// Setup step cbuffer
+		hr = createCBuffer(device, stepConstants, &step_cbuffer);
 
-		indexDesc.Usage = D3D11_USAGE_IMMUTABLE;
-		indexDesc.ByteWidth = sizeof(DWORD) * (w-1) * (h-1) * 6;
-		indexDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-		indexData.pSysMem = indices;
+		if (!SUCCEEDED(hr))
+			throw("Step cbuffer cannot be created");
 
-		hr = device->CreateBuffer(&indexDesc, &indexData, &indexBuffer);
+		// Setup index buffer (16 bit when the cloth has few enough particles)
+		hr = createIndexBuffer(device, topology->indices, indexCount, particleCount, D3D11_USAGE_IMMUTABLE, &indexBuffer, &indexFormat);
 
 		if (!SUCCEEDED(hr))
 			throw("Index buffer cannot be created");
@@ -453,7 +309,7 @@ void Cloth::setupBuffers(ID3D11Device *device, ID3DBlob *vsBytecode)
 
 		particlesUAVDesc.Buffer.FirstElement		= 0;
 		particlesUAVDesc.Buffer.Flags				= 0;
-		particlesUAVDesc.Buffer.NumElements			= w * h;
+		particlesUAVDesc.Buffer.NumElements			= particleCount;
 		particlesUAVDesc.Format						= DXGI_FORMAT_UNKNOWN;
 		particlesUAVDesc.ViewDimension				= D3D11_UAV_DIMENSION_BUFFER;
 
@@ -479,7 +335,7 @@ void Cloth::setupBuffers(ID3D11Device *device, ID3DBlob *vsBytecode)
 		// ------------------------------------------------------
 		int firstEl = 0;
 
-		for (int i = 0; i < 8; i++)
+		for (int i = 0; i < batchCount; i++)
 		{
 			D3D11_SHADER_RESOURCE_VIEW_DESC constraintSRVDesc;
 
@@ -498,27 +354,25 @@ void Cloth::setupBuffers(ID3D11Device *device, ID3DBlob *vsBytecode)
 
 		
 
-		// Create shader resource view for anchors
-		D3D11_SHADER_RESOURCE_VIEW_DESC anchorSRVDesc;
+		// Create shader resource view for the anchor slots
+		D3D11_SHADER_RESOURCE_VIEW_DESC anchorSlotSRVDesc;
 
-		anchorSRVDesc.Buffer.FirstElement			= 0;
-		anchorSRVDesc.Buffer.NumElements			= 3;
-		anchorSRVDesc.Format						= DXGI_FORMAT_UNKNOWN;
-		anchorSRVDesc.ViewDimension					= D3D11_SRV_DIMENSION_BUFFER;
+		anchorSlotSRVDesc.Buffer.FirstElement		= 0;
+		anchorSlotSRVDesc.Buffer.NumElements		= particleCount;
+		anchorSlotSRVDesc.Format					= DXGI_FORMAT_UNKNOWN;
+		anchorSlotSRVDesc.ViewDimension				= D3D11_SRV_DIMENSION_BUFFER;
 
-		hr = device->CreateShaderResourceView(anchorBuffer, &anchorSRVDesc, &anchorSRV);
+		hr = device->CreateShaderResourceView(anchorSlotBuffer, &anchorSlotSRVDesc, &anchorSlotSRV);
 
 		if (!SUCCEEDED(hr))
-			throw("Cannot create anchors SRV");
+			throw("Cannot create anchor slots SRV");
 
 
 #pragma endregion
 
 		// dispose of local buffer resources since no longer needed
 		free(vertices);
-		free(indices);
-		free(constraints);
-		free(anchors);
+		delete topology;
 	}
 	catch (char *err)
 	{
@@ -528,8 +382,11 @@ void Cloth::setupBuffers(ID3D11Device *device, ID3DBlob *vsBytecode)
 		if (vertices)
 			free(vertices);
 
-		if (indices)
-			free(indices);
+		if (topology)
+			delete topology;
+
+		if (solver)
+			delete solver;
 
 		if (vertexBuffer)
 			vertexBuffer->Release();
@@ -546,17 +403,164 @@ void Cloth::setupBuffers(ID3D11Device *device, ID3DBlob *vsBytecode)
 		if (anchorBuffer)
 			anchorBuffer->Release();
 
+		if (anchorSRV)
+			anchorSRV->Release();
+
+		if (anchorSlotBuffer)
+			anchorSlotBuffer->Release();
+
+		if (anchorSlotSRV)
+			anchorSlotSRV->Release();
+
+		if (step_cbuffer)
+			step_cbuffer->Release();
+
+		if (stepConstants)
+			_aligned_free(stepConstants);
+
+		delete anchors;
+		free(restPositions);
+		free(anchorSlots);
+
+		if (constraintBatchSRV)
+		{
+			for (int i = 0; i < batchCount; i++)
+			{
+				if (constraintBatchSRV[i])
+					constraintBatchSRV[i]->Release();
+			}
+
+			free(constraintBatchSRV);
+		}
+
+		if (batchSize)
+			free(batchSize);
+
 		vertexBuffer		= nullptr;
 		indexBuffer			= nullptr;
 		inputLayout			= nullptr;
 		constraintBuffer	= nullptr;
 		anchorBuffer		= nullptr;
+		anchorSRV			= nullptr;
+		anchorSlotBuffer	= nullptr;
+		anchorSlotSRV		= nullptr;
+		step_cbuffer		= nullptr;
+		stepConstants		= nullptr;
+		anchors				= nullptr;
+		restPositions		= nullptr;
+		anchorSlots			= nullptr;
+		anchorCapacity		= 0;
+		solver				= nullptr;
+		constraintBatchSRV	= nullptr;
+		batchSize			= nullptr;
+		batchCount			= 0;
 
 		w = 0;
 		h = 0;
+		particleCount = 0;
+		indexCount = 0;
 	}
 }
 
+// Render buffer setup for the CPU solver
+void Cloth::setupCPUBuffers(ID3D11Device *device, ID3DBlob *vsBytecode)
+{
+	const ClothTopology* topology = solver->getTopology();
+
+	// Rest state vertices - rendered until the first step is simulated
+	ClothVertex* restVertices = (ClothVertex*)malloc(sizeof(ClothVertex) * solver->particleCount());
+
+	if (!restVertices)
+		throw("Cannot create cloth buffers");
+
+	solver->assembleVertices(restVertices);
+
+	// Setup vertex buffer - only the render vertices are uploaded, the solver streams stay on the CPU
+	D3D11_BUFFER_DESC vertexDesc;
+	D3D11_SUBRESOURCE_DATA vertexData;
+
+	ZeroMemory(&vertexDesc, sizeof(D3D11_BUFFER_DESC));
+	ZeroMemory(&vertexData, sizeof(D3D11_SUBRESOURCE_DATA));
+
+	vertexDesc.BindFlags			= D3D11_BIND_VERTEX_BUFFER;
+	vertexDesc.CPUAccessFlags		= D3D11_CPU_ACCESS_WRITE;
+	vertexDesc.Usage				= D3D11_USAGE_DYNAMIC;
+	vertexDesc.ByteWidth			= sizeof(ClothVertex) * solver->particleCount();
+	vertexData.pSysMem				= restVertices;
+
+	HRESULT hr = device->CreateBuffer(&vertexDesc, &vertexData, &vertexBuffer);
+
+	free(restVertices);
+
+	if (!SUCCEEDED(hr))
+		throw("Vertex buffer cannot be created");
+
+	vertexStride = sizeof(ClothVertex);
+
+	// Setup index buffer (16 bit when the cloth has few enough particles)
+	hr = createIndexBuffer(device, topology->indices, topology->totalIndices, solver->particleCount(), D3D11_USAGE_IMMUTABLE, &indexBuffer, &indexFormat);
+
+	if (!SUCCEEDED(hr))
+		throw("Index buffer cannot be created");
+
+	// build the vertex input layout
+	hr = CGVertexExt::createInputLayout(device, vsBytecode, &inputLayout);
+
+	if (!SUCCEEDED(hr))
+		throw("Cannot create input layout interface");
+}
+
+// Create anchor targets
+HRESULT Cloth::createAnchorTargets(ID3D11Device *device, int capacity)
+{
+	if (anchorSRV)
+		anchorSRV->Release();
+
+	if (anchorBuffer)
+		anchorBuffer->Release();
+
+	anchorSRV		= nullptr;
+	anchorBuffer	= nullptr;
+	anchorCapacity	= 0;
+
+	// One float4 per anchor, so a batch of targets is a single copy
+	D3D11_BUFFER_DESC anchorDesc;
+
+	ZeroMemory(&anchorDesc, sizeof(D3D11_BUFFER_DESC));
+
+	anchorDesc.BindFlags			= D3D11_BIND_SHADER_RESOURCE;
+	anchorDesc.CPUAccessFlags		= D3D11_CPU_ACCESS_WRITE;
+	anchorDesc.MiscFlags			= D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	anchorDesc.StructureByteStride	= sizeof(ClothFloat4);
+	anchorDesc.Usage				= D3D11_USAGE_DYNAMIC;
+	anchorDesc.ByteWidth			= sizeof(ClothFloat4) * capacity;
+
+	HRESULT hr = device->CreateBuffer(&anchorDesc, nullptr, &anchorBuffer);
+
+	if (!SUCCEEDED(hr))
+		return hr;
+
+	// Create shader resource view for the anchor targets
+	D3D11_SHADER_RESOURCE_VIEW_DESC anchorSRVDesc;
+
+	anchorSRVDesc.Buffer.FirstElement			= 0;
+	anchorSRVDesc.Buffer.NumElements			= capacity;
+	anchorSRVDesc.Format						= DXGI_FORMAT_UNKNOWN;
+	anchorSRVDesc.ViewDimension					= D3D11_SRV_DIMENSION_BUFFER;
+
+	hr = device->CreateShaderResourceView(anchorBuffer, &anchorSRVDesc, &anchorSRV);
+
+	if (!SUCCEEDED(hr))
+		return hr;
+
+	anchorCapacity = capacity;
+
+	// The new buffer holds nothing yet
+	anchorSlotsStale = true;
+
+	return hr;
+}
+
 // Compile and create shaders
 void Cloth::compileClothShaders(ID3D11Device *device)
 {
@@ -603,60 +607,106 @@ void Cloth::compileClothShaders(ID3D11Device *device)
 
 #pragma endregion
 
-#pragma region Anchor Shader
-		// Anchor shader compile and create
+	}
+	catch(char* err)
+	{
+		cout << err;
+	}
+}
 
-		// Compile shader
-		hr = CShaderFactory::CompileComputeShader(L"Resources\\Shaders\\cloth_anchors_cs.hlsl", "main", device, &cShaderBlob);
+// Simulate
+void Cloth::simulate(ID3D11DeviceContext *context, double frameSeconds)
+{
+	if (!context || !vertexBuffer)
+		return;
 
-		if(!SUCCEEDED(hr))
-			throw("Anchors shader compile error");
+	int steps = scheduler.advance(frameSeconds);
 
-		// Create shader
-		hr = device->CreateComputeShader(cShaderBlob->GetBufferPointer(), cShaderBlob->GetBufferSize(), nullptr, &clothAnchors);
+	// The anchor targets written this frame go up once, however many steps are owed
+	if (!solver && steps > 0)
+		uploadAnchors(context);
 
-		cShaderBlob->Release();
+	for (int i = 0; i < steps; i++)
+		step(context);
 
-		if(!SUCCEEDED(hr))
-			throw("Anchors shader create error");
-
-#pragma endregion
+	// The CPU solver renders between its last two states so motion stays smooth when
+	// the frame rate and step rate differ. The compute shaders render the latest state.
+	if (solver)
+		uploadVertices(context, scheduler.alpha());
+}
 
-	}
-	catch(char* err)
+// Step
+void Cloth::step(ID3D11DeviceContext* context)
+{
+	// Step on the CPU
+	if (solver)
 	{
-		cout << err;
+		solver->anchorOn = anchorOn;
+		solver->timeStep = scheduler.stepTime;
+		solver->step();
+
+		// Patch the triangles the tears changed, a box for each range of them
+		solver->takeChangedTriangles(changedRanges);
+
+		for (size_t r = 0; r < changedRanges.size(); r++)
+		{
+			int first	= changedRanges[r].first;
+			int end		= changedRanges[r].end;
+
+			const DWORD* changed = solver->getTopology()->indices + first * 3;
+
+			if (indexFormat == DXGI_FORMAT_R16_UINT)
+			{
+				shortIndices.resize((end - first) * 3);
+				ClothIndexOptimiser::narrowIndices(changed, (end - first) * 3, shortIndices.data());
+
+				D3D11_BOX box = { (UINT)(first * 3 * sizeof(WORD)), 0, 0, (UINT)(end * 3 * sizeof(WORD)), 1, 1 };
+
+				context->UpdateSubresource(indexBuffer, 0, &box, shortIndices.data(), 0, 0);
+			}
+			else
+			{
+				D3D11_BOX box = { (UINT)(first * 3 * sizeof(DWORD)), 0, 0, (UINT)(end * 3 * sizeof(DWORD)), 1, 1 };
+
+				context->UpdateSubresource(indexBuffer, 0, &box, changed, 0, 0);
+			}
+		}
+
+		if (hashLog)
+			fprintf(hashLog, "%u %016llx\n", stepCount, solver->getStats().stateHash);
+
+		stepCount++;
+
+		return;
 	}
-}
 
-// Update
-void Cloth::update(ID3D11DeviceContext* context)
-{
+	// Update the step constants
+	stepConstants->timeStep = scheduler.stepTime;
+	stepConstants->anchorOn = anchorOn ? 1 : 0;
+
+	mapBuffer<clothStepStruct>(context, stepConstants, step_cbuffer);
+
 	// Bind Unordered Access View to the compute shader
 	context->CSSetUnorderedAccessViews(0, 1, &particlesUAV, nullptr);
-	
+	context->CSSetConstantBuffers(0, 1, &step_cbuffer);
+
+	// Bind SRVs - the anchors are pinned by the forces shader and not moved by the constraints shader
+	ID3D11ShaderResourceView* SRV[] = {nullptr, anchorSRV, anchorSlotSRV};
+
+	context->CSSetShaderResources(0, 3, SRV);
+
 	// Apply forces shader
 	context->CSSetShader(clothForces, 0, 0);
-	context->Dispatch((int)(w*h), 1, 1);
-
-	// Apply anchors shader
-	if(anchorOn)
-	{
-		context->CSSetShader(clothAnchors, 0, 0);
-		context->Dispatch(3, 1, 1);
-	}
+	context->Dispatch(particleCount, 1, 1);
 
 	// Apply constraints shader
 	context->CSSetShader(clothConstraints, 0, 0);
 	//context->Dispatch(totalConstraints, 1, 1);
 
-	// Bind SRVs
-	ID3D11ShaderResourceView* SRV[] = {constraintBatchSRV[0], anchorSRV};
-
-	for(int i = 0; i < 8; i++)
+	for(int i = 0; i < batchCount; i++)
 	{
 		SRV[0] = constraintBatchSRV[i];
-		context->CSSetShaderResources(0, 2, SRV); 
+		context->CSSetShaderResources(0, 3, SRV); 
 		context->Dispatch(batchSize[i], 1, 1);
 	}
 
@@ -665,6 +715,462 @@ void Cloth::update(ID3D11DeviceContext* context)
 	context->CSSetUnorderedAccessViews(0, 1, &noUAV, nullptr);
 }
 
+// Upload vertices
+void Cloth::uploadVertices(ID3D11DeviceContext* context, float alpha)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped;
+
+	if (SUCCEEDED(context->Map(vertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+	{
+		solver->assembleVertices((ClothVertex*)mapped.pData, alpha);
+		context->Unmap(vertexBuffer, 0);
+	}
+}
+
+// Upload anchors
+void Cloth::uploadAnchors(ID3D11DeviceContext* context)
+{
+	int first, end;
+
+	bool moved = anchors->publish(first, end);
+
+	if (anchorSlotsStale)
+	{
+		// Grow the target buffer to fit
+		if (anchors->count() > anchorCapacity)
+		{
+			ID3D11Device* device = nullptr;
+
+			context->GetDevice(&device);
+
+			HRESULT hr = createAnchorTargets(device, anchors->count());
+
+			device->Release();
+
+			if (!SUCCEEDED(hr))
+				return;
+		}
+
+		context->UpdateSubresource(anchorSlotBuffer, 0, nullptr, anchorSlots, 0, 0);
+		anchorSlotsStale = false;
+		moved = true;
+	}
+
+	if (!moved)
+		return;
+
+	// Discarding rewrites the whole buffer, so every target goes up
+	D3D11_MAPPED_SUBRESOURCE mapped;
+
+	if (SUCCEEDED(context->Map(anchorBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+	{
+		memcpy(mapped.pData, anchors->targets(), sizeof(ClothFloat4) * anchors->count());
+		context->Unmap(anchorBuffer, 0);
+	}
+}
+
+// Set solver mode
+bool Cloth::setSolverMode(ClothSolverMode mode)
+{
+	if (!solver)
+		return false;
+
+	solver->setMode(mode);
+
+	return true;
+}
+
+// Set multigrid
+bool Cloth::setMultigrid(int levels)
+{
+	if (!solver)
+		return false;
+
+	return solver->setMultigrid(levels);
+}
+
+// Set attachments
+bool Cloth::setAttachments(bool enabled)
+{
+	if (!solver)
+		return false;
+
+	solver->setAttachments(enabled);
+
+	return true;
+}
+
+// Set ground
+bool Cloth::setGround(const ClothHeightfield* heightfield)
+{
+	if (!solver)
+		return false;
+
+	solver->setGround(heightfield);
+
+	return true;
+}
+
+// Set collider
+bool Cloth::setCollider(const ClothMeshCollider* meshCollider)
+{
+	if (!solver)
+		return false;
+
+	solver->setCollider(meshCollider);
+
+	return true;
+}
+
+// Set distance field
+bool Cloth::setDistanceField(const ClothDistanceField* distanceField)
+{
+	if (!solver)
+		return false;
+
+	solver->setDistanceField(distanceField);
+
+	return true;
+}
+
+// Set self collision
+bool Cloth::setSelfCollision(bool enabled)
+{
+	if (!solver)
+		return false;
+
+	solver->setSelfCollision(enabled);
+
+	return true;
+}
+
+// Set wind
+bool Cloth::setWind(const ClothWindField* windField, const ClothFloat3& origin)
+{
+	if (!solver)
+		return false;
+
+	solver->windOrigin = origin;
+	solver->setWind(windField);
+
+	return true;
+}
+
+// Set hash log
+bool Cloth::setHashLog(FILE* log)
+{
+	if (!solver)
+		return false;
+
+	solver->setHashing(log != nullptr);
+	hashLog = log;
+
+	return true;
+}
+
+// Set tearing
+bool Cloth::setTearing(float strain)
+{
+	if (!solver)
+		return false;
+
+	if (!solver->setTearing(strain))
+		return false;
+
+	if (strain <= 0.0f)
+		return true;
+
+	// Tears add particles and rewrite indices - the vertex buffer is grown to the room the solver
+	// made and the index buffer is made updatable, unless an earlier call did already
+	const ClothTopology* topology		= solver->getTopology();
+	const ClothParticleStore* particles	= solver->getParticles();
+
+	D3D11_BUFFER_DESC vertexBufferDesc;
+	D3D11_BUFFER_DESC indexBufferDesc;
+
+	vertexBuffer->GetDesc(&vertexBufferDesc);
+	indexBuffer->GetDesc(&indexBufferDesc);
+
+	if (vertexBufferDesc.ByteWidth >= sizeof(ClothVertex) * particles->capacity && indexBufferDesc.Usage == D3D11_USAGE_DEFAULT)
+		return true;
+
+	// Current vertices - rendered until the next step is simulated
+	ClothVertex* vertices = (ClothVertex*)calloc(particles->capacity, sizeof(ClothVertex));
+
+	if (!vertices)
+	{
+		solver->setTearing(0.0f);
+		return false;
+	}
+
+	solver->assembleVertices(vertices);
+
+	ID3D11Device* device = nullptr;
+
+	vertexBuffer->GetDevice(&device);
+
+	D3D11_BUFFER_DESC vertexDesc;
+	D3D11_SUBRESOURCE_DATA vertexData;
+
+	ZeroMemory(&vertexDesc, sizeof(D3D11_BUFFER_DESC));
+	ZeroMemory(&vertexData, sizeof(D3D11_SUBRESOURCE_DATA));
+
+	vertexDesc.BindFlags			= D3D11_BIND_VERTEX_BUFFER;
+	vertexDesc.CPUAccessFlags		= D3D11_CPU_ACCESS_WRITE;
+	vertexDesc.Usage				= D3D11_USAGE_DYNAMIC;
+	vertexDesc.ByteWidth			= sizeof(ClothVertex) * particles->capacity;
+	vertexData.pSysMem				= vertices;
+
+	ID3D11Buffer* grownVertices		= nullptr;
+	ID3D11Buffer* patchedIndices	= nullptr;
+	DXGI_FORMAT patchedFormat		= indexFormat;
+
+	HRESULT hr = device->CreateBuffer(&vertexDesc, &vertexData, &grownVertices);
+
+	// 16 bit indices only while every particle tearing can add still fits them
+	if (SUCCEEDED(hr))
+		hr = createIndexBuffer(device, topology->indices, topology->totalIndices, particles->capacity, D3D11_USAGE_DEFAULT, &patchedIndices, &patchedFormat);
+
+	device->Release();
+	free(vertices);
+
+	if (!SUCCEEDED(hr))
+	{
+		if (grownVertices)
+			grownVertices->Release();
+
+		solver->setTearing(0.0f);
+
+		return false;
+	}
+
+	vertexBuffer->Release();
+	indexBuffer->Release();
+
+	vertexBuffer	= grownVertices;
+	indexBuffer		= patchedIndices;
+	indexFormat		= patchedFormat;
+
+	return true;
+}
+
+// Set anchors
+bool Cloth::setAnchors(const int* particleIndices, const ClothFloat3* targets, int count)
+{
+	if (solver)
+		return solver->setAnchors(particleIndices, targets, count);
+
+	if (!anchors || count < 0)
+		return false;
+
+	for (int a = 0; a < count; a++)
+	{
+		if (particleIndices[a] < 0 || particleIndices[a] >= particleCount)
+			return false;
+	}
+
+	// The particles cannot be read back cheaply - without targets they go to where they started
+	ClothFloat3* rest = nullptr;
+
+	if (!targets)
+	{
+		rest = (ClothFloat3*)malloc(sizeof(ClothFloat3) * (count > 0 ? count : 1));
+
+		if (!rest)
+			return false;
+
+		for (int a = 0; a < count; a++)
+			rest[a] = restPositions[particleIndices[a]];
+
+		targets = rest;
+	}
+
+	anchors->set(particleIndices, targets, count);
+
+	free(rest);
+
+	// A particle given twice is pinned to the last
+	for (int i = 0; i < particleCount; i++)
+		anchorSlots[i] = CLOTH_NO_ANCHOR;
+
+	for (int a = 0; a < count; a++)
+		anchorSlots[particleIndices[a]] = a;
+
+	anchorSlotsStale = true;
+
+	return true;
+}
+
+// Write anchor targets
+bool Cloth::writeAnchorTargets(const ClothFloat3* targets, int first, int count)
+{
+	if (first < 0 || count <= 0 || first + count > anchorCount())
+		return false;
+
+	if (solver)
+		solver->writeAnchorTargets(targets, first, count);
+	else
+		anchors->write(targets, first, count);
+
+	return true;
+}
+
+// Anchor count
+int Cloth::anchorCount() const
+{
+	if (solver)
+		return solver->getAnchors().count();
+
+	return anchors ? anchors->count() : 0;
+}
+
+// Anchor rest
+ClothFloat3 Cloth::anchorRest(int anchor) const
+{
+	return solver ? solver->getAnchors().restOf(anchor) : anchors->restOf(anchor);
+}
+
+// Settle
+bool Cloth::settle(const char* cacheDirectory, int* stepsRun)
+{
+	if (!solver)
+		return false;
+
+	solver->anchorOn = anchorOn;
+	solver->timeStep = scheduler.stepTime;
+
+	int steps = solver->settle(cacheDirectory);
+
+	if (stepsRun)
+		*stepsRun = steps;
+
+	return true;
+}
+
+// Pick
+bool Cloth::pick(const ClothFloat3& origin, const ClothFloat3& direction, ClothRayHit& hit)
+{
+	if (!solver)
+		return false;
+
+	if (!solver->getPicking())
+		solver->setPicking(true);
+
+	ClothRay ray;
+
+	ray.origin		= origin;
+	ray.direction	= direction;
+	ray.tMax		= FLT_MAX;
+
+	return solver->intersect(&ray, 1, &hit);
+}
+
+// Drag
+bool Cloth::drag(const ClothRayHit& hit, const ClothFloat3& target)
+{
+	if (!solver)
+		return false;
+
+	solver->drag(hit, target);
+
+	return true;
+}
+
+// Release
+bool Cloth::release()
+{
+	if (!solver)
+		return false;
+
+	solver->release();
+
+	return true;
+}
+
+// Compare solvers - both cloths hang from the same anchors and take the same steps, so they
+// differ only by how the GPU rounds
+bool Cloth::compareSolvers(ID3D11Device *device, ID3D11DeviceContext *context, ID3DBlob *vsBytecode, DWORD clothW, DWORD clothH, ClothWorkerPool *cpuPool, int steps, FILE *fp)
+{
+	if (!device || !context || !cpuPool || !fp)
+		return false;
+
+	Cloth gpu(device, vsBytecode, clothW, clothH);
+	Cloth cpu(device, vsBytecode, clothW, clothH, cpuPool);
+
+	if (!gpu.vertexBuffer || !gpu.clothForces || !gpu.clothConstraints || !cpu.solver)
+		return false;
+
+	// The compute shaders run one PBD pass a step over every constraint, so nothing may sleep
+	cpu.solver->setSleeping(false);
+
+	// Staging copy of the GPU particles to read them back through
+	D3D11_BUFFER_DESC stagingDesc;
+
+	ZeroMemory(&stagingDesc, sizeof(D3D11_BUFFER_DESC));
+
+	stagingDesc.ByteWidth		= sizeof(Particle) * gpu.particleCount;
+	stagingDesc.Usage			= D3D11_USAGE_STAGING;
+	stagingDesc.CPUAccessFlags	= D3D11_CPU_ACCESS_READ;
+
+	ID3D11Buffer* staging = nullptr;
+
+	if (!SUCCEEDED(device->CreateBuffer(&stagingDesc, nullptr, &staging)))
+		return false;
+
+	fprintf(fp, "CPU and GPU solvers (%lux%lu cloth, distance between their particles in m)\n", (unsigned long)clothW, (unsigned long)clothH);
+
+	// Within a millimetre on a 1m cloth - far below what shows, far above float rounding
+	const float tolerance = 1e-3f;
+
+	float worst = 0.0f;
+
+	for (int s = 1; s <= steps; s++)
+	{
+		gpu.uploadAnchors(context);
+		gpu.step(context);
+		cpu.step(context);
+
+		context->CopyResource(staging, gpu.vertexBuffer);
+
+		D3D11_MAPPED_SUBRESOURCE mapped;
+
+		if (!SUCCEEDED(context->Map(staging, 0, D3D11_MAP_READ, 0, &mapped)))
+			break;
+
+		const Particle* onGPU		= (const Particle*)mapped.pData;
+		const ClothFloat4* onCPU	= cpu.solver->getParticles()->pos;
+
+		double sumSquared	= 0.0;
+		float maximum		= 0.0f;
+
+		for (int i = 0; i < gpu.particleCount; i++)
+		{
+			float dx = onGPU[i].vertex.pos.x - onCPU[i].x;
+			float dy = onGPU[i].vertex.pos.y - onCPU[i].y;
+			float dz = onGPU[i].vertex.pos.z - onCPU[i].z;
+
+			float squared = dx * dx + dy * dy + dz * dz;
+
+			sumSquared += squared;
+			maximum = squared > maximum ? squared : maximum;
+		}
+
+		context->Unmap(staging, 0);
+
+		maximum	= sqrtf(maximum);
+		worst	= maximum > worst ? maximum : worst;
+
+		if (s == 1 || s % 60 == 0 || s == steps)
+			fprintf(fp, "  step %4d  max %.3g  RMS %.3g\n", s, maximum, sqrt(sumSquared / (double)gpu.particleCount));
+	}
+
+	fprintf(fp, "  largest %.3g - %s\n\n", worst, worst <= tolerance ? "agree" : "DIFFER");
+
+	staging->Release();
+
+	return true;
+}
+
 // Render cloth
 void Cloth::render(ID3D11DeviceContext *context)
 {
@@ -672,25 +1178,22 @@ void Cloth::render(ID3D11DeviceContext *context)
 	if (!context || !vertexBuffer || !indexBuffer || !inputLayout)
 		return;
 
-	// Update 
-	update(context);
-
 	// Set vertex layout
 	context->IASetInputLayout(inputLayout);
 
 	// Set basic terrain model vertex and index buffers for IA
 	ID3D11Buffer* vertexBuffers[] = {vertexBuffer};
-	UINT vertexStrides[] = {sizeof(Particle)};
+	UINT vertexStrides[] = {vertexStride};
 	UINT vertexOffsets[] = {0};
 
 	context->IASetVertexBuffers(0, 1, vertexBuffers, vertexStrides, vertexOffsets);
-	context->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	context->IASetIndexBuffer(indexBuffer, indexFormat, 0);
 
 	// Set primitive topology for IA
 	context->IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
 	// Draw basic terrain model
-	context->DrawIndexed((w-1) * (h-1) * 6, 0, 0);
+	context->DrawIndexed(indexCount, 0, 0);
 
 }
 
@@ -2,55 +2,83 @@
 
 #include <D3DX11.h>
 #include <xnamath.h>
+#include <stdio.h>
+#include <vector>
 
 #include "Source\CGBaseModel.h"
 #include "Source\CGVertexExt.h"
 #include "CoreStructures\CoreStructures.h"
 #include "CShaderFactory.h"
+#include "ClothTypes.h"
+#include "ClothSolver.h"
+#include "ClothAnchors.h"
+#include "ClothScheduler.h"
 
+// Anchor slot of a particle no anchor pins
+#define CLOTH_NO_ANCHOR 0xFFFFFFFF
 
-// Structure for the particle
-struct Particle
-{
-	CGVertexExt vertex;
-	XMFLOAT3 prevPos;
-};
 
-struct Constraint
-{
-	// Start and end vertex of the constraint
-	unsigned int start;
-	unsigned int end;
+// Per step constants of cloth_forces_cs and cloth_constraints_cs. Padding is applied to match the HLSL cbuffer packing
+_DECLSPEC_ALIGN_16_ struct clothStepStruct {
 
-	// Length of the constraint
-	float length;
-};
+	XMFLOAT4		gravity;
+	FLOAT			timeStep;
+	FLOAT			damping;
+	UINT			anchorOn;
+	FLOAT			_pad01;
 
-struct Anchor
-{
-	// Anchor index
-	DWORD32 index;
+	clothStepStruct() {
 
-	// Position of the anchor
-	XMFLOAT3 pos;
+		ZeroMemory(this, sizeof(clothStepStruct));
+	}
 };
 
 
 class Cloth : public CGBaseModel
 {
 private:
-	// Dimensions of the cloth
+	// Dimensions of the cloth (0 for a mesh cloth)
 	DWORD		w, h;
 	int totalConstraints;
-	
-	int batchSize[8];
-	int constraintBatch[8];
+
+	int particleCount;
+	int indexCount;
+
+	// Constraint batches
+	int batchCount;
+	int* batchSize;
+
+	// CPU solver (nullptr when simulating with the compute shaders)
+	ClothSolver* solver;
+
+	// Where the state hash of every CPU step is written (not owned, nullptr for nowhere)
+	FILE* hashLog;
+	unsigned int stepCount;
+
+	// Particle for the compute shaders, ClothVertex (laid out as CGVertexExt) for the CPU solver
+	UINT vertexStride;
+
+	// Ranges of triangles the last tears changed, and each narrowed for a 16 bit index buffer
+	// before it is patched in
+	std::vector<ClothTriangleRange> changedRanges;
+	std::vector<WORD> shortIndices;
+
+	// Anchors of the compute shaders (nullptr for the CPU solver, which keeps its own), and the
+	// rest positions they default to
+	ClothAnchors* anchors;
+	ClothFloat3* restPositions;
+
+	// Anchor of each particle (CLOTH_NO_ANCHOR for none) - uploaded by the next simulate when stale
+	UINT* anchorSlots;
+	bool anchorSlotsStale;
+
+	// Targets the anchor buffer has room for
+	int anchorCapacity;
 
 
 	// Shader
 	ID3D11ComputeShader* clothForces;
 	ID3D11ComputeShader* clothConstraints;
-	ID3D11ComputeShader* clothAnchors;
 
 	// Unordered Access Views
 	ID3D11UnorderedAccessView* particlesUAV;
@@ -58,30 +86,125 @@ private:
 	// Buffers
 	ID3D11Buffer		*constraintBuffer;
 	ID3D11Buffer		*anchorBuffer;
+	ID3D11Buffer		*anchorSlotBuffer;
+
+	// Step constants for the forces shader
+	clothStepStruct		*stepConstants;
+	ID3D11Buffer		*step_cbuffer;
 
 	// Shader Resource Views
 	//ID3D11ShaderResourceView* constraintSRV;
-	ID3D11ShaderResourceView* constraintBatchSRV[8];
+	ID3D11ShaderResourceView** constraintBatchSRV;
 	ID3D11ShaderResourceView* anchorSRV;
+	ID3D11ShaderResourceView* anchorSlotSRV;
+
+
+	// Initialise variables
+	void init();
 
+	// Buffer setup - builds a grid cloth when mesh is nullptr, mapped from the topology cache in cacheDirectory if given
+	void setupBuffers(ID3D11Device *device, ID3DBlob *vsBytecode, CGPolyMesh *mesh, ClothWorkerPool *cpuPool, const char *cacheDirectory);
 
-	// Buffer setup 
-	void setupBuffers(ID3D11Device *device, ID3DBlob *vsBytecode);
+	// Render buffer setup for the CPU solver
+	void setupCPUBuffers(ID3D11Device *device, ID3DBlob *vsBytecode);
+
+	// (Re)create the anchor target buffer with room for capacity targets
+	HRESULT createAnchorTargets(ID3D11Device *device, int capacity);
 
 	// Compile and create the shaders
 	void compileClothShaders(ID3D11Device *device);
 
-	// Update
-	void update(ID3D11DeviceContext* context);
+	// Upload the anchor slots when stale and the anchor targets written since the last upload, in one
+	// batch each
+	void uploadAnchors(ID3D11DeviceContext* context);
+
+	// Advance the simulation by one fixed step
+	void step(ID3D11DeviceContext* context);
+
+	// Upload the CPU solver particles, alpha of the way through the last step
+	void uploadVertices(ID3D11DeviceContext* context, float alpha);
 
 public:
-	// Constructor
-	Cloth(ID3D11Device *device, ID3DBlob *vsBytecode, DWORD clothW, DWORD clothH);
+	// Constructor - passing a worker pool simulates on the CPU instead of the compute shaders. Given a
+	// cache directory the grid topology is read from there once it has been built for this size.
+	Cloth(ID3D11Device *device, ID3DBlob *vsBytecode, DWORD clothW, DWORD clothH, ClothWorkerPool *cpuPool = nullptr, const char *cacheDirectory = nullptr);
+	// Constructor - cloth from the vertices and triangles of a mesh (e.g. loaded with importOBJ)
+	Cloth(ID3D11Device *device, ID3DBlob *vsBytecode, CGPolyMesh *mesh, ClothWorkerPool *cpuPool = nullptr);
 	// Destructor
 	~Cloth();
 
+	// Run the simulation steps owed for frameSeconds of game time - call once per frame, not per render
+	void simulate(ID3D11DeviceContext *context, double frameSeconds);
+
 	// Render the cloth
 	void render (ID3D11DeviceContext *context);
 
+	// Select the constraint formulation of the CPU solver (false when simulating on the GPU)
+	bool setSolverMode(ClothSolverMode mode);
+
+	// Solve the CPU solver constraints coarse to fine over up to levels coarser grids (false when simulating on the GPU)
+	bool setMultigrid(int levels);
+
+	// Tether the CPU solver particles to the anchors (false when simulating on the GPU)
+	bool setAttachments(bool enabled);
+
+	// Collide the CPU solver particles with a heightfield, nullptr for none (false when simulating on the GPU)
+	bool setGround(const ClothHeightfield* heightfield);
+
+	// Collide the CPU solver particles with a triangle mesh, nullptr for none (false when simulating on the GPU)
+	bool setCollider(const ClothMeshCollider* meshCollider);
+
+	// Collide the CPU solver particles with a baked distance field, nullptr for none (false when simulating on the GPU)
+	bool setDistanceField(const ClothDistanceField* distanceField);
+
+	// Collide the CPU solver cloth with itself (false when simulating on the GPU)
+	bool setSelfCollision(bool enabled);
+
+	// Blow the CPU solver cloth about with a wind field, nullptr for none, with the cloth space origin at
+	// origin in the field (false when simulating on the GPU)
+	bool setWind(const ClothWindField* windField, const ClothFloat3& origin);
+
+	// Write the step number and state hash of every CPU solver step to log as a line, nullptr
+	// to stop (false when simulating on the GPU)
+	bool setHashLog(FILE* log);
+
+	// Let the CPU solver cloth tear where stretched past (1 + strain) times its rest length, 0 to stop
+	// (false when simulating on the GPU, or while multigrid or attachments are on)
+	bool setTearing(float strain);
+
+	// Pin count particles to targets, replacing the anchors the cloth hangs from. Without targets the
+	// particles are pinned where they are on the CPU and to their rest positions on the GPU. False
+	// when a particle is out of range.
+	bool setAnchors(const int* particleIndices, const ClothFloat3* targets, int count);
+
+	// Write the targets of anchors [first, first + count) - the next step moves the anchors to them,
+	// uploaded in one batch on the GPU (false when out of range)
+	bool writeAnchorTargets(const ClothFloat3* targets, int first, int count);
+
+	// Number of anchors, and where an anchor was pinned to first
+	int anchorCount() const;
+	ClothFloat3 anchorRest(int anchor) const;
+
+	// Settle the CPU solver cloth where it hangs, through the rest state cache in cacheDirectory
+	// when given. stepsRun gets the steps it took, 0 from the cache (false when simulating on the GPU)
+	bool settle(const char* cacheDirectory = nullptr, int* stepsRun = nullptr);
+
+	// Nearest triangle of the CPU solver cloth a ray hits, in cloth space - triangle -1 for a miss.
+	// The first call builds the tree the rays are tested through (false when simulating on the GPU).
+	bool pick(const ClothFloat3& origin, const ClothFloat3& direction, ClothRayHit& hit);
+
+	// Drag the point hit by pick towards target until released - call again as the target moves
+	// (false when simulating on the GPU)
+	bool drag(const ClothRayHit& hit, const ClothFloat3& target);
+	bool release();
+
+	// Step a w x h cloth on the compute shaders and another on the CPU solver from the same rest
+	// state, reading the GPU particles back after each step, and write the largest and RMS
+	// distance between the two to fp. False when either cloth cannot be created.
+	static bool compareSolvers(ID3D11Device *device, ID3D11DeviceContext *context, ID3DBlob *vsBytecode, DWORD clothW, DWORD clothH, ClothWorkerPool *cpuPool, int steps, FILE *fp);
+
 	bool anchorOn;
+
+	// Fixed simulation step and catch-up limit
+	ClothScheduler scheduler;
 };
\ No newline at end of file
@@ -0,0 +1,255 @@
+#include "ClothAerodynamics.h"
+#include "ClothFpContract.h"
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+
+// Particles and triangles per worker chunk
+static const int particleGrain	= 2048;
+static const int triangleGrain	= 2048;
+
+
+#pragma region Helpers
+
+// Whether a triangle was collapsed onto its first corner by a tear
+static inline bool collapsed(const DWORD* corner)
+{
+	return corner[1] == corner[0] && corner[2] == corner[0];
+}
+
+#pragma endregion
+
+
+// Constructor
+ClothAerodynamics::ClothAerodynamics(const ClothTopology* clothTopology, ClothWorkerPool* workerPool)
+{
+	topology		= clothTopology;
+	pool			= workerPool;
+	count			= topology->particleCount;
+	totalTriangles	= topology->totalIndices / 3;
+
+	const DWORD* indices = topology->indices;
+
+	// Triangles touching each particle, in triangle order so every gather sums in the same
+	// order. A triangle dropped by a tear is collapsed onto one corner, and touches nothing.
+	incidentOffset.assign(count + 1, 0);
+
+	for (int t = 0; t < totalTriangles; t++)
+	{
+		if (!collapsed(indices + t * 3))
+		{
+			incidentOffset[indices[t * 3] + 1]++;
+			incidentOffset[indices[t * 3 + 1] + 1]++;
+			incidentOffset[indices[t * 3 + 2] + 1]++;
+		}
+	}
+
+	for (int i = 0; i < count; i++)
+		incidentOffset[i + 1] += incidentOffset[i];
+
+	incident.resize(incidentOffset[count]);
+
+	vector<int> next(incidentOffset.begin(), incidentOffset.end() - 1);
+
+	for (int t = 0; t < totalTriangles; t++)
+	{
+		if (!collapsed(indices + t * 3))
+		{
+			incident[next[indices[t * 3]]++]		= t;
+			incident[next[indices[t * 3 + 1]]++]	= t;
+			incident[next[indices[t * 3 + 2]]++]	= t;
+		}
+	}
+
+	incidentEnd.assign(incidentOffset.begin() + 1, incidentOffset.end());
+	incidentOffset.pop_back();
+
+	// Rest areas - flat for a grid, the mesh vertices otherwise
+	vector<Particle> rest(count);
+
+	topology->buildParticles(rest.data());
+
+	area.assign(count, 0.0f);
+	triangleShare.assign(totalTriangles, 0.0f);
+
+	for (int t = 0; t < totalTriangles; t++)
+	{
+		const DWORD* corner = indices + t * 3;
+
+		if (collapsed(corner))
+			continue;
+
+		const ClothFloat3& a = rest[corner[0]].vertex.pos;
+		const ClothFloat3& b = rest[corner[1]].vertex.pos;
+		const ClothFloat3& c = rest[corner[2]].vertex.pos;
+
+		float ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+		float wx = c.x - a.x, wy = c.y - a.y, wz = c.z - a.z;
+
+		float nx = uy * wz - uz * wy;
+		float ny = uz * wx - ux * wz;
+		float nz = ux * wy - uy * wx;
+
+		float share = sqrtf(nx * nx + ny * ny + nz * nz) / 6.0f;
+
+		triangleShare[t] = share;
+
+		area[corner[0]] += share;
+		area[corner[1]] += share;
+		area[corner[2]] += share;
+	}
+
+	flow.assign(count, ClothFloat4(0.0f, 0.0f, 0.0f, 0.0f));
+	force.assign(totalTriangles, ClothFloat4(0.0f, 0.0f, 0.0f, 0.0f));
+	pressure.assign(count, ClothFloat4(0.0f, 0.0f, 0.0f, 0.0f));
+}
+
+// Follow tears - a split particle starts as a copy of its source, so the triangles that move
+// to it keep their rest area
+void ClothAerodynamics::followTears(const ClothTearing& tearing, const vector<int>& changed)
+{
+	if (topology->particleCount > count)
+	{
+		count = topology->particleCount;
+
+		incidentOffset.resize(count, 0);
+		incidentEnd.resize(count, 0);
+		area.resize(count, 0.0f);
+		flow.resize(count, ClothFloat4(0.0f, 0.0f, 0.0f, 0.0f));
+		pressure.resize(count, ClothFloat4(0.0f, 0.0f, 0.0f, 0.0f));
+	}
+
+	for (size_t c = 0; c < changed.size(); c++)
+	{
+		int i = changed[c];
+
+		// In triangle order, as the constructor lists them, so the sums come out the same
+		followed.assign(tearing.trianglesAround(i).begin(), tearing.trianglesAround(i).end());
+		sort(followed.begin(), followed.end());
+
+		int first	= incidentOffset[i];
+		int room	= incidentEnd[i] - first;
+
+		if ((int)followed.size() > room)
+		{
+			first = (int)incident.size();
+			incident.resize(first + followed.size());
+		}
+
+		float sum = 0.0f;
+
+		for (size_t k = 0; k < followed.size(); k++)
+		{
+			incident[first + k] = followed[k];
+			sum += triangleShare[followed[k]];
+		}
+
+		incidentOffset[i]	= first;
+		incidentEnd[i]		= first + (int)followed.size();
+		area[i]				= sum;
+	}
+}
+
+// Compute forces
+void ClothAerodynamics::computeForces(const ClothFloat4* pos, const ClothFloat4* prevPos, float h, const ClothWindField* wind, const ClothFloat3& origin, float density, float dragCoefficient, float liftCoefficient, ClothAeroFn kernel)
+{
+	ClothFloat4* relative	= flow.data();
+	ClothFloat4* result		= force.data();
+	ClothFloat4* gathered	= pressure.data();
+	const DWORD* tri		= topology->indices;
+	const int* offset		= incidentOffset.data();
+	const int* last			= incidentEnd.data();
+	const int* around		= incident.data();
+	const float* share		= area.data();
+	float invH				= h > 0.0f ? 1.0f / h : 0.0f;
+
+	// Velocity relative to the air
+	pool->parallelFor(count, particleGrain, [=](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			ClothFloat3 air(0.0f, 0.0f, 0.0f);
+
+			if (wind)
+				air = wind->sample(ClothFloat3(origin.x + pos[i].x, origin.y + pos[i].y, origin.z + pos[i].z));
+
+			relative[i].x = (pos[i].x - prevPos[i].x) * invH - air.x;
+			relative[i].y = (pos[i].y - prevPos[i].y) * invH - air.y;
+			relative[i].z = (pos[i].z - prevPos[i].z) * invH - air.z;
+			relative[i].w = 0.0f;
+		}
+	});
+
+	// Half rho C |v|^2 times the area facing the flow - the kernel's cross product is twice
+	// the area - and a third of it on each corner
+	float drag = density * dragCoefficient / 12.0f;
+	float lift = density * liftCoefficient / 12.0f;
+
+	pool->parallelFor(totalTriangles, triangleGrain, [=](int begin, int end)
+	{
+		kernel(pos, relative, tri, drag, lift, begin, end, result);
+	});
+
+	// Each particle's corner of the triangles around it, over its area
+	pool->parallelFor(count, particleGrain, [=](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			float fx = 0.0f, fy = 0.0f, fz = 0.0f;
+
+			for (int k = offset[i]; k < last[i]; k++)
+			{
+				const ClothFloat4& triangleForce = result[around[k]];
+
+				fx += triangleForce.x;
+				fy += triangleForce.y;
+				fz += triangleForce.z;
+			}
+
+			float invArea = share[i] > 0.0f ? 1.0f / share[i] : 0.0f;
+
+			gathered[i] = ClothFloat4(fx * invArea, fy * invArea, fz * invArea, 0.0f);
+		}
+	});
+}
+
+// Displace
+void ClothAerodynamics::displace(ClothFloat4* pos, float h, float clothDensity, int begin, int end) const
+{
+	const ClothFloat4* p = pressure.data();
+
+	// Force over mass is pressure over density
+	float scale = clothDensity > 0.0f ? h * h / clothDensity : 0.0f;
+
+	for (int i = begin; i < end; i++)
+	{
+		pos[i].x += p[i].x * scale;
+		pos[i].y += p[i].y * scale;
+		pos[i].z += p[i].z * scale;
+	}
+}
+
+// Particle force
+ClothFloat3 ClothAerodynamics::particleForce(int i) const
+{
+	return ClothFloat3(pressure[i].x * area[i], pressure[i].y * area[i], pressure[i].z * area[i]);
+}
+
+// Pressures
+const ClothFloat4* ClothAerodynamics::pressures() const
+{
+	return pressure.data();
+}
+
+// Particle count
+int ClothAerodynamics::particleCount() const
+{
+	return count;
+}
+
+// Triangle count
+int ClothAerodynamics::triangleCount() const
+{
+	return totalTriangles;
+}
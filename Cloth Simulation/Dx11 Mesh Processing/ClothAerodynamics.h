@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include "ClothTypes.h"
+#include "ClothTopology.h"
+#include "ClothWorkerPool.h"
+#include "ClothKernels.h"
+#include "ClothWindField.h"
+#include "ClothTearing.h"
+
+
+// Drag and lift of the air on the cloth for the CPU solver, triangle by triangle.
+// Every particle gets its velocity relative to the wind, then every triangle its
+// force from the mean relative velocity of its corners, in parallel and with the
+// SIMD kernel of the solver. Each particle then gathers a third of the force of
+// the triangles around it, so no two threads ever add to the same particle.
+//
+// A particle is accelerated by its share of the forces over its mass, which comes
+// from the rest area of the triangles around it and the density of the cloth. The
+// gathered force is kept per unit of that area, so moving the particles by it (once
+// per substep in XPBD) costs no more than gravity does.
+//
+// A tear only changes the triangles around the particles it touches, so only their
+// lists and areas are redone - a list that grows goes to the end of the others.
+class ClothAerodynamics
+{
+private:
+	const ClothTopology*	topology;
+	ClothWorkerPool*		pool;
+	int						count;
+	int						totalTriangles;
+
+	// Triangles touching each particle, [incidentOffset, incidentEnd) of incident
+	std::vector<int>		incidentOffset;
+	std::vector<int>		incidentEnd;
+	std::vector<int>		incident;
+
+	// Rest area each particle stands for - a third of each triangle touching it
+	std::vector<float>		area;
+	std::vector<float>		triangleShare;
+
+	// Triangles of a particle being followed through a tear
+	std::vector<int>		followed;
+
+	// Velocity of each particle relative to the air, the force on each corner of each triangle,
+	// and the force on each particle over its rest area
+	std::vector<ClothFloat4>	flow;
+	std::vector<ClothFloat4>	force;
+	std::vector<ClothFloat4>	pressure;
+
+public:
+	// Constructor - triangles and rest areas of the topology, which must outlive this. Its indices
+	// are read at each computeForces, so they may be moved (by makeWritable), and changed by
+	// tears that followTears is told of.
+	ClothAerodynamics(const ClothTopology* clothTopology, ClothWorkerPool* workerPool);
+
+	// Follow tears of the topology - the triangles and areas of the changed particles, and the
+	// particles added to the topology, come from tearing
+	void followTears(const ClothTearing& tearing, const std::vector<int>& changed);
+
+	// Forces on the triangles for particles that moved from prevPos to pos over h seconds, in the
+	// wind sampled at origin + pos (still air for nullptr). density is of the air, in kg/m^3.
+	void computeForces(const ClothFloat4* pos, const ClothFloat4* prevPos, float h, const ClothWindField* wind, const ClothFloat3& origin, float density, float dragCoefficient, float liftCoefficient, ClothAeroFn kernel);
+
+	// Move the particles [begin, end) by the forces of the last computeForces over h seconds,
+	// for a cloth of clothDensity kg/m^2
+	void displace(ClothFloat4* pos, float h, float clothDensity, int begin, int end) const;
+
+	// Force on particle i from the last computeForces, in newtons
+	ClothFloat3 particleForce(int i) const;
+
+	// Force on each particle over its rest area from the last computeForces, in pascals
+	const ClothFloat4* pressures() const;
+
+	// Accessors
+	int particleCount() const;
+	int triangleCount() const;
+};
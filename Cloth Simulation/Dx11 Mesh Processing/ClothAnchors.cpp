@@ -0,0 +1,184 @@
+#include "ClothAnchors.h"
+#include "ClothFpContract.h"
+#include <algorithm>
+
+using namespace std;
+
+
+// Constructor
+ClothAnchors::ClothAnchors()
+{
+	writtenFirst	= 0;
+	writtenEnd		= 0;
+	movedFirst		= 0;
+	movedEnd		= 0;
+}
+
+// Set
+void ClothAnchors::set(const int* particles, const ClothFloat3* targets, int count)
+{
+	particle.assign(particles, particles + count);
+
+	pending.resize(count);
+
+	for (int a = 0; a < count; a++)
+		pending[a] = ClothFloat4(targets[a].x, targets[a].y, targets[a].z, 0.0f);
+
+	target	= pending;
+	last	= pending;
+	rest	= pending;
+
+	// Stable, so the anchors of a particle given twice are pinned in the order given
+	order.resize(count);
+
+	for (int a = 0; a < count; a++)
+		order[a] = a;
+
+	const int* p = particle.data();
+
+	stable_sort(order.begin(), order.end(), [p](int a, int b)
+	{
+		return p[a] < p[b];
+	});
+
+	sortedParticle.resize(count);
+
+	for (int k = 0; k < count; k++)
+		sortedParticle[k] = particle[order[k]];
+
+	writtenFirst	= 0;
+	writtenEnd		= 0;
+	movedFirst		= 0;
+	movedEnd		= 0;
+}
+
+// Append
+void ClothAnchors::append(const int* particles, const ClothFloat3* targets, int count)
+{
+	if (count <= 0)
+		return;
+
+	int first	= (int)particle.size();
+	bool after	= first == 0 || *min_element(particles, particles + count) >= sortedParticle.back();
+
+	particle.insert(particle.end(), particles, particles + count);
+
+	for (int a = 0; a < count; a++)
+	{
+		ClothFloat4 t(targets[a].x, targets[a].y, targets[a].z, 0.0f);
+
+		pending.push_back(t);
+		target.push_back(t);
+		last.push_back(t);
+		rest.push_back(t);
+		order.push_back(first + a);
+	}
+
+	const int* p = particle.data();
+
+	// The old anchors are in order already - anchors on new particles past all of them only
+	// have to be sorted among themselves
+	stable_sort(order.begin() + (after ? first : 0), order.end(), [p](int a, int b)
+	{
+		return p[a] < p[b];
+	});
+
+	sortedParticle.resize(particle.size());
+
+	for (int k = after ? first : 0; k < (int)particle.size(); k++)
+		sortedParticle[k] = particle[order[k]];
+}
+
+// Write
+void ClothAnchors::write(const ClothFloat3* targets, int first, int n)
+{
+	if (first < 0 || n <= 0 || first + n > (int)particle.size())
+		return;
+
+	for (int a = 0; a < n; a++)
+		pending[first + a] = ClothFloat4(targets[a].x, targets[a].y, targets[a].z, 0.0f);
+
+	writtenFirst	= writtenFirst < writtenEnd ? min(writtenFirst, first) : first;
+	writtenEnd		= max(writtenEnd, first + n);
+}
+
+// Publish
+bool ClothAnchors::publish(int& first, int& end)
+{
+	// The anchors that moved over the last step have arrived
+	for (int a = movedFirst; a < movedEnd; a++)
+		last[a] = target[a];
+
+	movedFirst	= writtenFirst;
+	movedEnd	= writtenEnd;
+
+	writtenFirst	= 0;
+	writtenEnd		= 0;
+
+	if (movedFirst >= movedEnd)
+		return false;
+
+	for (int a = movedFirst; a < movedEnd; a++)
+		target[a] = pending[a];
+
+	first	= movedFirst;
+	end		= movedEnd;
+
+	return true;
+}
+
+// Pin
+void ClothAnchors::pin(ClothFloat4* pos, int begin, int end, float t) const
+{
+	int k		= (int)(lower_bound(sortedParticle.begin(), sortedParticle.end(), begin) - sortedParticle.begin());
+	int count	= (int)sortedParticle.size();
+
+	for (; k < count && sortedParticle[k] < end; k++)
+	{
+		const ClothFloat4& from	= last[order[k]];
+		const ClothFloat4& to	= target[order[k]];
+
+		// The last substep lands on the target exactly
+		if (t < 1.0f)
+			pos[sortedParticle[k]] = ClothFloat4(from.x + (to.x - from.x) * t, from.y + (to.y - from.y) * t, from.z + (to.z - from.z) * t, 0.0f);
+		else
+			pos[sortedParticle[k]] = ClothFloat4(to.x, to.y, to.z, 0.0f);
+	}
+}
+
+// Set inverse mass
+void ClothAnchors::setInvMass(ClothFloat4* pos, float invMass) const
+{
+	for (size_t a = 0; a < particle.size(); a++)
+		pos[particle[a]].w = invMass;
+}
+
+// Count
+int ClothAnchors::count() const
+{
+	return (int)particle.size();
+}
+
+// Particle of an anchor
+int ClothAnchors::particleOf(int anchor) const
+{
+	return particle[anchor];
+}
+
+// Target of an anchor
+ClothFloat3 ClothAnchors::targetOf(int anchor) const
+{
+	return ClothFloat3(target[anchor].x, target[anchor].y, target[anchor].z);
+}
+
+// Rest of an anchor
+ClothFloat3 ClothAnchors::restOf(int anchor) const
+{
+	return ClothFloat3(rest[anchor].x, rest[anchor].y, rest[anchor].z);
+}
+
+// Targets
+const ClothFloat4* ClothAnchors::targets() const
+{
+	return target.data();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include "ClothTypes.h"
+
+
+// Particles pinned to target positions (inverse mass zero), and where each is pinned to.
+// Targets are double buffered: writes go to the pending set, which publish makes current
+// at the start of a step, so a step never sees a half written set and the game can write
+// the targets of the next frame in one batch whenever it likes. The integrate pass pins
+// the anchors of each chunk of particles as it goes - the anchors are kept sorted by
+// particle, so a chunk finds its own with a binary search and no pass visits them all.
+class ClothAnchors
+{
+private:
+	// Particle each anchor pins, in the order the anchors were given
+	std::vector<int>		particle;
+
+	// Anchors sorted by particle, and their particles in that order
+	std::vector<int>		order;
+	std::vector<int>		sortedParticle;
+
+	// Targets written for the next step, of the current step, and of the step before
+	std::vector<ClothFloat4>	pending;
+	std::vector<ClothFloat4>	target;
+	std::vector<ClothFloat4>	last;
+
+	// Where each anchor was pinned to first
+	std::vector<ClothFloat4>	rest;
+
+	// Anchors written since the last publish, and moved by it (none while first >= end)
+	int						writtenFirst;
+	int						writtenEnd;
+	int						movedFirst;
+	int						movedEnd;
+
+public:
+	// Constructor - no anchors
+	ClothAnchors();
+
+	// Pin count particles, each to its target. A particle given twice is pinned to the last.
+	void set(const int* particles, const ClothFloat3* targets, int count);
+
+	// Pin count more particles after the anchors there are, keeping theirs and any targets
+	// written for them. Cheap when the new particles come after every anchored one.
+	void append(const int* particles, const ClothFloat3* targets, int count);
+
+	// Write the targets of anchors [first, first + n) for the next step
+	void write(const ClothFloat3* targets, int first, int n);
+
+	// Make the written targets current. Returns whether any anchor moved, and the range of
+	// anchors that did in first and end.
+	bool publish(int& first, int& end);
+
+	// Pin the anchored particles in [begin, end) t of the way from the last targets to the
+	// current ones, with inverse mass zero
+	void pin(ClothFloat4* pos, int begin, int end, float t) const;
+
+	// Set the inverse mass of every anchored particle
+	void setInvMass(ClothFloat4* pos, float invMass) const;
+
+	// Accessors
+	int count() const;
+	int particleOf(int anchor) const;
+	ClothFloat3 targetOf(int anchor) const;
+	ClothFloat3 restOf(int anchor) const;
+
+	// Current targets, one ClothFloat4 (w = 0) per anchor
+	const ClothFloat4* targets() const;
+};
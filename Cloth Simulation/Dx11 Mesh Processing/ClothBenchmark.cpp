@@ -0,0 +1,2382 @@
+#include "ClothBenchmark.h"
+#include "ClothFpContract.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <vector>
+#include <thread>
+#include "ClothTopology.h"
+#include "ClothParticleStore.h"
+#include "ClothKernels.h"
+#include "ClothSolver.h"
+#include "ClothTearing.h"
+#include "ClothAnchors.h"
+#include "ClothPicking.h"
+#include "ClothIndexOptimiser.h"
+#include "ClothSetSolver.h"
+#include "ClothHeightfield.h"
+#include "ClothMeshCollider.h"
+#include "ClothDistanceField.h"
+#include "ClothSelfCollision.h"
+#include "ClothWindField.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <time.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+
+#pragma region Helpers
+
+// High resolution wall clock in seconds
+static double benchmarkTime()
+{
+#ifdef _WIN32
+	LARGE_INTEGER frequency, counter;
+
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+	timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+#endif
+}
+
+// Drop the file at path from the operating system's file cache, so the next read of it
+// comes from the disk - false when it cannot be
+static bool evictFile(const char* path)
+{
+#ifdef _WIN32
+	// Opening a file unbuffered flushes its cached pages
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	CloseHandle(file);
+
+	return true;
+#else
+	int file = open(path, O_RDONLY);
+
+	if (file < 0)
+		return false;
+
+	// Pages not yet written back cannot be dropped
+	bool evicted = fdatasync(file) == 0 && posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED) == 0;
+
+	close(file);
+
+	return evicted;
+#endif
+}
+
+// Height of the demo's CGBasicTerrain at (x, z) - its kernel, repeated so the benchmarks build
+// without the renderer
+static float terrainHeight(float x, float z)
+{
+	return 0.1f * (z * sinf(x) + x * cosf(z));
+}
+
+// Repeatable pseudo random number in [-0.5, 0.5) - rand() differs between C runtimes
+static float benchmarkNoise(unsigned int& seed)
+{
+	seed = seed * 1664525u + 1013904223u;
+
+	return (float)(seed >> 8) / 16777216.0f - 0.5f;
+}
+
+// Rest state of a w x h cloth with every particle jittered so the constraints have work to do
+static ClothParticleStore* jitteredCloth(const ClothTopology& topology, float amount)
+{
+	int count = topology.particleCount;
+
+	Particle* rest = (Particle*)malloc(sizeof(Particle) * count);
+
+	if (!rest)
+		return nullptr;
+
+	topology.buildParticles(rest);
+
+	ClothParticleStore* store = new ClothParticleStore(count);
+	store->load(rest);
+
+	free(rest);
+
+	unsigned int seed = 12345;
+
+	for (int i = 0; i < count; i++)
+	{
+		store->pos[i].x += benchmarkNoise(seed) * amount;
+		store->pos[i].y += benchmarkNoise(seed) * amount;
+		store->pos[i].z += benchmarkNoise(seed) * amount;
+	}
+
+	return store;
+}
+
+// Distinct 64 byte lines of particle data a batch of constraints touches, with each particle
+// stride bytes long - summed over the batches, the traffic of a pass over a cloth too large
+// for any batch to find another's lines still in cache
+static double batchLineBytes(const ClothTopology& topology, size_t stride)
+{
+	size_t lines = ((size_t)topology.particleCount * stride + 63) / 64;
+
+	std::vector<int> stamp(lines, -1);
+
+	double bytes = 0.0;
+
+	for (int k = 0; k < topology.batchCount; k++)
+	{
+		const Constraint* batch = topology.constraints + topology.batchOffset[k];
+
+		for (int c = 0; c < topology.batchSize[k]; c++)
+		{
+			unsigned int ends[2] = {batch[c].start, batch[c].end};
+
+			// Every line the particle straddles
+			for (int e = 0; e < 2; e++)
+			{
+				size_t first	= (size_t)ends[e] * stride / 64;
+				size_t last		= ((size_t)ends[e] * stride + stride - 1) / 64;
+
+				for (size_t l = first; l <= last; l++)
+				{
+					if (stamp[l] != k)
+					{
+						stamp[l] = k;
+						bytes += 64.0;
+					}
+				}
+			}
+		}
+	}
+
+	return bytes;
+}
+
+// Particle stride bytes long with its position and inverse mass first - the size of a whole
+// Particle, or of the hot stream alone, so one projection can run over either
+template <size_t stride> struct StridedParticle
+{
+	ClothFloat4	pos;
+	char		rest[stride - sizeof(ClothFloat4)];
+};
+
+template <> struct StridedParticle<sizeof(ClothFloat4)>
+{
+	ClothFloat4	pos;
+};
+
+// Projection of a batch over strided particles - the scalar kernel's projection, inverse mass
+// weights and residual included, so the layouts are timed on the same arithmetic
+template <size_t stride> static void projectStrided(StridedParticle<stride>* particles, const Constraint* batch, int count, ClothResidual& residual)
+{
+	float sumSquared = 0.0f, maximum = 0.0f;
+
+	for (int c = 0; c < count; c++)
+	{
+		ClothFloat4 one = particles[batch[c].start].pos;
+		ClothFloat4 two = particles[batch[c].end].pos;
+
+		float dx = one.x - two.x;
+		float dy = one.y - two.y;
+		float dz = one.z - two.z;
+
+		float distance	= sqrtf(dx * dx + dy * dy + dz * dz);
+		float weight	= one.w + two.w;
+
+		float violation = fabsf(distance - batch[c].length);
+
+		sumSquared += violation * violation;
+		maximum = violation > maximum ? violation : maximum;
+
+		if (distance <= 0.0f || weight <= 0.0f)
+			continue;
+
+		float stretching = (distance - batch[c].length) / (distance * weight);
+
+		dx *= stretching;
+		dy *= stretching;
+		dz *= stretching;
+
+		particles[batch[c].start].pos	= ClothFloat4(one.x - dx * one.w, one.y - dy * one.w, one.z - dz * one.w, one.w);
+		particles[batch[c].end].pos		= ClothFloat4(two.x + dx * two.w, two.y + dy * two.w, two.z + dz * two.w, two.w);
+	}
+
+	residual.sumSquared += sumSquared;
+	residual.maximum = maximum > residual.maximum ? maximum : residual.maximum;
+}
+
+// Seconds for passes over every batch of a cloth in strided particles, loaded from the same
+// positions and inverse masses
+template <size_t stride> static double timeStrided(const ClothTopology& topology, const ClothFloat4* pos, int passes, ClothResidual& residual)
+{
+	int count = topology.particleCount;
+
+	StridedParticle<stride>* particles = (StridedParticle<stride>*)malloc(sizeof(StridedParticle<stride>) * count);
+
+	if (!particles)
+		return 0.0;
+
+	for (int i = 0; i < count; i++)
+		particles[i].pos = pos[i];
+
+	double start = benchmarkTime();
+
+	for (int i = 0; i < passes; i++)
+	{
+		for (int k = 0; k < topology.batchCount; k++)
+			projectStrided<stride>(particles, topology.constraints + topology.batchOffset[k], topology.batchSize[k], residual);
+	}
+
+	double seconds = benchmarkTime() - start;
+
+	free(particles);
+
+	return seconds;
+}
+
+// Nearest hit of a ray over every triangle, to check the picking tree against
+static ClothRayHit bruteForceHit(const ClothTopology& topology, const ClothFloat4* pos, const ClothRay& ray)
+{
+	ClothRayHit hit;
+
+	hit.triangle	= -1;
+	hit.t			= ray.tMax;
+	hit.u			= 0.0f;
+	hit.v			= 0.0f;
+
+	const ClothFloat3& o = ray.origin;
+	const ClothFloat3& d = ray.direction;
+
+	for (int t = 0; t < topology.totalIndices / 3; t++)
+	{
+		const ClothFloat4& a = pos[topology.indices[t * 3]];
+		const ClothFloat4& b = pos[topology.indices[t * 3 + 1]];
+		const ClothFloat4& c = pos[topology.indices[t * 3 + 2]];
+
+		ClothFloat3 e1(b.x - a.x, b.y - a.y, b.z - a.z);
+		ClothFloat3 e2(c.x - a.x, c.y - a.y, c.z - a.z);
+		ClothFloat3 p(d.y * e2.z - d.z * e2.y, d.z * e2.x - d.x * e2.z, d.x * e2.y - d.y * e2.x);
+
+		float det = e1.x * p.x + e1.y * p.y + e1.z * p.z;
+
+		if (det == 0.0f)
+			continue;
+
+		ClothFloat3 s(o.x - a.x, o.y - a.y, o.z - a.z);
+		ClothFloat3 q(s.y * e1.z - s.z * e1.y, s.z * e1.x - s.x * e1.z, s.x * e1.y - s.y * e1.x);
+
+		float u			= (s.x * p.x + s.y * p.y + s.z * p.z) / det;
+		float v			= (d.x * q.x + d.y * q.y + d.z * q.z) / det;
+		float distance	= (e2.x * q.x + e2.y * q.y + e2.z * q.z) / det;
+
+		if (u < 0.0f || v < 0.0f || u + v > 1.0f || distance < 0.0f || distance >= hit.t)
+			continue;
+
+		hit.triangle	= t;
+		hit.t			= distance;
+		hit.u			= u;
+		hit.v			= v;
+	}
+
+	return hit;
+}
+
+// Sphere of 12 x n x n triangles facing outwards - a cube with n x n quads on each face,
+// pushed out onto the sphere so the triangles are all about the same size
+static void sphereMesh(int n, float radius, const ClothFloat3& centre, std::vector<ClothFloat3>& vertices, std::vector<DWORD>& indices)
+{
+	// Face normal and the two axes across the face
+	static const float axes[6][3][3] = {
+		{{ 1, 0, 0}, {0, 0, 1}, {0,  1,  0}}, {{-1, 0, 0}, {0,  0, 1}, {0, -1,  0}},
+		{{0,  1, 0}, {1, 0, 0}, {0,  0,  1}}, {{0, -1, 0}, {-1, 0, 0}, {0,  0,  1}},
+		{{0, 0,  1}, {0, 1, 0}, {1,  0,  0}}, {{0, 0, -1}, {0, -1, 0}, {1,  0,  0}}};
+
+	vertices.clear();
+	indices.clear();
+
+	for (int f = 0; f < 6; f++)
+	{
+		const float* normal	= axes[f][0];
+		const float* u		= axes[f][1];
+		const float* v		= axes[f][2];
+
+		DWORD first = (DWORD)vertices.size();
+
+		for (int j = 0; j <= n; j++)
+		{
+			for (int i = 0; i <= n; i++)
+			{
+				float s = 2.0f * (float)i / (float)n - 1.0f;
+				float t = 2.0f * (float)j / (float)n - 1.0f;
+
+				float x = normal[0] + u[0] * s + v[0] * t;
+				float y = normal[1] + u[1] * s + v[1] * t;
+				float z = normal[2] + u[2] * s + v[2] * t;
+
+				float scale = radius / sqrtf(x * x + y * y + z * z);
+
+				vertices.push_back(ClothFloat3(centre.x + x * scale, centre.y + y * scale, centre.z + z * scale));
+			}
+		}
+
+		for (int j = 0; j < n; j++)
+		{
+			for (int i = 0; i < n; i++)
+			{
+				DWORD c = first + j * (n + 1) + i;
+
+				indices.push_back(c); indices.push_back(c + n + 2); indices.push_back(c + 1);
+				indices.push_back(c); indices.push_back(c + n + 1); indices.push_back(c + n + 2);
+			}
+		}
+	}
+}
+
+#pragma endregion
+
+
+// Run all
+void ClothBenchmark::run(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	constraintKernels(fp);
+	particleLayout(fp);
+	threadScaling(fp);
+	solverConvergence(fp);
+	earlyExit(fp);
+	tileSleeping(fp);
+	clothSet(fp);
+	multigrid(fp);
+	attachments(fp);
+	terrainCollision(fp);
+	meshCollision(fp);
+	distanceField(fp);
+	selfCollision(fp);
+	vertexAssembly(fp);
+	aerodynamics(fp);
+	determinism(fp);
+	restState(fp);
+	topologyCache(fp);
+	gridTopology(fp);
+	tearing(fp);
+	anchors(fp);
+	picking(fp);
+	indexOrder(fp);
+}
+
+// Constraint kernels
+void ClothBenchmark::constraintKernels(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD sizes[]		= {256, 1024};
+	const int iterations	= 20;
+
+	fprintf(fp, "Constraint projection kernels (single thread, %d iterations)\n", iterations);
+
+	for (int s = 0; s < 2; s++)
+	{
+		ClothTopology topology(sizes[s], sizes[s]);
+
+		int count = topology.particleCount;
+
+		ClothParticleStore* initial = jitteredCloth(topology, 0.25f / (float)topology.w);
+		ClothParticleStore* scalar	= nullptr;
+
+		if (!initial)
+			continue;
+
+		fprintf(fp, "  %lux%lu cloth, %d constraints\n", (unsigned long)topology.w, (unsigned long)topology.h, topology.totalConstraints);
+
+		for (int isa = CLOTH_ISA_SCALAR; isa < CLOTH_ISA_COUNT; isa++)
+		{
+			if (!ClothKernels::isaSupported((ClothIsa)isa))
+			{
+				fprintf(fp, "    %-8s not supported\n", ClothKernels::isaName((ClothIsa)isa));
+				continue;
+			}
+
+			ClothProjectBatchFn kernel = ClothKernels::projectBatch((ClothIsa)isa);
+
+			ClothParticleStore* store = new ClothParticleStore(count);
+			memcpy(store->pos, initial->pos, sizeof(ClothFloat4) * count);
+
+			double start = benchmarkTime();
+
+			for (int i = 0; i < iterations; i++)
+			{
+				for (int k = 0; k < topology.batchCount; k++)
+					kernel(store->pos, topology.constraints + topology.batchOffset[k], 0, topology.batchSize[k], nullptr);
+			}
+
+			double seconds = benchmarkTime() - start;
+
+			// Largest difference from the scalar kernel
+			float maxError = 0.0f;
+
+			if (!scalar)
+			{
+				scalar = store;
+			}
+			else
+			{
+				for (int i = 0; i < count; i++)
+				{
+					float dx = fabsf(store->pos[i].x - scalar->pos[i].x);
+					float dy = fabsf(store->pos[i].y - scalar->pos[i].y);
+					float dz = fabsf(store->pos[i].z - scalar->pos[i].z);
+
+					maxError = dx > maxError ? dx : maxError;
+					maxError = dy > maxError ? dy : maxError;
+					maxError = dz > maxError ? dz : maxError;
+				}
+
+				delete store;
+			}
+
+			double rate = (double)topology.totalConstraints * iterations / seconds;
+
+			fprintf(fp, "    %-8s %8.1f M constraints/s  max error vs scalar %g\n", ClothKernels::isaName((ClothIsa)isa), rate * 1e-6, maxError);
+		}
+
+		delete scalar;
+		delete initial;
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Particle layout
+void ClothBenchmark::particleLayout(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD sizes[]		= {256, 1024, 2048};
+	const int iterations	= 10;
+	const int trials		= 3;
+
+	fprintf(fp, "Particle layout (single thread scalar projection, %d iterations, best of %d)\n", iterations, trials);
+
+	for (int s = 0; s < 3; s++)
+	{
+		ClothTopology topology(sizes[s], sizes[s]);
+
+		ClothParticleStore* store = jitteredCloth(topology, 0.25f / (float)topology.w);
+
+		if (!store)
+			continue;
+
+		fprintf(fp, "  %lux%lu cloth, %d constraints\n", (unsigned long)topology.w, (unsigned long)topology.h, topology.totalConstraints);
+
+		// The same positions, arithmetic and order in both - only the bytes between particles
+		// differ. The layouts take turns and each keeps its best trial, so a slow moment on the
+		// machine does not land on one of them.
+		double best[2]			= {DBL_MAX, DBL_MAX};
+		ClothResidual residual[2];
+
+		for (int trial = 0; trial < trials; trial++)
+		{
+			for (int layout = 0; layout < 2; layout++)
+			{
+				residual[layout].sumSquared	= 0.0f;
+				residual[layout].maximum	= 0.0f;
+
+				double seconds = layout ? timeStrided<sizeof(ClothFloat4)>(topology, store->pos, iterations, residual[layout]) : timeStrided<sizeof(Particle)>(topology, store->pos, iterations, residual[layout]);
+
+				if (seconds > 0.0 && seconds < best[layout])
+					best[layout] = seconds;
+			}
+		}
+
+		for (int layout = 0; layout < 2; layout++)
+		{
+			size_t stride = layout ? sizeof(ClothFloat4) : sizeof(Particle);
+
+			// Constraints themselves are 12 bytes each in either layout
+			double bytes = batchLineBytes(topology, stride) / (double)topology.totalConstraints;
+
+			fprintf(fp, "    %-12s %3lu bytes/particle  %6.1f particle bytes/constraint  %8.1f M constraints/s  (residual %g)\n", layout ? "hot stream" : "Particle", (unsigned long)stride, bytes,
+				best[layout] < DBL_MAX ? (double)topology.totalConstraints * iterations / best[layout] * 1e-6 : 0.0, residual[layout].sumSquared);
+		}
+
+		delete store;
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Thread scaling
+void ClothBenchmark::threadScaling(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD sizes[]		= {512, 1024};
+	const int frames		= 10;
+	const int iterations	= 8;
+
+	// Powers of two up to the hardware threads, and at least up to 4 - counts past the
+	// hardware threads show what oversubscribing costs, not scaling
+	int hardware	= (int)std::thread::hardware_concurrency();
+	hardware		= hardware > 0 ? hardware : 1;
+
+	std::vector<int> threads;
+
+	for (int t = 1; t <= (hardware > 4 ? hardware : 4); t *= 2)
+		threads.push_back(t);
+
+	if (threads.back() < hardware)
+		threads.push_back(hardware);
+
+	fprintf(fp, "Thread scaling (PBD cloths, %d iterations, %d frames, %d hardware threads)\n", iterations, frames, hardware);
+
+	for (int s = 0; s < 2; s++)
+	{
+		fprintf(fp, "  %lux%lu\n", (unsigned long)sizes[s], (unsigned long)sizes[s]);
+
+		double single = 0.0;
+
+		for (size_t t = 0; t < threads.size(); t++)
+		{
+			ClothWorkerPool pool(threads[t]);
+			ClothSolver solver(sizes[s], sizes[s], &pool);
+
+			solver.iterations = iterations;
+
+			// The first step pages the streams in
+			solver.step();
+
+			double start = benchmarkTime();
+
+			for (int f = 0; f < frames; f++)
+				solver.step();
+
+			double seconds = benchmarkTime() - start;
+
+			if (t == 0)
+				single = seconds;
+
+			double speedup = seconds > 0.0 ? single / seconds : 0.0;
+
+			fprintf(fp, "    %2d threads %9.3f ms/frame  speedup %5.2f  efficiency %5.1f%%%s\n", pool.threadCount(), seconds * 1000.0 / frames, speedup, speedup * 100.0 / pool.threadCount(),
+				pool.threadCount() > hardware ? "  (oversubscribed)" : "");
+		}
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Solver convergence
+void ClothBenchmark::solverConvergence(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD sizes[]		= {64, 128, 256};
+	const int passes[]		= {1, 2, 4, 8, 16};
+	const int frames		= 60;
+
+	ClothWorkerPool pool;
+
+	fprintf(fp, "PBD iterations against XPBD substeps (%d threads, %d frames of 1/60s, zero compliance)\n", pool.threadCount(), frames);
+
+	for (int s = 0; s < 3; s++)
+	{
+		fprintf(fp, "  %lux%lu cloth\n", (unsigned long)sizes[s], (unsigned long)sizes[s]);
+
+		for (int m = 0; m < 2; m++)
+		{
+			for (int p = 0; p < 5; p++)
+			{
+				ClothSolver solver(sizes[s], sizes[s], &pool);
+
+				// Both use the XPBD integrator with the same time step - PBD is one
+				// substep with several iterations, XPBD several substeps of one iteration
+				solver.setMode(CLOTH_SOLVER_XPBD);
+				solver.setCompliance(0.0f);
+
+				solver.substeps		= m ? passes[p] : 1;
+				solver.iterations	= m ? 1 : passes[p];
+
+				double start = benchmarkTime();
+
+				for (int f = 0; f < frames; f++)
+					solver.step();
+
+				double seconds = benchmarkTime() - start;
+
+				fprintf(fp, "    %-4s %2d %-10s %8.3f ms/frame  stretch %8.4f%%\n", m ? "XPBD" : "PBD", passes[p], m ? "substeps" : "iterations", seconds * 1000.0 / frames, solver.stretchError() * 100.0f);
+			}
+		}
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Early exit
+void ClothBenchmark::earlyExit(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD size		= 128;
+	const float tolerance[]	= {0.0f, 2e-2f, 1e-2f};
+	const int frames		= 240;
+
+	ClothWorkerPool pool;
+
+	fprintf(fp, "Residual early exit (%lux%lu PBD cloth, up to 16 iterations, %d frames)\n", (unsigned long)size, (unsigned long)size, frames);
+
+	for (int t = 0; t < 3; t++)
+	{
+		ClothSolver solver(size, size, &pool);
+
+		solver.iterations	= 16;
+		solver.tolerance	= tolerance[t];
+
+		int firstIterations	= 0;
+		int totalIterations	= 0;
+
+		double start = benchmarkTime();
+
+		for (int f = 0; f < frames; f++)
+		{
+			solver.step();
+
+			ClothSolverStats stats = solver.getStats();
+
+			totalIterations += stats.iterations;
+
+			if (f == 0)
+				firstIterations = stats.iterations;
+		}
+
+		double seconds = benchmarkTime() - start;
+
+		ClothSolverStats stats = solver.getStats();
+
+		fprintf(fp, "  tolerance %-7g %8.3f ms/frame  iterations first %2d last %2d mean %5.2f  residual max %g rms %g\n", tolerance[t], seconds * 1000.0 / frames, firstIterations, stats.iterations, (double)totalIterations / frames, stats.residualMax, stats.residualRMS);
+	}
+
+	// A falling cloth keeps every pass busy. Once at rest only the stretch gravity adds each
+	// step is left to take out, and with multigrid and attachments the passes get it under a
+	// centimetre or so (about one rest length) - plain PBD passes leave the rows under the
+	// anchors stretched far past any tolerance however long it hangs.
+	const int settledFrames = 120;
+
+	fprintf(fp, "  Settled (multigrid 3 levels, attachments on, %d frames)\n", settledFrames);
+
+	for (int t = 0; t < 3; t++)
+	{
+		ClothSolver solver(size, size, &pool);
+
+		solver.iterations = 16;
+		solver.setMultigrid(3);
+		solver.setAttachments(true);
+		solver.settle(".");
+
+		solver.tolerance = tolerance[t];
+
+		int totalIterations = 0;
+
+		double start = benchmarkTime();
+
+		for (int f = 0; f < settledFrames; f++)
+		{
+			solver.step();
+
+			totalIterations += solver.getStats().iterations;
+		}
+
+		double seconds = benchmarkTime() - start;
+
+		ClothSolverStats stats = solver.getStats();
+
+		fprintf(fp, "    tolerance %-7g %8.3f ms/frame  iterations last %2d mean %5.2f  residual max %g rms %g\n", tolerance[t], seconds * 1000.0 / settledFrames, stats.iterations, (double)totalIterations / settledFrames,
+			stats.residualMax, stats.residualRMS);
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Tile sleeping
+void ClothBenchmark::tileSleeping(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD size		= 64;
+	const int settleFrames	= 1200;
+	const int frames		= 300;
+
+	ClothWorkerPool pool;
+
+	fprintf(fp, "Tile sleeping (%lux%lu XPBD cloth, 16 substeps, timed over %d frames after %d to settle)\n", (unsigned long)size, (unsigned long)size, frames, settleFrames);
+
+	for (int on = 0; on < 2; on++)
+	{
+		ClothSolver solver(size, size, &pool);
+
+		solver.setMode(CLOTH_SOLVER_XPBD);
+		solver.setCompliance(0.0f);
+		solver.substeps = 16;
+		solver.setSleeping(on != 0);
+
+		for (int f = 0; f < settleFrames; f++)
+			solver.step();
+
+		double start = benchmarkTime();
+
+		for (int f = 0; f < frames; f++)
+			solver.step();
+
+		double seconds = benchmarkTime() - start;
+
+		ClothSolverStats stats = solver.getStats();
+
+		fprintf(fp, "  sleeping %-3s %8.3f ms/frame  tiles awake %3d asleep %3d  constraints solved %d\n", on ? "on" : "off", seconds * 1000.0 / frames, stats.awakeTiles, stats.sleepingTiles, stats.activeConstraints);
+
+		if (on)
+		{
+			// Setting a wind wakes the whole cloth, and once it settles in the calm again a
+			// gust wakes the tiles it pushes
+			ClothWindField air(ClothFloat3(-1.0f, -2.0f, -1.0f), ClothFloat3(2.0f, 1.0f, 2.0f), 0.1f, &pool);
+
+			solver.setWind(&air);
+			solver.step();
+
+			stats = solver.getStats();
+
+			fprintf(fp, "  wind set                  tiles awake %3d asleep %3d\n", stats.awakeTiles, stats.sleepingTiles);
+
+			for (int f = 0; f < settleFrames; f++)
+				solver.step();
+
+			stats = solver.getStats();
+
+			fprintf(fp, "  settled in still air      tiles awake %3d asleep %3d\n", stats.awakeTiles, stats.sleepingTiles);
+
+			air.baseWind = ClothFloat3(5.0f, 0.0f, 0.0f);
+			air.advance(solver.timeStep);
+
+			solver.step();
+
+			stats = solver.getStats();
+
+			fprintf(fp, "  gust of 5 m/s             tiles awake %3d asleep %3d\n", stats.awakeTiles, stats.sleepingTiles);
+
+			solver.setWind(nullptr);
+
+			// Releasing the anchors wakes the whole cloth
+			solver.anchorOn = false;
+			solver.step();
+
+			stats = solver.getStats();
+
+			fprintf(fp, "  anchors released          tiles awake %3d asleep %3d\n", stats.awakeTiles, stats.sleepingTiles);
+		}
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Cloth set
+void ClothBenchmark::clothSet(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD size		= 16;
+	const int counts[]		= {16, 256, 1024};
+	const int frames		= 120;
+
+	ClothWorkerPool pool;
+
+	fprintf(fp, "Cloth set (%lux%lu PBD cloths, 4 iterations, %d threads, %d frames)\n", (unsigned long)size, (unsigned long)size, pool.threadCount(), frames);
+
+	for (int c = 0; c < 3; c++)
+	{
+		int count = counts[c];
+
+		// One solver per cloth, each with its own topology and store
+		double start = benchmarkTime();
+
+		ClothSolver** solvers = new ClothSolver*[count];
+
+		for (int i = 0; i < count; i++)
+		{
+			solvers[i] = new ClothSolver(size, size, &pool);
+			solvers[i]->iterations = 4;
+		}
+
+		double separateBuild = benchmarkTime() - start;
+
+		const ClothTopology* t = solvers[0]->getTopology();
+
+		// Topology and XPBD compliance of every solver
+		size_t separateTopology = (t->bytes() + sizeof(float) * t->totalConstraints) * count;
+
+		start = benchmarkTime();
+
+		for (int f = 0; f < frames; f++)
+		{
+			for (int i = 0; i < count; i++)
+				solvers[i]->step();
+		}
+
+		double separateSeconds = benchmarkTime() - start;
+
+		for (int i = 0; i < count; i++)
+			delete solvers[i];
+
+		delete[] solvers;
+
+		// The same cloths in one set, added one at a time
+		start = benchmarkTime();
+
+		ClothSetSolver set(&pool);
+
+		set.iterations = 4;
+
+		for (int i = 0; i < count; i++)
+			set.add(size, size, ClothFloat3(1.5f * (float)i, 0.0f, 0.0f));
+
+		double setBuild = benchmarkTime() - start;
+
+		// And with the room for them reserved first
+		start = benchmarkTime();
+
+		{
+			ClothSetSolver reserved(&pool);
+
+			reserved.reserve(count, size, size);
+
+			for (int i = 0; i < count; i++)
+				reserved.add(size, size, ClothFloat3(1.5f * (float)i, 0.0f, 0.0f));
+		}
+
+		double reservedBuild = benchmarkTime() - start;
+
+		start = benchmarkTime();
+
+		for (int f = 0; f < frames; f++)
+			set.step();
+
+		double setSeconds = benchmarkTime() - start;
+
+		fprintf(fp, "  %4d cloths  separate %8.3f ms/frame  built in %8.2f ms  topology %8lu bytes\n", count, separateSeconds * 1000.0 / frames, separateBuild * 1000.0, (unsigned long)separateTopology);
+		fprintf(fp, "               set      %8.3f ms/frame  built in %8.2f ms (%.2f ms reserved)  topology %8lu bytes  particles %lu bytes  %s\n", setSeconds * 1000.0 / frames, setBuild * 1000.0, reservedBuild * 1000.0,
+			(unsigned long)set.topologyBytes(), (unsigned long)set.particleBytes(), setSeconds < separateSeconds ? "faster" : "SLOWER");
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Multigrid
+void ClothBenchmark::multigrid(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD sizes[]			= {64, 256};
+	const float tolerance		= 0.06f;
+	const int maxIterations		= 64;
+	const int frames			= 60;
+
+	ClothWorkerPool pool;
+
+	fprintf(fp, "Multigrid (PBD iterations to reach %g%% RMS stretch after %d frames, %d threads)\n", tolerance * 100.0f, frames, pool.threadCount());
+
+	for (int s = 0; s < 2; s++)
+	{
+		fprintf(fp, "  %lux%lu cloth\n", (unsigned long)sizes[s], (unsigned long)sizes[s]);
+
+		for (int m = 0; m < 2; m++)
+		{
+			// Double the iterations until the cloth is stiff enough
+			for (int n = 1; n <= maxIterations; n *= 2)
+			{
+				ClothSolver solver(sizes[s], sizes[s], &pool);
+
+				solver.iterations = n;
+
+				if (m)
+					solver.setMultigrid(8);
+
+				double start = benchmarkTime();
+
+				for (int f = 0; f < frames; f++)
+					solver.step();
+
+				double seconds = benchmarkTime() - start;
+				float stretch = solver.stretchError();
+
+				if (stretch <= tolerance || n == maxIterations)
+				{
+					fprintf(fp, "    %-9s %2d levels %3d iterations %8.3f ms/frame  stretch %8.4f%%%s\n", m ? "multigrid" : "flat", solver.getMultigrid(), n, seconds * 1000.0 / frames, stretch * 100.0f, stretch <= tolerance ? "" : "  (not reached)");
+					break;
+				}
+			}
+		}
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Attachments
+void ClothBenchmark::attachments(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD w			= 32;
+	const DWORD h			= 256;
+	const int passes[]		= {1, 4, 16, 64};
+	const int frames		= 60;
+
+	ClothWorkerPool pool;
+
+	fprintf(fp, "Long range attachments (%lux%lu PBD cloth hanging from its short edge, %d frames)\n", (unsigned long)w, (unsigned long)h, frames);
+
+	for (int m = 0; m < 2; m++)
+	{
+		for (int p = 0; p < 4; p++)
+		{
+			ClothSolver solver(w, h, &pool);
+
+			solver.iterations = passes[p];
+			solver.setAttachments(m != 0);
+
+			double start = benchmarkTime();
+
+			for (int f = 0; f < frames; f++)
+				solver.step();
+
+			double seconds = benchmarkTime() - start;
+
+			// Distance from the middle anchor to the middle of the far edge, against the rest length of 1
+			const ClothFloat4& top		= solver.getParticles()->pos[w / 2];
+			const ClothFloat4& bottom	= solver.getParticles()->pos[(h - 1) * w + w / 2];
+
+			float dx = bottom.x - top.x;
+			float dy = bottom.y - top.y;
+			float dz = bottom.z - top.z;
+
+			float farEdge = sqrtf(dx * dx + dy * dy + dz * dz) - 1.0f;
+
+			fprintf(fp, "  %-11s %2d iterations %8.3f ms/frame  far edge %+8.3f%%  stretch %8.3f%%\n", m ? "attachments" : "flat", passes[p], seconds * 1000.0 / frames, farEdge * 100.0f, solver.stretchError() * 100.0f);
+		}
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Terrain collision
+void ClothBenchmark::terrainCollision(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD size		= 256;
+	const int frames		= 120;
+	const char* names[]		= {"none", "analytic", "baked"};
+
+	ClothWorkerPool pool;
+
+	// The terrain half a unit under the cloth, baked at a quarter unit over its 64 x 64 vertex mesh
+	ClothHeightfield analytic(terrainHeight);
+	ClothHeightfield baked(terrainHeight, -16.0f, -16.0f, 16.0f, 16.0f, 0.25f);
+
+	analytic.origin	= ClothFloat3(0.0f, -0.5f, 0.0f);
+	baked.origin	= ClothFloat3(0.0f, -0.5f, 0.0f);
+
+	const ClothHeightfield* grounds[] = {nullptr, &analytic, &baked};
+
+	fprintf(fp, "Terrain collision (%lux%lu PBD cloth dropped on CGBasicTerrain, %d frames, %d threads)\n", (unsigned long)size, (unsigned long)size, frames, pool.threadCount());
+
+	double baseline = 0.0;
+
+	for (int m = 0; m < 3; m++)
+	{
+		ClothSolver solver(size, size, &pool);
+
+		solver.anchorOn = false;
+		solver.setGround(grounds[m]);
+
+		double start = benchmarkTime();
+
+		for (int f = 0; f < frames; f++)
+			solver.step();
+
+		double seconds = benchmarkTime() - start;
+
+		if (!m)
+			baseline = seconds;
+
+		// Deepest particle under the ground (negative when every particle is above it)
+		const ClothFloat4* pos = solver.getParticles()->pos;
+		float depth = 0.0f;
+
+		for (int i = 0; m && i < solver.particleCount(); i++)
+		{
+			float d = grounds[m]->height(pos[i].x, pos[i].z) - pos[i].y;
+
+			depth = (i == 0 || d > depth) ? d : depth;
+		}
+
+		fprintf(fp, "  %-8s %8.3f ms/frame  collision %6.2f ns/particle  deepest %+g\n", names[m], seconds * 1000.0 / frames, (seconds - baseline) * 1e9 / ((double)frames * solver.particleCount()), depth);
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Mesh collision
+void ClothBenchmark::meshCollision(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const int triangles[]	= {10000, 100000, 1000000};
+	const DWORD size		= 256;
+	const int repeats		= 20;
+	const int blocks[]		= {1, 8, 16, 32};
+
+	ClothWorkerPool pool;
+
+	fprintf(fp, "Mesh collision (sphere of radius 0.4, %lux%lu particles on its upper half, %d threads)\n", (unsigned long)size, (unsigned long)size, pool.threadCount());
+
+	std::vector<ClothFloat3> vertices;
+	std::vector<DWORD> indices;
+
+	const ClothFloat3 centre(0.5f, 0.0f, 0.5f);
+	const float radius = 0.4f;
+
+	for (int m = 0; m < 3; m++)
+	{
+		sphereMesh((int)sqrtf((float)triangles[m] / 12.0f), radius, centre, vertices, indices);
+
+		double start = benchmarkTime();
+
+		ClothMeshCollider collider(vertices.data(), (int)vertices.size(), indices.data(), (int)indices.size() / 3, &pool);
+
+		double buildSeconds = benchmarkTime() - start;
+
+		// Particles draped over the top of the sphere, each within a thickness of the surface
+		int count = (int)(size * size);
+		std::vector<ClothFloat4> rest(count), pos(count);
+		unsigned int seed = 12345;
+
+		for (DWORD j = 0; j < size; j++)
+		{
+			for (DWORD i = 0; i < size; i++)
+			{
+				float x = 0.22f + 0.56f * (float)i / (float)(size - 1) - centre.x;
+				float z = 0.22f + 0.56f * (float)j / (float)(size - 1) - centre.z;
+				float y = sqrtf(radius * radius - x * x - z * z) + benchmarkNoise(seed) * 2.0f * collider.thickness;
+
+				rest[j * size + i] = ClothFloat4(centre.x + x, centre.y + y, centre.z + z, 1.0f);
+			}
+		}
+
+		fprintf(fp, "  %7d triangles  build %8.3f ms  %6d nodes\n", collider.triangleCount(), buildSeconds * 1000.0, collider.nodeCount());
+
+		for (int b = 0; b < 4; b++)
+		{
+			collider.blockSize = blocks[b];
+
+			ClothFloat4* p = pos.data();
+			const ClothMeshCollider* c = &collider;
+			double seconds = 0.0;
+
+			for (int r = 0; r < repeats; r++)
+			{
+				pos = rest;
+
+				start = benchmarkTime();
+
+				pool.parallelFor(count, 2048, [p, c](int begin, int end)
+				{
+					c->collide(p, begin, end);
+				});
+
+				seconds += benchmarkTime() - start;
+			}
+
+			// Particles left inside the shell (every one is pushed out to exactly the thickness)
+			int inside = 0;
+
+			for (int i = 0; i < count; i++)
+			{
+				float dx = pos[i].x - centre.x, dy = pos[i].y - centre.y, dz = pos[i].z - centre.z;
+
+				if (sqrtf(dx * dx + dy * dy + dz * dz) < radius + collider.thickness * 0.5f)
+					inside++;
+			}
+
+			fprintf(fp, "    block %2d  %8.2f ns/particle  %6d inside\n", blocks[b], seconds * 1e9 / ((double)repeats * count), inside);
+		}
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Distance field
+void ClothBenchmark::distanceField(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const int triangles[]	= {10000, 100000, 1000000};
+	const int resolution	= 128;
+	const DWORD size		= 256;
+	const int repeats		= 20;
+
+	ClothWorkerPool pool;
+
+	fprintf(fp, "Distance field collision (sphere of radius 0.4, %d cells across, %lux%lu particles on its upper half, %d threads, cache in the working directory)\n", resolution, (unsigned long)size, (unsigned long)size, pool.threadCount());
+
+	std::vector<ClothFloat3> vertices;
+	std::vector<DWORD> indices;
+
+	const ClothFloat3 centre(0.5f, 0.0f, 0.5f);
+	const float radius = 0.4f;
+
+	for (int m = 0; m < 3; m++)
+	{
+		sphereMesh((int)sqrtf((float)triangles[m] / 12.0f), radius, centre, vertices, indices);
+
+		int triangleCount = (int)indices.size() / 3;
+
+		double start = benchmarkTime();
+
+		ClothDistanceField baked(vertices.data(), (int)vertices.size(), indices.data(), triangleCount, resolution, &pool);
+
+		double bakeSeconds = benchmarkTime() - start;
+
+		// Make sure the cache holds the mesh, then time a startup that finds it
+		ClothDistanceField writer(vertices.data(), (int)vertices.size(), indices.data(), triangleCount, resolution, &pool, ".");
+
+		start = benchmarkTime();
+
+		ClothDistanceField field(vertices.data(), (int)vertices.size(), indices.data(), triangleCount, resolution, &pool, ".");
+
+		double cachedSeconds = benchmarkTime() - start;
+
+		// Particles draped over the top of the sphere, each within a thickness of the surface
+		int count = (int)(size * size);
+		std::vector<ClothFloat4> rest(count), pos(count);
+		unsigned int seed = 12345;
+
+		for (DWORD j = 0; j < size; j++)
+		{
+			for (DWORD i = 0; i < size; i++)
+			{
+				float x = 0.22f + 0.56f * (float)i / (float)(size - 1) - centre.x;
+				float z = 0.22f + 0.56f * (float)j / (float)(size - 1) - centre.z;
+				float y = sqrtf(radius * radius - x * x - z * z) + benchmarkNoise(seed) * 2.0f * field.thickness;
+
+				rest[j * size + i] = ClothFloat4(centre.x + x, centre.y + y, centre.z + z, 1.0f);
+			}
+		}
+
+		ClothFloat4* p = pos.data();
+		const ClothDistanceField* f = &field;
+		double seconds = 0.0;
+
+		for (int r = 0; r < repeats; r++)
+		{
+			pos = rest;
+
+			start = benchmarkTime();
+
+			pool.parallelFor(count, 2048, [p, f](int begin, int end)
+			{
+				f->collide(p, begin, end);
+			});
+
+			seconds += benchmarkTime() - start;
+		}
+
+		int inside = 0;
+
+		for (int i = 0; i < count; i++)
+		{
+			float dx = pos[i].x - centre.x, dy = pos[i].y - centre.y, dz = pos[i].z - centre.z;
+
+			if (sqrtf(dx * dx + dy * dy + dz * dz) < radius + field.thickness * 0.5f)
+				inside++;
+		}
+
+		fprintf(fp, "  %7d triangles  bake %8.1f ms  cached %s %6.2f ms  %5d of %5d bricks  %8.2f ns/particle  %6d inside\n", triangleCount, bakeSeconds * 1000.0,
+			field.isCached() ? "yes" : "no ", cachedSeconds * 1000.0, field.keptBricks(), field.totalBricks(), seconds * 1e9 / ((double)repeats * count), inside);
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Self collision
+void ClothBenchmark::selfCollision(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD sizes[]	= {64, 128, 256};
+	const int frames	= 120;
+	const int repeats	= 20;
+
+	ClothWorkerPool pool;
+
+	// Sphere under the middle of the cloth, which folds over it as it slides off
+	std::vector<ClothFloat3> vertices;
+	std::vector<DWORD> indices;
+
+	sphereMesh(16, 0.25f, ClothFloat3(0.5f, -0.4f, 0.5f), vertices, indices);
+
+	ClothMeshCollider sphere(vertices.data(), (int)vertices.size(), indices.data(), (int)indices.size() / 3, &pool);
+
+	fprintf(fp, "Self collision (PBD cloth dropped on a sphere, 8 iterations, %d frames, %d threads)\n", frames, pool.threadCount());
+
+	for (int s = 0; s < 3; s++)
+	{
+		fprintf(fp, "  %lux%lu\n", (unsigned long)sizes[s], (unsigned long)sizes[s]);
+
+		for (int on = 0; on < 2; on++)
+		{
+			ClothSolver solver(sizes[s], sizes[s], &pool);
+
+			solver.anchorOn		= false;
+			solver.iterations	= 8;
+			solver.setCollider(&sphere);
+			solver.setSelfCollision(on != 0);
+
+			double start = benchmarkTime();
+
+			for (int f = 0; f < frames; f++)
+				solver.step();
+
+			double seconds = benchmarkTime() - start;
+
+			// Hash build and query timed apart on the final state
+			ClothSelfCollision self(solver.getTopology(), &pool);
+
+			int count = solver.particleCount();
+			std::vector<ClothFloat4> rest(solver.getParticles()->pos, solver.getParticles()->pos + count), pos(count);
+
+			ClothFloat4* p = pos.data();
+			const ClothSelfCollision* c = &self;
+			double buildSeconds = 0.0, querySeconds = 0.0;
+
+			for (int r = 0; r < repeats; r++)
+			{
+				pos = rest;
+
+				start = benchmarkTime();
+
+				self.build(p);
+
+				buildSeconds += benchmarkTime() - start;
+				start = benchmarkTime();
+
+				pool.parallelFor(count, 2048, [p, c](int begin, int end)
+				{
+					c->collide(p, begin, end);
+				});
+
+				querySeconds += benchmarkTime() - start;
+			}
+
+			// Furthest a particle was pushed - how deep the cloth overlaps itself
+			float overlap = 0.0f;
+
+			for (int i = 0; i < count; i++)
+			{
+				float dx = pos[i].x - rest[i].x, dy = pos[i].y - rest[i].y, dz = pos[i].z - rest[i].z;
+				float d = sqrtf(dx * dx + dy * dy + dz * dz);
+
+				overlap = d > overlap ? d : overlap;
+			}
+
+			fprintf(fp, "    self %-3s %8.3f ms/frame  build %7.3f ms  query %7.3f ms (%6.2f ns/particle)  overlap %5.1f%% of thickness\n", on ? "on" : "off", seconds * 1000.0 / frames,
+				buildSeconds * 1000.0 / repeats, querySeconds * 1000.0 / repeats, querySeconds * 1e9 / ((double)repeats * count), overlap * 100.0f / self.thickness);
+		}
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Vertex assembly
+void ClothBenchmark::vertexAssembly(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD size	= 512;
+	const int repeats	= 50;
+	const int w			= (int)size;
+	const int count		= w * w;
+
+	ClothTopology topology(size, size);
+	ClothParticleStore* store = jitteredCloth(topology, 0.002f);
+
+	if (!store)
+		return;
+
+	// Half way through a step, so every position is interpolated
+	store->saveStep(0, count);
+
+	for (int i = 0; i < count; i++)
+		store->pos[i].y += 0.001f;
+
+	std::vector<ClothVertex> vertices(count);
+	std::vector<ClothFloat3> normals(count);
+
+	ClothVertex* out		= vertices.data();
+	ClothFloat3* separate		= normals.data();
+	const ClothParticleStore* p	= store;
+
+	fprintf(fp, "Vertex assembly (%lux%lu particles, %d repeats, single thread)\n", (unsigned long)size, (unsigned long)size, repeats);
+
+	// Positions only, as before the normals were assembled
+	double start = benchmarkTime();
+
+	for (int r = 0; r < repeats; r++)
+		p->assembleVertices(out, 0, count, 0.5f);
+
+	fprintf(fp, "  %-18s %8.3f ms\n", "positions only", (benchmarkTime() - start) * 1000.0 / repeats);
+
+	for (int isa = 0; isa < CLOTH_ISA_COUNT; isa++)
+	{
+		if (!ClothKernels::isaSupported((ClothIsa)isa) || isa == CLOTH_ISA_AVX512)
+			continue;
+
+		ClothGridNormalsFn kernel = ClothKernels::gridNormals((ClothIsa)isa);
+
+		// Separate pass - the positions are assembled, then read back for the normals
+		start = benchmarkTime();
+
+		for (int r = 0; r < repeats; r++)
+		{
+			p->assembleVertices(out, 0, count, 0.5f);
+
+			std::vector<ClothFloat4> rows(w * 3);
+
+			for (int j = 0; j < w; j++)
+			{
+				for (int k = -1; k <= 1; k++)
+				{
+					int row = j + k < 0 ? 0 : (j + k >= w ? w - 1 : j + k);
+
+					for (int i = 0; i < w; i++)
+						rows[(k + 1) * w + i] = ClothFloat4(out[row * w + i].pos.x, out[row * w + i].pos.y, out[row * w + i].pos.z, 0.0f);
+				}
+
+				kernel(&rows[0], &rows[w], &rows[2 * w], w, 0, w, separate + j * w);
+			}
+
+			for (int i = 0; i < count; i++)
+				out[i].normal = separate[i];
+		}
+
+		double separateSeconds = benchmarkTime() - start;
+
+		start = benchmarkTime();
+
+		for (int r = 0; r < repeats; r++)
+			p->assembleGridVertices(out, 0, w, w, 0, w, 0.5f, kernel);
+
+		double fusedSeconds = benchmarkTime() - start;
+
+		fprintf(fp, "  %-6s normals    separate %8.3f ms  fused %8.3f ms\n", ClothKernels::isaName((ClothIsa)isa), separateSeconds * 1000.0 / repeats, fusedSeconds * 1000.0 / repeats);
+	}
+
+	delete store;
+
+	fprintf(fp, "\n");
+}
+
+// Aerodynamics
+void ClothBenchmark::aerodynamics(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD size	= 256;
+	const int repeats	= 20;
+
+	ClothTopology topology(size, size);
+	ClothParticleStore* store = jitteredCloth(topology, 0.25f / (float)size);
+
+	if (!store)
+		return;
+
+	int count		= topology.particleCount;
+	int triangles	= topology.totalIndices / 3;
+
+	// Air moving at a few m/s in every direction relative to the particles
+	std::vector<ClothFloat4> flow(count);
+	unsigned int seed = 54321;
+
+	for (int i = 0; i < count; i++)
+		flow[i] = ClothFloat4(benchmarkNoise(seed) * 8.0f, benchmarkNoise(seed) * 8.0f, benchmarkNoise(seed) * 8.0f, 0.0f);
+
+	std::vector<ClothFloat4> scalar(triangles), force(triangles);
+
+	fprintf(fp, "Aerodynamics kernels (%lux%lu cloth, %d triangles, single thread, %d repeats)\n", (unsigned long)size, (unsigned long)size, triangles, repeats);
+
+	for (int isa = CLOTH_ISA_SCALAR; isa < CLOTH_ISA_COUNT; isa++)
+	{
+		if (!ClothKernels::isaSupported((ClothIsa)isa) || isa == CLOTH_ISA_AVX512)
+			continue;
+
+		ClothAeroFn kernel = ClothKernels::aero((ClothIsa)isa);
+
+		std::vector<ClothFloat4>& out = isa == CLOTH_ISA_SCALAR ? scalar : force;
+
+		double start = benchmarkTime();
+
+		for (int r = 0; r < repeats; r++)
+			kernel(store->pos, flow.data(), topology.indices, 0.1f, 0.05f, 0, triangles, out.data());
+
+		double seconds = benchmarkTime() - start;
+
+		// Largest difference from the scalar kernel
+		float maxError = 0.0f;
+
+		for (int t = 0; isa != CLOTH_ISA_SCALAR && t < triangles; t++)
+		{
+			float dx = fabsf(force[t].x - scalar[t].x);
+			float dy = fabsf(force[t].y - scalar[t].y);
+			float dz = fabsf(force[t].z - scalar[t].z);
+
+			maxError = dx > maxError ? dx : maxError;
+			maxError = dy > maxError ? dy : maxError;
+			maxError = dz > maxError ? dz : maxError;
+		}
+
+		fprintf(fp, "  %-8s %8.1f M triangles/s  max error vs scalar %g\n", ClothKernels::isaName((ClothIsa)isa), (double)triangles * repeats / seconds * 1e-6, maxError);
+	}
+
+	delete store;
+
+	// Hanging cloths in still air and in a turbulent wind over a box around them
+	const DWORD sizes[]	= {64, 128, 256};
+	const int frames	= 120;
+
+	ClothWorkerPool pool;
+
+	ClothWindField still(ClothFloat3(-1.0f, -2.0f, -1.0f), ClothFloat3(2.0f, 1.0f, 2.0f), 0.1f, &pool);
+	ClothWindField gusty(ClothFloat3(-1.0f, -2.0f, -1.0f), ClothFloat3(2.0f, 1.0f, 2.0f), 0.1f, &pool);
+
+	gusty.baseWind		= ClothFloat3(5.0f, 0.0f, 0.0f);
+	gusty.turbulence	= 2.0f;
+
+	// XPBD - the anchors move to their positions over the substeps. The substeps alone
+	// leave a fine cloth stretching further every frame under the wind, so it is tethered
+	// to its anchors, and the air is checked to stretch it no further past its reach from
+	// them than hanging in no air does (the tethers follow the constraints, so are a little
+	// longer than the straight distances measured here).
+	fprintf(fp, "Aerodynamics (XPBD cloth tethered to its anchors, %d frames, %d threads)\n", frames, pool.threadCount());
+
+	for (int s = 0; s < 3; s++)
+	{
+		fprintf(fp, "  %lux%lu\n", (unsigned long)sizes[s], (unsigned long)sizes[s]);
+
+		float hangingOverreach = 0.0f;
+
+		for (int mode = 0; mode < 3; mode++)
+		{
+			ClothWindField* wind = mode == 0 ? nullptr : (mode == 1 ? &still : &gusty);
+
+			ClothSolver solver(sizes[s], sizes[s], &pool);
+
+			solver.setMode(CLOTH_SOLVER_XPBD);
+			solver.setAttachments(true);
+			solver.setWind(wind);
+
+			std::vector<ClothFloat4> restPos(solver.getParticles()->pos, solver.getParticles()->pos + solver.particleCount());
+
+			double advanceSeconds = 0.0;
+			double start = benchmarkTime();
+
+			for (int f = 0; f < frames; f++)
+			{
+				if (wind)
+				{
+					double advanceStart = benchmarkTime();
+
+					wind->advance(solver.timeStep);
+
+					advanceSeconds += benchmarkTime() - advanceStart;
+				}
+
+				solver.step();
+			}
+
+			double seconds = benchmarkTime() - start;
+
+			// How far downwind the cloth was blown
+			float drift = 0.0f;
+
+			for (int i = 0; i < solver.particleCount(); i++)
+				drift += solver.getParticles()->pos[i].x;
+
+			drift = drift / (float)solver.particleCount() - 0.5f;
+
+			// Furthest any particle got from the anchors past its distance from them at rest
+			const ClothAnchors& anchors = solver.getAnchors();
+			float overreach = 0.0f;
+
+			for (int i = 0; i < solver.particleCount(); i++)
+			{
+				ClothFloat4 p = solver.getParticles()->pos[i];
+				float reach = FLT_MAX, distance = FLT_MAX;
+
+				for (int a = 0; a < anchors.count(); a++)
+				{
+					ClothFloat3 r = anchors.restOf(a);
+					ClothFloat3 t = anchors.targetOf(a);
+
+					float rx = restPos[i].x - r.x, ry = restPos[i].y - r.y, rz = restPos[i].z - r.z;
+					float tx = p.x - t.x, ty = p.y - t.y, tz = p.z - t.z;
+
+					float r2 = sqrtf(rx * rx + ry * ry + rz * rz);
+					float t2 = sqrtf(tx * tx + ty * ty + tz * tz);
+
+					reach		= r2 < reach ? r2 : reach;
+					distance	= t2 < distance ? t2 : distance;
+				}
+
+				overreach = distance - reach > overreach ? distance - reach : overreach;
+			}
+
+			if (mode == 0)
+				hangingOverreach = overreach;
+
+			// A hundredth of the cloth's width is left for the constraints still moving
+			fprintf(fp, "    %-10s %8.3f ms/frame  wind advance %7.3f ms  mean drift %6.3f m  past reach %6.3f m %s\n", mode == 0 ? "no air" : (mode == 1 ? "still air" : "wind"), seconds * 1000.0 / frames,
+				advanceSeconds * 1000.0 / frames, drift, overreach, overreach <= hangingOverreach + 0.01f ? "ok" : "UNBOUNDED");
+		}
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Determinism
+void ClothBenchmark::determinism(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD size		= 64;
+	const int frames		= 60;
+	const int threads[]		= {1, 2, 4};
+
+	// Every pass that touches the particles - wind, tethers, self collision and a tolerance,
+	// with the anchors released half way so the cloth falls and folds onto itself. The state
+	// hash of every step is folded into one hash per run.
+	fprintf(fp, "Repeatability (%lux%lu cloth in wind with tethers and self collision, %d frames, anchors released half way)\n", (unsigned long)size, (unsigned long)size, frames);
+
+	for (int mode = 0; mode < 2; mode++)
+	{
+		fprintf(fp, "  %s\n", mode == 0 ? "PBD, 8 iterations" : "XPBD, 8 substeps of 2 iterations");
+
+		unsigned long long reference = 0;
+
+		for (int t = 0; t < 3; t++)
+		{
+			ClothWorkerPool pool(threads[t]);
+
+			for (int isa = CLOTH_ISA_SCALAR; isa <= CLOTH_ISA_AVX512; isa++)
+			{
+				if (!ClothKernels::isaSupported((ClothIsa)isa))
+					continue;
+
+				ClothWindField wind(ClothFloat3(-1.0f, -2.0f, -1.0f), ClothFloat3(2.0f, 1.0f, 2.0f), 0.1f, &pool);
+
+				wind.baseWind	= ClothFloat3(3.0f, 0.0f, 1.0f);
+				wind.turbulence	= 1.5f;
+
+				ClothSolver solver(size, size, &pool);
+
+				solver.setMode(mode == 0 ? CLOTH_SOLVER_PBD : CLOTH_SOLVER_XPBD);
+				solver.iterations	= mode == 0 ? 8 : 2;
+				solver.tolerance	= 1e-4f;
+
+				solver.setIsa((ClothIsa)isa);
+				solver.setHashing(true);
+				solver.setWind(&wind);
+				solver.setAttachments(true);
+				solver.setSelfCollision(true);
+
+				unsigned long long history = 0;
+
+				for (int f = 0; f < frames; f++)
+				{
+					wind.advance(solver.timeStep);
+
+					solver.anchorOn = f < frames / 2;
+					solver.step();
+
+					unsigned long long stepHash = solver.getStats().stateHash;
+
+					history = ClothHash::xxh64(&stepHash, sizeof(stepHash), history);
+				}
+
+				if (t == 0 && isa == CLOTH_ISA_SCALAR)
+					reference = history;
+
+				fprintf(fp, "    %d threads %-8s steps %016llx %-9s  residual rms %.9g\n", threads[t], ClothKernels::isaName((ClothIsa)isa), history, history == reference ? "same" : "DIFFERENT", solver.getStats().residualRMS);
+			}
+		}
+	}
+
+	// Cost of hashing every step
+	const DWORD sizes[]	= {64, 128, 256};
+	const int steps		= 120;
+
+	ClothWorkerPool pool;
+
+	fprintf(fp, "State hashing (PBD cloth hanging from its anchors, 8 iterations, %d threads, %d frames)\n", pool.threadCount(), steps);
+
+	for (int s = 0; s < 3; s++)
+	{
+		double seconds[2];
+
+		for (int on = 0; on < 2; on++)
+		{
+			ClothSolver solver(sizes[s], sizes[s], &pool);
+
+			solver.iterations = 8;
+			solver.setHashing(on != 0);
+
+			double start = benchmarkTime();
+
+			for (int f = 0; f < steps; f++)
+				solver.step();
+
+			seconds[on] = benchmarkTime() - start;
+		}
+
+		fprintf(fp, "  %4lux%-4lu hashing off %8.3f ms/frame  on %8.3f ms/frame (%+5.1f%%)\n", (unsigned long)sizes[s], (unsigned long)sizes[s],
+			seconds[0] * 1000.0 / steps, seconds[1] * 1000.0 / steps, (seconds[1] / seconds[0] - 1.0) * 100.0);
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Rest state
+void ClothBenchmark::restState(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD sizes[] = {32, 64, 128};
+
+	ClothWorkerPool pool;
+
+	fprintf(fp, "Rest state cache (cloth hanging from its anchors settled to rest, %d threads, cache in the working directory)\n", pool.threadCount());
+
+	for (int mode = 0; mode < 2; mode++)
+	{
+		fprintf(fp, "  %s\n", mode == 0 ? "PBD, 8 iterations" : "XPBD, 8 substeps");
+
+		for (int s = 0; s < 3; s++)
+		{
+			double start = benchmarkTime();
+
+			ClothSolver settled(sizes[s], sizes[s], &pool);
+
+			settled.setMode(mode == 0 ? CLOTH_SOLVER_PBD : CLOTH_SOLVER_XPBD);
+			settled.iterations = mode == 0 ? 8 : 1;
+
+			int steps = settled.settle();
+
+			double settleSeconds = benchmarkTime() - start;
+
+			// Make sure the cache holds the state, then time a startup that finds it
+			{
+				ClothSolver writer(sizes[s], sizes[s], &pool);
+
+				writer.setMode(settled.getMode());
+				writer.iterations = settled.iterations;
+				writer.settle(".");
+			}
+
+			start = benchmarkTime();
+
+			ClothSolver cached(sizes[s], sizes[s], &pool);
+
+			cached.setMode(settled.getMode());
+			cached.iterations = settled.iterations;
+
+			int cachedSteps = cached.settle(".");
+
+			double cachedSeconds = benchmarkTime() - start;
+
+			fprintf(fp, "    %4lux%-4lu settled in %5d steps %9.1f ms  cached %s %7.2f ms  state %s\n", (unsigned long)sizes[s], (unsigned long)sizes[s], steps, settleSeconds * 1000.0,
+				cachedSteps == 0 ? "yes" : "no ", cachedSeconds * 1000.0, cached.stateHash() == settled.stateHash() ? "same" : "DIFFERENT");
+		}
+	}
+
+	// A cloth settled with its tiles asleep (stiff enough to come to rest, as in tileSleeping)
+	// keys its state by the sleeping thresholds too, so a solver without sleeping settles
+	// afresh. Read into a solver that sleeps the same way, with sleeping then turned off so
+	// nothing would wake a particle, it has to be free once let go. Gravity moves a particle of
+	// no inverse mass all the same, so the constraints are what would hold it.
+	const DWORD size	= 64;
+	const int frames	= 30;
+
+	{
+		ClothSolver writer(size, size, &pool);
+
+		writer.setMode(CLOTH_SOLVER_XPBD);
+		writer.setCompliance(0.0f);
+		writer.substeps = 16;
+		writer.setSleeping(true);
+		writer.settle(".");
+	}
+
+	ClothSolver awake(size, size, &pool);
+
+	awake.setMode(CLOTH_SOLVER_XPBD);
+	awake.setCompliance(0.0f);
+	awake.substeps = 16;
+
+	bool separate = awake.settle(".") > 0;
+
+	ClothSolver reader(size, size, &pool);
+
+	reader.setMode(CLOTH_SOLVER_XPBD);
+	reader.setCompliance(0.0f);
+	reader.substeps = 16;
+	reader.setSleeping(true);
+
+	int cachedSteps = reader.settle(".");
+
+	reader.setSleeping(false);
+	reader.anchorOn = false;
+
+	for (int f = 0; f < frames; f++)
+		reader.step();
+
+	int freed = 0;
+
+	for (int i = 0; i < reader.particleCount(); i++)
+		freed += reader.getParticles()->pos[i].w > 0.0f;
+
+	fprintf(fp, "  XPBD without sleeping, %lux%lu cached %s (%s)\n", (unsigned long)size, (unsigned long)size, separate ? "no " : "yes", separate ? "ok" : "SHARED WITH SLEEPING");
+
+	fprintf(fp, "  XPBD asleep at rest, %lux%lu cached %s, anchors released for %d frames: %d of %d particles free %s\n", (unsigned long)size, (unsigned long)size, cachedSteps == 0 ? "yes" : "no ",
+		frames, freed, reader.particleCount(), freed == reader.particleCount() ? "ok" : "STUCK");
+
+	fprintf(fp, "\n");
+}
+
+// Topology cache
+void ClothBenchmark::topologyCache(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD sizes[] = {512, 1024, 2048};
+
+	ClothWorkerPool pool;
+
+	// Cold is read from the disk, warm from the file cache - a startup only wins when the
+	// read beats the quicker build
+	fprintf(fp, "Topology cache (grid cloths, cache in the working directory, %d threads)\n", pool.threadCount());
+
+	for (int s = 0; s < 3; s++)
+	{
+		double start = benchmarkTime();
+
+		ClothTopology built(sizes[s], sizes[s]);
+
+		double buildSeconds = benchmarkTime() - start;
+
+		start = benchmarkTime();
+
+		{
+			ClothTopology pooled(sizes[s], sizes[s], &pool);
+		}
+
+		double poolSeconds = benchmarkTime() - start;
+
+		// Make sure the cache holds the grid (named as ClothTopology names it)
+		{
+			ClothTopology writer(sizes[s], sizes[s], nullptr, ".");
+		}
+
+		char path[64];
+
+		sprintf(path, "./cloth_grid_%lux%lu.bin", (unsigned long)sizes[s], (unsigned long)sizes[s]);
+
+		fprintf(fp, "  %4lux%-4lu build %8.1f ms  on the pool %8.1f ms\n", (unsigned long)sizes[s], (unsigned long)sizes[s], buildSeconds * 1000.0, poolSeconds * 1000.0);
+
+		for (int warm = 0; warm < 2; warm++)
+		{
+			if (!warm && !evictFile(path))
+			{
+				fprintf(fp, "    cold  cannot evict the cache file\n");
+				continue;
+			}
+
+			start = benchmarkTime();
+
+			ClothTopology cached(sizes[s], sizes[s], nullptr, ".");
+
+			double mapSeconds = benchmarkTime() - start;
+
+			// The pages are only read in now, as the solver would on its first step
+			start = benchmarkTime();
+
+			float lengths	= 0.0f;
+			DWORD corners	= 0;
+
+			for (int i = 0; i < cached.totalConstraints; i++)
+				lengths += cached.constraints[i].length;
+
+			for (int i = 0; i < cached.totalIndices; i++)
+				corners ^= cached.indices[i];
+
+			double readSeconds = benchmarkTime() - start;
+
+			// Kept in volatiles so the reads are not optimised away
+			volatile float keptLengths	= lengths;
+			volatile DWORD keptCorners	= corners;
+
+			(void)keptLengths;
+			(void)keptCorners;
+
+			bool same =	memcmp(built.constraints, cached.constraints, sizeof(Constraint) * built.totalConstraints) == 0 &&
+						memcmp(built.indices, cached.indices, sizeof(DWORD) * built.totalIndices) == 0;
+
+			double totalSeconds = mapSeconds + readSeconds;
+			double buildBest	= poolSeconds < buildSeconds ? poolSeconds : buildSeconds;
+
+			fprintf(fp, "    %-5s cached %s map %6.2f ms  first read %7.1f ms  %6.1f MB  topology %s  %s than building\n", warm ? "warm" : "cold", cached.isCached() ? "yes" : "no ",
+				mapSeconds * 1000.0, readSeconds * 1000.0, (double)cached.bytes() / (1024.0 * 1024.0), same ? "same" : "DIFFERENT", totalSeconds < buildBest ? "faster" : "SLOWER");
+		}
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Grid topology
+void ClothBenchmark::gridTopology(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD sizes[] = {1024, 2048, 4096};
+
+	ClothWorkerPool pool;
+
+	fprintf(fp, "Grid topology build (constraints, batches and indices, %d threads)\n", pool.threadCount());
+
+	for (int s = 0; s < 3; s++)
+	{
+		double start = benchmarkTime();
+
+		{
+			ClothTopology serial(sizes[s], sizes[s]);
+		}
+
+		double serialSeconds = benchmarkTime() - start;
+
+		start = benchmarkTime();
+
+		ClothTopology parallel(sizes[s], sizes[s], &pool);
+
+		double parallelSeconds = benchmarkTime() - start;
+
+		fprintf(fp, "  %4lux%-4lu %9d constraints  1 thread %8.1f ms  %2d threads %8.1f ms  %6.1f MB\n", (unsigned long)sizes[s], (unsigned long)sizes[s], parallel.totalConstraints,
+			serialSeconds * 1000.0, pool.threadCount(), parallelSeconds * 1000.0, (double)parallel.bytes() / (1024.0 * 1024.0));
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Tearing
+void ClothBenchmark::tearing(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD sizes[]	= {64, 128, 256};
+	const int repeats	= 20;
+
+	ClothWorkerPool pool;
+
+	fprintf(fp, "Tearing (scan at rest %d times, then the lower half pulled off the upper, %d threads)\n", repeats, pool.threadCount());
+
+	for (int s = 0; s < 3; s++)
+	{
+		ClothTopology topology(sizes[s], sizes[s], &pool);
+
+		int count = topology.particleCount;
+
+		std::vector<Particle> rest(count);
+		std::vector<float> compliance(topology.totalConstraints, 0.0f), lambda(topology.totalConstraints, 0.0f);
+
+		topology.buildParticles(rest.data());
+
+		ClothParticleStore particles(count, count * 2);
+		particles.load(rest.data());
+
+		ClothTearing tearing(&topology, &pool);
+		ClothSelfCollision selfCollision(&topology, &pool);
+		ClothAerodynamics aerodynamics(&topology, &pool);
+
+		// Nothing is stretched, so this is the cost every step pays
+		double start = benchmarkTime();
+
+		for (int r = 0; r < repeats; r++)
+			tearing.tear(&particles, compliance.data(), lambda.data(), 0.5f);
+
+		double scanSeconds = (benchmarkTime() - start) / repeats;
+
+		// Every constraint across the middle row tears at once
+		for (int i = count / 2; i < count; i++)
+			particles.pos[i].z += 1.0f;
+
+		start = benchmarkTime();
+
+		int torn = tearing.tear(&particles, compliance.data(), lambda.data(), 0.5f);
+
+		double tearSeconds = benchmarkTime() - start;
+
+		int splits	= tearing.splitCount();
+		int removed	= tearing.removedCount();
+
+		// The cut runs along a row, so it changes a few triangles in every strip of the index
+		// buffer - each is patched on its own rather than all the strips between them
+		std::vector<ClothTriangleRange> ranges;
+
+		tearing.takeChangedTriangles(ranges);
+
+		int patched = 0;
+
+		for (size_t r = 0; r < ranges.size(); r++)
+			patched += ranges[r].end - ranges[r].first;
+
+		int spanned = ranges.empty() ? 0 : ranges.back().end - ranges.front().first;
+
+		// Only the particles around the cut change. The arrays grow for the first particles
+		// added, so a second cut a quarter of the way up shows what a tear costs after that.
+		std::vector<int> changed;
+		double followSeconds[2];
+		int followed[2];
+
+		for (int cut = 0; cut < 2; cut++)
+		{
+			if (cut == 1)
+			{
+				for (int i = count / 4; i < count / 2; i++)
+					particles.pos[i].z -= 1.0f;
+
+				tearing.tear(&particles, compliance.data(), lambda.data(), 0.5f);
+			}
+
+			start = benchmarkTime();
+
+			tearing.takeChangedParticles(changed);
+			selfCollision.followTears(&topology, tearing, changed);
+			aerodynamics.followTears(tearing, changed);
+
+			followSeconds[cut]	= benchmarkTime() - start;
+			followed[cut]		= (int)changed.size();
+		}
+
+		start = benchmarkTime();
+
+		ClothSelfCollision rebuiltCollision(&topology, &pool);
+		ClothAerodynamics rebuiltAerodynamics(&topology, &pool);
+
+		double rebuildSeconds = benchmarkTime() - start;
+
+		fprintf(fp, "  %4lux%-4lu scan %7.3f ms  %5d torn %8.2f ms  %6.2f us/tear  %5d split  %5d removed\n", (unsigned long)sizes[s], (unsigned long)sizes[s], scanSeconds * 1000.0,
+			torn, tearSeconds * 1000.0, torn ? (tearSeconds - scanSeconds) * 1e6 / torn : 0.0, splits, removed);
+		fprintf(fp, "             index patch %4d ranges %8.1f KB (one range %8.1f KB, buffer %8.1f KB)\n", (int)ranges.size(), patched * 3 * sizeof(DWORD) / 1024.0,
+			spanned * 3 * sizeof(DWORD) / 1024.0, topology.totalIndices * sizeof(DWORD) / 1024.0);
+		fprintf(fp, "             self collision and aerodynamics follow %5d particles %7.3f ms, then %5d %7.3f ms - rebuilt %7.3f ms\n", followed[0], followSeconds[0] * 1000.0,
+			followed[1], followSeconds[1] * 1000.0, rebuildSeconds * 1000.0);
+	}
+
+	// XPBD cloths hanging from their anchors in a gusty wind, torn a little more every frame
+	const DWORD clothSizes[]	= {32, 64};
+	const int frames			= 30;
+
+	ClothWindField gusty(ClothFloat3(-1.0f, -2.0f, -1.0f), ClothFloat3(2.0f, 1.0f, 2.0f), 0.1f, &pool);
+
+	gusty.baseWind		= ClothFloat3(5.0f, 0.0f, 0.0f);
+	gusty.turbulence	= 2.0f;
+
+	fprintf(fp, "Tearing in wind with self collision (XPBD, %d frames)\n", frames);
+
+	for (int s = 0; s < 2; s++)
+	{
+		for (int torn = 0; torn < 2; torn++)
+		{
+			ClothSolver solver(clothSizes[s], clothSizes[s], &pool);
+
+			solver.setMode(CLOTH_SOLVER_XPBD);
+			solver.setWind(&gusty);
+			solver.setSelfCollision(true);
+
+			if (torn)
+				solver.setTearing(0.05f);
+
+			std::vector<ClothTriangleRange> ranges;
+
+			int tornConstraints	= 0;
+			int patched			= 0;
+			int patches			= 0;
+			double start		= benchmarkTime();
+
+			for (int f = 0; f < frames; f++)
+			{
+				gusty.advance(solver.timeStep);
+				solver.step();
+
+				tornConstraints += solver.getStats().torn;
+
+				solver.takeChangedTriangles(ranges);
+
+				for (size_t r = 0; r < ranges.size(); r++)
+					patched += ranges[r].end - ranges[r].first;
+
+				patches += (int)ranges.size();
+			}
+
+			double seconds = benchmarkTime() - start;
+
+			fprintf(fp, "  %4lux%-4lu %-10s %8.3f ms/frame  %6d torn  %6d particles  index patches %5.1f/frame %7.1f KB/frame of %7.1f KB\n", (unsigned long)clothSizes[s], (unsigned long)clothSizes[s],
+				torn ? "tearing" : "no tearing", seconds * 1000.0 / frames, tornConstraints, solver.particleCount(), (double)patches / frames,
+				patched * 3 * sizeof(DWORD) / 1024.0 / frames, solver.getTopology()->totalIndices * sizeof(DWORD) / 1024.0);
+		}
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Anchors
+void ClothBenchmark::anchors(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD size		= 256;
+	const int rows[]		= {0, 1, 64};
+	const int spacing[]		= {0, 1, 4};
+	const int frames		= 60;
+	const int repeats		= 100;
+
+	ClothWorkerPool pool;
+
+	fprintf(fp, "Anchors (%lux%lu XPBD cloth, anchors swaying every frame, %d frames, %d threads)\n", (unsigned long)size, (unsigned long)size, frames, pool.threadCount());
+
+	for (int s = 0; s < 3; s++)
+	{
+		ClothSolver solver(size, size, &pool);
+
+		solver.setMode(CLOTH_SOLVER_XPBD);
+
+		// The hanging anchors, the top row, or every 4th particle of the top 64 rows
+		if (rows[s] > 0)
+		{
+			std::vector<int> pinned;
+
+			for (int y = 0; y < rows[s]; y++)
+			{
+				for (int x = 0; x < (int)size; x += spacing[s])
+					pinned.push_back(y * size + x);
+			}
+
+			solver.setAnchors(pinned.data(), nullptr, (int)pinned.size());
+		}
+
+		const ClothAnchors& anchors = solver.getAnchors();
+		int count = anchors.count();
+
+		std::vector<ClothFloat3> targets(count);
+
+		double writeSeconds	= 0.0;
+		double start		= benchmarkTime();
+
+		for (int f = 0; f < frames; f++)
+		{
+			float sway = 0.2f * sinf((float)f * 0.1f);
+
+			double writeStart = benchmarkTime();
+
+			for (int a = 0; a < count; a++)
+			{
+				ClothFloat3 rest = anchors.restOf(a);
+
+				targets[a] = ClothFloat3(rest.x + sway, rest.y, rest.z);
+			}
+
+			solver.writeAnchorTargets(targets.data(), 0, count);
+
+			writeSeconds += benchmarkTime() - writeStart;
+
+			solver.step();
+		}
+
+		double seconds = benchmarkTime() - start;
+
+		// How far the anchored particles are from their targets after the last step
+		float error = 0.0f;
+
+		for (int a = 0; a < count; a++)
+		{
+			const ClothFloat4& pos	= solver.getParticles()->pos[anchors.particleOf(a)];
+			ClothFloat3 target		= anchors.targetOf(a);
+
+			error = fmaxf(error, fabsf(pos.x - target.x) + fabsf(pos.y - target.y) + fabsf(pos.z - target.z));
+		}
+
+		// A batched write and publish on their own, without the step
+		ClothAnchors copy = anchors;
+		int first, end;
+
+		start = benchmarkTime();
+
+		for (int r = 0; r < repeats; r++)
+		{
+			copy.write(targets.data(), 0, count);
+			copy.publish(first, end);
+		}
+
+		double publishSeconds = (benchmarkTime() - start) / repeats;
+
+		fprintf(fp, "  %5d anchors %8.3f ms/frame  write %8.2f us/frame  write + publish %8.2f us  pin error %g\n", count, (seconds - writeSeconds) * 1000.0 / frames,
+			writeSeconds * 1e6 / frames, publishSeconds * 1e6, error);
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Picking
+void ClothBenchmark::picking(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD sizes[]	= {256, 1024};
+	const int rayCount	= 65536;
+	const int checked	= 256;
+	const int repeats	= 10;
+
+	ClothWorkerPool pool;
+
+	fprintf(fp, "Picking (folded cloth, %d rays cast down onto it, %d checked against every triangle, %d threads)\n", rayCount, checked, pool.threadCount());
+
+	for (int s = 0; s < 2; s++)
+	{
+		ClothTopology topology(sizes[s], sizes[s], &pool);
+
+		int count = topology.particleCount;
+
+		std::vector<Particle> rest(count);
+
+		topology.buildParticles(rest.data());
+
+		ClothParticleStore particles(count);
+		particles.load(rest.data());
+
+		double start = benchmarkTime();
+
+		ClothPicking picking(&topology, &pool);
+
+		double buildSeconds = benchmarkTime() - start;
+
+		// Waves across the cloth, and a fold that lays part of it back over itself
+		for (int i = 0; i < count; i++)
+		{
+			ClothFloat4& p = particles.pos[i];
+
+			p.y = 0.1f * sinf(p.x * 12.0f) * cosf(p.z * 9.0f);
+
+			if (p.x > 0.7f)
+			{
+				float angle = (p.x - 0.7f) * 10.0f;
+
+				p.x = 0.7f + 0.1f * sinf(angle);
+				p.y += 0.1f - 0.1f * cosf(angle);
+			}
+		}
+
+		start = benchmarkTime();
+
+		for (int r = 0; r < repeats; r++)
+			picking.refit(particles.pos);
+
+		double refitSeconds = (benchmarkTime() - start) / repeats;
+
+		std::vector<ClothRay> rays(rayCount);
+		std::vector<ClothRayHit> hits(rayCount);
+
+		unsigned int seed = 4321;
+
+		for (int r = 0; r < rayCount; r++)
+		{
+			rays[r].origin		= ClothFloat3(0.5f + benchmarkNoise(seed) * 1.2f, 1.0f, 0.5f + benchmarkNoise(seed) * 1.2f);
+			rays[r].direction	= ClothFloat3(benchmarkNoise(seed) * 0.5f, -1.0f, benchmarkNoise(seed) * 0.5f);
+			rays[r].tMax		= FLT_MAX;
+		}
+
+		start = benchmarkTime();
+
+		picking.intersect(particles.pos, rays.data(), rayCount, hits.data());
+
+		double castSeconds = benchmarkTime() - start;
+
+		int hit = 0;
+
+		for (int r = 0; r < rayCount; r++)
+			hit += hits[r].triangle >= 0 ? 1 : 0;
+
+		// A refit tree has to find the same nearest hits as testing everything
+		int mismatches = 0;
+
+		for (int r = 0; r < checked; r++)
+		{
+			const ClothRayHit& expected = bruteForceHit(topology, particles.pos, rays[r]);
+
+			if (expected.triangle != hits[r].triangle && fabsf(expected.t - hits[r].t) > 1e-5f)
+				mismatches++;
+		}
+
+		fprintf(fp, "  %4lux%-4lu %7d nodes %2d levels  build %8.2f ms  refit %7.3f ms  cast %6.2f Mrays/s  %5.1f%% hit  %d mismatched\n", (unsigned long)sizes[s], (unsigned long)sizes[s],
+			picking.nodeCount(), picking.levelCount(), buildSeconds * 1000.0, refitSeconds * 1000.0, rayCount / castSeconds * 1e-6, hit * 100.0 / rayCount, mismatches);
+	}
+
+	fprintf(fp, "\n");
+}
+
+// Index order
+void ClothBenchmark::indexOrder(FILE *fp)
+{
+	if (!fp)
+		return;
+
+	const DWORD sizes[]		= {64, 256, 1024};
+	const int caches[]		= {16, 32};
+	const DWORD forsythMax	= 256;
+
+	ClothWorkerPool pool;
+
+	fprintf(fp, "Index order (ACMR / ATVR through FIFO caches of %d and %d vertices, %d threads)\n", caches[0], caches[1], pool.threadCount());
+
+	for (int s = 0; s < 3; s++)
+	{
+		DWORD w = sizes[s], h = sizes[s];
+
+		int vertexCount	= int(w * h);
+		int indexCount	= int((w - 1) * (h - 1) * 6);
+
+		// The row major list the grids were built with before
+		std::vector<DWORD> rowMajor(indexCount);
+		DWORD* iptr = rowMajor.data();
+
+		double start = benchmarkTime();
+
+		for (DWORD j = 0; j < h - 1; ++j)
+		{
+			for (DWORD i = 0; i < w - 1; ++i, iptr += 6)
+			{
+				DWORD a = w * j + i;
+				DWORD b = a + w;
+
+				iptr[0] = a;
+				iptr[1] = b;
+				iptr[2] = a + 1;
+				iptr[3] = b;
+				iptr[4] = b + 1;
+				iptr[5] = a + 1;
+			}
+		}
+
+		double rowMajorSeconds = benchmarkTime() - start;
+
+		std::vector<DWORD> strips(indexCount);
+
+		start = benchmarkTime();
+
+		ClothIndexOptimiser::gridIndices(w, h, strips.data(), &pool);
+
+		double stripSeconds = benchmarkTime() - start;
+
+		fprintf(fp, "  %lux%lu\n", (unsigned long)w, (unsigned long)h);
+
+		for (int order = 0; order < 3; order++)
+		{
+			const char* names[]		= {"row major", "strips", "Forsyth"};
+			std::vector<DWORD> forsyth;
+			const DWORD* indices	= order == 0 ? rowMajor.data() : strips.data();
+			double seconds			= order == 1 ? stripSeconds : rowMajorSeconds;
+
+			// Forsyth is greedy over every triangle, so the largest grid is left out
+			if (order == 2)
+			{
+				if (w > forsythMax)
+					continue;
+
+				forsyth = rowMajor;
+
+				start = benchmarkTime();
+
+				ClothIndexOptimiser::optimiseVertexCache(forsyth.data(), indexCount, vertexCount);
+
+				seconds = benchmarkTime() - start;
+				indices = forsyth.data();
+			}
+
+			fprintf(fp, "    %-10s", names[order]);
+
+			for (int c = 0; c < 2; c++)
+			{
+				ClothCacheStats stats = ClothIndexOptimiser::simulateCache(indices, indexCount, vertexCount, caches[c]);
+
+				fprintf(fp, "  ACMR %5.3f ATVR %5.3f", stats.acmr, stats.atvr);
+			}
+
+			fprintf(fp, "  ordered in %8.2f ms\n", seconds * 1000.0);
+		}
+
+		std::vector<ClothMeshlet> meshlets;
+		std::vector<DWORD> meshletVertices;
+		std::vector<unsigned char> meshletTriangles;
+
+		start = benchmarkTime();
+
+		ClothIndexOptimiser::buildMeshlets(strips.data(), indexCount, vertexCount, meshlets, meshletVertices, meshletTriangles);
+
+		double meshletSeconds = benchmarkTime() - start;
+
+		bool narrow = ClothIndexOptimiser::fitsShortIndices(vertexCount);
+
+		fprintf(fp, "    %d meshlets of %.1f vertices and %.1f triangles in %.2f ms  index buffer %lu bytes (%s)\n", (int)meshlets.size(), (double)meshletVertices.size() / meshlets.size(),
+			(double)meshletTriangles.size() / 3.0 / meshlets.size(), meshletSeconds * 1000.0, (unsigned long)(indexCount * (narrow ? sizeof(WORD) : sizeof(DWORD))), narrow ? "16 bit" : "32 bit");
+	}
+
+	fprintf(fp, "\n");
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdio.h>
+
+
+// Headless benchmarks for the CPU cloth solver (run with -benchmark).
+// Results are written as plain text to fp.
+class ClothBenchmark
+{
+public:
+	// Run every benchmark
+	static void run(FILE *fp);
+
+	// Distance constraint projection throughput for each instruction set
+	static void constraintKernels(FILE *fp);
+
+	// Particle bytes moved per constraint and projection throughput over whole Particles and
+	// over the hot position stream, on 256x256 to 2048x2048 cloths
+	static void particleLayout(FILE *fp);
+
+	// Time per frame of 512x512 and 1024x1024 cloths on 1 thread up to every hardware thread,
+	// with the speedup over one thread and the parallel efficiency
+	static void threadScaling(FILE *fp);
+
+	// Stretch error against wall time for PBD iterations and XPBD substeps
+	static void solverConvergence(FILE *fp);
+
+	// Iterations used and time per frame with and without a residual tolerance, on a falling
+	// cloth and on one settled to rest
+	static void earlyExit(FILE *fp);
+
+	// Time per frame of a settling cloth with and without tile sleeping, and the tiles woken by
+	// setting a wind, by a gust and by releasing the anchors
+	static void tileSleeping(FILE *fp);
+
+	// Time per frame, time to build and memory of many small cloths as separate solvers and as
+	// one cloth set
+	static void clothSet(FILE *fp);
+
+	// PBD iterations and time per frame needed to reach a stretch tolerance, flat and multigrid
+	static void multigrid(FILE *fp);
+
+	// Far edge stretch and time per frame of a tall cloth with and without long range attachments
+	static void attachments(FILE *fp);
+
+	// Time per frame of a cloth dropped on the terrain with no ground, the analytic heights and baked heights
+	static void terrainCollision(FILE *fp);
+
+	// BVH build time and per particle query cost against meshes of 10k to 1M triangles
+	static void meshCollision(FILE *fp);
+
+	// Distance field bake time, cached startup time and per particle query cost against the same meshes
+	static void distanceField(FILE *fp);
+
+	// Time per frame of a cloth draped over a sphere with and without self collision, and the
+	// hash build and query times of its final state
+	static void selfCollision(FILE *fp);
+
+	// Vertex assembly time without normals, with the normals as a separate pass and fused, for each instruction set
+	static void vertexAssembly(FILE *fp);
+
+	// Aerodynamics kernel throughput for each instruction set, and time per frame of a tethered
+	// hanging cloth in still air and in turbulent wind with the time to advance the wind field,
+	// checking the air stretches it no further from its anchors than hanging in no air does
+	static void aerodynamics(FILE *fp);
+
+	// Hash of every step of a windy cloth for each thread count and instruction set, and the
+	// time per frame hashing every step costs
+	static void determinism(FILE *fp);
+
+	// Steps and time to settle a hanging cloth, and the time to read the settled state from the
+	// cache. Then whether a cloth settled asleep and read from the cache is free once let go.
+	static void restState(FILE *fp);
+
+	// Time to build grid topologies of 512x512 to 2048x2048 on one thread and on the worker pool,
+	// and to map them from the cache and first read the mapped constraints and indices, with the
+	// cache file cold on the disk and warm in the file cache
+	static void topologyCache(FILE *fp);
+
+	// Time to build grid topologies of 1024x1024 to 4096x4096 on one thread and on the worker pool
+	static void gridTopology(FILE *fp);
+
+	// Time to scan 64x64 to 256x256 cloths for tears with none to make, and per tear to cut one
+	// across the middle, the index ranges the cut patches, and the time for the self collision
+	// and aerodynamics to follow it against building them again. Then the time per frame and
+	// index patches of cloths torn by a gusty wind with both on.
+	static void tearing(FILE *fp);
+
+	// Time to step a 256x256 XPBD cloth pinned by 3 to 4096 anchors swaying every frame, and
+	// to write and publish their targets
+	static void anchors(FILE *fp);
+
+	// Time to build the picking tree of 256x256 and 1024x1024 cloths, to refit it once folded, and
+	// to cast a batch of rays through it, checked against testing every triangle
+	static void picking(FILE *fp);
+
+	// ACMR and ATVR through a simulated post-transform cache of 64x64 to 1024x1024 grid index lists
+	// row major, in cache ordered strips and Forsyth ordered, the time to order them, and the
+	// meshlets and 16 bit index bytes of the strips
+	static void indexOrder(FILE *fp);
+};
@@ -0,0 +1,71 @@
+#include "ClothBenchmark.h"
+#include <stdio.h>
+#include <string.h>
+
+// Benchmarks by name
+static const struct
+{
+	const char*	name;
+	void		(*run)(FILE *fp);
+} benchmarks[] =
+{
+	{"constraintKernels",	ClothBenchmark::constraintKernels},
+	{"particleLayout",		ClothBenchmark::particleLayout},
+	{"threadScaling",		ClothBenchmark::threadScaling},
+	{"solverConvergence",	ClothBenchmark::solverConvergence},
+	{"earlyExit",			ClothBenchmark::earlyExit},
+	{"tileSleeping",		ClothBenchmark::tileSleeping},
+	{"clothSet",			ClothBenchmark::clothSet},
+	{"multigrid",			ClothBenchmark::multigrid},
+	{"attachments",			ClothBenchmark::attachments},
+	{"terrainCollision",	ClothBenchmark::terrainCollision},
+	{"meshCollision",		ClothBenchmark::meshCollision},
+	{"distanceField",		ClothBenchmark::distanceField},
+	{"selfCollision",		ClothBenchmark::selfCollision},
+	{"vertexAssembly",		ClothBenchmark::vertexAssembly},
+	{"aerodynamics",		ClothBenchmark::aerodynamics},
+	{"determinism",			ClothBenchmark::determinism},
+	{"restState",			ClothBenchmark::restState},
+	{"topologyCache",		ClothBenchmark::topologyCache},
+	{"gridTopology",		ClothBenchmark::gridTopology},
+	{"tearing",				ClothBenchmark::tearing},
+	{"anchors",				ClothBenchmark::anchors},
+	{"picking",				ClothBenchmark::picking},
+	{"indexOrder",			ClothBenchmark::indexOrder}
+};
+
+static const int benchmarkCount = sizeof(benchmarks) / sizeof(benchmarks[0]);
+
+
+// Run every benchmark, or the ones named on the command line
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		ClothBenchmark::run(stdout);
+		return 0;
+	}
+
+	for (int a = 1; a < argc; a++)
+	{
+		int b = 0;
+
+		while (b < benchmarkCount && strcmp(argv[a], benchmarks[b].name) != 0)
+			b++;
+
+		if (b == benchmarkCount)
+		{
+			fprintf(stderr, "Unknown benchmark %s - one of:\n", argv[a]);
+
+			for (b = 0; b < benchmarkCount; b++)
+				fprintf(stderr, "  %s\n", benchmarks[b].name);
+
+			return 1;
+		}
+
+		benchmarks[b].run(stdout);
+		fflush(stdout);
+	}
+
+	return 0;
+}
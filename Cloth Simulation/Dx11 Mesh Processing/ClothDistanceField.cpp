@@ -0,0 +1,721 @@
+#include "ClothDistanceField.h"
+#include "ClothFpContract.h"
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <string>
+#include <algorithm>
+
+using namespace std;
+
+// Samples within exactCells cells of a triangle get their exact distance, bricks with a
+// sample within bandCells cells of the surface are kept, and the grid reaches padCells
+// cells beyond the mesh so its edges are always outside
+static const int exactCells		= 2;
+static const int bandCells		= 3;
+static const int padCells		= 4;
+
+// Samples along each side of a brick, and in one brick
+static const int brickSide		= CLOTH_BRICK_SIZE + 1;
+static const int brickStride	= brickSide * brickSide * brickSide;
+
+// Triangles, slices, plane slices and bricks per worker chunk
+static const int triangleGrain	= 4096;
+static const int sliceGrain		= 1;
+static const int planeGrain		= 4;
+static const int brickGrain		= 16;
+
+// Most triangles tested against a block of samples in one kernel call
+static const int maxCandidates	= 256;
+
+// Cache file layout - the header, the brick table and the brick samples, each part
+// starting on a 64 byte boundary
+static const char fieldMagic[4]	= {'C', 'S', 'D', 'F'};
+static const int fieldVersion	= 1;
+static const size_t fieldAlign	= 64;
+
+
+#pragma region Helpers
+
+struct ClothFieldHeader
+{
+	char				magic[4];
+	int					version;
+	unsigned long long	key;
+	int					resolution;
+	int					bricksX, bricksY, bricksZ;
+	int					brickCount;
+	float				lowerX, lowerY, lowerZ;
+	float				cellSize;
+};
+
+static inline size_t alignUp(size_t offset)
+{
+	return (offset + fieldAlign - 1) / fieldAlign * fieldAlign;
+}
+
+// FNV-1a, a 32 bit word at a time, over the triangle corners in cloth space and the resolution
+static unsigned long long meshKey(const ClothFloat3* vertices, const DWORD* indices, int triangleCount, int resolution)
+{
+	unsigned long long key = 14695981039346656037ULL;
+
+	for (int i = 0; i < triangleCount * 3; i++)
+	{
+		unsigned int words[3];
+
+		memcpy(words, &vertices[indices[i]], sizeof(words));
+
+		key = (key ^ words[0]) * 1099511628211ULL;
+		key = (key ^ words[1]) * 1099511628211ULL;
+		key = (key ^ words[2]) * 1099511628211ULL;
+	}
+
+	return (key ^ (unsigned long long)resolution) * 1099511628211ULL;
+}
+
+// Cache file name of a mesh at a resolution
+static string cacheName(unsigned long long key, int resolution)
+{
+	const char* digits = "0123456789abcdef";
+	string name = "cloth_sdf_";
+
+	for (int shift = 60; shift >= 0; shift -= 4)
+		name += digits[(key >> shift) & 15];
+
+	return name + "_" + to_string((long long)resolution) + ".bin";
+}
+
+// Smallest distance to a sample reachable from neighbouring distances a, b and c along
+// the three axes (the Godunov upwind solution of |grad d| = 1)
+static inline float solveEikonal(float a, float b, float c, float h)
+{
+	float t;
+
+	if (a > b) { t = a; a = b; b = t; }
+	if (b > c) { t = b; b = c; c = t; }
+	if (a > b) { t = a; a = b; b = t; }
+
+	float d = a + h;
+
+	if (d <= b)
+		return d;
+
+	d = 0.5f * (a + b + sqrtf(2.0f * h * h - (a - b) * (a - b)));
+
+	if (d <= c)
+		return d;
+
+	float sum = a + b + c;
+
+	return (sum + sqrtf(sum * sum - 3.0f * (a * a + b * b + c * c - h * h))) / 3.0f;
+}
+
+static inline float min3(float a, float b, float c)
+{
+	return a < b ? (a < c ? a : c) : (b < c ? b : c);
+}
+
+static inline float max3(float a, float b, float c)
+{
+	return a > b ? (a > c ? a : c) : (b > c ? b : c);
+}
+
+// Sample range [first, last] within radius of [low, high] along an axis
+static inline void sampleRange(float low, float high, float radius, float origin, float h, int samples, int& first, int& last)
+{
+	first	= (int)floorf((low - radius - origin) / h);
+	last	= (int)ceilf((high + radius - origin) / h);
+
+	first	= first < 0 ? 0 : first;
+	last	= last >= samples ? samples - 1 : last;
+}
+
+#pragma endregion
+
+
+// Constructor
+ClothDistanceField::ClothDistanceField(const ClothFloat3* vertices, int vertexCount, const DWORD* indices, int triangleCount, int resolution, ClothWorkerPool* pool, const char* cacheDirectory)
+{
+	thickness = 0.01f;
+
+	if (!vertices || !indices || !pool || vertexCount <= 0 || triangleCount <= 0 || resolution < 1)
+		throw("Invalid parameters for cloth distance field instantiation");
+
+	setup(vertices, vertexCount, indices, triangleCount, resolution, pool, cacheDirectory);
+}
+
+// Setup
+void ClothDistanceField::setup(const ClothFloat3* vertices, int vertexCount, const DWORD* indices, int triangleCount, int resolution, ClothWorkerPool* pool, const char* cacheDirectory)
+{
+	for (int i = 0; i < triangleCount * 3; i++)
+	{
+		if (indices[i] >= (DWORD)vertexCount)
+			throw("Invalid mesh for cloth distance field");
+	}
+
+	unsigned long long key = meshKey(vertices, indices, triangleCount, resolution);
+
+	string path;
+
+	if (cacheDirectory && cacheDirectory[0])
+	{
+		path = cacheDirectory;
+
+		if (path[path.size() - 1] != '/' && path[path.size() - 1] != '\\')
+			path += "/";
+
+		path += cacheName(key, resolution);
+
+		// A cache of another mesh, version or resolution, or a truncated one, is baked again
+		cached = cache.open(path.c_str()) && attach((const unsigned char*)cache.data(), cache.size(), key, resolution);
+
+		if (cached)
+			return;
+
+		cache.close();
+	}
+
+	cached = false;
+
+	bake(vertices, indices, triangleCount, resolution, key, pool);
+
+	// The cache only saves time, so the field is used even when it cannot be written
+	if (!path.empty())
+		ClothMappedFile::write(path.c_str(), image.data(), image.size());
+}
+
+// Bake
+void ClothDistanceField::bake(const ClothFloat3* vertices, const DWORD* indices, int triangleCount, int resolution, unsigned long long key, ClothWorkerPool* pool)
+{
+	vector<ClothColliderTriangle> triangles(triangleCount);
+	ClothColliderTriangle* trianglePtr = triangles.data();
+
+	pool->parallelFor(triangleCount, triangleGrain, [=](int begin, int end)
+	{
+		for (int t = begin; t < end; t++)
+		{
+			ClothColliderTriangle& triangle = trianglePtr[t];
+
+			triangle.a = vertices[indices[t * 3]];
+			triangle.b = vertices[indices[t * 3 + 1]];
+			triangle.c = vertices[indices[t * 3 + 2]];
+
+			ClothFloat3 ab(triangle.b.x - triangle.a.x, triangle.b.y - triangle.a.y, triangle.b.z - triangle.a.z);
+			ClothFloat3 ac(triangle.c.x - triangle.a.x, triangle.c.y - triangle.a.y, triangle.c.z - triangle.a.z);
+			ClothFloat3 n(ab.y * ac.z - ab.z * ac.y, ab.z * ac.x - ab.x * ac.z, ab.x * ac.y - ab.y * ac.x);
+
+			float length	= sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+			float inverse	= length > 0.0f ? 1.0f / length : 0.0f;
+
+			triangle.normal = ClothFloat3(n.x * inverse, n.y * inverse, n.z * inverse);
+		}
+	});
+
+	// Grid around the mesh
+	ClothFloat3 meshLower(FLT_MAX, FLT_MAX, FLT_MAX), meshUpper(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+	for (int i = 0; i < triangleCount * 3; i++)
+	{
+		const ClothFloat3& v = vertices[indices[i]];
+
+		meshLower = ClothFloat3(v.x < meshLower.x ? v.x : meshLower.x, v.y < meshLower.y ? v.y : meshLower.y, v.z < meshLower.z ? v.z : meshLower.z);
+		meshUpper = ClothFloat3(v.x > meshUpper.x ? v.x : meshUpper.x, v.y > meshUpper.y ? v.y : meshUpper.y, v.z > meshUpper.z ? v.z : meshUpper.z);
+	}
+
+	float extent = meshUpper.x - meshLower.x;
+
+	extent = meshUpper.y - meshLower.y > extent ? meshUpper.y - meshLower.y : extent;
+	extent = meshUpper.z - meshLower.z > extent ? meshUpper.z - meshLower.z : extent;
+
+	if (!(extent > 0.0f))
+		throw("Invalid mesh for cloth distance field");
+
+	float h		= extent / (float)resolution;
+	float pad	= (float)padCells * h;
+
+	cellSize	= h;
+	lower		= ClothFloat3(meshLower.x - pad, meshLower.y - pad, meshLower.z - pad);
+	bricksX		= ((int)ceilf((meshUpper.x - meshLower.x + 2.0f * pad) / h) + CLOTH_BRICK_SIZE - 1) / CLOTH_BRICK_SIZE;
+	bricksY		= ((int)ceilf((meshUpper.y - meshLower.y + 2.0f * pad) / h) + CLOTH_BRICK_SIZE - 1) / CLOTH_BRICK_SIZE;
+	bricksZ		= ((int)ceilf((meshUpper.z - meshLower.z + 2.0f * pad) / h) + CLOTH_BRICK_SIZE - 1) / CLOTH_BRICK_SIZE;
+
+	int sx = bricksX * CLOTH_BRICK_SIZE + 1;
+	int sy = bricksY * CLOTH_BRICK_SIZE + 1;
+	int sz = bricksZ * CLOTH_BRICK_SIZE + 1;
+
+	ClothFloat3 origin = lower;
+
+	// Distance of every sample, and for those given their exact distance which side of the
+	// nearest triangle they are on (1 in front, -1 behind, 0 not exact)
+	vector<float> distance(sx * sy * sz, FLT_MAX);
+	vector<signed char> side(sx * sy * sz, 0);
+
+	float* distancePtr	= distance.data();
+	signed char* sidePtr	= side.data();
+
+	// Exact distances - the triangles are bucketed by the slices of samples they reach so
+	// each slice is written by one worker only
+	float radius = (float)exactCells * h;
+
+	vector<int> sliceFirst(triangleCount), sliceLast(triangleCount);
+	vector<int> sliceOffset(sz + 1, 0);
+
+	for (int t = 0; t < triangleCount; t++)
+	{
+		const ClothColliderTriangle& triangle = triangles[t];
+
+		sampleRange(min3(triangle.a.z, triangle.b.z, triangle.c.z), max3(triangle.a.z, triangle.b.z, triangle.c.z), radius, origin.z, h, sz, sliceFirst[t], sliceLast[t]);
+
+		for (int k = sliceFirst[t]; k <= sliceLast[t]; k++)
+			sliceOffset[k + 1]++;
+	}
+
+	for (int k = 0; k < sz; k++)
+		sliceOffset[k + 1] += sliceOffset[k];
+
+	vector<int> sliceTriangles(sliceOffset[sz]);
+	vector<int> sliceFill(sliceOffset.begin(), sliceOffset.end() - 1);
+
+	for (int t = 0; t < triangleCount; t++)
+	{
+		for (int k = sliceFirst[t]; k <= sliceLast[t]; k++)
+			sliceTriangles[sliceFill[k]++] = t;
+	}
+
+	const int* offsetPtr	= sliceOffset.data();
+	const int* bucketPtr	= sliceTriangles.data();
+	ClothClosestFn closest	= ClothKernels::closest(ClothKernels::bestIsa());
+
+	pool->parallelFor(sz, sliceGrain, [=](int begin, int end)
+	{
+		ClothQueryBlock block;
+		int candidates[maxCandidates];
+		vector<int> rowOffset(sy + 1), rowFill(sy), rowTriangles, rowFirst, rowLast, columnFirst, columnLast;
+
+		for (int k = begin; k < end; k++)
+		{
+			const int* bucket	= bucketPtr + offsetPtr[k];
+			int count			= offsetPtr[k + 1] - offsetPtr[k];
+
+			// Bucket the triangles of the slice by the rows they reach in turn
+			rowFirst.resize(count);
+			rowLast.resize(count);
+			columnFirst.resize(count);
+			columnLast.resize(count);
+			fill(rowOffset.begin(), rowOffset.end(), 0);
+
+			for (int n = 0; n < count; n++)
+			{
+				const ClothColliderTriangle& triangle = trianglePtr[bucket[n]];
+
+				sampleRange(min3(triangle.a.y, triangle.b.y, triangle.c.y), max3(triangle.a.y, triangle.b.y, triangle.c.y), radius, origin.y, h, sy, rowFirst[n], rowLast[n]);
+				sampleRange(min3(triangle.a.x, triangle.b.x, triangle.c.x), max3(triangle.a.x, triangle.b.x, triangle.c.x), radius, origin.x, h, sx, columnFirst[n], columnLast[n]);
+
+				for (int j = rowFirst[n]; j <= rowLast[n]; j++)
+					rowOffset[j + 1]++;
+			}
+
+			for (int j = 0; j < sy; j++)
+			{
+				rowOffset[j + 1]	+= rowOffset[j];
+				rowFill[j]			= rowOffset[j];
+			}
+
+			rowTriangles.resize(rowOffset[sy]);
+
+			for (int n = 0; n < count; n++)
+			{
+				for (int j = rowFirst[n]; j <= rowLast[n]; j++)
+					rowTriangles[rowFill[j]++] = n;
+			}
+
+			// Each row in blocks of samples, tested against the triangles reaching the block
+			for (int j = 0; j < sy; j++)
+			{
+				if (rowOffset[j] == rowOffset[j + 1])
+					continue;
+
+				for (int first = 0; first < sx; first += CLOTH_QUERY_BLOCK)
+				{
+					int last	= first + CLOTH_QUERY_BLOCK < sx ? first + CLOTH_QUERY_BLOCK : sx;
+					int lanes	= last - first;
+
+					for (int l = 0; l < lanes; l++)
+					{
+						block.x[l]			= origin.x + (float)(first + l) * h;
+						block.y[l]			= origin.y + (float)j * h;
+						block.z[l]			= origin.z + (float)k * h;
+						block.best[l]		= radius * radius;
+						block.cx[l]			= block.x[l];
+						block.cy[l]			= block.y[l];
+						block.cz[l]			= block.z[l];
+						block.nearest[l]	= -1;
+					}
+
+					int candidateCount = 0;
+
+					for (int r = rowOffset[j]; r < rowOffset[j + 1]; r++)
+					{
+						int n = rowTriangles[r];
+
+						if (columnLast[n] < first || columnFirst[n] >= last)
+							continue;
+
+						candidates[candidateCount++] = bucket[n];
+
+						if (candidateCount == maxCandidates)
+						{
+							closest(trianglePtr, candidates, candidateCount, block, 0, lanes);
+							candidateCount = 0;
+						}
+					}
+
+					if (candidateCount)
+						closest(trianglePtr, candidates, candidateCount, block, 0, lanes);
+
+					for (int l = 0; l < lanes; l++)
+					{
+						if (block.nearest[l] < 0)
+							continue;
+
+						const ClothFloat3& n = trianglePtr[block.nearest[l]].normal;
+
+						float dot	= (block.x[l] - block.cx[l]) * n.x + (block.y[l] - block.cy[l]) * n.y + (block.z[l] - block.cz[l]) * n.z;
+						int s		= (k * sy + j) * sx + first + l;
+
+						distancePtr[s]	= sqrtf(block.best[l]);
+						sidePtr[s]		= dot < 0.0f ? -1 : 1;
+					}
+				}
+			}
+		}
+	});
+
+	// Fast sweeping - eight sweeps, one from each corner of the grid. Along a sweep each
+	// sample only depends on the samples of the diagonal plane before it, so the planes
+	// are solved one after another and the samples of a plane in parallel.
+	int planes = (sx - 1) + (sy - 1) + (sz - 1);
+
+	for (int corner = 0; corner < 8; corner++)
+	{
+		bool flipX = (corner & 1) != 0, flipY = (corner & 2) != 0, flipZ = (corner & 4) != 0;
+
+		for (int plane = 0; plane <= planes; plane++)
+		{
+			int firstSlice	= plane - (sx - 1) - (sy - 1) > 0 ? plane - (sx - 1) - (sy - 1) : 0;
+			int lastSlice	= plane < sz - 1 ? plane : sz - 1;
+
+			pool->parallelFor(lastSlice - firstSlice + 1, planeGrain, [=](int begin, int end)
+			{
+				for (int slice = firstSlice + begin; slice < firstSlice + end; slice++)
+				{
+					int rest	= plane - slice;
+					int firstRow	= rest - (sx - 1) > 0 ? rest - (sx - 1) : 0;
+					int lastRow		= rest < sy - 1 ? rest : sy - 1;
+
+					int k = flipZ ? sz - 1 - slice : slice;
+
+					for (int row = firstRow; row <= lastRow; row++)
+					{
+						int j = flipY ? sy - 1 - row : row;
+						int i = flipX ? sx - 1 - (rest - row) : rest - row;
+						int s = (k * sy + j) * sx + i;
+
+						if (sidePtr[s])
+							continue;
+
+						float a = min3(i > 0 ? distancePtr[s - 1] : FLT_MAX, i < sx - 1 ? distancePtr[s + 1] : FLT_MAX, FLT_MAX);
+						float b = min3(j > 0 ? distancePtr[s - sx] : FLT_MAX, j < sy - 1 ? distancePtr[s + sx] : FLT_MAX, FLT_MAX);
+						float c = min3(k > 0 ? distancePtr[s - sx * sy] : FLT_MAX, k < sz - 1 ? distancePtr[s + sx * sy] : FLT_MAX, FLT_MAX);
+
+						if (a == FLT_MAX && b == FLT_MAX && c == FLT_MAX)
+							continue;
+
+						float d = solveEikonal(a, b, c, h);
+
+						if (d < distancePtr[s])
+							distancePtr[s] = d;
+					}
+				}
+			});
+		}
+	}
+
+	// Inside and outside - flood the samples reachable from the grid edges without crossing
+	// the samples within a cell of the surface, which a closed mesh leaves no gap in
+	vector<unsigned char> outside(sx * sy * sz, 0);
+	vector<int> queue;
+
+	for (int k = 0; k < sz; k++)
+	{
+		for (int j = 0; j < sy; j++)
+		{
+			for (int i = 0; i < sx; i++)
+			{
+				if (i > 0 && i < sx - 1 && j > 0 && j < sy - 1 && k > 0 && k < sz - 1)
+					continue;
+
+				int s = (k * sy + j) * sx + i;
+
+				if (distance[s] > h)
+				{
+					outside[s] = 1;
+					queue.push_back(s);
+				}
+			}
+		}
+	}
+
+	for (size_t q = 0; q < queue.size(); q++)
+	{
+		int s = queue[q];
+		int i = s % sx, j = (s / sx) % sy, k = s / (sx * sy);
+
+		int neighbour[6] = {i > 0 ? s - 1 : -1, i < sx - 1 ? s + 1 : -1, j > 0 ? s - sx : -1, j < sy - 1 ? s + sx : -1, k > 0 ? s - sx * sy : -1, k < sz - 1 ? s + sx * sy : -1};
+
+		for (int n = 0; n < 6; n++)
+		{
+			if (neighbour[n] < 0 || outside[neighbour[n]] || distance[neighbour[n]] <= h)
+				continue;
+
+			outside[neighbour[n]] = 1;
+			queue.push_back(neighbour[n]);
+		}
+	}
+
+	// Signs - flooded samples are outside, samples by the surface take the side of their
+	// nearest triangle and the rest are inside
+	const unsigned char* outsidePtr = outside.data();
+
+	pool->parallelFor(sz, sliceGrain, [=](int begin, int end)
+	{
+		for (int s = begin * sx * sy; s < end * sx * sy; s++)
+		{
+			if (!outsidePtr[s] && (distancePtr[s] > h || sidePtr[s] < 0))
+				distancePtr[s] = -distancePtr[s];
+		}
+	});
+
+	// Keep the bricks with a sample within the band
+	int brickTotal = bricksX * bricksY * bricksZ;
+	float band = (float)bandCells * h;
+
+	vector<int> table(brickTotal);
+	int* tablePtr = table.data();
+	int bx = bricksX, by = bricksY;
+
+	pool->parallelFor(brickTotal, brickGrain, [=](int begin, int end)
+	{
+		for (int b = begin; b < end; b++)
+		{
+			int i0 = (b % bx) * CLOTH_BRICK_SIZE, j0 = ((b / bx) % by) * CLOTH_BRICK_SIZE, k0 = (b / (bx * by)) * CLOTH_BRICK_SIZE;
+			bool kept = false;
+
+			for (int k = k0; k < k0 + brickSide && !kept; k++)
+			{
+				for (int j = j0; j < j0 + brickSide && !kept; j++)
+				{
+					for (int i = i0; i < i0 + brickSide && !kept; i++)
+						kept = fabsf(distancePtr[(k * sy + j) * sx + i]) < band;
+				}
+			}
+
+			int centre = ((k0 + CLOTH_BRICK_SIZE / 2) * sy + j0 + CLOTH_BRICK_SIZE / 2) * sx + i0 + CLOTH_BRICK_SIZE / 2;
+
+			tablePtr[b] = kept ? 0 : (distancePtr[centre] < 0.0f ? -2 : -1);
+		}
+	});
+
+	brickCount = 0;
+
+	for (int b = 0; b < brickTotal; b++)
+	{
+		if (table[b] == 0)
+			table[b] = brickCount++;
+	}
+
+	// Image - header, brick table and the samples of the kept bricks
+	size_t tableOffset		= alignUp(sizeof(ClothFieldHeader));
+	size_t samplesOffset	= alignUp(tableOffset + sizeof(int) * brickTotal);
+
+	image.assign(samplesOffset + sizeof(float) * brickStride * (size_t)brickCount, 0);
+
+	ClothFieldHeader* header = (ClothFieldHeader*)image.data();
+
+	memcpy(header->magic, fieldMagic, sizeof(fieldMagic));
+	header->version		= fieldVersion;
+	header->key			= key;
+	header->resolution	= resolution;
+	header->bricksX		= bricksX;
+	header->bricksY		= bricksY;
+	header->bricksZ		= bricksZ;
+	header->brickCount	= brickCount;
+	header->lowerX		= lower.x;
+	header->lowerY		= lower.y;
+	header->lowerZ		= lower.z;
+	header->cellSize	= cellSize;
+
+	memcpy(image.data() + tableOffset, table.data(), sizeof(int) * brickTotal);
+
+	float* samplePtr = (float*)(image.data() + samplesOffset);
+
+	pool->parallelFor(brickTotal, brickGrain, [=](int begin, int end)
+	{
+		for (int b = begin; b < end; b++)
+		{
+			if (tablePtr[b] < 0)
+				continue;
+
+			int i0 = (b % bx) * CLOTH_BRICK_SIZE, j0 = ((b / bx) % by) * CLOTH_BRICK_SIZE, k0 = (b / (bx * by)) * CLOTH_BRICK_SIZE;
+			float* brick = samplePtr + (size_t)tablePtr[b] * brickStride;
+
+			for (int k = 0; k < brickSide; k++)
+			{
+				for (int j = 0; j < brickSide; j++)
+					memcpy(brick + (k * brickSide + j) * brickSide, distancePtr + ((k0 + k) * sy + j0 + j) * sx + i0, sizeof(float) * brickSide);
+			}
+		}
+	});
+
+	attach(image.data(), image.size(), key, resolution);
+}
+
+// Attach
+bool ClothDistanceField::attach(const unsigned char* bytes, size_t size, unsigned long long key, int resolution)
+{
+	if (!bytes || size < sizeof(ClothFieldHeader))
+		return false;
+
+	const ClothFieldHeader* header = (const ClothFieldHeader*)bytes;
+
+	if (memcmp(header->magic, fieldMagic, sizeof(fieldMagic)) != 0 || header->version != fieldVersion || header->key != key || header->resolution != resolution)
+		return false;
+
+	if (header->bricksX <= 0 || header->bricksY <= 0 || header->bricksZ <= 0 || header->brickCount < 0 || !(header->cellSize > 0.0f))
+		return false;
+
+	size_t brickTotal		= (size_t)header->bricksX * header->bricksY * header->bricksZ;
+	size_t tableOffset		= alignUp(sizeof(ClothFieldHeader));
+	size_t samplesOffset	= alignUp(tableOffset + sizeof(int) * brickTotal);
+
+	if (size != samplesOffset + sizeof(float) * brickStride * (size_t)header->brickCount)
+		return false;
+
+	const int* table = (const int*)(bytes + tableOffset);
+
+	for (size_t b = 0; b < brickTotal; b++)
+	{
+		if (table[b] < -2 || table[b] >= header->brickCount)
+			return false;
+	}
+
+	lower			= ClothFloat3(header->lowerX, header->lowerY, header->lowerZ);
+	cellSize		= header->cellSize;
+	bricksX			= header->bricksX;
+	bricksY			= header->bricksY;
+	bricksZ			= header->bricksZ;
+	brickCount		= header->brickCount;
+	brickTable		= table;
+	brickSamples	= (const float*)(bytes + samplesOffset);
+
+	return true;
+}
+
+// Sample - trilinear within the cell, and the gradient of the same interpolation
+bool ClothDistanceField::sample(const ClothFloat3& p, float& distance, ClothFloat3& gradient) const
+{
+	float u = (p.x - lower.x) / cellSize;
+	float v = (p.y - lower.y) / cellSize;
+	float w = (p.z - lower.z) / cellSize;
+
+	int cellsX = bricksX * CLOTH_BRICK_SIZE, cellsY = bricksY * CLOTH_BRICK_SIZE, cellsZ = bricksZ * CLOTH_BRICK_SIZE;
+
+	if (!(u >= 0.0f && v >= 0.0f && w >= 0.0f && u < (float)cellsX && v < (float)cellsY && w < (float)cellsZ))
+		return false;
+
+	int i = (int)u < cellsX - 1 ? (int)u : cellsX - 1;
+	int j = (int)v < cellsY - 1 ? (int)v : cellsY - 1;
+	int k = (int)w < cellsZ - 1 ? (int)w : cellsZ - 1;
+
+	int brick = brickTable[((k / CLOTH_BRICK_SIZE) * bricksY + j / CLOTH_BRICK_SIZE) * bricksX + i / CLOTH_BRICK_SIZE];
+
+	if (brick < 0)
+		return false;
+
+	const float* s = brickSamples + (size_t)brick * brickStride + ((k % CLOTH_BRICK_SIZE) * brickSide + j % CLOTH_BRICK_SIZE) * brickSide + i % CLOTH_BRICK_SIZE;
+
+	const int dy = brickSide, dz = brickSide * brickSide;
+
+	float fx = u - (float)i, fy = v - (float)j, fz = w - (float)k;
+
+	// Along x on the four edges of the cell, then along y, then z
+	float x00 = s[0] + (s[1] - s[0]) * fx;
+	float x10 = s[dy] + (s[dy + 1] - s[dy]) * fx;
+	float x01 = s[dz] + (s[dz + 1] - s[dz]) * fx;
+	float x11 = s[dz + dy] + (s[dz + dy + 1] - s[dz + dy]) * fx;
+
+	float y0 = x00 + (x10 - x00) * fy;
+	float y1 = x01 + (x11 - x01) * fy;
+
+	distance = y0 + (y1 - y0) * fz;
+
+	float gx0 = (s[1] - s[0]) + ((s[dy + 1] - s[dy]) - (s[1] - s[0])) * fy;
+	float gx1 = (s[dz + 1] - s[dz]) + ((s[dz + dy + 1] - s[dz + dy]) - (s[dz + 1] - s[dz])) * fy;
+
+	gradient.x = (gx0 + (gx1 - gx0) * fz) / cellSize;
+	gradient.y = ((x10 - x00) + ((x11 - x01) - (x10 - x00)) * fz) / cellSize;
+	gradient.z = (y1 - y0) / cellSize;
+
+	return true;
+}
+
+// Collide
+void ClothDistanceField::collide(ClothFloat4* pos, int begin, int end) const
+{
+	for (int i = begin; i < end; i++)
+	{
+		if (pos[i].w <= 0.0f)
+			continue;
+
+		float d;
+		ClothFloat3 g;
+
+		if (!sample(ClothFloat3(pos[i].x, pos[i].y, pos[i].z), d, g) || d >= thickness)
+			continue;
+
+		float length = sqrtf(g.x * g.x + g.y * g.y + g.z * g.z);
+
+		if (length <= 0.0f)
+			continue;
+
+		float move = (thickness - d) / length;
+
+		pos[i].x += g.x * move;
+		pos[i].y += g.y * move;
+		pos[i].z += g.z * move;
+	}
+}
+
+// Is cached
+bool ClothDistanceField::isCached() const
+{
+	return cached;
+}
+
+// Kept bricks
+int ClothDistanceField::keptBricks() const
+{
+	return brickCount;
+}
+
+// Total bricks
+int ClothDistanceField::totalBricks() const
+{
+	return bricksX * bricksY * bricksZ;
+}
+
+// Spacing
+float ClothDistanceField::spacing() const
+{
+	return cellSize;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include "ClothTypes.h"
+#include "ClothKernels.h"
+#include "ClothMappedFile.h"
+#include "ClothWorkerPool.h"
+
+class CGPolyMesh;
+
+
+// Cells along each side of a distance field brick
+#define CLOTH_BRICK_SIZE 8
+
+
+// Signed distance field of a static triangle mesh the CPU solver collides the cloth
+// with, for colliders too detailed to query triangle by triangle every pass. The
+// distances are baked once on a grid: exactly within a couple of cells of the
+// triangles, then out to the rest of the grid by fast sweeping, with every sweep
+// solved a diagonal plane of samples at a time in parallel. Samples reachable from
+// the grid edges without crossing the surface are outside, the rest inside.
+//
+// Only the bricks of 8 x 8 x 8 cells near the surface are kept. Each brick holds its
+// own 9 x 9 x 9 samples so a lookup reads all eight corners of its cell from one brick.
+//
+// Given a cache directory the baked field is written there as one file named after a
+// hash of the triangles and the resolution. The next time the same mesh is collided
+// with at that resolution the file is memory-mapped and used as is, without baking.
+//
+// A particle closer than thickness to the surface (or inside it, but no further than
+// the bricks reach) is moved out along the distance gradient to the thickness.
+class ClothDistanceField
+{
+private:
+	// Baked field (empty when used from the cache), and the cache file it was mapped from
+	std::vector<unsigned char>	image;
+	ClothMappedFile				cache;
+	bool						cached;
+
+	// Grid origin, spacing and size in bricks
+	ClothFloat3					lower;
+	float						cellSize;
+	int							bricksX, bricksY, bricksZ;
+	int							brickCount;
+
+	// Index of each brick (-1 for an empty brick outside the surface, -2 for one inside),
+	// and the samples of the kept bricks - both point into image or the mapped cache
+	const int*					brickTable;
+	const float*				brickSamples;
+
+	// Field setup - from the cache in cacheDirectory when it holds this mesh, else baked
+	// (and written there when given)
+	void setup(const ClothFloat3* vertices, int vertexCount, const DWORD* indices, int triangleCount, int resolution, ClothWorkerPool* pool, const char* cacheDirectory);
+
+	// Bake the field into image
+	void bake(const ClothFloat3* vertices, const DWORD* indices, int triangleCount, int resolution, unsigned long long key, ClothWorkerPool* pool);
+
+	// Point the field at an image - false if it is not a field of this mesh and resolution
+	bool attach(const unsigned char* bytes, size_t size, unsigned long long key, int resolution);
+
+public:
+	// Constructor - triangles of a mesh, moved into cloth space as origin + scale * vertex.
+	// resolution is the number of cells across the longest side of the mesh. In
+	// ClothMeshImport.cpp, with the other constructors from a CGPolyMesh.
+	ClothDistanceField(CGPolyMesh* mesh, const ClothFloat3& origin, float scale, int resolution, ClothWorkerPool* pool, const char* cacheDirectory = nullptr);
+	// Constructor - triangles given in cloth space as three vertex indices each
+	ClothDistanceField(const ClothFloat3* vertices, int vertexCount, const DWORD* indices, int triangleCount, int resolution, ClothWorkerPool* pool, const char* cacheDirectory = nullptr);
+
+	// Move the movable particles [begin, end) out of the mesh
+	void collide(ClothFloat4* pos, int begin, int end) const;
+
+	// Signed distance and its gradient at p - false away from the surface, where no brick is kept
+	bool sample(const ClothFloat3& p, float& distance, ClothFloat3& gradient) const;
+
+	// Whether the field was read from the cache instead of baked
+	bool isCached() const;
+
+	// Accessors
+	int keptBricks() const;
+	int totalBricks() const;
+	float spacing() const;
+
+	// Distance the particles are kept from the surface
+	float thickness;
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+// Included by every Cloth translation unit, straight after its own header. Keeps
+// multiplies and adds from being fused into one instruction, which rounds once instead
+// of twice, so a step moves the particles the same whichever instruction set the
+// compiler targets and whichever kernel runs - a fused and an unfused build never agree
+// bit for bit.
+#if defined(_MSC_VER)
+	#pragma fp_contract (off)
+#elif defined(__clang__)
+	#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+	#pragma GCC optimize ("fp-contract=off")
+#endif
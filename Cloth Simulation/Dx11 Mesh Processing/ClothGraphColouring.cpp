@@ -0,0 +1,237 @@
+#include "ClothGraphColouring.h"
+#include "ClothFpContract.h"
+#include <vector>
+
+using namespace std;
+
+// Constraints per block - each block is coloured by one worker. Large blocks keep
+// the share of constraints with neighbours in other blocks small, and a fixed size
+// gives the same colours whatever the number of threads.
+static const int blockSize = 65536;
+
+
+#pragma region Helpers
+
+// Particle to constraint adjacency in compressed rows
+struct ConstraintGraph
+{
+	const Constraint*	constraints;
+	vector<int>			first;		// First entry of each particle in adjacent
+	vector<int>			adjacent;	// Constraints touching each particle
+
+	ConstraintGraph(const Constraint* c, int constraintCount, int particleCount)
+		: constraints(c), first(particleCount + 1, 0), adjacent(constraintCount * 2)
+	{
+		for (int i = 0; i < constraintCount; i++)
+		{
+			first[c[i].start + 1]++;
+			first[c[i].end + 1]++;
+		}
+
+		for (int p = 0; p < particleCount; p++)
+			first[p + 1] += first[p];
+
+		vector<int> next(first.begin(), first.end() - 1);
+
+		for (int i = 0; i < constraintCount; i++)
+		{
+			adjacent[next[c[i].start]++]	= i;
+			adjacent[next[c[i].end]++]		= i;
+		}
+	}
+
+	// Call f(j) for every constraint j sharing a particle with constraint i
+	template <class F>
+	void forNeighbours(int i, F f) const
+	{
+		unsigned int ends[2] = {constraints[i].start, constraints[i].end};
+
+		for (int e = 0; e < 2; e++)
+		{
+			for (int k = first[ends[e]]; k < first[ends[e] + 1]; k++)
+			{
+				if (adjacent[k] != i)
+					f(adjacent[k]);
+			}
+		}
+	}
+
+	// Whether a neighbour of constraint i has colour c
+	bool colourUsed(int i, int c, const int* colours) const
+	{
+		bool used = false;
+
+		forNeighbours(i, [&](int j) { used = used || colours[j] == c; });
+
+		return used;
+	}
+
+	// Bit mask of the first 64 colours used by the neighbours of constraint i
+	unsigned long long neighbourColours(int i, const int* colours) const
+	{
+		unsigned long long used = 0;
+
+		forNeighbours(i, [&](int j)
+		{
+			if (colours[j] >= 0 && colours[j] < 64)
+				used |= 1ull << colours[j];
+		});
+
+		return used;
+	}
+
+	// Smallest colour none of the neighbours of constraint i use
+	int smallestFreeColour(int i, const int* colours) const
+	{
+		unsigned long long used = neighbourColours(i, colours);
+
+		int c = 0;
+
+		while (c < 64 && (used >> c) & 1)
+			c++;
+
+		while (c >= 64 && colourUsed(i, c, colours))
+			c++;
+
+		return c;
+	}
+};
+
+#pragma endregion
+
+
+// Colour
+int ClothGraphColouring::colour(const Constraint* constraints, int constraintCount, int particleCount, int* colours, ClothWorkerPool* pool)
+{
+	if (constraintCount <= 0)
+		return 0;
+
+	ConstraintGraph graph(constraints, constraintCount, particleCount);
+
+	for (int i = 0; i < constraintCount; i++)
+		colours[i] = -1;
+
+	// Greedy first fit in constraint order. Constraints with a neighbour in another
+	// block are coloured first on this thread, then the blocks are finished in
+	// parallel - their remaining constraints only read colours from their own
+	// block or the already fixed borders.
+	int blockCount = (constraintCount + blockSize - 1) / blockSize;
+
+	vector<char> border(constraintCount, 0);
+
+	for (int i = 0; i < constraintCount; i++)
+	{
+		int block = i / blockSize;
+
+		graph.forNeighbours(i, [&](int j) { border[i] = border[i] || j / blockSize != block; });
+
+		if (border[i])
+			colours[i] = graph.smallestFreeColour(i, colours);
+	}
+
+	const ConstraintGraph* g = &graph;
+	const char* onBorder = border.data();
+
+	ClothTask colourBlocks = [=](int begin, int end)
+	{
+		for (int b = begin; b < end; b++)
+		{
+			int first	= b * blockSize;
+			int last	= first + blockSize < constraintCount ? first + blockSize : constraintCount;
+
+			for (int i = first; i < last; i++)
+			{
+				if (!onBorder[i])
+					colours[i] = g->smallestFreeColour(i, colours);
+			}
+		}
+	};
+
+	if (pool)
+		pool->parallelFor(blockCount, 1, colourBlocks);
+	else
+		colourBlocks(0, blockCount);
+
+	int colourCount = 0;
+
+	for (int i = 0; i < constraintCount; i++)
+	{
+		if (colours[i] >= colourCount)
+			colourCount = colours[i] + 1;
+	}
+
+	// Try to empty the last colours - the block borders can push a few constraints
+	// past the colours first fit needs elsewhere
+	while (colourCount > 1)
+	{
+		int last	= colourCount - 1;
+		bool empty	= true;
+
+		for (int i = 0; i < constraintCount; i++)
+		{
+			if (colours[i] != last)
+				continue;
+
+			int c = graph.smallestFreeColour(i, colours);
+
+			if (c < last)
+				colours[i] = c;
+			else
+				empty = false;
+		}
+
+		if (!empty)
+			break;
+
+		colourCount--;
+	}
+
+	// Balance - first fit leaves the last colours nearly empty, and each colour
+	// costs a dispatch or a barrier. Move constraints out of oversized colours
+	// into the smallest colour none of their neighbours use.
+	vector<int> size(colourCount, 0);
+
+	for (int i = 0; i < constraintCount; i++)
+		size[colours[i]]++;
+
+	int target = (constraintCount + colourCount - 1) / colourCount;
+
+	for (int i = 0; i < constraintCount; i++)
+	{
+		if (size[colours[i]] <= target)
+			continue;
+
+		unsigned long long used = graph.neighbourColours(i, colours);
+		int best = -1;
+
+		for (int c = 0; c < colourCount; c++)
+		{
+			bool available = c < 64 ? ((used >> c) & 1) == 0 : !graph.colourUsed(i, c, colours);
+
+			if (size[c] < target && (best < 0 || size[c] < size[best]) && available)
+				best = c;
+		}
+
+		if (best >= 0)
+		{
+			size[colours[i]]--;
+			size[best]++;
+			colours[i] = best;
+		}
+	}
+
+	// Drop colours emptied by the balancing
+	vector<int> remap(colourCount, -1);
+	int used = 0;
+
+	for (int c = 0; c < colourCount; c++)
+	{
+		if (size[c] > 0)
+			remap[c] = used++;
+	}
+
+	for (int i = 0; i < constraintCount; i++)
+		colours[i] = remap[colours[i]];
+
+	return used;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "ClothTypes.h"
+#include "ClothWorkerPool.h"
+
+
+// Colours the constraint graph of a cloth so constraints sharing a particle
+// never get the same colour - each colour is then a batch that can be solved
+// in parallel. Uses greedy first fit in constraint order, which needs the
+// minimum 8 colours on a grid, then evens out the colour sizes so no batch is
+// left nearly empty.
+class ClothGraphColouring
+{
+public:
+	// Write the colour of each constraint to colours and return the number of colours.
+	// pool may be nullptr to colour on the calling thread.
+	static int colour(const Constraint* constraints, int constraintCount, int particleCount, int* colours, ClothWorkerPool* pool);
+};
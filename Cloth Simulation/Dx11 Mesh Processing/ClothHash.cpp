@@ -0,0 +1,120 @@
+#include "ClothHash.h"
+#include "ClothFpContract.h"
+#include <string.h>
+
+// xxHash64 primes
+static const unsigned long long prime1	= 11400714785074694791ULL;
+static const unsigned long long prime2	= 14029467366897019727ULL;
+static const unsigned long long prime3	= 1609587929392839161ULL;
+static const unsigned long long prime4	= 9650029242287828579ULL;
+static const unsigned long long prime5	= 2870177450012600261ULL;
+
+
+#pragma region Helpers
+
+static inline unsigned long long rotateLeft(unsigned long long x, int bits)
+{
+	return (x << bits) | (x >> (64 - bits));
+}
+
+// Unaligned little endian reads
+static inline unsigned long long read64(const unsigned char* p)
+{
+	unsigned long long x;
+	memcpy(&x, p, sizeof(x));
+	return x;
+}
+
+static inline unsigned long long read32(const unsigned char* p)
+{
+	unsigned int x;
+	memcpy(&x, p, sizeof(x));
+	return x;
+}
+
+// Mix 8 bytes into an accumulator
+static inline unsigned long long mixRound(unsigned long long accumulator, unsigned long long input)
+{
+	accumulator += input * prime2;
+	accumulator = rotateLeft(accumulator, 31);
+	return accumulator * prime1;
+}
+
+// Fold an accumulator into the hash of a long input
+static inline unsigned long long mergeRound(unsigned long long hash, unsigned long long accumulator)
+{
+	hash ^= mixRound(0, accumulator);
+	return hash * prime1 + prime4;
+}
+
+#pragma endregion
+
+
+// xxHash64
+unsigned long long ClothHash::xxh64(const void* data, size_t size, unsigned long long seed)
+{
+	const unsigned char* p		= (const unsigned char*)data;
+	const unsigned char* end	= p + size;
+
+	unsigned long long hash;
+
+	// Four lanes of 8 bytes over every whole 32 byte stripe
+	if (size >= 32)
+	{
+		unsigned long long v1 = seed + prime1 + prime2;
+		unsigned long long v2 = seed + prime2;
+		unsigned long long v3 = seed;
+		unsigned long long v4 = seed - prime1;
+
+		const unsigned char* limit = end - 32;
+
+		do
+		{
+			v1 = mixRound(v1, read64(p));
+			v2 = mixRound(v2, read64(p + 8));
+			v3 = mixRound(v3, read64(p + 16));
+			v4 = mixRound(v4, read64(p + 24));
+			p += 32;
+		}
+		while (p <= limit);
+
+		hash = rotateLeft(v1, 1) + rotateLeft(v2, 7) + rotateLeft(v3, 12) + rotateLeft(v4, 18);
+		hash = mergeRound(hash, v1);
+		hash = mergeRound(hash, v2);
+		hash = mergeRound(hash, v3);
+		hash = mergeRound(hash, v4);
+	}
+	else
+		hash = seed + prime5;
+
+	hash += (unsigned long long)size;
+
+	// The remaining bytes 8, 4 and then 1 at a time
+	for (; p + 8 <= end; p += 8)
+	{
+		hash ^= mixRound(0, read64(p));
+		hash = rotateLeft(hash, 27) * prime1 + prime4;
+	}
+
+	if (p + 4 <= end)
+	{
+		hash ^= read32(p) * prime1;
+		hash = rotateLeft(hash, 23) * prime2 + prime3;
+		p += 4;
+	}
+
+	for (; p < end; p++)
+	{
+		hash ^= (*p) * prime5;
+		hash = rotateLeft(hash, 11) * prime1;
+	}
+
+	// Avalanche
+	hash ^= hash >> 33;
+	hash *= prime2;
+	hash ^= hash >> 29;
+	hash *= prime3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
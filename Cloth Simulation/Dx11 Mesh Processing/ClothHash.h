@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stddef.h>
+
+
+// 64 bit hashing for the CPU cloth - xxHash64, so a hash logged on one machine or
+// build can be compared with one from another. Bytes are read little endian, as
+// every platform the demo builds for stores them.
+class ClothHash
+{
+public:
+	// xxHash64 of size bytes at data
+	static unsigned long long xxh64(const void* data, size_t size, unsigned long long seed = 0);
+};
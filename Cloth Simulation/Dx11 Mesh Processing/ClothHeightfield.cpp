@@ -0,0 +1,114 @@
+#include "ClothHeightfield.h"
+#include "ClothFpContract.h"
+
+// Particles sampled per block - the ground heights of a block stay on the stack
+static const int blockSize = 256;
+
+
+// Constructor
+ClothHeightfield::ClothHeightfield(ClothHeightFn heightFunction)
+{
+	function	= heightFunction;
+	origin		= ClothFloat3(0.0f, 0.0f, 0.0f);
+	thickness	= 0.01f;
+	friction	= 0.5f;
+
+	if (!heightFunction)
+		throw("Invalid parameters for cloth heightfield instantiation");
+
+	grid.heights		= nullptr;
+	grid.w				= 0;
+	grid.h				= 0;
+	grid.x0				= 0.0f;
+	grid.z0				= 0.0f;
+	grid.invCellSize	= 0.0f;
+
+	sampleGrid	= ClothKernels::sampleGrid(ClothKernels::bestIsa());
+	contact		= ClothKernels::contact(ClothKernels::bestIsa());
+}
+
+// Constructor
+ClothHeightfield::ClothHeightfield(ClothHeightFn heightFunction, float minX, float minZ, float maxX, float maxZ, float cellSize)
+{
+	function	= nullptr;
+	origin		= ClothFloat3(0.0f, 0.0f, 0.0f);
+	thickness	= 0.01f;
+	friction	= 0.5f;
+
+	if (!heightFunction || cellSize <= 0.0f || maxX <= minX || maxZ <= minZ)
+		throw("Invalid parameters for cloth heightfield instantiation");
+
+	// At least one cell so every sample has four corners
+	grid.w				= (int)((maxX - minX) / cellSize) + 2;
+	grid.h				= (int)((maxZ - minZ) / cellSize) + 2;
+	grid.x0				= minX;
+	grid.z0				= minZ;
+	grid.invCellSize	= 1.0f / cellSize;
+
+	heights.resize(grid.w * grid.h);
+
+	for (int j = 0; j < grid.h; j++)
+	{
+		for (int i = 0; i < grid.w; i++)
+			heights[j * grid.w + i] = heightFunction(minX + (float)i * cellSize, minZ + (float)j * cellSize);
+	}
+
+	grid.heights = heights.data();
+
+	sampleGrid	= ClothKernels::sampleGrid(ClothKernels::bestIsa());
+	contact		= ClothKernels::contact(ClothKernels::bestIsa());
+}
+
+// Collide
+void ClothHeightfield::collide(ClothFloat4* pos, const ClothFloat4* prevPos, int begin, int end) const
+{
+	float ground[blockSize];
+
+	// The grid and the function are both placed at the origin
+	ClothHeightGrid placed = grid;
+
+	placed.x0 += origin.x;
+	placed.z0 += origin.z;
+
+	for (int first = begin; first < end; first += blockSize)
+	{
+		int last = first + blockSize < end ? first + blockSize : end;
+
+		if (function)
+		{
+			for (int i = first; i < last; i++)
+				ground[i - first] = function(pos[i].x - origin.x, pos[i].z - origin.z);
+		}
+		else
+		{
+			sampleGrid(pos, placed, ground, first, last);
+		}
+
+		contact(pos, prevPos, ground, origin.y + thickness, friction, first, last);
+	}
+}
+
+// Height
+float ClothHeightfield::height(float x, float z) const
+{
+	if (function)
+		return function(x - origin.x, z - origin.z) + origin.y;
+
+	ClothFloat4 p(x, 0.0f, z, 0.0f);
+	float ground;
+
+	ClothHeightGrid placed = grid;
+
+	placed.x0 += origin.x;
+	placed.z0 += origin.z;
+
+	sampleGrid(&p, placed, &ground, 0, 1);
+
+	return ground + origin.y;
+}
+
+// Baked
+bool ClothHeightfield::isBaked() const
+{
+	return function == nullptr;
+}
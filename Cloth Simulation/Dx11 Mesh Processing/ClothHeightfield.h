@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include "ClothTypes.h"
+#include "ClothKernels.h"
+
+
+// Height of the ground at (x, z)
+typedef float (*ClothHeightFn)(float x, float z);
+
+
+// Ground the CPU solver collides the cloth with - an analytic height function
+// (e.g. CGBasicTerrain::height), or the same function baked into a height grid
+// so every particle costs a bilinear lookup instead of the function.
+class ClothHeightfield
+{
+private:
+	// Analytic height (nullptr once baked)
+	ClothHeightFn		function;
+
+	// Baked heights
+	std::vector<float>	heights;
+	ClothHeightGrid		grid;
+
+	// Kernels for the best instruction set
+	ClothSampleGridFn	sampleGrid;
+	ClothContactFn		contact;
+
+public:
+	// Constructor - analytic heights
+	ClothHeightfield(ClothHeightFn heightFunction);
+	// Constructor - heights of heightFunction baked every cellSize over [minX, maxX] x [minZ, maxZ].
+	// Outside the grid the height of the nearest edge is used.
+	ClothHeightfield(ClothHeightFn heightFunction, float minX, float minZ, float maxX, float maxZ, float cellSize);
+
+	// Lift the movable particles [begin, end) that went under the ground back onto it, with friction
+	void collide(ClothFloat4* pos, const ClothFloat4* prevPos, int begin, int end) const;
+
+	// Ground height at (x, z) in cloth space
+	float height(float x, float z) const;
+
+	// Whether the heights are baked
+	bool isBaked() const;
+
+	// Position of the height function origin in cloth space
+	ClothFloat3 origin;
+
+	// Distance the particles are kept above the ground
+	float thickness;
+
+	// Fraction of the sliding motion removed while in contact (0 to 1)
+	float friction;
+};
@@ -0,0 +1,347 @@
+#include "ClothIndexOptimiser.h"
+#include "ClothFpContract.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+// Quads per worker chunk when filling a grid
+static const int gridGrain			= 4096;
+
+// LRU cache the Forsyth scores model - larger than the FIFO the orders are measured on,
+// as the scores only rank the triangles
+static const int forsythCacheSize	= 32;
+
+// Triangles per vertex the valence scores are tabled for - a vertex with more scores as if
+// it had this many
+static const int forsythValences	= 32;
+
+
+#pragma region Helpers
+
+// Score of a vertex by its place in the cache (-1 when out of it). The three vertices of the
+// last triangle score the same, so the next one is not pushed to a particular edge.
+static float cacheScore(int position)
+{
+	if (position < 0)
+		return 0.0f;
+
+	if (position < 3)
+		return 0.75f;
+
+	return powf(1.0f - (float)(position - 3) / (float)(forsythCacheSize - 3), 1.5f);
+}
+
+// Score of a vertex by the triangles it has left - finishing a vertex off frees its place
+static float valenceScore(int remaining)
+{
+	return 2.0f * powf((float)remaining, -0.5f);
+}
+
+#pragma endregion
+
+
+// Grid indices - strip after strip, each row of a strip left to right
+void ClothIndexOptimiser::gridIndices(DWORD w, DWORD h, DWORD* indices, ClothWorkerPool* pool)
+{
+	if (w < 2 || h < 2)
+		return;
+
+	DWORD width		= w;
+	DWORD rows		= h - 1;
+	int strips		= int((w - 1 + CLOTH_GRID_STRIP - 1) / CLOTH_GRID_STRIP);
+	DWORD* out		= indices;
+
+	// Every strip but the last is full width, so each starts at a known place
+	ClothTask fillStrips = [=](int begin, int end)
+	{
+		for (int s = begin; s < end; s++)
+		{
+			DWORD first	= DWORD(s) * CLOTH_GRID_STRIP;
+			DWORD last	= min(first + CLOTH_GRID_STRIP, width - 1);
+
+			DWORD *iptr = out + (size_t)first * rows * 6;
+
+			for (DWORD j = 0; j < rows; ++j)
+			{
+				for (DWORD i = first; i < last; ++i, iptr += 6)
+				{
+					DWORD a = width * j + i;
+					DWORD b = a + width;
+					DWORD c = b + 1;
+					DWORD d = a + 1;
+
+					iptr[0] = a;
+					iptr[1] = b;
+					iptr[2] = d;
+
+					iptr[3] = b;
+					iptr[4] = c;
+					iptr[5] = d;
+				}
+			}
+		}
+	};
+
+	int stripQuads = int(rows) * CLOTH_GRID_STRIP;
+	int grain = gridGrain / stripQuads;
+
+	if (pool)
+		pool->parallelFor(strips, grain > 1 ? grain : 1, fillStrips);
+	else
+		fillStrips(0, strips);
+}
+
+// Optimise vertex cache - Forsyth's linear speed vertex cache optimisation. Each triangle
+// scores the sum of its vertex scores, and the best triangle over the vertices in the cache
+// goes next; at a dead end the next triangle not yet added in the list does.
+void ClothIndexOptimiser::optimiseVertexCache(DWORD* indices, int indexCount, int vertexCount)
+{
+	int triangleCount = indexCount / 3;
+
+	if (triangleCount < 2 || vertexCount <= 0)
+		return;
+
+	float cacheTable[forsythCacheSize];
+	float valenceTable[forsythValences + 1];
+
+	for (int p = 0; p < forsythCacheSize; p++)
+		cacheTable[p] = cacheScore(p);
+
+	valenceTable[0] = 0.0f;
+
+	for (int n = 1; n <= forsythValences; n++)
+		valenceTable[n] = valenceScore(n);
+
+	// Triangles of each vertex - the ones not yet added are kept first
+	vector<int> remaining(vertexCount, 0);
+	vector<int> offset(vertexCount + 1, 0);
+
+	for (int k = 0; k < triangleCount * 3; k++)
+		remaining[indices[k]]++;
+
+	for (int v = 0; v < vertexCount; v++)
+		offset[v + 1] = offset[v] + remaining[v];
+
+	vector<int> vertexTriangles(triangleCount * 3);
+	vector<int> next(offset.begin(), offset.end() - 1);
+
+	for (int k = 0; k < triangleCount * 3; k++)
+		vertexTriangles[next[indices[k]]++] = k / 3;
+
+	vector<int> position(vertexCount, -1);
+	vector<float> vertexScore(vertexCount);
+	vector<float> triangleScore(triangleCount, 0.0f);
+	vector<char> added(triangleCount, 0);
+
+	for (int v = 0; v < vertexCount; v++)
+		vertexScore[v] = valenceTable[min(remaining[v], forsythValences)];
+
+	for (int k = 0; k < triangleCount * 3; k++)
+		triangleScore[k / 3] += vertexScore[indices[k]];
+
+	vector<DWORD> order(triangleCount * 3);
+
+	// The triangle just added goes at the front, the ones pushed past the end leave
+	int cache[forsythCacheSize + 3];
+	int cacheCount = 0;
+
+	int best	= 0;
+	int cursor	= 0;
+
+	for (int t = 0; t < triangleCount; t++)
+	{
+		// Dead end - nothing in the cache has triangles left
+		if (best < 0)
+		{
+			while (added[cursor])
+				cursor++;
+
+			best = cursor;
+		}
+
+		const DWORD* corner = indices + best * 3;
+
+		order[t * 3]		= corner[0];
+		order[t * 3 + 1]	= corner[1];
+		order[t * 3 + 2]	= corner[2];
+
+		added[best] = 1;
+
+		// Take the triangle off its vertices
+		for (int k = 0; k < 3; k++)
+		{
+			int v		= corner[k];
+			int* list	= vertexTriangles.data() + offset[v];
+			int live	= remaining[v]--;
+
+			for (int i = 0; i < live; i++)
+			{
+				if (list[i] == best)
+				{
+					swap(list[i], list[live - 1]);
+					break;
+				}
+			}
+		}
+
+		int updated[forsythCacheSize + 3];
+		int updatedCount = 0;
+
+		updated[updatedCount++] = corner[0];
+		updated[updatedCount++] = corner[1];
+		updated[updatedCount++] = corner[2];
+
+		for (int i = 0; i < cacheCount; i++)
+		{
+			int v = cache[i];
+
+			if (v != (int)corner[0] && v != (int)corner[1] && v != (int)corner[2])
+				updated[updatedCount++] = v;
+		}
+
+		// Rescore every vertex the move touched, and the triangles they have left
+		best = -1;
+		float bestScore = -1.0f;
+
+		for (int i = 0; i < updatedCount; i++)
+		{
+			int v = updated[i];
+
+			position[v] = i < forsythCacheSize ? i : -1;
+
+			float score = 0.0f;
+
+			if (remaining[v] > 0)
+				score = (position[v] >= 0 ? cacheTable[position[v]] : 0.0f) + valenceTable[min(remaining[v], forsythValences)];
+
+			float delta = score - vertexScore[v];
+
+			vertexScore[v] = score;
+
+			const int* list = vertexTriangles.data() + offset[v];
+
+			for (int j = 0; j < remaining[v]; j++)
+			{
+				int u = list[j];
+
+				triangleScore[u] += delta;
+
+				if (triangleScore[u] > bestScore)
+				{
+					bestScore	= triangleScore[u];
+					best		= u;
+				}
+			}
+		}
+
+		cacheCount = min(updatedCount, forsythCacheSize);
+		memcpy(cache, updated, sizeof(int) * cacheCount);
+	}
+
+	memcpy(indices, order.data(), sizeof(DWORD) * triangleCount * 3);
+}
+
+// Simulate cache - a vertex is in the cache while fewer than cacheSize vertices were
+// transformed after it
+ClothCacheStats ClothIndexOptimiser::simulateCache(const DWORD* indices, int indexCount, int vertexCount, int cacheSize)
+{
+	ClothCacheStats stats;
+
+	stats.triangles		= indexCount / 3;
+	stats.vertices		= 0;
+	stats.transformed	= 0;
+
+	vector<int> stamp(vertexCount, -1);
+
+	for (int k = 0; k < stats.triangles * 3; k++)
+	{
+		int& s = stamp[indices[k]];
+
+		if (s >= 0 && stats.transformed - s <= cacheSize)
+			continue;
+
+		if (s < 0)
+			stats.vertices++;
+
+		s = stats.transformed++;
+	}
+
+	stats.acmr = stats.triangles ? (float)stats.transformed / (float)stats.triangles : 0.0f;
+	stats.atvr = stats.vertices ? (float)stats.transformed / (float)stats.vertices : 0.0f;
+
+	return stats;
+}
+
+// Fits short indices
+bool ClothIndexOptimiser::fitsShortIndices(int vertexCount)
+{
+	return vertexCount <= 0xFFFF;
+}
+
+// Narrow indices
+void ClothIndexOptimiser::narrowIndices(const DWORD* indices, int indexCount, WORD* shortIndices)
+{
+	for (int k = 0; k < indexCount; k++)
+		shortIndices[k] = (WORD)indices[k];
+}
+
+// Build meshlets - a meshlet is closed when the next triangle would take it past either limit
+void ClothIndexOptimiser::buildMeshlets(const DWORD* indices, int indexCount, int vertexCount, vector<ClothMeshlet>& meshlets, vector<DWORD>& meshletVertices,
+	vector<unsigned char>& meshletTriangles, int maxVertices, int maxTriangles)
+{
+	meshlets.clear();
+	meshletVertices.clear();
+	meshletTriangles.clear();
+
+	// Local number of each vertex in the open meshlet (-1 when not in it)
+	vector<int> local(vertexCount, -1);
+
+	ClothMeshlet meshlet;
+
+	memset(&meshlet, 0, sizeof(ClothMeshlet));
+
+	for (int t = 0; t < indexCount / 3; t++)
+	{
+		const DWORD* corner = indices + t * 3;
+
+		// Repeated corners of a degenerate triangle count once
+		int added = local[corner[0]] < 0 ? 1 : 0;
+
+		if (local[corner[1]] < 0 && corner[1] != corner[0])
+			added++;
+
+		if (local[corner[2]] < 0 && corner[2] != corner[0] && corner[2] != corner[1])
+			added++;
+
+		if (meshlet.vertexCount + added > maxVertices || meshlet.triangleCount == maxTriangles)
+		{
+			for (int v = meshlet.firstVertex; v < meshlet.firstVertex + meshlet.vertexCount; v++)
+				local[meshletVertices[v]] = -1;
+
+			meshlets.push_back(meshlet);
+
+			meshlet.firstVertex		= (int)meshletVertices.size();
+			meshlet.firstTriangle	= (int)meshletTriangles.size() / 3;
+			meshlet.vertexCount		= 0;
+			meshlet.triangleCount	= 0;
+		}
+
+		for (int k = 0; k < 3; k++)
+		{
+			if (local[corner[k]] < 0)
+			{
+				local[corner[k]] = meshlet.vertexCount++;
+				meshletVertices.push_back(corner[k]);
+			}
+
+			meshletTriangles.push_back((unsigned char)local[corner[k]]);
+		}
+
+		meshlet.triangleCount++;
+	}
+
+	if (meshlet.triangleCount > 0)
+		meshlets.push_back(meshlet);
+}
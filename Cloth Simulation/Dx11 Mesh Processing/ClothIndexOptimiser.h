@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+#include "ClothTypes.h"
+#include "ClothWorkerPool.h"
+
+
+// Post-transform cache the index orders are laid out for - a FIFO of this many vertices
+#define CLOTH_CACHE_SIZE 16
+
+// Quads across each strip of a grid - a row of a strip and the row above it (2 x 8 vertices)
+// fit the cache together
+#define CLOTH_GRID_STRIP 7
+
+// Most vertices and triangles in a meshlet
+#define CLOTH_MESHLET_VERTICES 64
+#define CLOTH_MESHLET_TRIANGLES 126
+
+
+// Post-transform cache behaviour of an index list - ACMR is the vertices transformed per
+// triangle (0.5 at best on a grid, 3 with no reuse), ATVR per vertex used (1 at best)
+struct ClothCacheStats
+{
+	int		triangles;
+	int		vertices;
+	int		transformed;
+	float	acmr;
+	float	atvr;
+};
+
+// Cluster of triangles over a few vertices - its vertices are [firstVertex, firstVertex +
+// vertexCount) of the meshlet vertices, its triangles three local vertex numbers each from
+// firstTriangle * 3 of the meshlet triangles
+struct ClothMeshlet
+{
+	int		firstVertex;
+	int		vertexCount;
+	int		firstTriangle;
+	int		triangleCount;
+};
+
+
+// Triangle orders that make the most of the post-transform vertex cache, a simulation of
+// that cache to measure them by, 16 bit index lists and meshlets.
+//
+// A grid is laid out straight in strips CLOTH_GRID_STRIP quads wide, row by row down each
+// strip, so every row reuses the vertices of the row before it and each vertex is
+// transformed little more than once. Any other triangle list is reordered with Forsyth's
+// greedy scoring over an LRU cache model. Only the order of the triangles changes - the
+// vertices, and the winding of each triangle, stay as they are.
+class ClothIndexOptimiser
+{
+public:
+	// Cache ordered indices of a w x h grid, the two triangles of each quad as in a row major
+	// list. pool may be nullptr to fill on the calling thread.
+	static void gridIndices(DWORD w, DWORD h, DWORD* indices, ClothWorkerPool* pool = nullptr);
+
+	// Reorder the triangles of an index list over vertexCount vertices for the vertex cache
+	static void optimiseVertexCache(DWORD* indices, int indexCount, int vertexCount);
+
+	// Transforms an index list costs through a FIFO cache of cacheSize vertices
+	static ClothCacheStats simulateCache(const DWORD* indices, int indexCount, int vertexCount, int cacheSize = CLOTH_CACHE_SIZE);
+
+	// Whether indices of vertexCount vertices fit 16 bits (0xFFFF is left unused, as it cuts
+	// strips on some hardware)
+	static bool fitsShortIndices(int vertexCount);
+
+	// Copy an index list into 16 bit indices
+	static void narrowIndices(const DWORD* indices, int indexCount, WORD* shortIndices);
+
+	// Cluster the triangles of an index list into meshlets in the order they come, so a cache
+	// ordered list gives tight ones
+	static void buildMeshlets(const DWORD* indices, int indexCount, int vertexCount, std::vector<ClothMeshlet>& meshlets, std::vector<DWORD>& meshletVertices,
+		std::vector<unsigned char>& meshletTriangles, int maxVertices = CLOTH_MESHLET_VERTICES, int maxTriangles = CLOTH_MESHLET_TRIANGLES);
+};
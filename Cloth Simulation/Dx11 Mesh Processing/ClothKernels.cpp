@@ -0,0 +1,1870 @@
+#include "ClothKernels.h"
+#include "ClothFpContract.h"
+#include <math.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+	#define CLOTH_X86 1
+	#include <immintrin.h>
+#else
+	#define CLOTH_X86 0
+#endif
+
+// MSVC allows intrinsics for any instruction set in any function, GCC and Clang
+// need each function tagged with the instruction set it uses
+#if defined(_MSC_VER)
+	#include <intrin.h>
+	#define CLOTH_TARGET(isa)
+	#define CLOTH_AVX512 (CLOTH_X86 && _MSC_VER >= 1910)
+#else
+	#include <cpuid.h>
+	#define CLOTH_TARGET(isa) __attribute__((target(isa)))
+	#define CLOTH_AVX512 CLOTH_X86
+#endif
+
+
+#pragma region Residual
+
+// Add a kernel's violations to the residual (which may be nullptr)
+static inline void addResidual(ClothResidual* residual, float sumSquared, float maximum)
+{
+	if (!residual)
+		return;
+
+	residual->sumSquared += sumSquared;
+
+	if (maximum > residual->maximum)
+		residual->maximum = maximum;
+}
+
+static inline float sumLanes(const float* lanes, int count)
+{
+	float sum = 0.0f;
+
+	for (int i = 0; i < count; i++)
+		sum += lanes[i];
+
+	return sum;
+}
+
+static inline float maxLanes(const float* lanes, int count)
+{
+	float maximum = 0.0f;
+
+	for (int i = 0; i < count; i++)
+		maximum = lanes[i] > maximum ? lanes[i] : maximum;
+
+	return maximum;
+}
+
+#pragma endregion
+
+#pragma region Scalar
+
+static void projectBatchScalar(ClothFloat4* pos, const Constraint* batch, int begin, int end, ClothResidual* residual)
+{
+	float sumSquared = 0.0f, maximum = 0.0f;
+
+	for (int c = begin; c < end; c++)
+	{
+		ClothFloat4 one = pos[batch[c].start];
+		ClothFloat4 two = pos[batch[c].end];
+
+		// Find the delta of the particles
+		float dx = one.x - two.x;
+		float dy = one.y - two.y;
+		float dz = one.z - two.z;
+
+		// Get the distance between the particles
+		float distance	= sqrtf(dx * dx + dy * dy + dz * dz);
+		float weight	= one.w + two.w;
+
+		// Violation before the projection
+		float violation = fabsf(distance - batch[c].length);
+
+		sumSquared += violation * violation;
+		maximum = violation > maximum ? violation : maximum;
+
+		if (distance <= 0.0f || weight <= 0.0f)
+			continue;
+
+		// Split the correction by inverse mass (halves for equal masses)
+		float stretching = (distance - batch[c].length) / (distance * weight);
+
+		dx *= stretching;
+		dy *= stretching;
+		dz *= stretching;
+
+		pos[batch[c].start]	= ClothFloat4(one.x - dx * one.w, one.y - dy * one.w, one.z - dz * one.w, one.w);
+		pos[batch[c].end]	= ClothFloat4(two.x + dx * two.w, two.y + dy * two.w, two.z + dz * two.w, two.w);
+	}
+	addResidual(residual, sumSquared, maximum);
+}
+
+
+// XPBD - lambda accumulates the constraint force over the iterations of a substep
+static void projectBatchXPBDScalar(ClothFloat4* pos, const Constraint* batch, const float* compliance, float* lambda, float alphaScale, int begin, int end, ClothResidual* residual)
+{
+	float sumSquared = 0.0f, maximum = 0.0f;
+
+	for (int c = begin; c < end; c++)
+	{
+		ClothFloat4 one = pos[batch[c].start];
+		ClothFloat4 two = pos[batch[c].end];
+
+		float dx = one.x - two.x;
+		float dy = one.y - two.y;
+		float dz = one.z - two.z;
+
+		float distance	= sqrtf(dx * dx + dy * dy + dz * dz);
+		float weight	= one.w + two.w;
+
+		// Violation before the projection
+		float violation = fabsf(distance - batch[c].length);
+
+		sumSquared += violation * violation;
+		maximum = violation > maximum ? violation : maximum;
+
+		// Compliance scaled by the substep (alpha / h^2)
+		float alpha		= compliance[c] * alphaScale;
+		float denom		= weight + alpha;
+
+		if (distance <= 0.0f || denom <= 0.0f)
+			continue;
+
+		float deltaLambda = ((batch[c].length - distance) - alpha * lambda[c]) / denom;
+
+		lambda[c] += deltaLambda;
+
+		float scale = deltaLambda / distance;
+
+		dx *= scale;
+		dy *= scale;
+		dz *= scale;
+
+		pos[batch[c].start]	= ClothFloat4(one.x + dx * one.w, one.y + dy * one.w, one.z + dz * one.w, one.w);
+		pos[batch[c].end]	= ClothFloat4(two.x - dx * two.w, two.y - dy * two.w, two.z - dz * two.w, two.w);
+	}
+	addResidual(residual, sumSquared, maximum);
+}
+
+// Pull particles [begin, end) back to at most tether[i] from their anchor. The anchors
+// are pinned, so they are only read.
+static void attachScalar(ClothFloat4* pos, const int* anchor, const float* tether, int begin, int end)
+{
+	for (int i = begin; i < end; i++)
+	{
+		ClothFloat4 p = pos[i];
+		ClothFloat4 a = pos[anchor[i]];
+
+		float dx = p.x - a.x;
+		float dy = p.y - a.y;
+		float dz = p.z - a.z;
+
+		float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+
+		if (distance <= tether[i] || p.w <= 0.0f)
+			continue;
+
+		float scale = tether[i] / distance;
+
+		pos[i] = ClothFloat4(a.x + dx * scale, a.y + dy * scale, a.z + dz * scale, p.w);
+	}
+}
+
+
+// Bilinear height grid sample
+static void sampleGridScalar(const ClothFloat4* pos, const ClothHeightGrid& grid, float* ground, int begin, int end)
+{
+	float maxX = (float)(grid.w - 1);
+	float maxZ = (float)(grid.h - 1);
+
+	for (int i = begin; i < end; i++)
+	{
+		float fx = (pos[i].x - grid.x0) * grid.invCellSize;
+		float fz = (pos[i].z - grid.z0) * grid.invCellSize;
+
+		fx = fx > 0.0f ? fx : 0.0f;
+		fx = fx < maxX ? fx : maxX;
+		fz = fz > 0.0f ? fz : 0.0f;
+		fz = fz < maxZ ? fz : maxZ;
+
+		// The last row and column sample the cell before them
+		int ix = (int)fx;
+		int iz = (int)fz;
+
+		ix = ix < grid.w - 2 ? ix : grid.w - 2;
+		iz = iz < grid.h - 2 ? iz : grid.h - 2;
+
+		float tx = fx - (float)ix;
+		float tz = fz - (float)iz;
+
+		const float* cell = grid.heights + iz * grid.w + ix;
+
+		float front	= cell[0] + (cell[1] - cell[0]) * tx;
+		float back	= cell[grid.w] + (cell[grid.w + 1] - cell[grid.w]) * tx;
+
+		ground[i - begin] = front + (back - front) * tz;
+	}
+}
+
+// Ground contact
+static void contactScalar(ClothFloat4* pos, const ClothFloat4* prevPos, const float* ground, float offset, float friction, int begin, int end)
+{
+	for (int i = begin; i < end; i++)
+	{
+		float surface = ground[i - begin] + offset;
+
+		if (pos[i].y >= surface || pos[i].w <= 0.0f)
+			continue;
+
+		pos[i].x = pos[i].x + (prevPos[i].x - pos[i].x) * friction;
+		pos[i].y = surface;
+		pos[i].z = pos[i].z + (prevPos[i].z - pos[i].z) * friction;
+	}
+}
+
+// Closest points - Ericson, Real-Time Collision Detection 5.1.5. Each region gives the
+// barycentrics (v, w) of the closest point a + ab * v + ac * w so the SIMD kernels can
+// pick between them with blends and still round the same.
+static void closestScalar(const ClothColliderTriangle* triangles, const int* candidates, int candidateCount, ClothQueryBlock& block, int begin, int end)
+{
+	for (int i = begin; i < end; i++)
+	{
+		float x = block.x[i], y = block.y[i], z = block.z[i];
+
+		for (int k = 0; k < candidateCount; k++)
+		{
+			const ClothColliderTriangle& t = triangles[candidates[k]];
+
+			float apx = x - t.a.x, apy = y - t.a.y, apz = z - t.a.z;
+
+			// The plane distance bounds the distance to the triangle from below
+			float plane = apx * t.normal.x + apy * t.normal.y + apz * t.normal.z;
+
+			if (plane * plane >= block.best[i])
+				continue;
+
+			float abx = t.b.x - t.a.x, aby = t.b.y - t.a.y, abz = t.b.z - t.a.z;
+			float acx = t.c.x - t.a.x, acy = t.c.y - t.a.y, acz = t.c.z - t.a.z;
+			float bpx = x - t.b.x, bpy = y - t.b.y, bpz = z - t.b.z;
+			float cpx = x - t.c.x, cpy = y - t.c.y, cpz = z - t.c.z;
+
+			float d1 = abx * apx + aby * apy + abz * apz;
+			float d2 = acx * apx + acy * apy + acz * apz;
+			float d3 = abx * bpx + aby * bpy + abz * bpz;
+			float d4 = acx * bpx + acy * bpy + acz * bpz;
+			float d5 = abx * cpx + aby * cpy + abz * cpz;
+			float d6 = acx * cpx + acy * cpy + acz * cpz;
+
+			float va = d3 * d6 - d5 * d4;
+			float vb = d5 * d2 - d1 * d6;
+			float vc = d1 * d4 - d3 * d2;
+
+			float v, w;
+
+			if (d1 <= 0.0f && d2 <= 0.0f)
+			{
+				v = 0.0f;
+				w = 0.0f;
+			}
+			else if (d3 >= 0.0f && d4 <= d3)
+			{
+				v = 1.0f;
+				w = 0.0f;
+			}
+			else if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+			{
+				v = d1 / (d1 - d3);
+				w = 0.0f;
+			}
+			else if (d6 >= 0.0f && d5 <= d6)
+			{
+				v = 0.0f;
+				w = 1.0f;
+			}
+			else if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+			{
+				v = 0.0f;
+				w = d2 / (d2 - d6);
+			}
+			else if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+			{
+				w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+				v = 1.0f - w;
+			}
+			else
+			{
+				float denom = 1.0f / (va + vb + vc);
+
+				v = vb * denom;
+				w = vc * denom;
+			}
+
+			float qx = t.a.x + abx * v + acx * w;
+			float qy = t.a.y + aby * v + acy * w;
+			float qz = t.a.z + abz * v + acz * w;
+
+			float dx = x - qx, dy = y - qy, dz = z - qz;
+			float distance = dx * dx + dy * dy + dz * dz;
+
+			if (distance < block.best[i])
+			{
+				block.best[i]		= distance;
+				block.cx[i]			= qx;
+				block.cy[i]			= qy;
+				block.cz[i]			= qz;
+				block.nearest[i]	= candidates[k];
+			}
+		}
+	}
+}
+
+// Unit normals of columns [begin, end) of a grid row - the cross product of the differences
+// down and across the grid, one sided at the edges (zero length normals point up)
+static void gridNormalsScalar(const ClothFloat4* above, const ClothFloat4* row, const ClothFloat4* below, int w, int begin, int end, ClothFloat3* normals)
+{
+	for (int i = begin; i < end; i++)
+	{
+		const ClothFloat4& left		= row[i > 0 ? i - 1 : 0];
+		const ClothFloat4& right	= row[i < w - 1 ? i + 1 : w - 1];
+
+		float ux = right.x - left.x;
+		float uy = right.y - left.y;
+		float uz = right.z - left.z;
+
+		float vx = below[i].x - above[i].x;
+		float vy = below[i].y - above[i].y;
+		float vz = below[i].z - above[i].z;
+
+		float nx = vy * uz - vz * uy;
+		float ny = vz * ux - vx * uz;
+		float nz = vx * uy - vy * ux;
+
+		float length = sqrtf(nx * nx + ny * ny + nz * nz);
+
+		if (length > 0.0f)
+			normals[i] = ClothFloat3(nx / length, ny / length, nz / length);
+		else
+			normals[i] = ClothFloat3(0.0f, 1.0f, 0.0f);
+	}
+}
+
+// Drag and lift of triangles [begin, end) - with n the cross product of two edges (twice
+// the area along the normal) and v the mean relative velocity of the corners, the drag is
+// -drag |n.v| v and the lift -lift (n.v / (|n| |v|)) ((v.v) n - (n.v) v), across v
+static void aeroScalar(const ClothFloat4* pos, const ClothFloat4* flow, const DWORD* indices, float drag, float lift, int begin, int end, ClothFloat4* force)
+{
+	const float third = 1.0f / 3.0f;
+
+	for (int t = begin; t < end; t++)
+	{
+		const DWORD* corner = indices + t * 3;
+
+		const ClothFloat4& a = pos[corner[0]];
+		const ClothFloat4& b = pos[corner[1]];
+		const ClothFloat4& c = pos[corner[2]];
+
+		float ux = b.x - a.x, uy = b.y - a.y, uz = b.z - a.z;
+		float wx = c.x - a.x, wy = c.y - a.y, wz = c.z - a.z;
+
+		float nx = uy * wz - uz * wy;
+		float ny = uz * wx - ux * wz;
+		float nz = ux * wy - uy * wx;
+
+		const ClothFloat4& fa = flow[corner[0]];
+		const ClothFloat4& fb = flow[corner[1]];
+		const ClothFloat4& fc = flow[corner[2]];
+
+		float vx = (fa.x + fb.x + fc.x) * third;
+		float vy = (fa.y + fb.y + fc.y) * third;
+		float vz = (fa.z + fb.z + fc.z) * third;
+
+		float vn = nx * vx + ny * vy + nz * vz;
+		float vv = vx * vx + vy * vy + vz * vz;
+		float nn = nx * nx + ny * ny + nz * nz;
+
+		float d		= drag * fabsf(vn);
+		float denom	= sqrtf(nn) * sqrtf(vv);
+		float l		= denom > 0.0f ? (lift * vn) / denom : 0.0f;
+
+		force[t].x = -(d * vx + l * (vv * nx - vn * vx));
+		force[t].y = -(d * vy + l * (vv * ny - vn * vy));
+		force[t].z = -(d * vz + l * (vv * nz - vn * vz));
+		force[t].w = 0.0f;
+	}
+}
+
+#pragma endregion
+
+#if CLOTH_X86
+
+#pragma region SSE4
+
+// 4 constraints per iteration - each particle is one aligned 16 byte load, transposed to x/y/z/w registers
+CLOTH_TARGET("sse4.1")
+static void projectBatchSSE4(ClothFloat4* pos, const Constraint* batch, int begin, int end, ClothResidual* residual)
+{
+	float* base = (float*)pos;
+	int c = begin;
+
+	__m128 sumSquared = _mm_setzero_ps(), maximum = _mm_setzero_ps();
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+	for (; c + 4 <= end; c += 4)
+	{
+		const Constraint* q = batch + c;
+
+		float* s0 = base + q[0].start * 4;
+		float* s1 = base + q[1].start * 4;
+		float* s2 = base + q[2].start * 4;
+		float* s3 = base + q[3].start * 4;
+		float* e0 = base + q[0].end * 4;
+		float* e1 = base + q[1].end * 4;
+		float* e2 = base + q[2].end * 4;
+		float* e3 = base + q[3].end * 4;
+
+		__m128 x1 = _mm_load_ps(s0), y1 = _mm_load_ps(s1), z1 = _mm_load_ps(s2), w1 = _mm_load_ps(s3);
+		__m128 x2 = _mm_load_ps(e0), y2 = _mm_load_ps(e1), z2 = _mm_load_ps(e2), w2 = _mm_load_ps(e3);
+
+		_MM_TRANSPOSE4_PS(x1, y1, z1, w1);
+		_MM_TRANSPOSE4_PS(x2, y2, z2, w2);
+
+		__m128 length = _mm_set_ps(q[3].length, q[2].length, q[1].length, q[0].length);
+
+		__m128 dx = _mm_sub_ps(x1, x2);
+		__m128 dy = _mm_sub_ps(y1, y2);
+		__m128 dz = _mm_sub_ps(z1, z2);
+
+		__m128 distance	= _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+		__m128 weight	= _mm_add_ps(w1, w2);
+
+		// Violation before the projection
+		__m128 violation = _mm_and_ps(absMask, _mm_sub_ps(distance, length));
+
+		sumSquared = _mm_add_ps(sumSquared, _mm_mul_ps(violation, violation));
+		maximum = _mm_max_ps(maximum, violation);
+
+		// Degenerate constraints get a zero correction
+		__m128 zero		= _mm_setzero_ps();
+		__m128 valid	= _mm_and_ps(_mm_cmpgt_ps(distance, zero), _mm_cmpgt_ps(weight, zero));
+
+		__m128 stretching = _mm_and_ps(valid, _mm_div_ps(_mm_sub_ps(distance, length), _mm_mul_ps(distance, weight)));
+
+		dx = _mm_mul_ps(dx, stretching);
+		dy = _mm_mul_ps(dy, stretching);
+		dz = _mm_mul_ps(dz, stretching);
+
+		x1 = _mm_sub_ps(x1, _mm_mul_ps(dx, w1));
+		y1 = _mm_sub_ps(y1, _mm_mul_ps(dy, w1));
+		z1 = _mm_sub_ps(z1, _mm_mul_ps(dz, w1));
+
+		x2 = _mm_add_ps(x2, _mm_mul_ps(dx, w2));
+		y2 = _mm_add_ps(y2, _mm_mul_ps(dy, w2));
+		z2 = _mm_add_ps(z2, _mm_mul_ps(dz, w2));
+
+		_MM_TRANSPOSE4_PS(x1, y1, z1, w1);
+		_MM_TRANSPOSE4_PS(x2, y2, z2, w2);
+
+		_mm_store_ps(s0, x1); _mm_store_ps(s1, y1); _mm_store_ps(s2, z1); _mm_store_ps(s3, w1);
+		_mm_store_ps(e0, x2); _mm_store_ps(e1, y2); _mm_store_ps(e2, z2); _mm_store_ps(e3, w2);
+	}
+
+	float sums[4], maxima[4];
+
+	_mm_storeu_ps(sums, sumSquared);
+	_mm_storeu_ps(maxima, maximum);
+
+	addResidual(residual, sumLanes(sums, 4), maxLanes(maxima, 4));
+
+	projectBatchScalar(pos, batch, c, end, residual);
+}
+
+
+CLOTH_TARGET("sse4.1")
+static void projectBatchXPBDSSE4(ClothFloat4* pos, const Constraint* batch, const float* compliance, float* lambda, float alphaScale, int begin, int end, ClothResidual* residual)
+{
+	float* base = (float*)pos;
+	int c = begin;
+
+	__m128 scale4 = _mm_set1_ps(alphaScale);
+
+	__m128 sumSquared = _mm_setzero_ps(), maximum = _mm_setzero_ps();
+	const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+	for (; c + 4 <= end; c += 4)
+	{
+		const Constraint* q = batch + c;
+
+		float* s0 = base + q[0].start * 4;
+		float* s1 = base + q[1].start * 4;
+		float* s2 = base + q[2].start * 4;
+		float* s3 = base + q[3].start * 4;
+		float* e0 = base + q[0].end * 4;
+		float* e1 = base + q[1].end * 4;
+		float* e2 = base + q[2].end * 4;
+		float* e3 = base + q[3].end * 4;
+
+		__m128 x1 = _mm_load_ps(s0), y1 = _mm_load_ps(s1), z1 = _mm_load_ps(s2), w1 = _mm_load_ps(s3);
+		__m128 x2 = _mm_load_ps(e0), y2 = _mm_load_ps(e1), z2 = _mm_load_ps(e2), w2 = _mm_load_ps(e3);
+
+		_MM_TRANSPOSE4_PS(x1, y1, z1, w1);
+		_MM_TRANSPOSE4_PS(x2, y2, z2, w2);
+
+		__m128 length	= _mm_set_ps(q[3].length, q[2].length, q[1].length, q[0].length);
+		__m128 alpha	= _mm_mul_ps(_mm_loadu_ps(compliance + c), scale4);
+		__m128 lam		= _mm_loadu_ps(lambda + c);
+
+		__m128 dx = _mm_sub_ps(x1, x2);
+		__m128 dy = _mm_sub_ps(y1, y2);
+		__m128 dz = _mm_sub_ps(z1, z2);
+
+		__m128 distance	= _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+		__m128 denom	= _mm_add_ps(_mm_add_ps(w1, w2), alpha);
+
+		// Violation before the projection
+		__m128 violation = _mm_and_ps(absMask, _mm_sub_ps(distance, length));
+
+		sumSquared = _mm_add_ps(sumSquared, _mm_mul_ps(violation, violation));
+		maximum = _mm_max_ps(maximum, violation);
+
+		// Degenerate constraints get a zero correction
+		__m128 zero		= _mm_setzero_ps();
+		__m128 valid	= _mm_and_ps(_mm_cmpgt_ps(distance, zero), _mm_cmpgt_ps(denom, zero));
+
+		__m128 deltaLambda = _mm_and_ps(valid, _mm_div_ps(_mm_sub_ps(_mm_sub_ps(length, distance), _mm_mul_ps(alpha, lam)), denom));
+
+		_mm_storeu_ps(lambda + c, _mm_add_ps(lam, deltaLambda));
+
+		__m128 scale = _mm_and_ps(valid, _mm_div_ps(deltaLambda, distance));
+
+		dx = _mm_mul_ps(dx, scale);
+		dy = _mm_mul_ps(dy, scale);
+		dz = _mm_mul_ps(dz, scale);
+
+		x1 = _mm_add_ps(x1, _mm_mul_ps(dx, w1));
+		y1 = _mm_add_ps(y1, _mm_mul_ps(dy, w1));
+		z1 = _mm_add_ps(z1, _mm_mul_ps(dz, w1));
+
+		x2 = _mm_sub_ps(x2, _mm_mul_ps(dx, w2));
+		y2 = _mm_sub_ps(y2, _mm_mul_ps(dy, w2));
+		z2 = _mm_sub_ps(z2, _mm_mul_ps(dz, w2));
+
+		_MM_TRANSPOSE4_PS(x1, y1, z1, w1);
+		_MM_TRANSPOSE4_PS(x2, y2, z2, w2);
+
+		_mm_store_ps(s0, x1); _mm_store_ps(s1, y1); _mm_store_ps(s2, z1); _mm_store_ps(s3, w1);
+		_mm_store_ps(e0, x2); _mm_store_ps(e1, y2); _mm_store_ps(e2, z2); _mm_store_ps(e3, w2);
+	}
+
+	float sums[4], maxima[4];
+
+	_mm_storeu_ps(sums, sumSquared);
+	_mm_storeu_ps(maxima, maximum);
+
+	addResidual(residual, sumLanes(sums, 4), maxLanes(maxima, 4));
+
+	projectBatchXPBDScalar(pos, batch, compliance, lambda, alphaScale, c, end, residual);
+}
+
+// 4 consecutive particles per iteration, their anchors gathered - skipped without a
+// store when none is too far
+CLOTH_TARGET("sse4.1")
+static void attachSSE4(ClothFloat4* pos, const int* anchor, const float* tether, int begin, int end)
+{
+	float* base = (float*)pos;
+	int i = begin;
+
+	const __m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= end; i += 4)
+	{
+		float* p = base + i * 4;
+
+		__m128 x = _mm_load_ps(p), y = _mm_load_ps(p + 4), z = _mm_load_ps(p + 8), w = _mm_load_ps(p + 12);
+
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+
+		__m128 ax = _mm_load_ps(base + anchor[i] * 4), ay = _mm_load_ps(base + anchor[i + 1] * 4);
+		__m128 az = _mm_load_ps(base + anchor[i + 2] * 4), aw = _mm_load_ps(base + anchor[i + 3] * 4);
+
+		_MM_TRANSPOSE4_PS(ax, ay, az, aw);
+
+		__m128 dx = _mm_sub_ps(x, ax);
+		__m128 dy = _mm_sub_ps(y, ay);
+		__m128 dz = _mm_sub_ps(z, az);
+
+		__m128 distance	= _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+		__m128 length	= _mm_loadu_ps(tether + i);
+		__m128 move		= _mm_and_ps(_mm_cmpgt_ps(distance, length), _mm_cmpgt_ps(w, zero));
+
+		if (!_mm_movemask_ps(move))
+			continue;
+
+		__m128 scale = _mm_div_ps(length, distance);
+
+		x = _mm_blendv_ps(x, _mm_add_ps(ax, _mm_mul_ps(dx, scale)), move);
+		y = _mm_blendv_ps(y, _mm_add_ps(ay, _mm_mul_ps(dy, scale)), move);
+		z = _mm_blendv_ps(z, _mm_add_ps(az, _mm_mul_ps(dz, scale)), move);
+
+		_MM_TRANSPOSE4_PS(x, y, z, w);
+
+		_mm_store_ps(p, x); _mm_store_ps(p + 4, y); _mm_store_ps(p + 8, z); _mm_store_ps(p + 12, w);
+	}
+
+	attachScalar(pos, anchor, tether, i, end);
+}
+
+
+// 4 consecutive particles per iteration. The height grid is sampled by the scalar
+// kernel - SSE4 has no gathers and the four corner loads dominate.
+CLOTH_TARGET("sse4.1")
+static void contactSSE4(ClothFloat4* pos, const ClothFloat4* prevPos, const float* ground, float offset, float friction, int begin, int end)
+{
+	float* base			= (float*)pos;
+	const float* prev	= (const float*)prevPos;
+	int i = begin;
+
+	const __m128 offset4 = _mm_set1_ps(offset), friction4 = _mm_set1_ps(friction);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= end; i += 4)
+	{
+		float* p = base + i * 4;
+
+		__m128 y		= _mm_set_ps(p[13], p[9], p[5], p[1]);
+		__m128 w		= _mm_set_ps(p[15], p[11], p[7], p[3]);
+		__m128 surface	= _mm_add_ps(_mm_loadu_ps(ground + i - begin), offset4);
+		__m128 lift		= _mm_and_ps(_mm_cmplt_ps(y, surface), _mm_cmpgt_ps(w, zero));
+
+		// Most particles are clear of the ground
+		if (!_mm_movemask_ps(lift))
+			continue;
+
+		const float* q = prev + i * 4;
+
+		__m128 x = _mm_load_ps(p), y4 = _mm_load_ps(p + 4), z = _mm_load_ps(p + 8), w4 = _mm_load_ps(p + 12);
+		__m128 px = _mm_load_ps(q), py = _mm_load_ps(q + 4), pz = _mm_load_ps(q + 8), pw = _mm_load_ps(q + 12);
+
+		_MM_TRANSPOSE4_PS(x, y4, z, w4);
+		_MM_TRANSPOSE4_PS(px, py, pz, pw);
+
+		x	= _mm_blendv_ps(x, _mm_add_ps(x, _mm_mul_ps(_mm_sub_ps(px, x), friction4)), lift);
+		y4	= _mm_blendv_ps(y4, surface, lift);
+		z	= _mm_blendv_ps(z, _mm_add_ps(z, _mm_mul_ps(_mm_sub_ps(pz, z), friction4)), lift);
+
+		_MM_TRANSPOSE4_PS(x, y4, z, w4);
+
+		_mm_store_ps(p, x); _mm_store_ps(p + 4, y4); _mm_store_ps(p + 8, z); _mm_store_ps(p + 12, w4);
+	}
+
+	contactScalar(pos, prevPos, ground, offset, friction, i, end);
+}
+
+// 4 particles of the block per iteration, each tested against every candidate
+CLOTH_TARGET("sse4.1")
+static void closestSSE4(const ClothColliderTriangle* triangles, const int* candidates, int candidateCount, ClothQueryBlock& block, int begin, int end)
+{
+	int i = begin;
+
+	const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(block.x + i), y = _mm_loadu_ps(block.y + i), z = _mm_loadu_ps(block.z + i);
+		__m128 best = _mm_loadu_ps(block.best + i);
+		__m128 cx = _mm_loadu_ps(block.cx + i), cy = _mm_loadu_ps(block.cy + i), cz = _mm_loadu_ps(block.cz + i);
+		__m128i nearest = _mm_loadu_si128((const __m128i*)(block.nearest + i));
+
+		for (int k = 0; k < candidateCount; k++)
+		{
+			const ClothColliderTriangle& t = triangles[candidates[k]];
+
+			__m128 apx = _mm_sub_ps(x, _mm_set1_ps(t.a.x));
+			__m128 apy = _mm_sub_ps(y, _mm_set1_ps(t.a.y));
+			__m128 apz = _mm_sub_ps(z, _mm_set1_ps(t.a.z));
+
+			__m128 plane = _mm_add_ps(_mm_add_ps(_mm_mul_ps(apx, _mm_set1_ps(t.normal.x)), _mm_mul_ps(apy, _mm_set1_ps(t.normal.y))), _mm_mul_ps(apz, _mm_set1_ps(t.normal.z)));
+			__m128 closer = _mm_cmplt_ps(_mm_mul_ps(plane, plane), best);
+
+			// Most candidates are further than the best so far along their normal
+			if (!_mm_movemask_ps(closer))
+				continue;
+
+			__m128 abx = _mm_set1_ps(t.b.x - t.a.x), aby = _mm_set1_ps(t.b.y - t.a.y), abz = _mm_set1_ps(t.b.z - t.a.z);
+			__m128 acx = _mm_set1_ps(t.c.x - t.a.x), acy = _mm_set1_ps(t.c.y - t.a.y), acz = _mm_set1_ps(t.c.z - t.a.z);
+
+			__m128 bpx = _mm_sub_ps(x, _mm_set1_ps(t.b.x)), bpy = _mm_sub_ps(y, _mm_set1_ps(t.b.y)), bpz = _mm_sub_ps(z, _mm_set1_ps(t.b.z));
+			__m128 cpx = _mm_sub_ps(x, _mm_set1_ps(t.c.x)), cpy = _mm_sub_ps(y, _mm_set1_ps(t.c.y)), cpz = _mm_sub_ps(z, _mm_set1_ps(t.c.z));
+
+			__m128 d1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abx, apx), _mm_mul_ps(aby, apy)), _mm_mul_ps(abz, apz));
+			__m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(acx, apx), _mm_mul_ps(acy, apy)), _mm_mul_ps(acz, apz));
+			__m128 d3 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abx, bpx), _mm_mul_ps(aby, bpy)), _mm_mul_ps(abz, bpz));
+			__m128 d4 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(acx, bpx), _mm_mul_ps(acy, bpy)), _mm_mul_ps(acz, bpz));
+			__m128 d5 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abx, cpx), _mm_mul_ps(aby, cpy)), _mm_mul_ps(abz, cpz));
+			__m128 d6 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(acx, cpx), _mm_mul_ps(acy, cpy)), _mm_mul_ps(acz, cpz));
+
+			__m128 va = _mm_sub_ps(_mm_mul_ps(d3, d6), _mm_mul_ps(d5, d4));
+			__m128 vb = _mm_sub_ps(_mm_mul_ps(d5, d2), _mm_mul_ps(d1, d6));
+			__m128 vc = _mm_sub_ps(_mm_mul_ps(d1, d4), _mm_mul_ps(d3, d2));
+
+			__m128 d43 = _mm_sub_ps(d4, d3), d56 = _mm_sub_ps(d5, d6);
+
+			// Face region, then each edge and vertex region over it - the regions tested
+			// first by the scalar kernel are blended in last
+			__m128 denom = _mm_div_ps(one, _mm_add_ps(_mm_add_ps(va, vb), vc));
+			__m128 v = _mm_mul_ps(vb, denom), w = _mm_mul_ps(vc, denom);
+
+			__m128 edge = _mm_and_ps(_mm_and_ps(_mm_cmple_ps(va, zero), _mm_cmpge_ps(d43, zero)), _mm_cmpge_ps(d56, zero));
+			__m128 wBC = _mm_div_ps(d43, _mm_add_ps(d43, d56));
+
+			v = _mm_blendv_ps(v, _mm_sub_ps(one, wBC), edge);
+			w = _mm_blendv_ps(w, wBC, edge);
+
+			edge = _mm_and_ps(_mm_and_ps(_mm_cmple_ps(vb, zero), _mm_cmpge_ps(d2, zero)), _mm_cmple_ps(d6, zero));
+			v = _mm_blendv_ps(v, zero, edge);
+			w = _mm_blendv_ps(w, _mm_div_ps(d2, _mm_sub_ps(d2, d6)), edge);
+
+			edge = _mm_and_ps(_mm_cmpge_ps(d6, zero), _mm_cmple_ps(d5, d6));
+			v = _mm_blendv_ps(v, zero, edge);
+			w = _mm_blendv_ps(w, one, edge);
+
+			edge = _mm_and_ps(_mm_and_ps(_mm_cmple_ps(vc, zero), _mm_cmpge_ps(d1, zero)), _mm_cmple_ps(d3, zero));
+			v = _mm_blendv_ps(v, _mm_div_ps(d1, _mm_sub_ps(d1, d3)), edge);
+			w = _mm_blendv_ps(w, zero, edge);
+
+			edge = _mm_and_ps(_mm_cmpge_ps(d3, zero), _mm_cmple_ps(d4, d3));
+			v = _mm_blendv_ps(v, one, edge);
+			w = _mm_blendv_ps(w, zero, edge);
+
+			edge = _mm_and_ps(_mm_cmple_ps(d1, zero), _mm_cmple_ps(d2, zero));
+			v = _mm_blendv_ps(v, zero, edge);
+			w = _mm_blendv_ps(w, zero, edge);
+
+			__m128 qx = _mm_add_ps(_mm_add_ps(_mm_set1_ps(t.a.x), _mm_mul_ps(abx, v)), _mm_mul_ps(acx, w));
+			__m128 qy = _mm_add_ps(_mm_add_ps(_mm_set1_ps(t.a.y), _mm_mul_ps(aby, v)), _mm_mul_ps(acy, w));
+			__m128 qz = _mm_add_ps(_mm_add_ps(_mm_set1_ps(t.a.z), _mm_mul_ps(abz, v)), _mm_mul_ps(acz, w));
+
+			__m128 dx = _mm_sub_ps(x, qx), dy = _mm_sub_ps(y, qy), dz = _mm_sub_ps(z, qz);
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+			closer = _mm_and_ps(closer, _mm_cmplt_ps(distance, best));
+
+			best	= _mm_blendv_ps(best, distance, closer);
+			cx		= _mm_blendv_ps(cx, qx, closer);
+			cy		= _mm_blendv_ps(cy, qy, closer);
+			cz		= _mm_blendv_ps(cz, qz, closer);
+			nearest	= _mm_blendv_epi8(nearest, _mm_set1_epi32(candidates[k]), _mm_castps_si128(closer));
+		}
+
+		_mm_storeu_ps(block.best + i, best);
+		_mm_storeu_ps(block.cx + i, cx); _mm_storeu_ps(block.cy + i, cy); _mm_storeu_ps(block.cz + i, cz);
+		_mm_storeu_si128((__m128i*)(block.nearest + i), nearest);
+	}
+
+	closestScalar(triangles, candidates, candidateCount, block, i, end);
+}
+
+// Store four x/y/z/padding registers as four consecutive ClothFloat3s
+CLOTH_TARGET("sse4.1")
+static inline void storeTriples(float* n, __m128 a, __m128 b, __m128 c, __m128 d)
+{
+	// Each store's padding is overwritten by the next, and the last one leaves it out
+	_mm_storeu_ps(n, a);
+	_mm_storeu_ps(n + 3, b);
+	_mm_storeu_ps(n + 6, c);
+	_mm_storel_pi((__m64*)(n + 9), d);
+	_mm_store_ss(n + 11, _mm_movehl_ps(d, d));
+}
+
+// 4 interior columns per iteration, the edge columns by the scalar kernel
+CLOTH_TARGET("sse4.1")
+static void gridNormalsSSE4(const ClothFloat4* above, const ClothFloat4* row, const ClothFloat4* below, int w, int begin, int end, ClothFloat3* normals)
+{
+	int i = begin;
+
+	if (i == 0 && end > 0)
+		gridNormalsScalar(above, row, below, w, i++, 1, normals);
+
+	int interior = end < w - 1 ? end : w - 1;
+
+	const __m128 zero = _mm_setzero_ps(), up = _mm_set1_ps(1.0f);
+
+	for (; i + 4 <= interior; i += 4)
+	{
+		const float* l = (const float*)(row + i - 1);
+		const float* r = (const float*)(row + i + 1);
+		const float* a = (const float*)(above + i);
+		const float* b = (const float*)(below + i);
+
+		__m128 lx = _mm_loadu_ps(l), ly = _mm_loadu_ps(l + 4), lz = _mm_loadu_ps(l + 8), lw = _mm_loadu_ps(l + 12);
+		__m128 rx = _mm_loadu_ps(r), ry = _mm_loadu_ps(r + 4), rz = _mm_loadu_ps(r + 8), rw = _mm_loadu_ps(r + 12);
+		__m128 ax = _mm_loadu_ps(a), ay = _mm_loadu_ps(a + 4), az = _mm_loadu_ps(a + 8), aw = _mm_loadu_ps(a + 12);
+		__m128 bx = _mm_loadu_ps(b), by = _mm_loadu_ps(b + 4), bz = _mm_loadu_ps(b + 8), bw = _mm_loadu_ps(b + 12);
+
+		_MM_TRANSPOSE4_PS(lx, ly, lz, lw);
+		_MM_TRANSPOSE4_PS(rx, ry, rz, rw);
+		_MM_TRANSPOSE4_PS(ax, ay, az, aw);
+		_MM_TRANSPOSE4_PS(bx, by, bz, bw);
+
+		__m128 ux = _mm_sub_ps(rx, lx), uy = _mm_sub_ps(ry, ly), uz = _mm_sub_ps(rz, lz);
+		__m128 vx = _mm_sub_ps(bx, ax), vy = _mm_sub_ps(by, ay), vz = _mm_sub_ps(bz, az);
+
+		__m128 nx = _mm_sub_ps(_mm_mul_ps(vy, uz), _mm_mul_ps(vz, uy));
+		__m128 ny = _mm_sub_ps(_mm_mul_ps(vz, ux), _mm_mul_ps(vx, uz));
+		__m128 nz = _mm_sub_ps(_mm_mul_ps(vx, uy), _mm_mul_ps(vy, ux));
+
+		__m128 length	= _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+		__m128 valid	= _mm_cmpgt_ps(length, zero);
+
+		nx = _mm_blendv_ps(zero, _mm_div_ps(nx, length), valid);
+		ny = _mm_blendv_ps(up, _mm_div_ps(ny, length), valid);
+		nz = _mm_blendv_ps(zero, _mm_div_ps(nz, length), valid);
+
+		__m128 pad = zero;
+
+		_MM_TRANSPOSE4_PS(nx, ny, nz, pad);
+
+		storeTriples((float*)(normals + i), nx, ny, nz, pad);
+	}
+
+	gridNormalsScalar(above, row, below, w, i, end, normals);
+}
+
+// 4 triangles per iteration, the corners gathered and transposed
+CLOTH_TARGET("sse4.1")
+static void aeroSSE4(const ClothFloat4* pos, const ClothFloat4* flow, const DWORD* indices, float drag, float lift, int begin, int end, ClothFloat4* force)
+{
+	int t = begin;
+
+	const __m128 third = _mm_set1_ps(1.0f / 3.0f), zero = _mm_setzero_ps(), sign = _mm_set1_ps(-0.0f);
+	const __m128 dragScale = _mm_set1_ps(drag), liftScale = _mm_set1_ps(lift);
+
+	for (; t + 4 <= end; t += 4)
+	{
+		const DWORD* corner = indices + t * 3;
+
+		// Corner k of triangle t + j is corner[j * 3 + k]
+		__m128 x[3], y[3], z[3], fx[3], fy[3], fz[3];
+
+		for (int k = 0; k < 3; k++)
+		{
+			__m128 r0 = _mm_loadu_ps((const float*)(pos + corner[k])), r1 = _mm_loadu_ps((const float*)(pos + corner[3 + k]));
+			__m128 r2 = _mm_loadu_ps((const float*)(pos + corner[6 + k])), r3 = _mm_loadu_ps((const float*)(pos + corner[9 + k]));
+
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+			x[k] = r0; y[k] = r1; z[k] = r2;
+
+			r0 = _mm_loadu_ps((const float*)(flow + corner[k])); r1 = _mm_loadu_ps((const float*)(flow + corner[3 + k]));
+			r2 = _mm_loadu_ps((const float*)(flow + corner[6 + k])); r3 = _mm_loadu_ps((const float*)(flow + corner[9 + k]));
+
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+			fx[k] = r0; fy[k] = r1; fz[k] = r2;
+		}
+
+		__m128 ux = _mm_sub_ps(x[1], x[0]), uy = _mm_sub_ps(y[1], y[0]), uz = _mm_sub_ps(z[1], z[0]);
+		__m128 wx = _mm_sub_ps(x[2], x[0]), wy = _mm_sub_ps(y[2], y[0]), wz = _mm_sub_ps(z[2], z[0]);
+
+		__m128 nx = _mm_sub_ps(_mm_mul_ps(uy, wz), _mm_mul_ps(uz, wy));
+		__m128 ny = _mm_sub_ps(_mm_mul_ps(uz, wx), _mm_mul_ps(ux, wz));
+		__m128 nz = _mm_sub_ps(_mm_mul_ps(ux, wy), _mm_mul_ps(uy, wx));
+
+		__m128 vx = _mm_mul_ps(_mm_add_ps(_mm_add_ps(fx[0], fx[1]), fx[2]), third);
+		__m128 vy = _mm_mul_ps(_mm_add_ps(_mm_add_ps(fy[0], fy[1]), fy[2]), third);
+		__m128 vz = _mm_mul_ps(_mm_add_ps(_mm_add_ps(fz[0], fz[1]), fz[2]), third);
+
+		__m128 vn = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, vx), _mm_mul_ps(ny, vy)), _mm_mul_ps(nz, vz));
+		__m128 vv = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+		__m128 nn = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz));
+
+		__m128 d		= _mm_mul_ps(dragScale, _mm_andnot_ps(sign, vn));
+		__m128 denom	= _mm_mul_ps(_mm_sqrt_ps(nn), _mm_sqrt_ps(vv));
+		__m128 l		= _mm_blendv_ps(zero, _mm_div_ps(_mm_mul_ps(liftScale, vn), denom), _mm_cmpgt_ps(denom, zero));
+
+		__m128 rx = _mm_xor_ps(sign, _mm_add_ps(_mm_mul_ps(d, vx), _mm_mul_ps(l, _mm_sub_ps(_mm_mul_ps(vv, nx), _mm_mul_ps(vn, vx)))));
+		__m128 ry = _mm_xor_ps(sign, _mm_add_ps(_mm_mul_ps(d, vy), _mm_mul_ps(l, _mm_sub_ps(_mm_mul_ps(vv, ny), _mm_mul_ps(vn, vy)))));
+		__m128 rz = _mm_xor_ps(sign, _mm_add_ps(_mm_mul_ps(d, vz), _mm_mul_ps(l, _mm_sub_ps(_mm_mul_ps(vv, nz), _mm_mul_ps(vn, vz)))));
+		__m128 rw = zero;
+
+		_MM_TRANSPOSE4_PS(rx, ry, rz, rw);
+
+		float* f = (float*)(force + t);
+
+		_mm_storeu_ps(f, rx); _mm_storeu_ps(f + 4, ry); _mm_storeu_ps(f + 8, rz); _mm_storeu_ps(f + 12, rw);
+	}
+
+	aeroScalar(pos, flow, indices, drag, lift, t, end, force);
+}
+
+
+#pragma endregion
+
+#pragma region AVX2
+
+// In-lane 4x4 transpose of two particles per register (self inverse)
+CLOTH_TARGET("avx2")
+static inline void transpose8(__m256& r0, __m256& r1, __m256& r2, __m256& r3)
+{
+	__m256 t0 = _mm256_unpacklo_ps(r0, r1);
+	__m256 t1 = _mm256_unpacklo_ps(r2, r3);
+	__m256 t2 = _mm256_unpackhi_ps(r0, r1);
+	__m256 t3 = _mm256_unpackhi_ps(r2, r3);
+
+	r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+	r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+	r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+CLOTH_TARGET("avx2")
+static inline __m256 loadPair(const float* low, const float* high)
+{
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(low)), _mm_load_ps(high), 1);
+}
+
+CLOTH_TARGET("avx2")
+static inline __m256 loadPairUnaligned(const float* low, const float* high)
+{
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(low)), _mm_loadu_ps(high), 1);
+}
+
+CLOTH_TARGET("avx2")
+static inline void storePair(float* low, float* high, __m256 v)
+{
+	_mm_store_ps(low, _mm256_castps256_ps128(v));
+	_mm_store_ps(high, _mm256_extractf128_ps(v, 1));
+}
+
+// 8 constraints per iteration - pairs of particles share a register so the
+// transposes stay within 128 bit lanes
+CLOTH_TARGET("avx2")
+static void projectBatchAVX2(ClothFloat4* pos, const Constraint* batch, int begin, int end, ClothResidual* residual)
+{
+	float* base = (float*)pos;
+	int c = begin;
+
+	__m256 sumSquared = _mm256_setzero_ps(), maximum = _mm256_setzero_ps();
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+	for (; c + 8 <= end; c += 8)
+	{
+		const Constraint* q = batch + c;
+
+		float* s[8];
+		float* e[8];
+
+		for (int i = 0; i < 8; i++)
+		{
+			s[i] = base + q[i].start * 4;
+			e[i] = base + q[i].end * 4;
+		}
+
+		// Lane order after the transpose is constraint 0..7
+		__m256 x1 = loadPair(s[0], s[4]), y1 = loadPair(s[1], s[5]), z1 = loadPair(s[2], s[6]), w1 = loadPair(s[3], s[7]);
+		__m256 x2 = loadPair(e[0], e[4]), y2 = loadPair(e[1], e[5]), z2 = loadPair(e[2], e[6]), w2 = loadPair(e[3], e[7]);
+
+		transpose8(x1, y1, z1, w1);
+		transpose8(x2, y2, z2, w2);
+
+		__m256 length = _mm256_set_ps(q[7].length, q[6].length, q[5].length, q[4].length, q[3].length, q[2].length, q[1].length, q[0].length);
+
+		__m256 dx = _mm256_sub_ps(x1, x2);
+		__m256 dy = _mm256_sub_ps(y1, y2);
+		__m256 dz = _mm256_sub_ps(z1, z2);
+
+		__m256 distance	= _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+		__m256 weight	= _mm256_add_ps(w1, w2);
+
+		// Violation before the projection
+		__m256 violation = _mm256_and_ps(absMask, _mm256_sub_ps(distance, length));
+
+		sumSquared = _mm256_add_ps(sumSquared, _mm256_mul_ps(violation, violation));
+		maximum = _mm256_max_ps(maximum, violation);
+
+		// Degenerate constraints get a zero correction
+		__m256 zero		= _mm256_setzero_ps();
+		__m256 valid	= _mm256_and_ps(_mm256_cmp_ps(distance, zero, _CMP_GT_OQ), _mm256_cmp_ps(weight, zero, _CMP_GT_OQ));
+
+		__m256 stretching = _mm256_and_ps(valid, _mm256_div_ps(_mm256_sub_ps(distance, length), _mm256_mul_ps(distance, weight)));
+
+		dx = _mm256_mul_ps(dx, stretching);
+		dy = _mm256_mul_ps(dy, stretching);
+		dz = _mm256_mul_ps(dz, stretching);
+
+		x1 = _mm256_sub_ps(x1, _mm256_mul_ps(dx, w1));
+		y1 = _mm256_sub_ps(y1, _mm256_mul_ps(dy, w1));
+		z1 = _mm256_sub_ps(z1, _mm256_mul_ps(dz, w1));
+
+		x2 = _mm256_add_ps(x2, _mm256_mul_ps(dx, w2));
+		y2 = _mm256_add_ps(y2, _mm256_mul_ps(dy, w2));
+		z2 = _mm256_add_ps(z2, _mm256_mul_ps(dz, w2));
+
+		transpose8(x1, y1, z1, w1);
+		transpose8(x2, y2, z2, w2);
+
+		storePair(s[0], s[4], x1); storePair(s[1], s[5], y1); storePair(s[2], s[6], z1); storePair(s[3], s[7], w1);
+		storePair(e[0], e[4], x2); storePair(e[1], e[5], y2); storePair(e[2], e[6], z2); storePair(e[3], e[7], w2);
+	}
+
+	float sums[8], maxima[8];
+
+	_mm256_storeu_ps(sums, sumSquared);
+	_mm256_storeu_ps(maxima, maximum);
+
+	addResidual(residual, sumLanes(sums, 8), maxLanes(maxima, 8));
+
+	// Clear the upper halves before the SSE tail and whatever runs next, which would
+	// otherwise pay the AVX to SSE transition on every instruction
+	_mm256_zeroupper();
+
+	projectBatchSSE4(pos, batch, c, end, residual);
+}
+
+
+CLOTH_TARGET("avx2")
+static void projectBatchXPBDAVX2(ClothFloat4* pos, const Constraint* batch, const float* compliance, float* lambda, float alphaScale, int begin, int end, ClothResidual* residual)
+{
+	float* base = (float*)pos;
+	int c = begin;
+
+	__m256 scale8 = _mm256_set1_ps(alphaScale);
+
+	__m256 sumSquared = _mm256_setzero_ps(), maximum = _mm256_setzero_ps();
+	const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+	for (; c + 8 <= end; c += 8)
+	{
+		const Constraint* q = batch + c;
+
+		float* s[8];
+		float* e[8];
+
+		for (int i = 0; i < 8; i++)
+		{
+			s[i] = base + q[i].start * 4;
+			e[i] = base + q[i].end * 4;
+		}
+
+		__m256 x1 = loadPair(s[0], s[4]), y1 = loadPair(s[1], s[5]), z1 = loadPair(s[2], s[6]), w1 = loadPair(s[3], s[7]);
+		__m256 x2 = loadPair(e[0], e[4]), y2 = loadPair(e[1], e[5]), z2 = loadPair(e[2], e[6]), w2 = loadPair(e[3], e[7]);
+
+		transpose8(x1, y1, z1, w1);
+		transpose8(x2, y2, z2, w2);
+
+		__m256 length	= _mm256_set_ps(q[7].length, q[6].length, q[5].length, q[4].length, q[3].length, q[2].length, q[1].length, q[0].length);
+		__m256 alpha	= _mm256_mul_ps(_mm256_loadu_ps(compliance + c), scale8);
+		__m256 lam		= _mm256_loadu_ps(lambda + c);
+
+		__m256 dx = _mm256_sub_ps(x1, x2);
+		__m256 dy = _mm256_sub_ps(y1, y2);
+		__m256 dz = _mm256_sub_ps(z1, z2);
+
+		__m256 distance	= _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+		__m256 denom	= _mm256_add_ps(_mm256_add_ps(w1, w2), alpha);
+
+		// Violation before the projection
+		__m256 violation = _mm256_and_ps(absMask, _mm256_sub_ps(distance, length));
+
+		sumSquared = _mm256_add_ps(sumSquared, _mm256_mul_ps(violation, violation));
+		maximum = _mm256_max_ps(maximum, violation);
+
+		// Degenerate constraints get a zero correction
+		__m256 zero		= _mm256_setzero_ps();
+		__m256 valid	= _mm256_and_ps(_mm256_cmp_ps(distance, zero, _CMP_GT_OQ), _mm256_cmp_ps(denom, zero, _CMP_GT_OQ));
+
+		__m256 deltaLambda = _mm256_and_ps(valid, _mm256_div_ps(_mm256_sub_ps(_mm256_sub_ps(length, distance), _mm256_mul_ps(alpha, lam)), denom));
+
+		_mm256_storeu_ps(lambda + c, _mm256_add_ps(lam, deltaLambda));
+
+		__m256 scale = _mm256_and_ps(valid, _mm256_div_ps(deltaLambda, distance));
+
+		dx = _mm256_mul_ps(dx, scale);
+		dy = _mm256_mul_ps(dy, scale);
+		dz = _mm256_mul_ps(dz, scale);
+
+		x1 = _mm256_add_ps(x1, _mm256_mul_ps(dx, w1));
+		y1 = _mm256_add_ps(y1, _mm256_mul_ps(dy, w1));
+		z1 = _mm256_add_ps(z1, _mm256_mul_ps(dz, w1));
+
+		x2 = _mm256_sub_ps(x2, _mm256_mul_ps(dx, w2));
+		y2 = _mm256_sub_ps(y2, _mm256_mul_ps(dy, w2));
+		z2 = _mm256_sub_ps(z2, _mm256_mul_ps(dz, w2));
+
+		transpose8(x1, y1, z1, w1);
+		transpose8(x2, y2, z2, w2);
+
+		storePair(s[0], s[4], x1); storePair(s[1], s[5], y1); storePair(s[2], s[6], z1); storePair(s[3], s[7], w1);
+		storePair(e[0], e[4], x2); storePair(e[1], e[5], y2); storePair(e[2], e[6], z2); storePair(e[3], e[7], w2);
+	}
+
+	float sums[8], maxima[8];
+
+	_mm256_storeu_ps(sums, sumSquared);
+	_mm256_storeu_ps(maxima, maximum);
+
+	addResidual(residual, sumLanes(sums, 8), maxLanes(maxima, 8));
+
+	_mm256_zeroupper();
+
+	projectBatchXPBDSSE4(pos, batch, compliance, lambda, alphaScale, c, end, residual);
+}
+
+// 8 consecutive particles per iteration, their anchors gathered
+CLOTH_TARGET("avx2")
+static void attachAVX2(ClothFloat4* pos, const int* anchor, const float* tether, int begin, int end)
+{
+	float* base = (float*)pos;
+	int i = begin;
+
+	const __m256 zero = _mm256_setzero_ps();
+
+	for (; i + 8 <= end; i += 8)
+	{
+		float* p = base + i * 4;
+		const int* a = anchor + i;
+
+		// Particle i + k is in lane k after the transpose, as in projectBatchAVX2
+
+		__m256 x = loadPair(p, p + 16), y = loadPair(p + 4, p + 20), z = loadPair(p + 8, p + 24), w = loadPair(p + 12, p + 28);
+
+		transpose8(x, y, z, w);
+
+		__m256 ax = loadPair(base + a[0] * 4, base + a[4] * 4), ay = loadPair(base + a[1] * 4, base + a[5] * 4);
+		__m256 az = loadPair(base + a[2] * 4, base + a[6] * 4), aw = loadPair(base + a[3] * 4, base + a[7] * 4);
+
+		transpose8(ax, ay, az, aw);
+
+		__m256 dx = _mm256_sub_ps(x, ax);
+		__m256 dy = _mm256_sub_ps(y, ay);
+		__m256 dz = _mm256_sub_ps(z, az);
+
+		__m256 distance	= _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+		__m256 length	= _mm256_loadu_ps(tether + i);
+		__m256 move		= _mm256_and_ps(_mm256_cmp_ps(distance, length, _CMP_GT_OQ), _mm256_cmp_ps(w, zero, _CMP_GT_OQ));
+
+		if (!_mm256_movemask_ps(move))
+			continue;
+
+		__m256 scale = _mm256_div_ps(length, distance);
+
+		x = _mm256_blendv_ps(x, _mm256_add_ps(ax, _mm256_mul_ps(dx, scale)), move);
+		y = _mm256_blendv_ps(y, _mm256_add_ps(ay, _mm256_mul_ps(dy, scale)), move);
+		z = _mm256_blendv_ps(z, _mm256_add_ps(az, _mm256_mul_ps(dz, scale)), move);
+
+		transpose8(x, y, z, w);
+
+		storePair(p, p + 16, x); storePair(p + 4, p + 20, y); storePair(p + 8, p + 24, z); storePair(p + 12, p + 28, w);
+	}
+
+	_mm256_zeroupper();
+
+	attachSSE4(pos, anchor, tether, i, end);
+}
+
+
+// 8 consecutive particles per iteration, the corner heights gathered
+CLOTH_TARGET("avx2")
+static void sampleGridAVX2(const ClothFloat4* pos, const ClothHeightGrid& grid, float* ground, int begin, int end)
+{
+	const float* base = (const float*)pos;
+	int i = begin;
+
+	const __m256 x0 = _mm256_set1_ps(grid.x0), z0 = _mm256_set1_ps(grid.z0), invCell = _mm256_set1_ps(grid.invCellSize);
+	const __m256 maxX = _mm256_set1_ps((float)(grid.w - 1)), maxZ = _mm256_set1_ps((float)(grid.h - 1));
+	const __m256i lastX = _mm256_set1_epi32(grid.w - 2), lastZ = _mm256_set1_epi32(grid.h - 2);
+	const __m256i rowStride = _mm256_set1_epi32(grid.w);
+	const __m256 zero = _mm256_setzero_ps();
+
+	for (; i + 8 <= end; i += 8)
+	{
+		const float* p = base + i * 4;
+
+		__m256 x = loadPair(p, p + 16), y = loadPair(p + 4, p + 20), z = loadPair(p + 8, p + 24), w = loadPair(p + 12, p + 28);
+
+		transpose8(x, y, z, w);
+
+		__m256 fx = _mm256_mul_ps(_mm256_sub_ps(x, x0), invCell);
+		__m256 fz = _mm256_mul_ps(_mm256_sub_ps(z, z0), invCell);
+
+		fx = _mm256_min_ps(_mm256_max_ps(fx, zero), maxX);
+		fz = _mm256_min_ps(_mm256_max_ps(fz, zero), maxZ);
+
+		__m256i ix = _mm256_min_epi32(_mm256_cvttps_epi32(fx), lastX);
+		__m256i iz = _mm256_min_epi32(_mm256_cvttps_epi32(fz), lastZ);
+
+		__m256 tx = _mm256_sub_ps(fx, _mm256_cvtepi32_ps(ix));
+		__m256 tz = _mm256_sub_ps(fz, _mm256_cvtepi32_ps(iz));
+
+		__m256i cell = _mm256_add_epi32(_mm256_mullo_epi32(iz, rowStride), ix);
+
+		__m256 h00 = _mm256_i32gather_ps(grid.heights, cell, 4);
+		__m256 h10 = _mm256_i32gather_ps(grid.heights + 1, cell, 4);
+		__m256 h01 = _mm256_i32gather_ps(grid.heights + grid.w, cell, 4);
+		__m256 h11 = _mm256_i32gather_ps(grid.heights + grid.w + 1, cell, 4);
+
+		__m256 front	= _mm256_add_ps(h00, _mm256_mul_ps(_mm256_sub_ps(h10, h00), tx));
+		__m256 back		= _mm256_add_ps(h01, _mm256_mul_ps(_mm256_sub_ps(h11, h01), tx));
+
+		_mm256_storeu_ps(ground + i - begin, _mm256_add_ps(front, _mm256_mul_ps(_mm256_sub_ps(back, front), tz)));
+	}
+
+	_mm256_zeroupper();
+
+	sampleGridScalar(pos, grid, ground + (i - begin), i, end);
+}
+
+// 8 consecutive particles per iteration
+CLOTH_TARGET("avx2")
+static void contactAVX2(ClothFloat4* pos, const ClothFloat4* prevPos, const float* ground, float offset, float friction, int begin, int end)
+{
+	float* base			= (float*)pos;
+	const float* prev	= (const float*)prevPos;
+	int i = begin;
+
+	const __m256 offset8 = _mm256_set1_ps(offset), friction8 = _mm256_set1_ps(friction);
+	const __m256 zero = _mm256_setzero_ps();
+
+	for (; i + 8 <= end; i += 8)
+	{
+		float* p = base + i * 4;
+
+		__m256 x = loadPair(p, p + 16), y = loadPair(p + 4, p + 20), z = loadPair(p + 8, p + 24), w = loadPair(p + 12, p + 28);
+
+		transpose8(x, y, z, w);
+
+		__m256 surface	= _mm256_add_ps(_mm256_loadu_ps(ground + i - begin), offset8);
+		__m256 lift		= _mm256_and_ps(_mm256_cmp_ps(y, surface, _CMP_LT_OQ), _mm256_cmp_ps(w, zero, _CMP_GT_OQ));
+
+		// Most particles are clear of the ground
+		if (!_mm256_movemask_ps(lift))
+			continue;
+
+		const float* q = prev + i * 4;
+
+		__m256 px = loadPair(q, q + 16), py = loadPair(q + 4, q + 20), pz = loadPair(q + 8, q + 24), pw = loadPair(q + 12, q + 28);
+
+		transpose8(px, py, pz, pw);
+
+		x = _mm256_blendv_ps(x, _mm256_add_ps(x, _mm256_mul_ps(_mm256_sub_ps(px, x), friction8)), lift);
+		y = _mm256_blendv_ps(y, surface, lift);
+		z = _mm256_blendv_ps(z, _mm256_add_ps(z, _mm256_mul_ps(_mm256_sub_ps(pz, z), friction8)), lift);
+
+		transpose8(x, y, z, w);
+
+		storePair(p, p + 16, x); storePair(p + 4, p + 20, y); storePair(p + 8, p + 24, z); storePair(p + 12, p + 28, w);
+	}
+
+	_mm256_zeroupper();
+
+	contactSSE4(pos, prevPos, ground + (i - begin), offset, friction, i, end);
+}
+
+// 8 particles of the block per iteration, each tested against every candidate
+CLOTH_TARGET("avx2")
+static void closestAVX2(const ClothColliderTriangle* triangles, const int* candidates, int candidateCount, ClothQueryBlock& block, int begin, int end)
+{
+	int i = begin;
+
+	const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(block.x + i), y = _mm256_loadu_ps(block.y + i), z = _mm256_loadu_ps(block.z + i);
+		__m256 best = _mm256_loadu_ps(block.best + i);
+		__m256 cx = _mm256_loadu_ps(block.cx + i), cy = _mm256_loadu_ps(block.cy + i), cz = _mm256_loadu_ps(block.cz + i);
+		__m256i nearest = _mm256_loadu_si256((const __m256i*)(block.nearest + i));
+
+		for (int k = 0; k < candidateCount; k++)
+		{
+			const ClothColliderTriangle& t = triangles[candidates[k]];
+
+			__m256 apx = _mm256_sub_ps(x, _mm256_set1_ps(t.a.x));
+			__m256 apy = _mm256_sub_ps(y, _mm256_set1_ps(t.a.y));
+			__m256 apz = _mm256_sub_ps(z, _mm256_set1_ps(t.a.z));
+
+			__m256 plane = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(apx, _mm256_set1_ps(t.normal.x)), _mm256_mul_ps(apy, _mm256_set1_ps(t.normal.y))), _mm256_mul_ps(apz, _mm256_set1_ps(t.normal.z)));
+			__m256 closer = _mm256_cmp_ps(_mm256_mul_ps(plane, plane), best, _CMP_LT_OQ);
+
+			// Most candidates are further than the best so far along their normal
+			if (!_mm256_movemask_ps(closer))
+				continue;
+
+			__m256 abx = _mm256_set1_ps(t.b.x - t.a.x), aby = _mm256_set1_ps(t.b.y - t.a.y), abz = _mm256_set1_ps(t.b.z - t.a.z);
+			__m256 acx = _mm256_set1_ps(t.c.x - t.a.x), acy = _mm256_set1_ps(t.c.y - t.a.y), acz = _mm256_set1_ps(t.c.z - t.a.z);
+
+			__m256 bpx = _mm256_sub_ps(x, _mm256_set1_ps(t.b.x)), bpy = _mm256_sub_ps(y, _mm256_set1_ps(t.b.y)), bpz = _mm256_sub_ps(z, _mm256_set1_ps(t.b.z));
+			__m256 cpx = _mm256_sub_ps(x, _mm256_set1_ps(t.c.x)), cpy = _mm256_sub_ps(y, _mm256_set1_ps(t.c.y)), cpz = _mm256_sub_ps(z, _mm256_set1_ps(t.c.z));
+
+			__m256 d1 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(abx, apx), _mm256_mul_ps(aby, apy)), _mm256_mul_ps(abz, apz));
+			__m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(acx, apx), _mm256_mul_ps(acy, apy)), _mm256_mul_ps(acz, apz));
+			__m256 d3 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(abx, bpx), _mm256_mul_ps(aby, bpy)), _mm256_mul_ps(abz, bpz));
+			__m256 d4 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(acx, bpx), _mm256_mul_ps(acy, bpy)), _mm256_mul_ps(acz, bpz));
+			__m256 d5 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(abx, cpx), _mm256_mul_ps(aby, cpy)), _mm256_mul_ps(abz, cpz));
+			__m256 d6 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(acx, cpx), _mm256_mul_ps(acy, cpy)), _mm256_mul_ps(acz, cpz));
+
+			__m256 va = _mm256_sub_ps(_mm256_mul_ps(d3, d6), _mm256_mul_ps(d5, d4));
+			__m256 vb = _mm256_sub_ps(_mm256_mul_ps(d5, d2), _mm256_mul_ps(d1, d6));
+			__m256 vc = _mm256_sub_ps(_mm256_mul_ps(d1, d4), _mm256_mul_ps(d3, d2));
+
+			__m256 d43 = _mm256_sub_ps(d4, d3), d56 = _mm256_sub_ps(d5, d6);
+
+			// Face region, then each edge and vertex region over it - the regions tested
+			// first by the scalar kernel are blended in last
+			__m256 denom = _mm256_div_ps(one, _mm256_add_ps(_mm256_add_ps(va, vb), vc));
+			__m256 v = _mm256_mul_ps(vb, denom), w = _mm256_mul_ps(vc, denom);
+
+			__m256 edge = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(va, zero, _CMP_LE_OQ), _mm256_cmp_ps(d43, zero, _CMP_GE_OQ)), _mm256_cmp_ps(d56, zero, _CMP_GE_OQ));
+			__m256 wBC = _mm256_div_ps(d43, _mm256_add_ps(d43, d56));
+
+			v = _mm256_blendv_ps(v, _mm256_sub_ps(one, wBC), edge);
+			w = _mm256_blendv_ps(w, wBC, edge);
+
+			edge = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(vb, zero, _CMP_LE_OQ), _mm256_cmp_ps(d2, zero, _CMP_GE_OQ)), _mm256_cmp_ps(d6, zero, _CMP_LE_OQ));
+			v = _mm256_blendv_ps(v, zero, edge);
+			w = _mm256_blendv_ps(w, _mm256_div_ps(d2, _mm256_sub_ps(d2, d6)), edge);
+
+			edge = _mm256_and_ps(_mm256_cmp_ps(d6, zero, _CMP_GE_OQ), _mm256_cmp_ps(d5, d6, _CMP_LE_OQ));
+			v = _mm256_blendv_ps(v, zero, edge);
+			w = _mm256_blendv_ps(w, one, edge);
+
+			edge = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(vc, zero, _CMP_LE_OQ), _mm256_cmp_ps(d1, zero, _CMP_GE_OQ)), _mm256_cmp_ps(d3, zero, _CMP_LE_OQ));
+			v = _mm256_blendv_ps(v, _mm256_div_ps(d1, _mm256_sub_ps(d1, d3)), edge);
+			w = _mm256_blendv_ps(w, zero, edge);
+
+			edge = _mm256_and_ps(_mm256_cmp_ps(d3, zero, _CMP_GE_OQ), _mm256_cmp_ps(d4, d3, _CMP_LE_OQ));
+			v = _mm256_blendv_ps(v, one, edge);
+			w = _mm256_blendv_ps(w, zero, edge);
+
+			edge = _mm256_and_ps(_mm256_cmp_ps(d1, zero, _CMP_LE_OQ), _mm256_cmp_ps(d2, zero, _CMP_LE_OQ));
+			v = _mm256_blendv_ps(v, zero, edge);
+			w = _mm256_blendv_ps(w, zero, edge);
+
+			__m256 qx = _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(t.a.x), _mm256_mul_ps(abx, v)), _mm256_mul_ps(acx, w));
+			__m256 qy = _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(t.a.y), _mm256_mul_ps(aby, v)), _mm256_mul_ps(acy, w));
+			__m256 qz = _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(t.a.z), _mm256_mul_ps(abz, v)), _mm256_mul_ps(acz, w));
+
+			__m256 dx = _mm256_sub_ps(x, qx), dy = _mm256_sub_ps(y, qy), dz = _mm256_sub_ps(z, qz);
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+
+			closer = _mm256_and_ps(closer, _mm256_cmp_ps(distance, best, _CMP_LT_OQ));
+
+			best	= _mm256_blendv_ps(best, distance, closer);
+			cx		= _mm256_blendv_ps(cx, qx, closer);
+			cy		= _mm256_blendv_ps(cy, qy, closer);
+			cz		= _mm256_blendv_ps(cz, qz, closer);
+			nearest	= _mm256_blendv_epi8(nearest, _mm256_set1_epi32(candidates[k]), _mm256_castps_si256(closer));
+		}
+
+		_mm256_storeu_ps(block.best + i, best);
+		_mm256_storeu_ps(block.cx + i, cx); _mm256_storeu_ps(block.cy + i, cy); _mm256_storeu_ps(block.cz + i, cz);
+		_mm256_storeu_si256((__m256i*)(block.nearest + i), nearest);
+	}
+
+	_mm256_zeroupper();
+
+	closestSSE4(triangles, candidates, candidateCount, block, i, end);
+}
+
+// 8 interior columns per iteration, the rest by the SSE4 kernel
+CLOTH_TARGET("avx2")
+static void gridNormalsAVX2(const ClothFloat4* above, const ClothFloat4* row, const ClothFloat4* below, int w, int begin, int end, ClothFloat3* normals)
+{
+	int i = begin;
+
+	if (i == 0 && end > 0)
+		gridNormalsScalar(above, row, below, w, i++, 1, normals);
+
+	int interior = end < w - 1 ? end : w - 1;
+
+	const __m256 zero = _mm256_setzero_ps(), up = _mm256_set1_ps(1.0f);
+
+	for (; i + 8 <= interior; i += 8)
+	{
+		// The rows are scratch copies with no alignment guarantee
+		const float* l = (const float*)(row + i - 1);
+		const float* r = (const float*)(row + i + 1);
+		const float* a = (const float*)(above + i);
+		const float* b = (const float*)(below + i);
+
+		__m256 lx = loadPairUnaligned(l, l + 16), ly = loadPairUnaligned(l + 4, l + 20), lz = loadPairUnaligned(l + 8, l + 24), lw = loadPairUnaligned(l + 12, l + 28);
+		__m256 rx = loadPairUnaligned(r, r + 16), ry = loadPairUnaligned(r + 4, r + 20), rz = loadPairUnaligned(r + 8, r + 24), rw = loadPairUnaligned(r + 12, r + 28);
+		__m256 ax = loadPairUnaligned(a, a + 16), ay = loadPairUnaligned(a + 4, a + 20), az = loadPairUnaligned(a + 8, a + 24), aw = loadPairUnaligned(a + 12, a + 28);
+		__m256 bx = loadPairUnaligned(b, b + 16), by = loadPairUnaligned(b + 4, b + 20), bz = loadPairUnaligned(b + 8, b + 24), bw = loadPairUnaligned(b + 12, b + 28);
+
+		transpose8(lx, ly, lz, lw);
+		transpose8(rx, ry, rz, rw);
+		transpose8(ax, ay, az, aw);
+		transpose8(bx, by, bz, bw);
+
+		__m256 ux = _mm256_sub_ps(rx, lx), uy = _mm256_sub_ps(ry, ly), uz = _mm256_sub_ps(rz, lz);
+		__m256 vx = _mm256_sub_ps(bx, ax), vy = _mm256_sub_ps(by, ay), vz = _mm256_sub_ps(bz, az);
+
+		__m256 nx = _mm256_sub_ps(_mm256_mul_ps(vy, uz), _mm256_mul_ps(vz, uy));
+		__m256 ny = _mm256_sub_ps(_mm256_mul_ps(vz, ux), _mm256_mul_ps(vx, uz));
+		__m256 nz = _mm256_sub_ps(_mm256_mul_ps(vx, uy), _mm256_mul_ps(vy, ux));
+
+		__m256 length	= _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz)));
+		__m256 valid	= _mm256_cmp_ps(length, zero, _CMP_GT_OQ);
+
+		nx = _mm256_blendv_ps(zero, _mm256_div_ps(nx, length), valid);
+		ny = _mm256_blendv_ps(up, _mm256_div_ps(ny, length), valid);
+		nz = _mm256_blendv_ps(zero, _mm256_div_ps(nz, length), valid);
+
+		// Columns i to i + 3 end up in the low halves, i + 4 to i + 7 in the high halves
+		__m256 pad = zero;
+
+		transpose8(nx, ny, nz, pad);
+
+		float* n = (float*)(normals + i);
+
+		storeTriples(n, _mm256_castps256_ps128(nx), _mm256_castps256_ps128(ny), _mm256_castps256_ps128(nz), _mm256_castps256_ps128(pad));
+		storeTriples(n + 12, _mm256_extractf128_ps(nx, 1), _mm256_extractf128_ps(ny, 1), _mm256_extractf128_ps(nz, 1), _mm256_extractf128_ps(pad, 1));
+	}
+
+	_mm256_zeroupper();
+
+	gridNormalsSSE4(above, row, below, w, i, end, normals);
+}
+
+// 8 triangles per iteration - triangles t + j and t + j + 4 share a register while gathered
+CLOTH_TARGET("avx2")
+static void aeroAVX2(const ClothFloat4* pos, const ClothFloat4* flow, const DWORD* indices, float drag, float lift, int begin, int end, ClothFloat4* force)
+{
+	int t = begin;
+
+	const __m256 third = _mm256_set1_ps(1.0f / 3.0f), zero = _mm256_setzero_ps(), sign = _mm256_set1_ps(-0.0f);
+	const __m256 dragScale = _mm256_set1_ps(drag), liftScale = _mm256_set1_ps(lift);
+
+	for (; t + 8 <= end; t += 8)
+	{
+		const DWORD* corner = indices + t * 3;
+
+		// Triangle t + k is in lane k after the transpose, as in attachAVX2
+		__m256 x[3], y[3], z[3], fx[3], fy[3], fz[3];
+
+		for (int k = 0; k < 3; k++)
+		{
+			const float* p = (const float*)pos;
+			const float* f = (const float*)flow;
+
+			__m256 r0 = loadPairUnaligned(p + corner[k] * 4, p + corner[12 + k] * 4), r1 = loadPairUnaligned(p + corner[3 + k] * 4, p + corner[15 + k] * 4);
+			__m256 r2 = loadPairUnaligned(p + corner[6 + k] * 4, p + corner[18 + k] * 4), r3 = loadPairUnaligned(p + corner[9 + k] * 4, p + corner[21 + k] * 4);
+
+			transpose8(r0, r1, r2, r3);
+
+			x[k] = r0; y[k] = r1; z[k] = r2;
+
+			r0 = loadPairUnaligned(f + corner[k] * 4, f + corner[12 + k] * 4); r1 = loadPairUnaligned(f + corner[3 + k] * 4, f + corner[15 + k] * 4);
+			r2 = loadPairUnaligned(f + corner[6 + k] * 4, f + corner[18 + k] * 4); r3 = loadPairUnaligned(f + corner[9 + k] * 4, f + corner[21 + k] * 4);
+
+			transpose8(r0, r1, r2, r3);
+
+			fx[k] = r0; fy[k] = r1; fz[k] = r2;
+		}
+
+		__m256 ux = _mm256_sub_ps(x[1], x[0]), uy = _mm256_sub_ps(y[1], y[0]), uz = _mm256_sub_ps(z[1], z[0]);
+		__m256 wx = _mm256_sub_ps(x[2], x[0]), wy = _mm256_sub_ps(y[2], y[0]), wz = _mm256_sub_ps(z[2], z[0]);
+
+		__m256 nx = _mm256_sub_ps(_mm256_mul_ps(uy, wz), _mm256_mul_ps(uz, wy));
+		__m256 ny = _mm256_sub_ps(_mm256_mul_ps(uz, wx), _mm256_mul_ps(ux, wz));
+		__m256 nz = _mm256_sub_ps(_mm256_mul_ps(ux, wy), _mm256_mul_ps(uy, wx));
+
+		__m256 vx = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(fx[0], fx[1]), fx[2]), third);
+		__m256 vy = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(fy[0], fy[1]), fy[2]), third);
+		__m256 vz = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(fz[0], fz[1]), fz[2]), third);
+
+		__m256 vn = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, vx), _mm256_mul_ps(ny, vy)), _mm256_mul_ps(nz, vz));
+		__m256 vv = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)), _mm256_mul_ps(vz, vz));
+		__m256 nn = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz));
+
+		__m256 d		= _mm256_mul_ps(dragScale, _mm256_andnot_ps(sign, vn));
+		__m256 denom	= _mm256_mul_ps(_mm256_sqrt_ps(nn), _mm256_sqrt_ps(vv));
+		__m256 l		= _mm256_blendv_ps(zero, _mm256_div_ps(_mm256_mul_ps(liftScale, vn), denom), _mm256_cmp_ps(denom, zero, _CMP_GT_OQ));
+
+		__m256 rx = _mm256_xor_ps(sign, _mm256_add_ps(_mm256_mul_ps(d, vx), _mm256_mul_ps(l, _mm256_sub_ps(_mm256_mul_ps(vv, nx), _mm256_mul_ps(vn, vx)))));
+		__m256 ry = _mm256_xor_ps(sign, _mm256_add_ps(_mm256_mul_ps(d, vy), _mm256_mul_ps(l, _mm256_sub_ps(_mm256_mul_ps(vv, ny), _mm256_mul_ps(vn, vy)))));
+		__m256 rz = _mm256_xor_ps(sign, _mm256_add_ps(_mm256_mul_ps(d, vz), _mm256_mul_ps(l, _mm256_sub_ps(_mm256_mul_ps(vv, nz), _mm256_mul_ps(vn, vz)))));
+		__m256 rw = zero;
+
+		// Back to triangles t + j (low halves) and t + j + 4 (high halves) in register j
+		transpose8(rx, ry, rz, rw);
+
+		float* f = (float*)(force + t);
+
+		_mm_storeu_ps(f, _mm256_castps256_ps128(rx)); _mm_storeu_ps(f + 16, _mm256_extractf128_ps(rx, 1));
+		_mm_storeu_ps(f + 4, _mm256_castps256_ps128(ry)); _mm_storeu_ps(f + 20, _mm256_extractf128_ps(ry, 1));
+		_mm_storeu_ps(f + 8, _mm256_castps256_ps128(rz)); _mm_storeu_ps(f + 24, _mm256_extractf128_ps(rz, 1));
+		_mm_storeu_ps(f + 12, _mm256_castps256_ps128(rw)); _mm_storeu_ps(f + 28, _mm256_extractf128_ps(rw, 1));
+	}
+
+	_mm256_zeroupper();
+
+	aeroSSE4(pos, flow, indices, drag, lift, t, end, force);
+}
+
+
+#pragma endregion
+
+#if CLOTH_AVX512
+
+#pragma region AVX-512
+
+// In-lane 4x4 transpose of four particles per register (self inverse)
+CLOTH_TARGET("avx512f")
+static inline void transpose16(__m512& r0, __m512& r1, __m512& r2, __m512& r3)
+{
+	__m512 t0 = _mm512_unpacklo_ps(r0, r1);
+	__m512 t1 = _mm512_unpacklo_ps(r2, r3);
+	__m512 t2 = _mm512_unpackhi_ps(r0, r1);
+	__m512 t3 = _mm512_unpackhi_ps(r2, r3);
+
+	r0 = _mm512_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+	r1 = _mm512_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+	r2 = _mm512_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	r3 = _mm512_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+CLOTH_TARGET("avx512f")
+static inline __m512 loadQuad(float* const* p, int i)
+{
+	__m512 v = _mm512_castps128_ps512(_mm_load_ps(p[i]));
+
+	v = _mm512_insertf32x4(v, _mm_load_ps(p[i + 4]), 1);
+	v = _mm512_insertf32x4(v, _mm_load_ps(p[i + 8]), 2);
+	return _mm512_insertf32x4(v, _mm_load_ps(p[i + 12]), 3);
+}
+
+CLOTH_TARGET("avx512f")
+static inline void storeQuad(float* const* p, int i, __m512 v)
+{
+	_mm_store_ps(p[i], _mm512_castps512_ps128(v));
+	_mm_store_ps(p[i + 4], _mm512_extractf32x4_ps(v, 1));
+	_mm_store_ps(p[i + 8], _mm512_extractf32x4_ps(v, 2));
+	_mm_store_ps(p[i + 12], _mm512_extractf32x4_ps(v, 3));
+}
+
+// 16 constraints per iteration - four particles share a register so the
+// transposes stay within 128 bit lanes. Gathering and scattering single
+// floats was measured slower than the AVX2 kernel, so the particles are
+// moved as whole 16 byte elements and only the rest lengths are gathered.
+CLOTH_TARGET("avx512f")
+static void projectBatchAVX512(ClothFloat4* pos, const Constraint* batch, int begin, int end, ClothResidual* residual)
+{
+	float* base = (float*)pos;
+	int c = begin;
+
+	// Constraint fields are 3 ints apart
+	const __m512i fieldOffsets = _mm512_setr_epi32(0, 3, 6, 9, 12, 15, 18, 21, 24, 27, 30, 33, 36, 39, 42, 45);
+
+	__m512 sumSquared = _mm512_setzero_ps(), maximum = _mm512_setzero_ps();
+
+	for (; c + 16 <= end; c += 16)
+	{
+		const Constraint* q = batch + c;
+
+		float* s[16];
+		float* e[16];
+
+		for (int i = 0; i < 16; i++)
+		{
+			s[i] = base + q[i].start * 4;
+			e[i] = base + q[i].end * 4;
+		}
+
+		// Lane order after the transpose is constraint 0..15
+		__m512 x1 = loadQuad(s, 0), y1 = loadQuad(s, 1), z1 = loadQuad(s, 2), w1 = loadQuad(s, 3);
+		__m512 x2 = loadQuad(e, 0), y2 = loadQuad(e, 1), z2 = loadQuad(e, 2), w2 = loadQuad(e, 3);
+
+		transpose16(x1, y1, z1, w1);
+		transpose16(x2, y2, z2, w2);
+
+		__m512 length = _mm512_i32gather_ps(fieldOffsets, &q[0].length, 4);
+
+		__m512 dx = _mm512_sub_ps(x1, x2);
+		__m512 dy = _mm512_sub_ps(y1, y2);
+		__m512 dz = _mm512_sub_ps(z1, z2);
+
+		__m512 distance	= _mm512_sqrt_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_mul_ps(dz, dz)));
+		__m512 weight	= _mm512_add_ps(w1, w2);
+
+		// Violation before the projection
+		__m512 violation = _mm512_abs_ps(_mm512_sub_ps(distance, length));
+
+		sumSquared = _mm512_add_ps(sumSquared, _mm512_mul_ps(violation, violation));
+		maximum = _mm512_max_ps(maximum, violation);
+
+		// Degenerate constraints get a zero correction
+		__m512 zero		= _mm512_setzero_ps();
+		__mmask16 valid	= _mm512_cmp_ps_mask(distance, zero, _CMP_GT_OQ) & _mm512_cmp_ps_mask(weight, zero, _CMP_GT_OQ);
+
+		__m512 stretching = _mm512_maskz_div_ps(valid, _mm512_sub_ps(distance, length), _mm512_mul_ps(distance, weight));
+
+		dx = _mm512_mul_ps(dx, stretching);
+		dy = _mm512_mul_ps(dy, stretching);
+		dz = _mm512_mul_ps(dz, stretching);
+
+		x1 = _mm512_sub_ps(x1, _mm512_mul_ps(dx, w1));
+		y1 = _mm512_sub_ps(y1, _mm512_mul_ps(dy, w1));
+		z1 = _mm512_sub_ps(z1, _mm512_mul_ps(dz, w1));
+
+		x2 = _mm512_add_ps(x2, _mm512_mul_ps(dx, w2));
+		y2 = _mm512_add_ps(y2, _mm512_mul_ps(dy, w2));
+		z2 = _mm512_add_ps(z2, _mm512_mul_ps(dz, w2));
+
+		transpose16(x1, y1, z1, w1);
+		transpose16(x2, y2, z2, w2);
+
+		storeQuad(s, 0, x1); storeQuad(s, 1, y1); storeQuad(s, 2, z1); storeQuad(s, 3, w1);
+		storeQuad(e, 0, x2); storeQuad(e, 1, y2); storeQuad(e, 2, z2); storeQuad(e, 3, w2);
+	}
+
+	float sums[16], maxima[16];
+
+	_mm512_storeu_ps(sums, sumSquared);
+	_mm512_storeu_ps(maxima, maximum);
+
+	addResidual(residual, sumLanes(sums, 16), maxLanes(maxima, 16));
+
+	projectBatchAVX2(pos, batch, c, end, residual);
+}
+
+#pragma endregion
+
+#endif
+
+#pragma region CPU detection
+
+static void cpuid(int leaf, int subleaf, unsigned int regs[4])
+{
+#if defined(_MSC_VER)
+	__cpuidex((int*)regs, leaf, subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static unsigned long long xgetbv0()
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+
+static ClothIsa detectIsa()
+{
+	unsigned int regs[4];
+
+	cpuid(0, 0, regs);
+	unsigned int maxLeaf = regs[0];
+
+	cpuid(1, 0, regs);
+
+	bool sse41		= (regs[2] & (1 << 19)) != 0;
+	bool osxsave	= (regs[2] & (1 << 27)) != 0;
+	bool avx		= (regs[2] & (1 << 28)) != 0;
+
+	if (!sse41)
+		return CLOTH_ISA_SCALAR;
+
+	// The OS must save the YMM (and ZMM) registers on context switches
+	if (!osxsave || !avx || maxLeaf < 7)
+		return CLOTH_ISA_SSE4;
+
+	unsigned long long xcr0 = xgetbv0();
+
+	if ((xcr0 & 0x6) != 0x6)
+		return CLOTH_ISA_SSE4;
+
+	cpuid(7, 0, regs);
+
+	bool avx2		= (regs[1] & (1 << 5)) != 0;
+	bool avx512f	= (regs[1] & (1 << 16)) != 0;
+
+	if (!avx2)
+		return CLOTH_ISA_SSE4;
+
+	if (CLOTH_AVX512 && avx512f && (xcr0 & 0xe6) == 0xe6)
+		return CLOTH_ISA_AVX512;
+
+	return CLOTH_ISA_AVX2;
+}
+
+#pragma endregion
+
+#endif
+
+// Best ISA
+ClothIsa ClothKernels::bestIsa()
+{
+#if CLOTH_X86
+	static const ClothIsa best = detectIsa();
+
+	return best;
+#else
+	return CLOTH_ISA_SCALAR;
+#endif
+}
+
+// ISA supported
+bool ClothKernels::isaSupported(ClothIsa isa)
+{
+	return isa >= CLOTH_ISA_SCALAR && isa <= bestIsa();
+}
+
+// ISA name
+const char* ClothKernels::isaName(ClothIsa isa)
+{
+	switch (isa)
+	{
+		case CLOTH_ISA_SCALAR:	return "Scalar";
+		case CLOTH_ISA_SSE4:	return "SSE4";
+		case CLOTH_ISA_AVX2:	return "AVX2";
+		case CLOTH_ISA_AVX512:	return "AVX-512";
+		default:				return "Unknown";
+	}
+}
+
+// Projection kernel
+ClothProjectBatchFn ClothKernels::projectBatch(ClothIsa isa)
+{
+	if (!isaSupported(isa))
+		isa = bestIsa();
+
+	switch (isa)
+	{
+#if CLOTH_X86
+		case CLOTH_ISA_SSE4:	return projectBatchSSE4;
+		case CLOTH_ISA_AVX2:	return projectBatchAVX2;
+#if CLOTH_AVX512
+		case CLOTH_ISA_AVX512:	return projectBatchAVX512;
+#endif
+#endif
+		default:				return projectBatchScalar;
+	}
+}
+
+// XPBD projection kernel
+ClothProjectBatchXPBDFn ClothKernels::projectBatchXPBD(ClothIsa isa)
+{
+	if (!isaSupported(isa))
+		isa = bestIsa();
+
+	// The XPBD kernels stop at AVX2 - the particle loads dominate and the AVX-512
+	// PBD kernel is barely ahead of AVX2
+	switch (isa)
+	{
+#if CLOTH_X86
+		case CLOTH_ISA_SSE4:	return projectBatchXPBDSSE4;
+		case CLOTH_ISA_AVX2:
+		case CLOTH_ISA_AVX512:	return projectBatchXPBDAVX2;
+#endif
+		default:				return projectBatchXPBDScalar;
+	}
+}
+
+// Attachment kernel
+ClothAttachFn ClothKernels::attach(ClothIsa isa)
+{
+	if (!isaSupported(isa))
+		isa = bestIsa();
+
+	// Consecutive particles need no gathers - AVX-512 would only widen the transposes
+	switch (isa)
+	{
+#if CLOTH_X86
+		case CLOTH_ISA_SSE4:	return attachSSE4;
+		case CLOTH_ISA_AVX2:
+		case CLOTH_ISA_AVX512:	return attachAVX2;
+#endif
+		default:				return attachScalar;
+	}
+}
+
+// Height grid sampling kernel
+ClothSampleGridFn ClothKernels::sampleGrid(ClothIsa isa)
+{
+	if (!isaSupported(isa))
+		isa = bestIsa();
+
+	switch (isa)
+	{
+#if CLOTH_X86
+		case CLOTH_ISA_AVX2:
+		case CLOTH_ISA_AVX512:	return sampleGridAVX2;
+#endif
+		default:				return sampleGridScalar;
+	}
+}
+
+// Ground contact kernel
+ClothContactFn ClothKernels::contact(ClothIsa isa)
+{
+	if (!isaSupported(isa))
+		isa = bestIsa();
+
+	switch (isa)
+	{
+#if CLOTH_X86
+		case CLOTH_ISA_SSE4:	return contactSSE4;
+		case CLOTH_ISA_AVX2:
+		case CLOTH_ISA_AVX512:	return contactAVX2;
+#endif
+		default:				return contactScalar;
+	}
+}
+
+// Closest point query kernel
+ClothClosestFn ClothKernels::closest(ClothIsa isa)
+{
+	if (!isaSupported(isa))
+		isa = bestIsa();
+
+	switch (isa)
+	{
+#if CLOTH_X86
+		case CLOTH_ISA_SSE4:	return closestSSE4;
+		case CLOTH_ISA_AVX2:
+		case CLOTH_ISA_AVX512:	return closestAVX2;
+#endif
+		default:				return closestScalar;
+	}
+}
+
+// Grid normals kernel
+ClothGridNormalsFn ClothKernels::gridNormals(ClothIsa isa)
+{
+	if (!isaSupported(isa))
+		isa = bestIsa();
+
+	switch (isa)
+	{
+#if CLOTH_X86
+		case CLOTH_ISA_SSE4:	return gridNormalsSSE4;
+		case CLOTH_ISA_AVX2:
+		case CLOTH_ISA_AVX512:	return gridNormalsAVX2;
+#endif
+		default:				return gridNormalsScalar;
+	}
+}
+
+// Aerodynamics kernel
+ClothAeroFn ClothKernels::aero(ClothIsa isa)
+{
+	if (!isaSupported(isa))
+		isa = bestIsa();
+
+	switch (isa)
+	{
+#if CLOTH_X86
+		case CLOTH_ISA_SSE4:	return aeroSSE4;
+		case CLOTH_ISA_AVX2:
+		case CLOTH_ISA_AVX512:	return aeroAVX2;
+#endif
+		default:				return aeroScalar;
+	}
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "ClothTypes.h"
+
+
+// Instruction sets the CPU kernels are compiled for
+enum ClothIsa
+{
+	CLOTH_ISA_SCALAR,
+	CLOTH_ISA_SSE4,
+	CLOTH_ISA_AVX2,
+	CLOTH_ISA_AVX512,
+
+	CLOTH_ISA_COUNT
+};
+
+
+// Constraint violation |distance - rest length| gathered by the projection kernels,
+// measured before each constraint is projected
+struct ClothResidual
+{
+	float	sumSquared;
+	float	maximum;
+};
+
+
+// Project constraints [begin, end) of a batch onto the particle positions (w = inverse mass).
+// The constraints must not share particles, which every cloth batch guarantees.
+typedef void (*ClothProjectBatchFn)(ClothFloat4* pos, const Constraint* batch, int begin, int end, ClothResidual* residual);
+
+// XPBD variant - compliance and lambda are indexed like batch, and alphaScale is 1 / h^2
+// for a substep of length h. With zero compliance it reduces to the PBD projection.
+typedef void (*ClothProjectBatchXPBDFn)(ClothFloat4* pos, const Constraint* batch, const float* compliance, float* lambda, float alphaScale, int begin, int end, ClothResidual* residual);
+
+// Long range attachment - pull each movable particle i in [begin, end) back to at most
+// tether[i] from the pinned particle anchor[i]. Particles within reach are left untouched.
+typedef void (*ClothAttachFn)(ClothFloat4* pos, const int* anchor, const float* tether, int begin, int end);
+
+
+// Baked height grid - w x h heights cellSize apart from (x0, z0), row by row along z
+struct ClothHeightGrid
+{
+	const float*	heights;
+	int				w, h;
+	float			x0, z0;
+	float			invCellSize;
+};
+
+// Bilinear ground height under particles [begin, end) into ground[i - begin], clamped to the grid edges
+typedef void (*ClothSampleGridFn)(const ClothFloat4* pos, const ClothHeightGrid& grid, float* ground, int begin, int end);
+
+// Lift each movable particle i in [begin, end) below ground[i - begin] + offset onto it, and pull
+// it friction (0 to 1) of the way back to prevPos across the ground
+typedef void (*ClothContactFn)(ClothFloat4* pos, const ClothFloat4* prevPos, const float* ground, float offset, float friction, int begin, int end);
+
+
+// Collider triangle with its unit normal (zero for a degenerate triangle)
+struct ClothColliderTriangle
+{
+	ClothFloat3	a, b, c;
+	ClothFloat3	normal;
+};
+
+// Most particles in one mesh collision query block
+#define CLOTH_QUERY_BLOCK 32
+
+// Particles of a mesh collision query, one lane each, with the nearest triangle found so far
+struct ClothQueryBlock
+{
+	float	x[CLOTH_QUERY_BLOCK], y[CLOTH_QUERY_BLOCK], z[CLOTH_QUERY_BLOCK];
+
+	// Squared distance to the nearest triangle (start at the squared search radius), the
+	// closest point on it and its index (start at -1)
+	float	best[CLOTH_QUERY_BLOCK];
+	float	cx[CLOTH_QUERY_BLOCK], cy[CLOTH_QUERY_BLOCK], cz[CLOTH_QUERY_BLOCK];
+	int		nearest[CLOTH_QUERY_BLOCK];
+};
+
+// Test the lanes [begin, end) of a query block against the candidate triangles, keeping
+// the nearest one closer than best for each lane
+typedef void (*ClothClosestFn)(const ClothColliderTriangle* triangles, const int* candidates, int candidateCount, ClothQueryBlock& block, int begin, int end);
+
+
+// Unit normals of columns [begin, end) of a w wide grid row into normals[i], from the
+// positions of the row and of the rows above and below it (the row itself at the edges)
+typedef void (*ClothGridNormalsFn)(const ClothFloat4* above, const ClothFloat4* row, const ClothFloat4* below, int w, int begin, int end, ClothFloat3* normals);
+
+
+// Aerodynamic force on each corner of triangles [begin, end) into force[t] (w = 0), from the
+// corner positions and the velocity of each particle relative to the air (flow). Drag opposes
+// the mean relative velocity v in proportion to the area facing it, lift pushes across v -
+// drag and lift scale the two against the raw cross product of the edges, and so fold in
+// the air density, the coefficients and the share of each corner.
+typedef void (*ClothAeroFn)(const ClothFloat4* pos, const ClothFloat4* flow, const DWORD* indices, float drag, float lift, int begin, int end, ClothFloat4* force);
+
+
+// Runtime dispatch of the vectorised CPU cloth kernels.
+// Every ISA performs the same operations in the same order as the scalar
+// kernel without fused multiply-adds, so the results match it bit for bit
+// apart from denormal handling.
+class ClothKernels
+{
+public:
+	// Best instruction set supported by the CPU and the OS
+	static ClothIsa bestIsa();
+
+	// Whether the kernels for isa were compiled in and can run here
+	static bool isaSupported(ClothIsa isa);
+
+	// Display name of isa
+	static const char* isaName(ClothIsa isa);
+
+	// Distance constraint projection kernel for isa (falls back to the best supported one)
+	static ClothProjectBatchFn projectBatch(ClothIsa isa);
+
+	// XPBD constraint projection kernel for isa (falls back to the best supported one)
+	static ClothProjectBatchXPBDFn projectBatchXPBD(ClothIsa isa);
+
+	// Long range attachment kernel for isa (falls back to the best supported one)
+	static ClothAttachFn attach(ClothIsa isa);
+
+	// Height grid sampling and ground contact kernels for isa (fall back to the best supported one)
+	static ClothSampleGridFn sampleGrid(ClothIsa isa);
+	static ClothContactFn contact(ClothIsa isa);
+
+	// Closest point query kernel for isa (falls back to the best supported one)
+	static ClothClosestFn closest(ClothIsa isa);
+
+	// Grid normals kernel for isa (falls back to the best supported one)
+	static ClothGridNormalsFn gridNormals(ClothIsa isa);
+
+	// Triangle aerodynamics kernel for isa (falls back to the best supported one)
+	static ClothAeroFn aero(ClothIsa isa);
+};
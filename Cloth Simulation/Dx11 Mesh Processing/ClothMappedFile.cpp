@@ -0,0 +1,185 @@
+#include "ClothMappedFile.h"
+#include "ClothFpContract.h"
+#include <stdio.h>
+
+#if defined(_WIN32)
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
+
+
+// Constructor
+ClothMappedFile::ClothMappedFile()
+{
+	view	= nullptr;
+	length	= 0;
+	file	= nullptr;
+	mapping	= nullptr;
+}
+
+// Destructor
+ClothMappedFile::~ClothMappedFile()
+{
+	close();
+}
+
+#if defined(_WIN32)
+
+// Open
+bool ClothMappedFile::open(const char* path)
+{
+	close();
+
+	if (!path)
+		return false;
+
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (handle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+
+	if (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart <= 0 || (unsigned long long)fileSize.QuadPart > (size_t)-1)
+	{
+		CloseHandle(handle);
+		return false;
+	}
+
+	HANDLE section = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	if (!section)
+	{
+		CloseHandle(handle);
+		return false;
+	}
+
+	const void* bytes = MapViewOfFile(section, FILE_MAP_READ, 0, 0, 0);
+
+	if (!bytes)
+	{
+		CloseHandle(section);
+		CloseHandle(handle);
+		return false;
+	}
+
+	file	= handle;
+	mapping	= section;
+	view	= bytes;
+	length	= (size_t)fileSize.QuadPart;
+
+	return true;
+}
+
+// Close
+void ClothMappedFile::close()
+{
+	if (view)
+		UnmapViewOfFile(view);
+
+	if (mapping)
+		CloseHandle((HANDLE)mapping);
+
+	if (file)
+		CloseHandle((HANDLE)file);
+
+	view	= nullptr;
+	length	= 0;
+	file	= nullptr;
+	mapping	= nullptr;
+}
+
+#else
+
+// Open
+bool ClothMappedFile::open(const char* path)
+{
+	close();
+
+	if (!path)
+		return false;
+
+	int descriptor = ::open(path, O_RDONLY);
+
+	if (descriptor < 0)
+		return false;
+
+	struct stat status;
+
+	if (fstat(descriptor, &status) != 0 || status.st_size <= 0)
+	{
+		::close(descriptor);
+		return false;
+	}
+
+	void* bytes = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+
+	// The mapping stays valid once the descriptor is closed
+	::close(descriptor);
+
+	if (bytes == MAP_FAILED)
+		return false;
+
+	view	= bytes;
+	length	= (size_t)status.st_size;
+
+	return true;
+}
+
+// Close
+void ClothMappedFile::close()
+{
+	if (view)
+		munmap((void*)view, length);
+
+	view	= nullptr;
+	length	= 0;
+}
+
+#endif
+
+// Data
+const void* ClothMappedFile::data() const
+{
+	return view;
+}
+
+// Size
+size_t ClothMappedFile::size() const
+{
+	return length;
+}
+
+// Write
+bool ClothMappedFile::write(const char* path, const void* bytes, size_t size)
+{
+	if (!path || !bytes)
+		return false;
+
+	FILE* fp = nullptr;
+
+#if defined(_MSC_VER)
+	if (fopen_s(&fp, path, "wb") != 0)
+		fp = nullptr;
+#else
+	fp = fopen(path, "wb");
+#endif
+
+	if (!fp)
+		return false;
+
+	bool written = fwrite(bytes, 1, size, fp) == size;
+
+	// A cache left incomplete would be rejected when read, but remove it anyway
+	if (fclose(fp) != 0 || !written)
+	{
+		remove(path);
+		return false;
+	}
+
+	return true;
+}
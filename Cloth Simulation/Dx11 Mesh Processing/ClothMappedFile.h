@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+
+
+// Read only view of a whole file mapped into memory, for the caches the CPU cloth
+// keeps on disk. The pages are only read in as they are touched, so a cache can be
+// used straight from the mapping without loading or copying it first.
+class ClothMappedFile
+{
+private:
+	const void*	view;
+	size_t		length;
+
+	// Operating system handles of the open file and its mapping
+	void*		file;
+	void*		mapping;
+
+	// Copying would unmap the view twice
+	ClothMappedFile(const ClothMappedFile&);
+	ClothMappedFile& operator=(const ClothMappedFile&);
+
+public:
+	// Constructor - nothing mapped
+	ClothMappedFile();
+	// Destructor
+	~ClothMappedFile();
+
+	// Map the file at path, replacing any open view - false if it cannot be opened or is empty
+	bool open(const char* path);
+	void close();
+
+	// Mapped bytes (nullptr and 0 while closed)
+	const void* data() const;
+	size_t size() const;
+
+	// Write size bytes to the file at path, replacing it - false on failure
+	static bool write(const char* path, const void* bytes, size_t size);
+};
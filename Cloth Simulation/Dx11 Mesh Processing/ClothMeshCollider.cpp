@@ -0,0 +1,692 @@
+#include "ClothMeshCollider.h"
+#include "ClothFpContract.h"
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+using namespace std;
+
+// SAH bins along the widest axis of a node, and the leaf sizes - a node of at most minLeafSize triangles is
+// always a leaf, one of up to maxLeafSize is a leaf when splitting it costs more
+static const int binCount			= 16;
+static const int minLeafSize		= 2;
+static const int maxLeafSize		= 16;
+
+// Nodes of at least this many triangles are binned with a parallelFor over the triangles,
+// smaller ones are split in parallel with each other
+static const int parallelNodeSize	= 32768;
+static const int triangleGrain		= 4096;
+static const int nodeGrain			= 16;
+
+// Deepest walk and most triangles gathered for one block of particles
+static const int stackSize			= 64;
+static const int maxCandidates		= 256;
+
+
+#pragma region Helpers
+
+// Axis aligned box
+struct ClothBox
+{
+	ClothFloat3 lower, upper;
+};
+
+// Box and centroid bounds of the triangles falling in a bin
+struct ClothBin
+{
+	ClothBox	bounds;
+	ClothBox	centroids;
+	int			count;
+};
+
+// Node waiting to be split - its triangles [first, first + count) of the build order
+struct ClothBuildTask
+{
+	int			node;
+	int			first;
+	int			count;
+	ClothBox	bounds;
+	ClothBox	centroids;
+};
+
+// Outcome of splitting a node - the triangles [first, mid) went left
+struct ClothSplit
+{
+	bool		leaf;
+	int			mid;
+	ClothBox	left, right;
+	ClothBox	leftCentroids, rightCentroids;
+};
+
+static inline float component(const ClothFloat3& v, int axis)
+{
+	return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+static inline ClothFloat3 sub(const ClothFloat3& a, const ClothFloat3& b)
+{
+	return ClothFloat3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static inline float dot(const ClothFloat3& a, const ClothFloat3& b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static ClothBox emptyBox()
+{
+	ClothBox box;
+
+	box.lower = ClothFloat3(FLT_MAX, FLT_MAX, FLT_MAX);
+	box.upper = ClothFloat3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+	return box;
+}
+
+static void grow(ClothBox& box, const ClothFloat3& p)
+{
+	box.lower = ClothFloat3(min(box.lower.x, p.x), min(box.lower.y, p.y), min(box.lower.z, p.z));
+	box.upper = ClothFloat3(max(box.upper.x, p.x), max(box.upper.y, p.y), max(box.upper.z, p.z));
+}
+
+static void grow(ClothBox& box, const ClothBox& other)
+{
+	box.lower = ClothFloat3(min(box.lower.x, other.lower.x), min(box.lower.y, other.lower.y), min(box.lower.z, other.lower.z));
+	box.upper = ClothFloat3(max(box.upper.x, other.upper.x), max(box.upper.y, other.upper.y), max(box.upper.z, other.upper.z));
+}
+
+// Half the surface area - the SAH only compares areas
+static float area(const ClothBox& box)
+{
+	if (box.upper.x < box.lower.x)
+		return 0.0f;
+
+	float dx = box.upper.x - box.lower.x;
+	float dy = box.upper.y - box.lower.y;
+	float dz = box.upper.z - box.lower.z;
+
+	return dx * dy + dy * dz + dz * dx;
+}
+
+// Squared distance from p to the box of a node (0 inside it)
+static inline float boxDistance(const ClothFloat3& p, const ClothBvhNode& node)
+{
+	float dx = max(max(node.lower.x - p.x, p.x - node.upper.x), 0.0f);
+	float dy = max(max(node.lower.y - p.y, p.y - node.upper.y), 0.0f);
+	float dz = max(max(node.lower.z - p.z, p.z - node.upper.z), 0.0f);
+
+	return dx * dx + dy * dy + dz * dz;
+}
+
+static inline bool overlaps(const ClothFloat3& lower, const ClothFloat3& upper, const ClothBvhNode& node)
+{
+	return lower.x <= node.upper.x && upper.x >= node.lower.x
+		&& lower.y <= node.upper.y && upper.y >= node.lower.y
+		&& lower.z <= node.upper.z && upper.z >= node.lower.z;
+}
+
+// Bin of a centroid along an axis
+static inline int binIndex(float c, float lower, float scale)
+{
+	int b = (int)((c - lower) * scale);
+
+	return b < 0 ? 0 : (b >= binCount ? binCount - 1 : b);
+}
+
+// Widest axis of a box
+static int widestAxis(const ClothBox& box)
+{
+	float dx = box.upper.x - box.lower.x;
+	float dy = box.upper.y - box.lower.y;
+	float dz = box.upper.z - box.lower.z;
+
+	return (dx >= dy && dx >= dz) ? 0 : (dy >= dz ? 1 : 2);
+}
+
+// Bin the triangles order[begin, end) along the widest axis of their centroid bounds
+static void binTriangles(const int* order, int begin, int end, const ClothBox* triangleBounds, const ClothFloat3* centroid, const ClothBox& centroids, ClothBin* bins)
+{
+	for (int b = 0; b < binCount; b++)
+	{
+		bins[b].bounds		= emptyBox();
+		bins[b].centroids	= emptyBox();
+		bins[b].count		= 0;
+	}
+
+	int axis		= widestAxis(centroids);
+	float lower		= component(centroids.lower, axis);
+	float extent	= component(centroids.upper, axis) - lower;
+
+	if (extent <= 0.0f)
+		return;
+
+	float scale = (float)binCount / extent;
+
+	for (int i = begin; i < end; i++)
+	{
+		int t = order[i];
+		ClothBin& bin = bins[binIndex(component(centroid[t], axis), lower, scale)];
+
+		grow(bin.bounds, triangleBounds[t]);
+		grow(bin.centroids, centroid[t]);
+		bin.count++;
+	}
+}
+
+// Cheapest SAH split plane between the bins - false if every triangle fell in one bin
+static bool chooseSplit(const ClothBin* bins, int& bestBin, float& bestCost)
+{
+	bestBin		= 0;
+	bestCost	= FLT_MAX;
+
+	// Area and count of everything right of each plane, swept from the right
+	float rightArea[binCount];
+	int rightCount[binCount];
+	ClothBox box = emptyBox();
+	int count = 0;
+
+	for (int b = binCount - 1; b > 0; b--)
+	{
+		grow(box, bins[b].bounds);
+		count += bins[b].count;
+
+		rightArea[b]	= area(box);
+		rightCount[b]	= count;
+	}
+
+	box		= emptyBox();
+	count	= 0;
+
+	for (int b = 1; b < binCount; b++)
+	{
+		grow(box, bins[b - 1].bounds);
+		count += bins[b - 1].count;
+
+		if (count == 0 || rightCount[b] == 0)
+			continue;
+
+		float cost = area(box) * (float)count + rightArea[b] * (float)rightCount[b];
+
+		if (cost < bestCost)
+		{
+			bestBin		= b;
+			bestCost	= cost;
+		}
+	}
+
+	return bestBin > 0;
+}
+
+// Split a node in half at its median centroid - for triangles the bins cannot separate
+static ClothSplit medianSplit(const ClothBuildTask& task, int* order, const ClothBox* triangleBounds, const ClothFloat3* centroid)
+{
+	ClothSplit split;
+
+	int axis = widestAxis(task.centroids);
+
+	split.leaf	= false;
+	split.mid	= task.first + task.count / 2;
+
+	nth_element(order + task.first, order + split.mid, order + task.first + task.count, [=](int t1, int t2)
+	{
+		return component(centroid[t1], axis) < component(centroid[t2], axis);
+	});
+
+	split.left				= emptyBox();
+	split.right				= emptyBox();
+	split.leftCentroids		= emptyBox();
+	split.rightCentroids	= emptyBox();
+
+	for (int i = task.first; i < task.first + task.count; i++)
+	{
+		int t = order[i];
+
+		grow(i < split.mid ? split.left : split.right, triangleBounds[t]);
+		grow(i < split.mid ? split.leftCentroids : split.rightCentroids, centroid[t]);
+	}
+
+	return split;
+}
+
+// Split a node at the cheapest plane of its bins, partitioning its triangles in place
+static ClothSplit splitNode(const ClothBuildTask& task, const ClothBin* bins, int* order, const ClothBox* triangleBounds, const ClothFloat3* centroid)
+{
+	ClothSplit split;
+
+	split.leaf	= true;
+	split.mid	= task.first;
+
+	if (task.count <= minLeafSize)
+		return split;
+
+	int plane;
+	float cost;
+
+	if (!chooseSplit(bins, plane, cost))
+		return task.count > maxLeafSize ? medianSplit(task, order, triangleBounds, centroid) : split;
+
+	// Traversal of the node costs about as much as testing one triangle
+	float nodeArea = area(task.bounds);
+
+	if (task.count <= maxLeafSize && nodeArea + cost >= nodeArea * (float)task.count)
+		return split;
+
+	int axis	= widestAxis(task.centroids);
+	float lower	= component(task.centroids.lower, axis);
+	float scale	= (float)binCount / (component(task.centroids.upper, axis) - lower);
+
+	int* middle = partition(order + task.first, order + task.first + task.count, [=](int t)
+	{
+		return binIndex(component(centroid[t], axis), lower, scale) < plane;
+	});
+
+	split.leaf				= false;
+	split.mid				= (int)(middle - order);
+	split.left				= emptyBox();
+	split.right				= emptyBox();
+	split.leftCentroids		= emptyBox();
+	split.rightCentroids	= emptyBox();
+
+	for (int b = 0; b < binCount; b++)
+	{
+		grow(b < plane ? split.left : split.right, bins[b].bounds);
+		grow(b < plane ? split.leftCentroids : split.rightCentroids, bins[b].centroids);
+	}
+
+	return split;
+}
+
+#pragma endregion
+
+
+// Constructor
+ClothMeshCollider::ClothMeshCollider(const ClothFloat3* vertices, int vertexCount, const DWORD* indices, int triangleCount, ClothWorkerPool* pool)
+{
+	thickness	= 0.01f;
+	blockSize	= 8;
+
+	if (!vertices || !indices || !pool || vertexCount <= 0 || triangleCount <= 0)
+		throw("Invalid parameters for cloth mesh collider instantiation");
+
+	build(vertices, vertexCount, indices, triangleCount, pool);
+
+	closest = ClothKernels::closest(ClothKernels::bestIsa());
+}
+
+// Build - the hierarchy is split a level at a time. Large nodes near the root are binned
+// in parallel over their triangles, the many small nodes further down in parallel with
+// each other, and the tree itself only grows between levels.
+void ClothMeshCollider::build(const ClothFloat3* vertices, int vertexCount, const DWORD* indices, int triangleCount, ClothWorkerPool* pool)
+{
+	for (int i = 0; i < triangleCount * 3; i++)
+	{
+		if (indices[i] >= (DWORD)vertexCount)
+			throw("Invalid mesh for cloth mesh collider");
+	}
+
+	vector<ClothColliderTriangle> source(triangleCount);
+	vector<ClothBox> triangleBounds(triangleCount);
+	vector<ClothFloat3> centroid(triangleCount);
+	vector<int> order(triangleCount);
+
+	ClothColliderTriangle* sourcePtr	= source.data();
+	ClothBox* boundsPtr					= triangleBounds.data();
+	ClothFloat3* centroidPtr			= centroid.data();
+	int* orderPtr						= order.data();
+
+	pool->parallelFor(triangleCount, triangleGrain, [=](int begin, int end)
+	{
+		for (int t = begin; t < end; t++)
+		{
+			ClothColliderTriangle& triangle = sourcePtr[t];
+
+			triangle.a = vertices[indices[t * 3]];
+			triangle.b = vertices[indices[t * 3 + 1]];
+			triangle.c = vertices[indices[t * 3 + 2]];
+
+			ClothFloat3 ab = sub(triangle.b, triangle.a), ac = sub(triangle.c, triangle.a);
+			ClothFloat3 n(ab.y * ac.z - ab.z * ac.y, ab.z * ac.x - ab.x * ac.z, ab.x * ac.y - ab.y * ac.x);
+
+			float length	= sqrtf(dot(n, n));
+			float inverse	= length > 0.0f ? 1.0f / length : 0.0f;
+
+			triangle.normal = ClothFloat3(n.x * inverse, n.y * inverse, n.z * inverse);
+
+			boundsPtr[t] = emptyBox();
+			grow(boundsPtr[t], triangle.a);
+			grow(boundsPtr[t], triangle.b);
+			grow(boundsPtr[t], triangle.c);
+
+			centroidPtr[t] = ClothFloat3((triangle.a.x + triangle.b.x + triangle.c.x) / 3.0f,
+				(triangle.a.y + triangle.b.y + triangle.c.y) / 3.0f,
+				(triangle.a.z + triangle.b.z + triangle.c.z) / 3.0f);
+
+			orderPtr[t] = t;
+		}
+	});
+
+	ClothBuildTask root;
+
+	root.node		= 0;
+	root.first		= 0;
+	root.count		= triangleCount;
+	root.bounds		= emptyBox();
+	root.centroids	= emptyBox();
+
+	for (int t = 0; t < triangleCount; t++)
+	{
+		grow(root.bounds, triangleBounds[t]);
+		grow(root.centroids, centroid[t]);
+	}
+
+	nodes.clear();
+	nodes.reserve(2 * (triangleCount / minLeafSize) + 1);
+	nodes.push_back(ClothBvhNode());
+
+	vector<ClothBuildTask> frontier(1, root), next;
+	vector<ClothSplit> splits;
+	vector<ClothBin> chunkBins;
+
+	while (!frontier.empty())
+	{
+		splits.resize(frontier.size());
+
+		// Nodes near the root - one at a time, binned over all threads
+		for (size_t n = 0; n < frontier.size(); n++)
+		{
+			const ClothBuildTask& task = frontier[n];
+
+			if (task.count < parallelNodeSize)
+				continue;
+
+			int chunks = (task.count + triangleGrain - 1) / triangleGrain;
+
+			chunkBins.resize(chunks * binCount);
+
+			ClothBin* chunkPtr = chunkBins.data();
+
+			pool->parallelFor(task.count, triangleGrain, [=, &task](int begin, int end)
+			{
+				binTriangles(orderPtr + task.first, begin, end, boundsPtr, centroidPtr, task.centroids, chunkPtr + (begin / triangleGrain) * binCount);
+			});
+
+			for (int c = 1; c < chunks; c++)
+			{
+				for (int b = 0; b < binCount; b++)
+				{
+					grow(chunkBins[b].bounds, chunkBins[c * binCount + b].bounds);
+					grow(chunkBins[b].centroids, chunkBins[c * binCount + b].centroids);
+					chunkBins[b].count += chunkBins[c * binCount + b].count;
+				}
+			}
+
+			splits[n] = splitNode(task, chunkPtr, orderPtr, boundsPtr, centroidPtr);
+		}
+
+		// Every smaller node of the level at once
+		const ClothBuildTask* taskPtr	= frontier.data();
+		ClothSplit* splitPtr			= splits.data();
+
+		pool->parallelFor((int)frontier.size(), nodeGrain, [=](int begin, int end)
+		{
+			ClothBin bins[binCount];
+
+			for (int n = begin; n < end; n++)
+			{
+				const ClothBuildTask& task = taskPtr[n];
+
+				if (task.count >= parallelNodeSize)
+					continue;
+
+				binTriangles(orderPtr, task.first, task.first + task.count, boundsPtr, centroidPtr, task.centroids, bins);
+
+				splitPtr[n] = splitNode(task, bins, orderPtr, boundsPtr, centroidPtr);
+			}
+		});
+
+		// Grow the tree and queue the next level
+		next.clear();
+
+		for (size_t n = 0; n < frontier.size(); n++)
+		{
+			const ClothBuildTask& task	= frontier[n];
+			const ClothSplit& split		= splits[n];
+
+			ClothBvhNode& node = nodes[task.node];
+
+			node.lower = task.bounds.lower;
+			node.upper = task.bounds.upper;
+
+			if (split.leaf)
+			{
+				node.first = task.first;
+				node.count = task.count;
+				continue;
+			}
+
+			int child = (int)nodes.size();
+
+			node.first = child;
+			node.count = 0;
+
+			ClothBuildTask left, right;
+
+			left.node			= child;
+			left.first			= task.first;
+			left.count			= split.mid - task.first;
+			left.bounds			= split.left;
+			left.centroids		= split.leftCentroids;
+
+			right.node			= child + 1;
+			right.first			= split.mid;
+			right.count			= task.first + task.count - split.mid;
+			right.bounds		= split.right;
+			right.centroids		= split.rightCentroids;
+
+			nodes.push_back(ClothBvhNode());
+			nodes.push_back(ClothBvhNode());
+
+			next.push_back(left);
+			next.push_back(right);
+		}
+
+		frontier.swap(next);
+	}
+
+	// Store the triangles in leaf order so each leaf reads one contiguous run
+	triangles.resize(triangleCount);
+
+	ClothColliderTriangle* trianglePtr = triangles.data();
+
+	pool->parallelFor(triangleCount, triangleGrain, [=](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+			trianglePtr[i] = sourcePtr[orderPtr[i]];
+	});
+}
+
+// Gather triangles
+bool ClothMeshCollider::gatherTriangles(const ClothFloat3& lower, const ClothFloat3& upper, int* candidates, int& count) const
+{
+	int stack[stackSize];
+	int top = 0;
+
+	count = 0;
+	stack[top++] = 0;
+
+	while (top > 0)
+	{
+		const ClothBvhNode& node = nodes[stack[--top]];
+
+		if (!overlaps(lower, upper, node))
+			continue;
+
+		if (node.count)
+		{
+			if (count + node.count > maxCandidates)
+				return false;
+
+			for (int t = node.first; t < node.first + node.count; t++)
+				candidates[count++] = t;
+
+			continue;
+		}
+
+		if (top + 2 > stackSize)
+			return false;
+
+		stack[top++] = node.first;
+		stack[top++] = node.first + 1;
+	}
+
+	return true;
+}
+
+// Nearest in tree - nearer child first, skipping every node further than the best so far
+void ClothMeshCollider::nearestInTree(ClothQueryBlock& block, int lane) const
+{
+	ClothFloat3 p(block.x[lane], block.y[lane], block.z[lane]);
+
+	int leaf[maxLeafSize];
+	int stack[stackSize];
+	float distance[stackSize];
+	int top = 0;
+
+	stack[top]		= 0;
+	distance[top++]	= boxDistance(p, nodes[0]);
+
+	while (top > 0)
+	{
+		top--;
+
+		if (distance[top] >= block.best[lane])
+			continue;
+
+		const ClothBvhNode& node = nodes[stack[top]];
+
+		if (node.count)
+		{
+			for (int i = 0; i < node.count; i++)
+				leaf[i] = node.first + i;
+
+			closest(triangles.data(), leaf, node.count, block, lane, lane + 1);
+			continue;
+		}
+
+		float d0 = boxDistance(p, nodes[node.first]);
+		float d1 = boxDistance(p, nodes[node.first + 1]);
+
+		bool leftFirst = d0 <= d1;
+
+		// Deeper than the stack - drop the further child
+		if (top + 2 <= stackSize)
+		{
+			stack[top]		= leftFirst ? node.first + 1 : node.first;
+			distance[top++]	= leftFirst ? d1 : d0;
+		}
+
+		stack[top]		= leftFirst ? node.first : node.first + 1;
+		distance[top++]	= leftFirst ? d0 : d1;
+	}
+}
+
+// Move out
+void ClothMeshCollider::moveOut(ClothFloat4& p, const ClothQueryBlock& block, int lane) const
+{
+	if (block.nearest[lane] < 0)
+		return;
+
+	const ClothFloat3& n	= triangles[block.nearest[lane]].normal;
+	ClothFloat3 c			= ClothFloat3(block.cx[lane], block.cy[lane], block.cz[lane]);
+	ClothFloat3 d			= sub(ClothFloat3(p.x, p.y, p.z), c);
+	float distance			= sqrtf(block.best[lane]);
+
+	// In front of the triangle - out along the offset, behind it - out through the front
+	ClothFloat3 out = (dot(d, n) < 0.0f || distance <= 0.0f) ? n : ClothFloat3(d.x / distance, d.y / distance, d.z / distance);
+
+	p.x = c.x + out.x * thickness;
+	p.y = c.y + out.y * thickness;
+	p.z = c.z + out.z * thickness;
+}
+
+// Collide - the movable particles of each block are packed into the lanes of a query block
+void ClothMeshCollider::collide(ClothFloat4* pos, int begin, int end) const
+{
+	ClothQueryBlock block;
+	int particle[CLOTH_QUERY_BLOCK];
+	int candidates[maxCandidates];
+
+	int size = blockSize < 1 ? 1 : (blockSize > CLOTH_QUERY_BLOCK ? CLOTH_QUERY_BLOCK : blockSize);
+
+	for (int first = begin; first < end; first += size)
+	{
+		int last	= first + size < end ? first + size : end;
+		int lanes	= 0;
+
+		ClothBox box = emptyBox();
+
+		for (int i = first; i < last; i++)
+		{
+			if (pos[i].w <= 0.0f)
+				continue;
+
+			block.x[lanes]			= pos[i].x;
+			block.y[lanes]			= pos[i].y;
+			block.z[lanes]			= pos[i].z;
+			block.best[lanes]		= thickness * thickness;
+			block.cx[lanes]			= pos[i].x;
+			block.cy[lanes]			= pos[i].y;
+			block.cz[lanes]			= pos[i].z;
+			block.nearest[lanes]	= -1;
+
+			grow(box, ClothFloat3(pos[i].x, pos[i].y, pos[i].z));
+
+			particle[lanes++] = i;
+		}
+
+		if (!lanes)
+			continue;
+
+		// Triangles around the block - when there are too many (a spread out block or
+		// a dense mesh) each particle walks the tree instead
+		ClothFloat3 lower(box.lower.x - thickness, box.lower.y - thickness, box.lower.z - thickness);
+		ClothFloat3 upper(box.upper.x + thickness, box.upper.y + thickness, box.upper.z + thickness);
+
+		int count = 0;
+
+		if (size > 1 && gatherTriangles(lower, upper, candidates, count))
+		{
+			if (!count)
+				continue;
+
+			closest(triangles.data(), candidates, count, block, 0, lanes);
+		}
+		else
+		{
+			for (int l = 0; l < lanes; l++)
+				nearestInTree(block, l);
+		}
+
+		for (int l = 0; l < lanes; l++)
+			moveOut(pos[particle[l]], block, l);
+	}
+}
+
+// Triangle count
+int ClothMeshCollider::triangleCount() const
+{
+	return (int)triangles.size();
+}
+
+// Node count
+int ClothMeshCollider::nodeCount() const
+{
+	return (int)nodes.size();
+}
+
+// Bounds
+void ClothMeshCollider::bounds(ClothFloat3& lower, ClothFloat3& upper) const
+{
+	lower = nodes.empty() ? ClothFloat3(0.0f, 0.0f, 0.0f) : nodes[0].lower;
+	upper = nodes.empty() ? ClothFloat3(0.0f, 0.0f, 0.0f) : nodes[0].upper;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include "ClothTypes.h"
+#include "ClothKernels.h"
+#include "ClothWorkerPool.h"
+
+class CGPolyMesh;
+
+
+// Static triangle mesh the CPU solver collides the cloth with, e.g. a prop imported
+// through CGModel. The triangles are held in a BVH built once with binned SAH splits.
+// The particles are queried in blocks: the BVH is walked once for the bounds of each
+// block and the particles of the block are tested against the triangles found side by
+// side in SIMD lanes, which suits the cloth since neighbouring particles are stored
+// next to each other.
+//
+// Each triangle is a shell thickness thick on its front. A particle closer than that
+// to the nearest triangle, or up to that far behind it, is moved out to the front of
+// the shell. Particles that step further than thickness through a triangle are missed.
+class ClothMeshCollider
+{
+private:
+	std::vector<ClothBvhNode>			nodes;
+	std::vector<ClothColliderTriangle>	triangles;
+	ClothClosestFn						closest;
+
+	// Hierarchy setup over the vertices and triangle indices
+	void build(const ClothFloat3* vertices, int vertexCount, const DWORD* indices, int triangleCount, ClothWorkerPool* pool);
+
+	// Triangles of the leaves overlapping the box [lower, upper] - false if there are too many to hold
+	bool gatherTriangles(const ClothFloat3& lower, const ClothFloat3& upper, int* candidates, int& count) const;
+
+	// Nearest triangle to one lane of a query block, walking the whole tree
+	void nearestInTree(ClothQueryBlock& block, int lane) const;
+
+	// Move a particle out to the front of the shell of the nearest triangle found for its lane
+	void moveOut(ClothFloat4& p, const ClothQueryBlock& block, int lane) const;
+
+public:
+	// Constructor - triangles of a mesh, moved into cloth space as origin + scale * vertex
+	// (in ClothMeshImport.cpp)
+	ClothMeshCollider(CGPolyMesh* mesh, const ClothFloat3& origin, float scale, ClothWorkerPool* pool);
+	// Constructor - triangles given in cloth space as three vertex indices each
+	ClothMeshCollider(const ClothFloat3* vertices, int vertexCount, const DWORD* indices, int triangleCount, ClothWorkerPool* pool);
+
+	// Move the movable particles [begin, end) out of the mesh
+	void collide(ClothFloat4* pos, int begin, int end) const;
+
+	// Accessors
+	int triangleCount() const;
+	int nodeCount() const;
+	void bounds(ClothFloat3& lower, ClothFloat3& upper) const;
+
+	// Thickness of the shell around the triangles
+	float thickness;
+
+	// Particles sharing one BVH walk, up to CLOTH_QUERY_BLOCK (1 walks the BVH for each particle)
+	int blockSize;
+};
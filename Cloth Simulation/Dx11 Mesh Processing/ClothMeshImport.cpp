@@ -0,0 +1,152 @@
+#include "ClothTopology.h"
+#include "ClothMeshCollider.h"
+#include "ClothDistanceField.h"
+#include <vector>
+#include "CoreStructures\CoreStructures.h"
+#include <CGModel\CGPolyMesh.h>
+
+using namespace std;
+using namespace CoreStructures;
+
+// The constructors that take an imported CGPolyMesh. They only copy the mesh into the plain
+// arrays the other constructors take, and are kept apart so the solver core builds without
+// CoreStructures and the importers.
+
+
+// Constructor
+ClothTopology::ClothTopology(CGPolyMesh* mesh, ClothWorkerPool* pool)
+{
+	reset();
+
+	if (!mesh || mesh->vertexCount() <= 0 || mesh->faceCount() <= 0 || !mesh->vertexArray() || !mesh->vertexIndexArray())
+		throw("Invalid mesh for cloth topology");
+
+	int vertexCount			= mesh->vertexCount();
+	int faceCount			= mesh->faceCount();
+	GUVector4* V			= mesh->vertexArray();
+	GUVector4* Vn			= mesh->vertexNormalArray();
+	CGFaceVertex* Fv		= mesh->vertexIndexArray();
+	CGTextureCoord* Vt		= mesh->textureCoordArray();
+	CGFaceTexture* Fvt		= mesh->faceTextureCoordArray();
+
+	for (int f = 0; f < faceCount; f++)
+	{
+		if (Fv[f].v1 < 0 || Fv[f].v1 >= vertexCount || Fv[f].v2 < 0 || Fv[f].v2 >= vertexCount || Fv[f].v3 < 0 || Fv[f].v3 >= vertexCount)
+			throw("Invalid mesh for cloth topology");
+	}
+
+	vector<ClothFloat3> positions(vertexCount);
+	vector<ClothFloat3> normals(Vn ? vertexCount : 0);
+	vector<ClothFloat2> texCoords(vertexCount, ClothFloat2(0, 0));
+	vector<DWORD> triangles(faceCount * 3);
+
+	for (int i = 0; i < vertexCount; i++)
+	{
+		positions[i] = ClothFloat3(V[i].x, V[i].y, V[i].z);
+
+		if (Vn)
+			normals[i] = ClothFloat3(Vn[i].x, Vn[i].y, Vn[i].z);
+	}
+
+	// Texture coordinates are per face corner in the mesh - take the last one written to each vertex
+	if (Vt && Fvt)
+	{
+		int VtSize = mesh->noofTextureCoords();
+
+		for (int f = 0; f < faceCount; f++)
+		{
+			int v[3] = {Fv[f].v1, Fv[f].v2, Fv[f].v3};
+			int t[3] = {Fvt[f].t1, Fvt[f].t2, Fvt[f].t3};
+
+			for (int k = 0; k < 3; k++)
+			{
+				if (t[k] >= 0 && t[k] < VtSize)
+					texCoords[v[k]] = ClothFloat2(Vt[t[k]].s, Vt[t[k]].t);
+			}
+		}
+	}
+
+	for (int f = 0; f < faceCount; f++)
+	{
+		triangles[f * 3]		= (DWORD)Fv[f].v1;
+		triangles[f * 3 + 1]	= (DWORD)Fv[f].v2;
+		triangles[f * 3 + 2]	= (DWORD)Fv[f].v3;
+	}
+
+	try
+	{
+		buildMesh(positions.data(), Vn ? normals.data() : nullptr, texCoords.data(), vertexCount, triangles.data(), faceCount, pool);
+	}
+	catch (...)
+	{
+		dispose();
+		throw;
+	}
+}
+
+// Constructor
+ClothMeshCollider::ClothMeshCollider(CGPolyMesh* mesh, const ClothFloat3& origin, float scale, ClothWorkerPool* pool)
+{
+	thickness	= 0.01f;
+	blockSize	= 8;
+
+	if (!mesh || !pool || mesh->vertexCount() <= 0 || mesh->faceCount() <= 0 || !mesh->vertexArray() || !mesh->vertexIndexArray() || scale <= 0.0f)
+		throw("Invalid parameters for cloth mesh collider instantiation");
+
+	int vertexCount		= mesh->vertexCount();
+	int faceCount		= mesh->faceCount();
+	GUVector4* V		= mesh->vertexArray();
+	CGFaceVertex* Fv	= mesh->vertexIndexArray();
+
+	vector<ClothFloat3> vertices(vertexCount);
+	vector<DWORD> indices(faceCount * 3);
+
+	for (int i = 0; i < vertexCount; i++)
+		vertices[i] = ClothFloat3(origin.x + V[i].x * scale, origin.y + V[i].y * scale, origin.z + V[i].z * scale);
+
+	for (int f = 0; f < faceCount; f++)
+	{
+		if (Fv[f].v1 < 0 || Fv[f].v2 < 0 || Fv[f].v3 < 0)
+			throw("Invalid mesh for cloth mesh collider");
+
+		indices[f * 3]		= (DWORD)Fv[f].v1;
+		indices[f * 3 + 1]	= (DWORD)Fv[f].v2;
+		indices[f * 3 + 2]	= (DWORD)Fv[f].v3;
+	}
+
+	build(vertices.data(), vertexCount, indices.data(), faceCount, pool);
+
+	closest = ClothKernels::closest(ClothKernels::bestIsa());
+}
+
+// Constructor
+ClothDistanceField::ClothDistanceField(CGPolyMesh* mesh, const ClothFloat3& origin, float scale, int resolution, ClothWorkerPool* pool, const char* cacheDirectory)
+{
+	thickness = 0.01f;
+
+	if (!mesh || !pool || mesh->vertexCount() <= 0 || mesh->faceCount() <= 0 || !mesh->vertexArray() || !mesh->vertexIndexArray() || scale <= 0.0f || resolution < 1)
+		throw("Invalid parameters for cloth distance field instantiation");
+
+	int vertexCount		= mesh->vertexCount();
+	int faceCount		= mesh->faceCount();
+	GUVector4* V		= mesh->vertexArray();
+	CGFaceVertex* Fv	= mesh->vertexIndexArray();
+
+	vector<ClothFloat3> vertices(vertexCount);
+	vector<DWORD> indices(faceCount * 3);
+
+	for (int i = 0; i < vertexCount; i++)
+		vertices[i] = ClothFloat3(origin.x + V[i].x * scale, origin.y + V[i].y * scale, origin.z + V[i].z * scale);
+
+	for (int f = 0; f < faceCount; f++)
+	{
+		if (Fv[f].v1 < 0 || Fv[f].v2 < 0 || Fv[f].v3 < 0)
+			throw("Invalid mesh for cloth distance field");
+
+		indices[f * 3]		= (DWORD)Fv[f].v1;
+		indices[f * 3 + 1]	= (DWORD)Fv[f].v2;
+		indices[f * 3 + 2]	= (DWORD)Fv[f].v3;
+	}
+
+	setup(vertices.data(), vertexCount, indices.data(), faceCount, resolution, pool, cacheDirectory);
+}
@@ -0,0 +1,274 @@
+#include "ClothMultigrid.h"
+#include "ClothFpContract.h"
+#include <math.h>
+
+using namespace std;
+
+// Constraints and rows per worker chunk
+static const int constraintGrain	= 2048;
+static const int rowGrain			= 8;
+
+// Smallest level side
+static const int minimumSide		= 4;
+
+
+#pragma region Helpers
+
+// Side of the coarser level - about half, and even so the grid batches stay disjoint
+static int coarseSide(int fineSide)
+{
+	int side = fineSide / 2;
+
+	return (side & 1) ? side + 1 : side;
+}
+
+// Project the constraints [begin, end) of a batch, only where they are stretched
+static void projectStretch(ClothFloat4* pos, const Constraint* batch, int begin, int end)
+{
+	for (int c = begin; c < end; c++)
+	{
+		ClothFloat4 one = pos[batch[c].start];
+		ClothFloat4 two = pos[batch[c].end];
+
+		float dx = one.x - two.x;
+		float dy = one.y - two.y;
+		float dz = one.z - two.z;
+
+		float distance	= sqrtf(dx * dx + dy * dy + dz * dz);
+		float weight	= one.w + two.w;
+
+		if (distance <= batch[c].length || weight <= 0.0f)
+			continue;
+
+		float stretching = (distance - batch[c].length) / (distance * weight);
+
+		dx *= stretching;
+		dy *= stretching;
+		dz *= stretching;
+
+		pos[batch[c].start]	= ClothFloat4(one.x - dx * one.w, one.y - dy * one.w, one.z - dz * one.w, one.w);
+		pos[batch[c].end]	= ClothFloat4(two.x + dx * two.w, two.y + dy * two.w, two.z + dz * two.w, two.w);
+	}
+}
+
+// Coarse lines of a side - spread evenly over the fine lines, keeping both edges
+static void mapLines(int fineSide, int side, vector<int>& fineLine, vector<int>& cell, vector<float>& cellWeight)
+{
+	fineLine.resize(side);
+
+	for (int c = 0; c < side; c++)
+		fineLine[c] = (c * (fineSide - 1) + (side - 1) / 2) / (side - 1);
+
+	cell.resize(fineSide);
+	cellWeight.resize(fineSide);
+
+	int c = 0;
+
+	for (int f = 0; f < fineSide; f++)
+	{
+		while (c < side - 2 && fineLine[c + 1] <= f)
+			c++;
+
+		cell[f]			= c;
+		cellWeight[f]	= (float)(f - fineLine[c]) / (float)(fineLine[c + 1] - fineLine[c]);
+	}
+}
+
+#pragma endregion
+
+
+// Constructor
+ClothMultigrid::ClothMultigrid(DWORD clothW, DWORD clothH, int maxLevels, ClothWorkerPool* workerPool)
+{
+	pool			= workerPool;
+	w				= (int)clothW;
+	h				= (int)clothH;
+	levelIterations	= 2;
+
+	// Rest coordinates of the fine grid, as laid out by ClothTopology
+	vector<float> restX(w), restY(h);
+
+	for (int i = 0; i < w; i++)
+		restX[i] = (float)i / (float)(w - 1);
+
+	for (int j = 0; j < h; j++)
+		restY[j] = (float)j / (float)(h - 1);
+
+	int fineW = w, fineH = h;
+
+	while ((int)levels.size() < maxLevels && coarseSide(fineW) >= minimumSide && coarseSide(fineH) >= minimumSide)
+	{
+		levels.push_back(ClothGridLevel());
+
+		try
+		{
+			buildLevel(levels.back(), fineW, fineH, restX, restY);
+		}
+		catch (...)
+		{
+			levels.pop_back();
+
+			for (size_t l = 0; l < levels.size(); l++)
+				delete levels[l].topology;
+
+			throw;
+		}
+
+		fineW = levels.back().topology->w;
+		fineH = levels.back().topology->h;
+	}
+}
+
+// Destructor
+ClothMultigrid::~ClothMultigrid()
+{
+	for (size_t l = 0; l < levels.size(); l++)
+		delete levels[l].topology;
+}
+
+// Level setup
+void ClothMultigrid::buildLevel(ClothGridLevel& level, int fineW, int fineH, vector<float>& restX, vector<float>& restY)
+{
+	int levelW = coarseSide(fineW);
+	int levelH = coarseSide(fineH);
+
+	level.topology = new ClothTopology(levelW, levelH, pool);
+
+	mapLines(fineW, levelW, level.fineColumn, level.cellColumn, level.cellX);
+	mapLines(fineH, levelH, level.fineRow, level.cellRow, level.cellY);
+
+	vector<float> levelX(levelW), levelY(levelH);
+
+	for (int c = 0; c < levelW; c++)
+		levelX[c] = restX[level.fineColumn[c]];
+
+	for (int r = 0; r < levelH; r++)
+		levelY[r] = restY[level.fineRow[r]];
+
+	// The level lines are not evenly spaced on the fine grid, so measure every rest length again
+	for (int i = 0; i < level.topology->totalConstraints; i++)
+	{
+		Constraint& c = level.topology->constraints[i];
+
+		float dx = levelX[c.end % levelW] - levelX[c.start % levelW];
+		float dz = levelY[c.end / levelW] - levelY[c.start / levelW];
+
+		c.length = sqrtf(dx * dx + dz * dz);
+	}
+
+	level.pos.resize(levelW * levelH);
+	level.restricted.resize(levelW * levelH);
+
+	restX.swap(levelX);
+	restY.swap(levelY);
+}
+
+// Restrict level
+void ClothMultigrid::restrictLevel(int l, const ClothFloat4* finePos)
+{
+	ClothGridLevel* level	= &levels[l];
+	int levelW				= level->topology->w;
+	int fineW				= l ? levels[l - 1].topology->w : w;
+
+	pool->parallelFor(level->topology->h, rowGrain, [=](int begin, int end)
+	{
+		for (int r = begin; r < end; r++)
+		{
+			const ClothFloat4* fineRow = finePos + level->fineRow[r] * fineW;
+
+			for (int c = 0; c < levelW; c++)
+			{
+				level->pos[r * levelW + c]			= fineRow[level->fineColumn[c]];
+				level->restricted[r * levelW + c]	= fineRow[level->fineColumn[c]];
+			}
+		}
+	});
+}
+
+// Solve level
+void ClothMultigrid::solveLevel(int l)
+{
+	const ClothTopology* topology	= levels[l].topology;
+	ClothFloat4* pos				= levels[l].pos.data();
+
+	for (int i = 0; i < levelIterations; i++)
+	{
+		for (int k = 0; k < topology->batchCount; k++)
+		{
+			const Constraint* batch = topology->constraints + topology->batchOffset[k];
+
+			pool->parallelFor(topology->batchSize[k], constraintGrain, [pos, batch](int begin, int end)
+			{
+				projectStretch(pos, batch, begin, end);
+			});
+		}
+	}
+}
+
+// Prolongate level - bilinear interpolation of the corrections of the four level
+// particles around each finer particle. Immovable particles are left in place.
+void ClothMultigrid::prolongateLevel(int l, ClothFloat4* finePos)
+{
+	const ClothGridLevel* level	= &levels[l];
+	int levelW					= level->topology->w;
+	int fineW					= l ? levels[l - 1].topology->w : w;
+	int fineH					= l ? levels[l - 1].topology->h : h;
+
+	pool->parallelFor(fineH, rowGrain, [=](int begin, int end)
+	{
+		const ClothFloat4* pos			= level->pos.data();
+		const ClothFloat4* restricted	= level->restricted.data();
+
+		for (int j = begin; j < end; j++)
+		{
+			int r0		= level->cellRow[j] * levelW;
+			int r1		= r0 + levelW;
+			float ty	= level->cellY[j];
+
+			for (int i = 0; i < fineW; i++)
+			{
+				ClothFloat4& p = finePos[j * fineW + i];
+
+				if (p.w <= 0.0f)
+					continue;
+
+				int c0		= level->cellColumn[i];
+				int c1		= c0 + 1;
+				float tx	= level->cellX[i];
+
+				float w00 = (1.0f - tx) * (1.0f - ty);
+				float w10 = tx * (1.0f - ty);
+				float w01 = (1.0f - tx) * ty;
+				float w11 = tx * ty;
+
+				p.x += w00 * (pos[r0 + c0].x - restricted[r0 + c0].x) + w10 * (pos[r0 + c1].x - restricted[r0 + c1].x)
+					+ w01 * (pos[r1 + c0].x - restricted[r1 + c0].x) + w11 * (pos[r1 + c1].x - restricted[r1 + c1].x);
+				p.y += w00 * (pos[r0 + c0].y - restricted[r0 + c0].y) + w10 * (pos[r0 + c1].y - restricted[r0 + c1].y)
+					+ w01 * (pos[r1 + c0].y - restricted[r1 + c0].y) + w11 * (pos[r1 + c1].y - restricted[r1 + c1].y);
+				p.z += w00 * (pos[r0 + c0].z - restricted[r0 + c0].z) + w10 * (pos[r0 + c1].z - restricted[r0 + c1].z)
+					+ w01 * (pos[r1 + c0].z - restricted[r1 + c0].z) + w11 * (pos[r1 + c1].z - restricted[r1 + c1].z);
+			}
+		}
+	});
+}
+
+// Solve - copy down the hierarchy, then solve and correct from the coarsest level up
+void ClothMultigrid::solve(ClothFloat4* pos)
+{
+	int count = (int)levels.size();
+
+	for (int l = 0; l < count; l++)
+		restrictLevel(l, l ? levels[l - 1].pos.data() : pos);
+
+	for (int l = count - 1; l >= 0; l--)
+	{
+		solveLevel(l);
+		prolongateLevel(l, l ? levels[l - 1].pos.data() : pos);
+	}
+}
+
+// Level count
+int ClothMultigrid::levelCount() const
+{
+	return (int)levels.size();
+}
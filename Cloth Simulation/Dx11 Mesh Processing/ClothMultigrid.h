@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+#include "ClothTypes.h"
+#include "ClothTopology.h"
+#include "ClothWorkerPool.h"
+
+
+// One coarse level of the hierarchy
+struct ClothGridLevel
+{
+	// Grid constraints between the level particles, with rest lengths measured on the finer grid
+	ClothTopology*			topology;
+
+	// Positions, and their values when last restricted from the finer level
+	std::vector<ClothFloat4>	pos;
+	std::vector<ClothFloat4>	restricted;
+
+	// Finer level column and row of each level column and row
+	std::vector<int>		fineColumn;
+	std::vector<int>		fineRow;
+
+	// For each finer level column and row - the level column or row at or before it,
+	// and how far it is towards the next one
+	std::vector<int>		cellColumn;
+	std::vector<float>		cellX;
+	std::vector<int>		cellRow;
+	std::vector<float>		cellY;
+};
+
+
+// Coarse to fine constraint solve for grid cloths. The lattice is halved into a
+// hierarchy of coarser grids whose particles are a subset of the finer ones. Each
+// pass copies the positions down the hierarchy, solves the coarsest level first and
+// carries the corrections of each level up to the next finer one, interpolated
+// bilinearly. Long range stretch is then removed in a few passes instead of
+// travelling one particle per batch sweep across the fine grid.
+//
+// The coarse constraints only resist stretching (as in hierarchical PBD) so they do
+// not push apart the folds and wrinkles the fine grid is free to form.
+class ClothMultigrid
+{
+private:
+	ClothWorkerPool*			pool;
+
+	// Fine grid dimensions
+	int							w, h;
+
+	// Coarse levels, finest first
+	std::vector<ClothGridLevel>	levels;
+
+	// Level setup from the finer grid of fineW x fineH particles. restX and restY hold the rest
+	// coordinates of the finer columns and rows, and are replaced by those of the level.
+	void buildLevel(ClothGridLevel& level, int fineW, int fineH, std::vector<float>& restX, std::vector<float>& restY);
+
+	// Copy positions from the finer level into level l
+	void restrictLevel(int l, const ClothFloat4* finePos);
+
+	// Solve the constraints of level l
+	void solveLevel(int l);
+
+	// Add the corrections of level l to the finer level positions
+	void prolongateLevel(int l, ClothFloat4* finePos);
+
+public:
+	// Constructor - at most maxLevels coarse levels of a w x h grid, stopping before a level
+	// would have fewer than 4 particles along a side
+	ClothMultigrid(DWORD clothW, DWORD clothH, int maxLevels, ClothWorkerPool* workerPool);
+	// Destructor
+	~ClothMultigrid();
+
+	// Correct the fine positions (w = inverse mass) with one pass over the hierarchy
+	void solve(ClothFloat4* pos);
+
+	// Number of coarse levels built
+	int levelCount() const;
+
+	// Constraint passes run on each coarse level per solve
+	int levelIterations;
+};
@@ -0,0 +1,205 @@
+#include "ClothParticleStore.h"
+#include "ClothFpContract.h"
+#include <stdlib.h>
+#include <malloc.h>
+#include <string.h>
+#include <vector>
+
+// Streams start on a cache line and are padded to whole cache lines
+static const int streamAlignment = 64;
+
+static int paddedStreamBytes(int count, int elementSize)
+{
+	int bytes = count * elementSize;
+
+	return (bytes + streamAlignment - 1) & ~(streamAlignment - 1);
+}
+
+static void* alignedAlloc(size_t bytes)
+{
+#ifdef _MSC_VER
+	return _aligned_malloc(bytes, streamAlignment);
+#else
+	void* ptr = nullptr;
+
+	return (posix_memalign(&ptr, streamAlignment, bytes) == 0) ? ptr : nullptr;
+#endif
+}
+
+static void alignedFree(void* ptr)
+{
+#ifdef _MSC_VER
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+// Constructor
+ClothParticleStore::ClothParticleStore(int particleCount, int particleCapacity)
+{
+	count		= particleCount;
+	capacity	= particleCapacity > particleCount ? particleCapacity : particleCount;
+
+	int hotBytes	= paddedStreamBytes(capacity, sizeof(ClothFloat4));
+	int renderBytes	= paddedStreamBytes(capacity, sizeof(ClothVertex));
+
+	memory = alignedAlloc(hotBytes * 3 + renderBytes);
+
+	if (!memory)
+		throw("Cannot create cloth particle streams");
+
+	// Zero so the padding at the end of each stream is harmless to vector loads
+	memset(memory, 0, hotBytes * 3 + renderBytes);
+
+	char* ptr = (char*)memory;
+
+	pos		= (ClothFloat4*)ptr;	ptr += hotBytes;
+	prevPos	= (ClothFloat4*)ptr;	ptr += hotBytes;
+	lastPos	= (ClothFloat4*)ptr;	ptr += hotBytes;
+	render	= (ClothVertex*)ptr;
+}
+
+// Destructor
+ClothParticleStore::~ClothParticleStore()
+{
+	alignedFree(memory);
+}
+
+// Load
+void ClothParticleStore::load(const Particle* particles)
+{
+	load(particles, 0, count);
+}
+
+// Load a range
+void ClothParticleStore::load(const Particle* particles, int first, int n)
+{
+	for (int k = 0; k < n; k++)
+	{
+		const ClothFloat3& p	= particles[k].vertex.pos;
+		const ClothFloat3& prev	= particles[k].prevPos;
+
+		int i = first + k;
+
+		pos[i]		= ClothFloat4(p.x, p.y, p.z, 1.0f);
+		prevPos[i]	= ClothFloat4(prev.x, prev.y, prev.z, 0.0f);
+		lastPos[i]	= pos[i];
+
+		render[i]	= particles[k].vertex;
+	}
+}
+
+// Copy
+void ClothParticleStore::copy(const ClothParticleStore* other)
+{
+	int n = other->count < count ? other->count : count;
+
+	memcpy(pos, other->pos, sizeof(ClothFloat4) * n);
+	memcpy(prevPos, other->prevPos, sizeof(ClothFloat4) * n);
+	memcpy(lastPos, other->lastPos, sizeof(ClothFloat4) * n);
+	memcpy(render, other->render, sizeof(ClothVertex) * n);
+}
+
+// Duplicate
+int ClothParticleStore::duplicate(int source)
+{
+	if (count >= capacity)
+		return -1;
+
+	int i = count++;
+
+	pos[i]		= pos[source];
+	prevPos[i]	= prevPos[source];
+	lastPos[i]	= lastPos[source];
+	render[i]	= render[source];
+
+	return i;
+}
+
+// Save step
+void ClothParticleStore::saveStep(int begin, int end)
+{
+	memcpy(lastPos + begin, pos + begin, sizeof(ClothFloat4) * (end - begin));
+}
+
+// Assemble vertices
+void ClothParticleStore::assembleVertices(ClothVertex* vertices, int begin, int end, float alpha) const
+{
+	if (alpha >= 1.0f)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			vertices[i]			= render[i];
+			vertices[i].pos		= ClothFloat3(pos[i].x, pos[i].y, pos[i].z);
+		}
+
+		return;
+	}
+
+	for (int i = begin; i < end; i++)
+	{
+		vertices[i]			= render[i];
+		vertices[i].pos		= ClothFloat3(lastPos[i].x + (pos[i].x - lastPos[i].x) * alpha,
+									   lastPos[i].y + (pos[i].y - lastPos[i].y) * alpha,
+									   lastPos[i].z + (pos[i].z - lastPos[i].z) * alpha);
+	}
+}
+
+// Interpolate
+void ClothParticleStore::interpolate(ClothFloat4* out, int first, int w, float alpha) const
+{
+	const ClothFloat4* p = pos + first;
+
+	if (alpha >= 1.0f)
+	{
+		memcpy(out, p, sizeof(ClothFloat4) * w);
+		return;
+	}
+
+	const ClothFloat4* last = lastPos + first;
+
+	for (int i = 0; i < w; i++)
+	{
+		out[i] = ClothFloat4(last[i].x + (p[i].x - last[i].x) * alpha,
+						  last[i].y + (p[i].y - last[i].y) * alpha,
+						  last[i].z + (p[i].z - last[i].z) * alpha, p[i].w);
+	}
+}
+
+// Assemble grid vertices
+void ClothParticleStore::assembleGridVertices(ClothVertex* vertices, int first, int w, int h, int beginRow, int endRow, float alpha, ClothGridNormalsFn gridNormals) const
+{
+	if (w <= 0 || beginRow >= endRow)
+		return;
+
+	// Rows j - 1, j and j + 1 are held in slots (j + 2) % 3, j % 3 and (j + 1) % 3
+	std::vector<ClothFloat4> rows(w * 3);
+	std::vector<ClothFloat3> normals(w);
+
+	if (beginRow > 0)
+		interpolate(&rows[((beginRow - 1) % 3) * w], first + (beginRow - 1) * w, w, alpha);
+
+	interpolate(&rows[(beginRow % 3) * w], first + beginRow * w, w, alpha);
+
+	for (int j = beginRow; j < endRow; j++)
+	{
+		if (j + 1 < h)
+			interpolate(&rows[((j + 1) % 3) * w], first + (j + 1) * w, w, alpha);
+
+		const ClothFloat4* row		= &rows[(j % 3) * w];
+		const ClothFloat4* above	= j > 0 ? &rows[((j + 2) % 3) * w] : row;
+		const ClothFloat4* below	= j + 1 < h ? &rows[((j + 1) % 3) * w] : row;
+
+		gridNormals(above, row, below, w, 0, w, &normals[0]);
+
+		int k = first + j * w;
+
+		for (int i = 0; i < w; i++, k++)
+		{
+			vertices[k]			= render[k];
+			vertices[k].pos		= ClothFloat3(row[i].x, row[i].y, row[i].z);
+			vertices[k].normal	= normals[i];
+		}
+	}
+}
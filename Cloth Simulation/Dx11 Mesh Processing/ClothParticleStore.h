@@ -0,0 +1,63 @@
+#pragma once
+
+#include "ClothTypes.h"
+#include "ClothKernels.h"
+
+
+// Hot/cold split particle storage for the CPU solver.
+// The solver passes only read the hot streams - positions packed with the
+// inverse mass in w, and previous positions - so projecting a constraint
+// touches one aligned 16 byte element per particle instead of a whole
+// 52 byte Particle. The render attributes live in a cold stream that is
+// only read when a vertex buffer is assembled.
+class ClothParticleStore
+{
+private:
+	// Single allocation backing every stream
+	void*			memory;
+
+	// Interpolate the w particles from first alpha of the way from lastPos to pos
+	void interpolate(ClothFloat4* out, int first, int w, float alpha) const;
+
+public:
+	// Particles in use, and particles the streams have room for
+	int				count;
+	int				capacity;
+
+	// Hot streams (pos.w is the inverse mass, prevPos.w is padding)
+	ClothFloat4		*pos;
+	ClothFloat4		*prevPos;
+
+	// Cold streams - positions at the start of the last step, for interpolated
+	// rendering, and the render attributes (the pos member is not kept up to date)
+	ClothFloat4		*lastPos;
+	ClothVertex		*render;
+
+	// Constructor - room for particleCapacity particles if that is more than particleCount
+	ClothParticleStore(int particleCount, int particleCapacity = 0);
+	// Destructor
+	~ClothParticleStore();
+
+	// Copy particles into the streams
+	void load(const Particle* particles);
+
+	// Copy n particles into the streams starting at particle first
+	void load(const Particle* particles, int first, int n);
+
+	// Copy the leading particles of another store (as many as both hold)
+	void copy(const ClothParticleStore* other);
+
+	// Append a copy of particle source - returns its index, or -1 when the streams are full
+	int duplicate(int source);
+
+	// Copy the positions of particles [begin, end) to lastPos
+	void saveStep(int begin, int end);
+
+	// Write particles [begin, end) as render vertices, alpha of the way from lastPos to pos
+	void assembleVertices(ClothVertex* vertices, int begin, int end, float alpha = 1.0f) const;
+
+	// Same for rows [beginRow, endRow) of a w x h grid cloth starting at particle first, with
+	// unit normals from the interpolated positions. Each position is read once - the rows
+	// are interpolated into a three row scratch buffer the normals are taken from.
+	void assembleGridVertices(ClothVertex* vertices, int first, int w, int h, int beginRow, int endRow, float alpha, ClothGridNormalsFn gridNormals) const;
+};
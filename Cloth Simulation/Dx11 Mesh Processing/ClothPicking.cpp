@@ -0,0 +1,395 @@
+#include "ClothPicking.h"
+#include "ClothFpContract.h"
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+
+// Most triangles in a leaf - a node with more is split in two
+static const int leafSize		= 4;
+
+// Triangles, nodes and rays per worker chunk
+static const int triangleGrain	= 4096;
+static const int nodeGrain		= 1024;
+static const int rayGrain		= 64;
+
+// Deepest walk of a ray - the median splits keep the tree balanced, so 2^stackSize
+// triangles could not fill it
+static const int stackSize		= 64;
+
+
+#pragma region Helpers
+
+static inline float component(const ClothFloat3& v, int axis)
+{
+	return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+static inline ClothFloat3 sub(const ClothFloat4& a, const ClothFloat4& b)
+{
+	return ClothFloat3(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static inline ClothFloat3 cross(const ClothFloat3& a, const ClothFloat3& b)
+{
+	return ClothFloat3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+
+static inline float dot(const ClothFloat3& a, const ClothFloat3& b)
+{
+	return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+// Reciprocal of a direction component - a huge one for 0, so a slab the ray runs along
+// is never 0 * infinity
+static inline float reciprocal(float d)
+{
+	if (fabsf(d) > 1e-20f)
+		return 1.0f / d;
+
+	return d < 0.0f ? -1e20f : 1e20f;
+}
+
+// Where the ray enters the box of a node, if it does before tMax
+static inline bool enters(const ClothBvhNode& node, const ClothFloat3& origin, const ClothFloat3& inv, float tMax, float& entry)
+{
+	float x0 = (node.lower.x - origin.x) * inv.x, x1 = (node.upper.x - origin.x) * inv.x;
+	float y0 = (node.lower.y - origin.y) * inv.y, y1 = (node.upper.y - origin.y) * inv.y;
+	float z0 = (node.lower.z - origin.z) * inv.z, z1 = (node.upper.z - origin.z) * inv.z;
+
+	float tNear	= max(max(min(x0, x1), min(y0, y1)), max(min(z0, z1), 0.0f));
+	float tFar	= min(min(max(x0, x1), max(y0, y1)), min(max(z0, z1), tMax));
+
+	entry = tNear;
+
+	return tNear <= tFar;
+}
+
+#pragma endregion
+
+
+// Constructor
+ClothPicking::ClothPicking(const ClothTopology* clothTopology, ClothWorkerPool* workerPool)
+{
+	topology	= clothTopology;
+	pool		= workerPool;
+
+	vector<Particle> rest(topology->particleCount);
+
+	topology->buildParticles(rest.data());
+
+	vector<ClothFloat3> restPos(rest.size());
+	vector<ClothFloat4> restState(rest.size());
+
+	for (size_t i = 0; i < rest.size(); i++)
+	{
+		restPos[i]		= rest[i].vertex.pos;
+		restState[i]	= ClothFloat4(restPos[i].x, restPos[i].y, restPos[i].z, 1.0f);
+	}
+
+	build(restPos.data());
+	refit(restState.data());
+}
+
+// Build - a level at a time, the nodes of a level split in parallel
+void ClothPicking::build(const ClothFloat3* rest)
+{
+	int count = topology->totalIndices / 3;
+
+	nodes.clear();
+	levelFirst.clear();
+	triangles.resize(count);
+
+	if (count == 0)
+		return;
+
+	vector<ClothFloat3> centre(count);
+
+	const DWORD* indices	= topology->indices;
+	ClothFloat3* c			= centre.data();
+	int* order				= triangles.data();
+
+	pool->parallelFor(count, triangleGrain, [=](int begin, int end)
+	{
+		for (int t = begin; t < end; t++)
+		{
+			const ClothFloat3& a = rest[indices[t * 3]];
+			const ClothFloat3& b = rest[indices[t * 3 + 1]];
+			const ClothFloat3& d = rest[indices[t * 3 + 2]];
+
+			c[t]		= ClothFloat3((a.x + b.x + d.x) / 3.0f, (a.y + b.y + d.y) / 3.0f, (a.z + b.z + d.z) / 3.0f);
+			order[t]	= t;
+		}
+	});
+
+	// While building, every node holds its triangles [first, first + count)
+	nodes.push_back(ClothBvhNode());
+	nodes[0].first = 0;
+	nodes[0].count = count;
+
+	int first	= 0;
+	int end		= 1;
+
+	while (first < end)
+	{
+		levelFirst.push_back(first);
+
+		// The children of the level go after it, in the order of their parents
+		vector<int> child(end - first, -1);
+		int next = end;
+
+		for (int n = first; n < end; n++)
+		{
+			if (nodes[n].count > leafSize)
+			{
+				child[n - first] = next;
+				next += 2;
+			}
+		}
+
+		nodes.resize(next, ClothBvhNode());
+
+		ClothBvhNode* node		= nodes.data();
+		const int* childOf		= child.data();
+		int levelStart			= first;
+
+		pool->parallelFor(end - first, nodeGrain, [=](int begin, int stop)
+		{
+			for (int k = begin; k < stop; k++)
+			{
+				if (childOf[k] < 0)
+					continue;
+
+				ClothBvhNode& parent	= node[levelStart + k];
+				int lo					= parent.first;
+				int hi					= parent.first + parent.count;
+
+				// Widest axis of the triangle centres
+				ClothFloat3 lower = c[order[lo]], upper = lower;
+
+				for (int i = lo + 1; i < hi; i++)
+				{
+					const ClothFloat3& p = c[order[i]];
+
+					lower = ClothFloat3(min(lower.x, p.x), min(lower.y, p.y), min(lower.z, p.z));
+					upper = ClothFloat3(max(upper.x, p.x), max(upper.y, p.y), max(upper.z, p.z));
+				}
+
+				float ex = upper.x - lower.x, ey = upper.y - lower.y, ez = upper.z - lower.z;
+				int axis = ex >= ey && ex >= ez ? 0 : (ey >= ez ? 1 : 2);
+
+				// Half the triangles each side of the median, ties broken by triangle so the split
+				// is the same on every run
+				int mid = lo + (hi - lo) / 2;
+
+				nth_element(order + lo, order + mid, order + hi, [c, axis](int a, int b)
+				{
+					float ca = component(c[a], axis), cb = component(c[b], axis);
+
+					return ca < cb || (ca == cb && a < b);
+				});
+
+				ClothBvhNode& left	= node[childOf[k]];
+				ClothBvhNode& right	= node[childOf[k] + 1];
+
+				left.first		= lo;
+				left.count		= mid - lo;
+				right.first		= mid;
+				right.count		= hi - mid;
+				parent.first	= childOf[k];
+				parent.count	= 0;
+			}
+		});
+
+		first	= end;
+		end		= next;
+	}
+
+	levelFirst.push_back(end);
+}
+
+// Refit
+void ClothPicking::refit(const ClothFloat4* pos)
+{
+	ClothBvhNode* node		= nodes.data();
+	const int* order		= triangles.data();
+	const DWORD* indices	= topology->indices;
+
+	for (int level = levelCount() - 1; level >= 0; level--)
+	{
+		int first = levelFirst[level];
+
+		pool->parallelFor(levelFirst[level + 1] - first, nodeGrain, [=](int begin, int end)
+		{
+			for (int k = begin; k < end; k++)
+			{
+				ClothBvhNode& n = node[first + k];
+
+				// The level below is already fitted
+				if (n.count == 0)
+				{
+					const ClothBvhNode& a = node[n.first];
+					const ClothBvhNode& b = node[n.first + 1];
+
+					n.lower = ClothFloat3(min(a.lower.x, b.lower.x), min(a.lower.y, b.lower.y), min(a.lower.z, b.lower.z));
+					n.upper = ClothFloat3(max(a.upper.x, b.upper.x), max(a.upper.y, b.upper.y), max(a.upper.z, b.upper.z));
+
+					continue;
+				}
+
+				const ClothFloat4& p = pos[indices[order[n.first] * 3]];
+
+				ClothFloat3 lower(p.x, p.y, p.z), upper = lower;
+
+				for (int i = n.first; i < n.first + n.count; i++)
+				{
+					for (int corner = 0; corner < 3; corner++)
+					{
+						const ClothFloat4& q = pos[indices[order[i] * 3 + corner]];
+
+						lower = ClothFloat3(min(lower.x, q.x), min(lower.y, q.y), min(lower.z, q.z));
+						upper = ClothFloat3(max(upper.x, q.x), max(upper.y, q.y), max(upper.z, q.z));
+					}
+				}
+
+				n.lower = lower;
+				n.upper = upper;
+			}
+		});
+	}
+}
+
+// Intersect ray - nearest child first, so the far one is usually cut off by the hit
+void ClothPicking::intersectRay(const ClothFloat4* pos, const ClothRay& ray, ClothRayHit& hit) const
+{
+	hit.triangle	= -1;
+	hit.t			= ray.tMax;
+	hit.u			= 0.0f;
+	hit.v			= 0.0f;
+
+	if (nodes.empty())
+		return;
+
+	const ClothFloat3& o	= ray.origin;
+	const ClothFloat3& d	= ray.direction;
+	const DWORD* indices	= topology->indices;
+
+	ClothFloat3 inv(reciprocal(d.x), reciprocal(d.y), reciprocal(d.z));
+
+	int stack[stackSize];
+	int top = 0;
+
+	stack[top++] = 0;
+
+	while (top > 0)
+	{
+		const ClothBvhNode& n = nodes[stack[--top]];
+		float entry;
+
+		if (!enters(n, o, inv, hit.t, entry))
+			continue;
+
+		if (n.count == 0)
+		{
+			float leftEntry, rightEntry;
+
+			bool left	= enters(nodes[n.first], o, inv, hit.t, leftEntry);
+			bool right	= enters(nodes[n.first + 1], o, inv, hit.t, rightEntry);
+
+			// The farther child goes on the stack first, so the nearer one is walked first
+			if (left && right)
+			{
+				bool leftFirst = leftEntry <= rightEntry;
+
+				stack[top++] = leftFirst ? n.first + 1 : n.first;
+				stack[top++] = leftFirst ? n.first : n.first + 1;
+			}
+			else if (left)
+				stack[top++] = n.first;
+			else if (right)
+				stack[top++] = n.first + 1;
+
+			continue;
+		}
+
+		// Moller-Trumbore, either side
+		for (int i = n.first; i < n.first + n.count; i++)
+		{
+			int t = triangles[i];
+
+			const ClothFloat4& a = pos[indices[t * 3]];
+
+			ClothFloat3 e1 = sub(pos[indices[t * 3 + 1]], a);
+			ClothFloat3 e2 = sub(pos[indices[t * 3 + 2]], a);
+			ClothFloat3 p	= cross(d, e2);
+
+			float det = dot(e1, p);
+
+			// A dropped triangle has no area
+			if (det == 0.0f)
+				continue;
+
+			float invDet = 1.0f / det;
+
+			ClothFloat3 s(o.x - a.x, o.y - a.y, o.z - a.z);
+
+			float u = dot(s, p) * invDet;
+
+			if (u < 0.0f || u > 1.0f)
+				continue;
+
+			ClothFloat3 q = cross(s, e1);
+
+			float v = dot(d, q) * invDet;
+
+			if (v < 0.0f || u + v > 1.0f)
+				continue;
+
+			float distance = dot(e2, q) * invDet;
+
+			if (distance < 0.0f || distance >= hit.t)
+				continue;
+
+			hit.triangle	= t;
+			hit.t			= distance;
+			hit.u			= u;
+			hit.v			= v;
+		}
+	}
+}
+
+// Intersect
+void ClothPicking::intersect(const ClothFloat4* pos, const ClothRay* rays, int count, ClothRayHit* hits) const
+{
+	pool->parallelFor(count, rayGrain, [=](int begin, int end)
+	{
+		for (int r = begin; r < end; r++)
+			intersectRay(pos, rays[r], hits[r]);
+	});
+}
+
+// Node count
+int ClothPicking::nodeCount() const
+{
+	return (int)nodes.size();
+}
+
+// Level count
+int ClothPicking::levelCount() const
+{
+	return levelFirst.empty() ? 0 : (int)levelFirst.size() - 1;
+}
+
+// Bounds
+void ClothPicking::bounds(ClothFloat3& lower, ClothFloat3& upper) const
+{
+	if (nodes.empty())
+	{
+		lower = ClothFloat3(0.0f, 0.0f, 0.0f);
+		upper = lower;
+		return;
+	}
+
+	lower = nodes[0].lower;
+	upper = nodes[0].upper;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include "ClothTypes.h"
+#include "ClothTopology.h"
+#include "ClothWorkerPool.h"
+
+
+// Ray from origin along direction, out to tMax directions (direction need not be unit length)
+struct ClothRay
+{
+	ClothFloat3	origin;
+	float		tMax;
+	ClothFloat3	direction;
+};
+
+// Nearest hit of a ray - triangle -1 for a miss. The point hit is origin + t * direction,
+// and (1 - u - v) * a + u * b + v * c over the corners a, b and c of the triangle.
+struct ClothRayHit
+{
+	int			triangle;
+	float		t;
+	float		u, v;
+};
+
+// Point of a triangle, at (u, v) as in ClothRayHit, pulled stiffness of the way to target
+// in every constraint pass (triangle -1 for none)
+struct ClothDrag
+{
+	int			triangle;
+	float		u, v;
+	ClothFloat3	target;
+	float		stiffness;
+};
+
+
+// Bounding volume hierarchy over the triangles of a deforming cloth, for picking and
+// hit tests. The tree is built once from the rest state, median splits along the
+// widest axis of the triangle centres, and is laid out a level at a time - the nodes
+// of each depth are next to each other, after the nodes above. Only the bounds change
+// as the cloth moves: refit sweeps the levels bottom up, each in a parallelFor, the
+// leaves boxing their triangles and the nodes above their two children. A refit tree
+// is looser than a rebuilt one once the cloth folds, but a cloth keeps its neighbours
+// close, so it stays tight enough to walk quickly.
+//
+// The triangles are read through the topology indices at every refit and query, so a
+// tree stays valid while the cloth tears - a triangle moved to a new particle is boxed
+// where that particle is, and a dropped one is too thin to hit.
+class ClothPicking
+{
+private:
+	const ClothTopology*		topology;
+	ClothWorkerPool*			pool;
+
+	std::vector<ClothBvhNode>	nodes;
+
+	// Triangles in leaf order
+	std::vector<int>			triangles;
+
+	// First node of each level, and one past the last level
+	std::vector<int>			levelFirst;
+
+	// Tree setup over the rest positions
+	void build(const ClothFloat3* rest);
+
+	// Nearest hit of one ray
+	void intersectRay(const ClothFloat4* pos, const ClothRay& ray, ClothRayHit& hit) const;
+
+public:
+	// Constructor - tree over the triangles of the topology, which must outlive this
+	ClothPicking(const ClothTopology* clothTopology, ClothWorkerPool* workerPool);
+
+	// Fit the bounds to the particles
+	void refit(const ClothFloat4* pos);
+
+	// Nearest hit of each of count rays, in parallel. The triangles are tested where the
+	// particles are, but found through the bounds of the last refit, so refit after the
+	// particles move. Both sides of a triangle are hit.
+	void intersect(const ClothFloat4* pos, const ClothRay* rays, int count, ClothRayHit* hits) const;
+
+	// Accessors
+	int nodeCount() const;
+	int levelCount() const;
+	void bounds(ClothFloat3& lower, ClothFloat3& upper) const;
+};
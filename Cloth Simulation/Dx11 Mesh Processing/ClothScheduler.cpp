@@ -0,0 +1,62 @@
+#include "ClothScheduler.h"
+#include "ClothFpContract.h"
+
+// Constructor
+ClothScheduler::ClothScheduler(float stepSeconds, int maxStepsPerFrame)
+{
+	stepTime	= stepSeconds;
+	maxSteps	= maxStepsPerFrame;
+
+	reset();
+}
+
+// Advance
+int ClothScheduler::advance(double frameSeconds)
+{
+	if (stepTime <= 0.0f || frameSeconds <= 0.0)
+		return 0;
+
+	accumulator += frameSeconds;
+
+	int steps = (int)(accumulator / stepTime);
+
+	// Spiral of death - if the steps cost more than the frame time the debt grows
+	// every frame, so run at most maxSteps and let the simulation slow down instead
+	if (steps > maxSteps)
+	{
+		droppedSteps	+= steps - maxSteps;
+		accumulator		-= (double)(steps - maxSteps) * stepTime;
+		steps			= maxSteps;
+	}
+
+	accumulator -= (double)steps * stepTime;
+
+	if (accumulator < 0.0)
+		accumulator = 0.0;
+
+	return steps;
+}
+
+// Interpolation factor
+float ClothScheduler::alpha() const
+{
+	if (stepTime <= 0.0f)
+		return 1.0f;
+
+	float a = (float)(accumulator / stepTime);
+
+	return a < 1.0f ? a : 1.0f;
+}
+
+// Reset
+void ClothScheduler::reset()
+{
+	accumulator		= 0.0;
+	droppedSteps	= 0;
+}
+
+// Dropped steps
+int ClothScheduler::dropped() const
+{
+	return droppedSteps;
+}
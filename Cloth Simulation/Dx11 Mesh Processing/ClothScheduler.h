@@ -0,0 +1,38 @@
+#pragma once
+
+
+// Fixed timestep accumulator - turns the variable frame time into a whole number
+// of simulation steps of stepTime seconds. The time left over is carried to the
+// next frame and exposed as an interpolation factor so rendering can blend the
+// last two simulated states.
+class ClothScheduler
+{
+private:
+	// Simulated time owed, in seconds - always less than stepTime after advance
+	double	accumulator;
+
+	// Steps dropped by the catch-up cap since the last reset
+	int		droppedSteps;
+
+public:
+	// Constructor
+	ClothScheduler(float stepSeconds = 1.0f / 60.0f, int maxStepsPerFrame = 4);
+
+	// Add the frame time and return the number of steps to run now (0 to maxSteps)
+	int advance(double frameSeconds);
+
+	// Fraction of a step the render time lies past the last simulated state, in [0, 1)
+	float alpha() const;
+
+	// Forget any time owed
+	void reset();
+
+	// Steps dropped so far to stop the simulation falling ever further behind
+	int dropped() const;
+
+	// Seconds per simulation step
+	float stepTime;
+
+	// Most steps run in one frame - slower frames drop time rather than catch up
+	int maxSteps;
+};
@@ -0,0 +1,709 @@
+#include "ClothSelfCollision.h"
+#include "ClothFpContract.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+// Particles per worker chunk of the hash build
+static const int hashGrain		= 4096;
+
+// Bits of the slot sorted by each counting sort pass, and the counts each chunk keeps
+static const int digitBits		= 11;
+static const int digitCount		= 1 << digitBits;
+
+// Smallest hash table
+static const unsigned int minSlots	= 1024;
+
+
+#pragma region Helpers
+
+// Point of the triangle (a, b, c) closest to p (Ericson, Real-Time Collision Detection 5.1.5)
+static ClothFloat3 closestOnTriangle(const ClothFloat4& p, const ClothFloat4& a, const ClothFloat4& b, const ClothFloat4& c)
+{
+	float abx = b.x - a.x, aby = b.y - a.y, abz = b.z - a.z;
+	float acx = c.x - a.x, acy = c.y - a.y, acz = c.z - a.z;
+	float apx = p.x - a.x, apy = p.y - a.y, apz = p.z - a.z;
+
+	float d1 = abx * apx + aby * apy + abz * apz;
+	float d2 = acx * apx + acy * apy + acz * apz;
+
+	if (d1 <= 0.0f && d2 <= 0.0f)
+		return ClothFloat3(a.x, a.y, a.z);
+
+	float bpx = p.x - b.x, bpy = p.y - b.y, bpz = p.z - b.z;
+	float d3 = abx * bpx + aby * bpy + abz * bpz;
+	float d4 = acx * bpx + acy * bpy + acz * bpz;
+
+	if (d3 >= 0.0f && d4 <= d3)
+		return ClothFloat3(b.x, b.y, b.z);
+
+	float vc = d1 * d4 - d3 * d2;
+
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+	{
+		float v = d1 / (d1 - d3);
+		return ClothFloat3(a.x + abx * v, a.y + aby * v, a.z + abz * v);
+	}
+
+	float cpx = p.x - c.x, cpy = p.y - c.y, cpz = p.z - c.z;
+	float d5 = abx * cpx + aby * cpy + abz * cpz;
+	float d6 = acx * cpx + acy * cpy + acz * cpz;
+
+	if (d6 >= 0.0f && d5 <= d6)
+		return ClothFloat3(c.x, c.y, c.z);
+
+	float vb = d5 * d2 - d1 * d6;
+
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+	{
+		float w = d2 / (d2 - d6);
+		return ClothFloat3(a.x + acx * w, a.y + acy * w, a.z + acz * w);
+	}
+
+	float va = d3 * d6 - d5 * d4;
+
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+	{
+		float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		return ClothFloat3(b.x + (c.x - b.x) * w, b.y + (c.y - b.y) * w, b.z + (c.z - b.z) * w);
+	}
+
+	float denom = 1.0f / (va + vb + vc);
+	float v = vb * denom;
+	float w = vc * denom;
+
+	return ClothFloat3(a.x + abx * v + acx * w, a.y + aby * v + acy * w, a.z + abz * v + acz * w);
+}
+
+static inline float min3(float a, float b, float c)
+{
+	float m = a < b ? a : b;
+
+	return c < m ? c : m;
+}
+
+static inline float max3(float a, float b, float c)
+{
+	float m = a > b ? a : b;
+
+	return c > m ? c : m;
+}
+
+static inline DWORD lowestCorner(const DWORD* corner)
+{
+	DWORD lowest = corner[0] < corner[1] ? corner[0] : corner[1];
+
+	return corner[2] < lowest ? corner[2] : lowest;
+}
+
+static inline bool collapsed(const DWORD* corner)
+{
+	return corner[1] == corner[0] && corner[2] == corner[0];
+}
+
+static inline float distanceSq(const ClothFloat4& a, const ClothFloat4& b)
+{
+	float x = a.x - b.x, y = a.y - b.y, z = a.z - b.z;
+
+	return x * x + y * y + z * z;
+}
+
+#pragma endregion
+
+
+// Constructor
+ClothSelfCollision::ClothSelfCollision(const ClothTopology* topology, ClothWorkerPool* workerPool, float clothThickness)
+{
+	pool	= workerPool;
+	count	= topology->particleCount;
+	built	= false;
+	hashed	= 0;
+	stretch	= 1.25f;
+
+	// Links - both ends of every constraint, sorted per particle. A constraint removed by a
+	// tear is left joining a particle to itself, and links nothing.
+	linkOffset.assign(count + 1, 0);
+
+	float totalLength		= 0.0f;
+	int liveConstraints		= 0;
+	longestEdge				= 0.0f;
+
+	for (int c = 0; c < topology->totalConstraints; c++)
+	{
+		const Constraint& constraint = topology->constraints[c];
+
+		if (constraint.start == constraint.end)
+			continue;
+
+		linkOffset[constraint.start + 1]++;
+		linkOffset[constraint.end + 1]++;
+
+		totalLength += constraint.length;
+		liveConstraints++;
+
+		if (constraint.length > longestEdge)
+			longestEdge = constraint.length;
+	}
+
+	for (int i = 0; i < count; i++)
+		linkOffset[i + 1] += linkOffset[i];
+
+	links.resize(linkOffset[count]);
+
+	vector<int> next(linkOffset.begin(), linkOffset.end() - 1);
+
+	for (int c = 0; c < topology->totalConstraints; c++)
+	{
+		const Constraint& constraint = topology->constraints[c];
+
+		if (constraint.start == constraint.end)
+			continue;
+
+		links[next[constraint.start]++]	= constraint.end;
+		links[next[constraint.end]++]	= constraint.start;
+	}
+
+	for (int i = 0; i < count; i++)
+		sort(links.begin() + linkOffset[i], links.begin() + linkOffset[i + 1]);
+
+	linkEnd.assign(linkOffset.begin() + 1, linkOffset.end());
+	linkOffset.pop_back();
+
+	// Triangles grouped by their lowest numbered corner - one dropped by a tear is collapsed
+	// onto a corner, and left out
+	int totalTriangles = topology->totalIndices / 3;
+	const DWORD* indices = topology->indices;
+
+	triangleOffset.assign(count + 1, 0);
+
+	for (int t = 0; t < totalTriangles; t++)
+	{
+		if (!collapsed(indices + t * 3))
+			triangleOffset[lowestCorner(indices + t * 3) + 1]++;
+	}
+
+	for (int i = 0; i < count; i++)
+		triangleOffset[i + 1] += triangleOffset[i];
+
+	liveTriangles = triangleOffset[count];
+
+	triangles.resize(liveTriangles * 3);
+	next.assign(triangleOffset.begin(), triangleOffset.end() - 1);
+
+	for (int t = 0; t < totalTriangles; t++)
+	{
+		if (collapsed(indices + t * 3))
+			continue;
+
+		int k = next[lowestCorner(indices + t * 3)]++;
+
+		triangles[k * 3]		= indices[t * 3];
+		triangles[k * 3 + 1]	= indices[t * 3 + 1];
+		triangles[k * 3 + 2]	= indices[t * 3 + 2];
+	}
+
+	triangleEnd.assign(triangleOffset.begin() + 1, triangleOffset.end());
+	triangleOffset.pop_back();
+
+	if (clothThickness > 0.0f)
+		thickness = clothThickness;
+	else
+		thickness = liveConstraints ? 0.5f * totalLength / (float)liveConstraints : 0.01f;
+
+	slotMask	= 0;
+	cellSize	= thickness + longestEdge * stretch;
+
+	allocate();
+}
+
+// Allocate - twice as many slots as particles keeps most cells in a slot of their own
+void ClothSelfCollision::allocate()
+{
+	unsigned int slots = minSlots;
+
+	while (slots < (unsigned int)count * 2)
+		slots <<= 1;
+
+	// A bigger table hashes every cell to another slot, so it starts empty
+	if (slots != slotMask + 1)
+	{
+		slotMask = slots - 1;
+		slotStart.assign(slots, 0);
+		slotEnd.assign(slots, 0);
+		built = false;
+	}
+
+	keys.resize(count);
+	keyScratch.resize(count);
+	order.resize(count);
+	orderScratch.resize(count);
+	sortedPos.resize(count);
+	bounds.resize(triangles.size() / 3 * 2 + 1);
+	place.resize(count);
+	histogram.resize(((count + hashGrain - 1) / hashGrain + 1) * digitCount);
+}
+
+// Follow tears - the lists of each changed particle are redone from those of tearing, in the
+// order the constructor gives them
+void ClothSelfCollision::followTears(const ClothTopology* topology, const ClothTearing& tearing, const vector<int>& changed)
+{
+	// The new particles are hashed from the next build on
+	if (topology->particleCount > count)
+	{
+		count = topology->particleCount;
+
+		linkOffset.resize(count, 0);
+		linkEnd.resize(count, 0);
+		triangleOffset.resize(count, 0);
+		triangleEnd.resize(count, 0);
+	}
+
+	const DWORD* indices = topology->indices;
+
+	for (size_t c = 0; c < changed.size(); c++)
+	{
+		int i = changed[c];
+
+		// Links - the far end of each live constraint around the particle
+		const vector<int>& slots = tearing.constraintsAround(i);
+
+		followed.resize(slots.size());
+
+		for (size_t k = 0; k < slots.size(); k++)
+		{
+			const Constraint& constraint = topology->constraints[slots[k]];
+
+			followed[k] = constraint.start == (unsigned int)i ? constraint.end : constraint.start;
+		}
+
+		sort(followed.begin(), followed.end());
+
+		int first = linkOffset[i];
+
+		if ((int)followed.size() > linkEnd[i] - first)
+		{
+			first = (int)links.size();
+			links.resize(first + followed.size());
+		}
+
+		copy(followed.begin(), followed.end(), links.begin() + first);
+
+		linkOffset[i]	= first;
+		linkEnd[i]		= first + (int)followed.size();
+
+		// Triangles - those around the particle it is the lowest corner of, in triangle order
+		const vector<int>& around = tearing.trianglesAround(i);
+
+		followed.clear();
+
+		for (size_t k = 0; k < around.size(); k++)
+		{
+			if (lowestCorner(indices + around[k] * 3) == (DWORD)i)
+				followed.push_back(around[k]);
+		}
+
+		sort(followed.begin(), followed.end());
+
+		first = triangleOffset[i];
+		liveTriangles -= triangleEnd[i] - first;
+
+		if ((int)followed.size() > triangleEnd[i] - first)
+		{
+			first = (int)triangles.size() / 3;
+			triangles.resize((first + followed.size()) * 3);
+		}
+
+		for (size_t k = 0; k < followed.size(); k++)
+		{
+			const DWORD* corner = indices + followed[k] * 3;
+
+			triangles[(first + k) * 3]		= corner[0];
+			triangles[(first + k) * 3 + 1]	= corner[1];
+			triangles[(first + k) * 3 + 2]	= corner[2];
+		}
+
+		triangleOffset[i]	= first;
+		triangleEnd[i]		= first + (int)followed.size();
+		liveTriangles		+= (int)followed.size();
+	}
+
+	allocate();
+}
+
+// Linked
+bool ClothSelfCollision::linked(int a, int b) const
+{
+	const int* first	= links.data() + linkOffset[a];
+	const int* last		= links.data() + linkEnd[a];
+
+	for (const int* l = first; l < last; l++)
+	{
+		if (*l >= b)
+			return *l == b;
+	}
+
+	return false;
+}
+
+// Slot of a cell
+unsigned int ClothSelfCollision::slotOf(int x, int y, int z) const
+{
+	return ((unsigned int)x * 92837111u ^ (unsigned int)y * 689287499u ^ (unsigned int)z * 283923481u) & slotMask;
+}
+
+// Build
+void ClothSelfCollision::build(const ClothFloat4* pos)
+{
+	if (count == 0)
+		return;
+
+	int n = count;
+	ClothSelfCollision* self = this;
+
+	// Empty the slots used by the last build - the sorted slots from then are still in keys
+	if (built)
+	{
+		const unsigned int* sortedKeys = keys.data();
+		int* start	= slotStart.data();
+		int* end	= slotEnd.data();
+
+		pool->parallelFor(hashed, hashGrain, [=](int begin, int last)
+		{
+			for (int s = begin; s < last; s++)
+			{
+				if (s == 0 || sortedKeys[s] != sortedKeys[s - 1])
+				{
+					start[sortedKeys[s]]	= 0;
+					end[sortedKeys[s]]		= 0;
+				}
+			}
+		});
+	}
+
+	cellSize = thickness + longestEdge * stretch;
+
+	float inverseCell = 1.0f / cellSize;
+
+	// Slot of each particle
+	{
+		unsigned int* key	= keys.data();
+		int* index			= order.data();
+
+		pool->parallelFor(n, hashGrain, [=](int begin, int end)
+		{
+			for (int i = begin; i < end; i++)
+			{
+				key[i]		= self->slotOf((int)floorf(pos[i].x * inverseCell), (int)floorf(pos[i].y * inverseCell), (int)floorf(pos[i].z * inverseCell));
+				index[i]	= i;
+			}
+		});
+	}
+
+	// Counting sort a digit at a time, lowest first - each pass keeps the order of the last within a digit
+	int chunks = (n + hashGrain - 1) / hashGrain;
+
+	for (int shift = 0; shift < 32 && (slotMask >> shift) != 0; shift += digitBits)
+	{
+		const unsigned int* inKey	= keys.data();
+		const int* inIndex			= order.data();
+		unsigned int* outKey		= keyScratch.data();
+		int* outIndex				= orderScratch.data();
+		int* counts					= histogram.data();
+
+		// The pool runs the whole range in one call when it has no workers, so the chunks are split out again
+		pool->parallelFor(n, hashGrain, [=](int begin, int end)
+		{
+			for (int first = begin; first < end; first += hashGrain)
+			{
+				int* chunkCounts	= counts + (first / hashGrain) * digitCount;
+				int last			= first + hashGrain < end ? first + hashGrain : end;
+
+				memset(chunkCounts, 0, sizeof(int) * digitCount);
+
+				for (int i = first; i < last; i++)
+					chunkCounts[(inKey[i] >> shift) & (digitCount - 1)]++;
+			}
+		});
+
+		// Offsets - every chunk of a digit before the next digit, chunks in order
+		int offset = 0;
+
+		for (int d = 0; d < digitCount; d++)
+		{
+			for (int c = 0; c < chunks; c++)
+			{
+				int k = counts[c * digitCount + d];
+
+				counts[c * digitCount + d] = offset;
+				offset += k;
+			}
+		}
+
+		pool->parallelFor(n, hashGrain, [=](int begin, int end)
+		{
+			for (int first = begin; first < end; first += hashGrain)
+			{
+				int* chunkOffsets	= counts + (first / hashGrain) * digitCount;
+				int last			= first + hashGrain < end ? first + hashGrain : end;
+
+				for (int i = first; i < last; i++)
+				{
+					int s = chunkOffsets[(inKey[i] >> shift) & (digitCount - 1)]++;
+
+					outKey[s]	= inKey[i];
+					outIndex[s]	= inIndex[i];
+				}
+			}
+		});
+
+		keys.swap(keyScratch);
+		order.swap(orderScratch);
+	}
+
+	// Sorted positions and the range of each slot
+	{
+		const unsigned int* sortedKeys	= keys.data();
+		const int* sorted				= order.data();
+		ClothFloat4* sortedP			= sortedPos.data();
+		int* where						= place.data();
+		int* start						= slotStart.data();
+		int* end						= slotEnd.data();
+
+		pool->parallelFor(n, hashGrain, [=](int begin, int last)
+		{
+			for (int s = begin; s < last; s++)
+			{
+				sortedP[s]			= pos[sorted[s]];
+				where[sorted[s]]	= s;
+
+				if (s == 0 || sortedKeys[s] != sortedKeys[s - 1])
+					start[sortedKeys[s]] = s;
+
+				if (s == n - 1 || sortedKeys[s] != sortedKeys[s + 1])
+					end[sortedKeys[s]] = s + 1;
+			}
+		});
+	}
+
+	// Triangle bounds, grown by the thickness
+	{
+		const DWORD* corners		= triangles.data();
+		const ClothFloat4* sortedP	= sortedPos.data();
+		const int* where			= place.data();
+		ClothFloat3* box			= bounds.data();
+		float t						= thickness;
+
+		pool->parallelFor((int)triangles.size() / 3, hashGrain, [=](int begin, int end)
+		{
+			for (int k = begin; k < end; k++)
+			{
+				const ClothFloat4& a = sortedP[where[corners[k * 3]]];
+				const ClothFloat4& b = sortedP[where[corners[k * 3 + 1]]];
+				const ClothFloat4& c = sortedP[where[corners[k * 3 + 2]]];
+
+				box[k * 2]		= ClothFloat3(min3(a.x, b.x, c.x) - t, min3(a.y, b.y, c.y) - t, min3(a.z, b.z, c.z) - t);
+				box[k * 2 + 1]	= ClothFloat3(max3(a.x, b.x, c.x) + t, max3(a.y, b.y, c.y) + t, max3(a.z, b.z, c.z) + t);
+			}
+		});
+	}
+
+	built	= true;
+	hashed	= n;
+}
+
+// Collide one particle - every contact pushes it out by its share of the overlap, and
+// the pushes are averaged so contacts found from both sides are not counted twice
+void ClothSelfCollision::collideParticle(ClothFloat4* pos, int i) const
+{
+	const ClothFloat4& p = sortedPos[place[i]];
+
+	float reachSq		= cellSize * cellSize;
+	float thicknessSq	= thickness * thickness;
+	float inverseCell	= 1.0f / cellSize;
+
+	int cx = (int)floorf(p.x * inverseCell);
+	int cy = (int)floorf(p.y * inverseCell);
+	int cz = (int)floorf(p.z * inverseCell);
+
+	float pushX = 0.0f, pushY = 0.0f, pushZ = 0.0f;
+	int contacts = 0;
+
+	// Cells sharing a slot with one already visited are skipped
+	unsigned int visited[27];
+	int visitedCount = 0;
+
+	for (int dz = -1; dz <= 1; dz++)
+	{
+		for (int dy = -1; dy <= 1; dy++)
+		{
+			for (int dx = -1; dx <= 1; dx++)
+			{
+				unsigned int slot = slotOf(cx + dx, cy + dy, cz + dz);
+				int first = slotStart[slot], last = slotEnd[slot];
+
+				if (first == last)
+					continue;
+
+				bool seen = false;
+
+				for (int v = 0; v < visitedCount && !seen; v++)
+					seen = visited[v] == slot;
+
+				if (seen)
+					continue;
+
+				visited[visitedCount++] = slot;
+
+				for (int s = first; s < last; s++)
+				{
+					int j = order[s];
+
+					if (j == i)
+						continue;
+
+					const ClothFloat4& q = sortedPos[s];
+					float dSq = distanceSq(p, q);
+
+					if (dSq >= reachSq)
+						continue;
+
+					// Particle against particle
+					if (dSq < thicknessSq && !linked(i, j))
+					{
+						float d = sqrtf(dSq);
+						float share = p.w / (p.w + q.w);
+
+						// Coincident particles are parted along y, in opposite directions
+						float nx = 0.0f, ny = i < j ? 1.0f : -1.0f, nz = 0.0f;
+
+						if (d > 1e-9f)
+						{
+							nx = (p.x - q.x) / d;
+							ny = (p.y - q.y) / d;
+							nz = (p.z - q.z) / d;
+						}
+
+						pushX += nx * (thickness - d) * share;
+						pushY += ny * (thickness - d) * share;
+						pushZ += nz * (thickness - d) * share;
+						contacts++;
+					}
+
+					// Particle against the triangles j is the lowest corner of - every corner of a
+					// triangle within thickness of the particle is in reach, so each is tested once
+					for (int k = triangleOffset[j]; k < triangleEnd[j]; k++)
+					{
+						const DWORD* corner = triangles.data() + k * 3;
+
+						// Box and plane tests first - most triangles in reach are not within thickness
+						const ClothFloat3& lower = bounds[k * 2];
+						const ClothFloat3& upper = bounds[k * 2 + 1];
+
+						if (p.x < lower.x || p.x > upper.x || p.y < lower.y || p.y > upper.y || p.z < lower.z || p.z > upper.z)
+							continue;
+
+						const ClothFloat4& a = sortedPos[place[corner[0]]];
+						const ClothFloat4& b = sortedPos[place[corner[1]]];
+						const ClothFloat4& c = sortedPos[place[corner[2]]];
+
+						float abx = b.x - a.x, aby = b.y - a.y, abz = b.z - a.z;
+						float acx = c.x - a.x, acy = c.y - a.y, acz = c.z - a.z;
+
+						float normalX = aby * acz - abz * acy;
+						float normalY = abz * acx - abx * acz;
+						float normalZ = abx * acy - aby * acx;
+						float normalSq = normalX * normalX + normalY * normalY + normalZ * normalZ;
+
+						float side = (p.x - a.x) * normalX + (p.y - a.y) * normalY + (p.z - a.z) * normalZ;
+
+						if (normalSq <= 0.0f || side * side >= thicknessSq * normalSq)
+							continue;
+
+						ClothFloat3 closest = closestOnTriangle(p, a, b, c);
+
+						float ex = p.x - closest.x, ey = p.y - closest.y, ez = p.z - closest.z;
+						float eSq = ex * ex + ey * ey + ez * ez;
+
+						if (eSq >= thicknessSq)
+							continue;
+
+						bool skip = false;
+
+						for (int v = 0; v < 3 && !skip; v++)
+							skip = (int)corner[v] == i || linked(i, (int)corner[v]);
+
+						if (skip)
+							continue;
+
+						float d = sqrtf(eSq);
+						float weight = (a.w + b.w + c.w) / 3.0f;
+						float share = p.w / (p.w + weight);
+
+						// On the triangle - out of the side the particle is on
+						if (d <= 1e-9f)
+						{
+							float normalLength = (side < 0.0f ? -1.0f : 1.0f) * sqrtf(normalSq);
+
+							ex = normalX / normalLength;
+							ey = normalY / normalLength;
+							ez = normalZ / normalLength;
+						}
+						else
+						{
+							ex /= d;
+							ey /= d;
+							ez /= d;
+						}
+
+						pushX += ex * (thickness - d) * share;
+						pushY += ey * (thickness - d) * share;
+						pushZ += ez * (thickness - d) * share;
+						contacts++;
+					}
+				}
+			}
+		}
+	}
+
+	if (contacts)
+	{
+		float scale = 1.0f / (float)contacts;
+
+		pos[i].x += pushX * scale;
+		pos[i].y += pushY * scale;
+		pos[i].z += pushZ * scale;
+	}
+}
+
+// Collide
+void ClothSelfCollision::collide(ClothFloat4* pos, int begin, int end) const
+{
+	if (!built)
+		return;
+
+	for (int i = begin; i < end; i++)
+	{
+		if (pos[i].w > 0.0f)
+			collideParticle(pos, i);
+	}
+}
+
+// Particle count
+int ClothSelfCollision::particleCount() const
+{
+	return count;
+}
+
+// Triangle count
+int ClothSelfCollision::triangleCount() const
+{
+	return liveTriangles;
+}
+
+// Spacing
+float ClothSelfCollision::spacing() const
+{
+	return cellSize;
+}
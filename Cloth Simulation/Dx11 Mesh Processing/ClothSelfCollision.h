@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+#include "ClothTypes.h"
+#include "ClothTopology.h"
+#include "ClothWorkerPool.h"
+#include "ClothTearing.h"
+
+
+// Collision of the cloth with itself for the CPU solver. The particles are hashed
+// into a uniform grid of cells, spread over a table of twice as many slots as there
+// are particles, which is rebuilt from scratch every time the cloth is collided. The
+// particles are sorted by slot with a parallel counting sort, a digit of the slot at
+// a time: each worker chunk counts its particles per digit, the counts are summed into
+// an offset for each chunk and digit, and each chunk scatters its particles to its
+// offsets. No locks are taken and nothing is allocated per cell.
+//
+// A particle closer than thickness to another particle or to a triangle of the cloth
+// is pushed out to thickness, except from the particles it shares a constraint with
+// and the triangles touching those, which the constraints already keep apart. Only the
+// particle queried is moved, so the particles can be collided in parallel. The cells
+// are thickness plus the longest rest edge (with some stretch) across, so a triangle
+// near a particle always has a corner in the cells around it.
+//
+// A tear only changes the links and triangles of the particles it touches, so only
+// theirs are redone - a list that grows goes to the end of the others, and the table
+// grows when the new particles fill it past half.
+class ClothSelfCollision
+{
+private:
+	ClothWorkerPool*			pool;
+	int							count;
+
+	// Particles each particle shares a constraint with, [linkOffset, linkEnd) of links
+	std::vector<int>			linkOffset;
+	std::vector<int>			linkEnd;
+	std::vector<int>			links;
+
+	// Cloth triangles grouped by their lowest numbered corner - those of each particle are
+	// [triangleOffset, triangleEnd), and liveTriangles are in a group
+	std::vector<DWORD>			triangles;
+	std::vector<int>			triangleOffset;
+	std::vector<int>			triangleEnd;
+	int							liveTriangles;
+
+	// Longest constraint rest length - every triangle edge is a constraint
+	float						longestEdge;
+
+	// Cell size and table slots (a power of two) of the last build
+	float						cellSize;
+	unsigned int				slotMask;
+
+	// Slots and particles sorted by slot, with the scratch arrays the sort passes
+	// alternate with (the slot of each particle and the particles in order before the sort)
+	std::vector<unsigned int>	keys, keyScratch;
+	std::vector<int>			order, orderScratch;
+
+	// Positions at the last build in sorted order, and where each particle went in it
+	std::vector<ClothFloat4>	sortedPos;
+	std::vector<int>			place;
+
+	// Lower and upper corner of each triangle at the last build, grown by the thickness
+	std::vector<ClothFloat3>		bounds;
+
+	// Count of each digit in each chunk during the sort
+	std::vector<int>			histogram;
+
+	// Range of the sorted particles in each slot (empty for the unused slots), and the
+	// particles the last build hashed
+	std::vector<int>			slotStart, slotEnd;
+	bool						built;
+	int							hashed;
+
+	// Links or triangles of a particle being followed through a tear
+	std::vector<int>			followed;
+
+	// Whether particles a and b share a constraint
+	bool linked(int a, int b) const;
+
+	// Slot of the cell (x, y, z)
+	unsigned int slotOf(int x, int y, int z) const;
+
+	// Push particle i out of the particles and triangles around it
+	void collideParticle(ClothFloat4* pos, int i) const;
+
+	// Size the table and the per particle arrays for count particles
+	void allocate();
+
+public:
+	// Constructor - links and triangles of the topology. thickness 0 uses half the mean rest length.
+	ClothSelfCollision(const ClothTopology* topology, ClothWorkerPool* workerPool, float clothThickness = 0.0f);
+
+	// Follow tears of the topology - the links and triangles of the changed particles, and the
+	// particles added to the topology, come from tearing
+	void followTears(const ClothTopology* topology, const ClothTearing& tearing, const std::vector<int>& changed);
+
+	// Hash the particle positions - call before collide whenever the particles have moved
+	void build(const ClothFloat4* pos);
+
+	// Push the movable particles [begin, end) out of the rest of the cloth, as hashed by the last build
+	void collide(ClothFloat4* pos, int begin, int end) const;
+
+	// Accessors
+	int particleCount() const;
+	int triangleCount() const;
+	float spacing() const;
+
+	// Distance kept between the unlinked parts of the cloth
+	float thickness;
+
+	// Stretch of the triangle edges the cells allow for
+	float stretch;
+};
@@ -0,0 +1,217 @@
+#include "ClothSet.h"
+#include "ClothFpContract.h"
+#include <iostream>
+#include "Source\buffers.h"
+
+using namespace std;
+
+
+// Constructor
+ClothSet::ClothSet(ID3D11Device *device, ID3DBlob *vsBytecode, ClothWorkerPool *cpuPool)
+{
+	solver			= new ClothSetSolver(cpuPool);
+	vertexCapacity	= 0;
+	anchorOn		= true;
+
+	try
+	{
+		if (!device || !vsBytecode)
+			throw("Invalid parameters for cloth set instantiation");
+
+		// build the vertex input layout
+		HRESULT hr = CGVertexExt::createInputLayout(device, vsBytecode, &inputLayout);
+
+		if (!SUCCEEDED(hr))
+			throw("Cannot create input layout interface");
+	}
+	catch (char *err)
+	{
+		cout << "Cloth set could not be instantiated due to:\n";
+		cout << err << endl << endl;
+
+		inputLayout = nullptr;
+	}
+}
+
+// Destructor
+ClothSet::~ClothSet()
+{
+	for (size_t i = 0; i < indexBuffers.size(); i++)
+	{
+		if (indexBuffers[i])
+			indexBuffers[i]->Release();
+	}
+
+	delete solver;
+}
+
+// Add cloth
+bool ClothSet::addCloth(ID3D11Device *device, DWORD clothW, DWORD clothH, const ClothFloat3& origin)
+{
+	if (!device || !inputLayout)
+		return false;
+
+	try
+	{
+		solver->add(clothW, clothH, origin);
+
+		// First cloth of this size - its indices are shared by every later one
+		while ((int)indexBuffers.size() < solver->groupCount())
+		{
+			const ClothTopology* topology = solver->getTopology((int)indexBuffers.size());
+
+			// The indices are relative to the first particle of each cloth, so a cloth of fewer
+			// than 65536 particles is drawn from 16 bit indices whatever the size of the set
+			ID3D11Buffer* buffer = nullptr;
+			DXGI_FORMAT format = DXGI_FORMAT_R32_UINT;
+
+			HRESULT hr = createIndexBuffer(device, topology->indices, topology->totalIndices, topology->particleCount, D3D11_USAGE_IMMUTABLE, &buffer, &format);
+
+			indexBuffers.push_back(buffer);
+			indexFormats.push_back(format);
+
+			if (!SUCCEEDED(hr))
+				throw("Index buffer cannot be created");
+		}
+
+		if (solver->particleCount() > vertexCapacity)
+			setupVertexBuffer(device);
+	}
+	catch (char *err)
+	{
+		cout << "Cloth could not be added to the set due to:\n";
+		cout << err << endl << endl;
+
+		return false;
+	}
+
+	return true;
+}
+
+// Vertex buffer setup
+void ClothSet::setupVertexBuffer(ID3D11Device *device)
+{
+	if (vertexBuffer)
+		vertexBuffer->Release();
+
+	vertexBuffer = nullptr;
+
+	// Grow geometrically so adding cloths one at a time does not recreate the buffer every time
+	int capacity = vertexCapacity * 2 > solver->particleCount() ? vertexCapacity * 2 : solver->particleCount();
+
+	// Rest state vertices - rendered until the first step is simulated
+	ClothVertex* restVertices = (ClothVertex*)calloc(capacity, sizeof(ClothVertex));
+
+	if (!restVertices)
+		throw("Cannot create cloth set buffers");
+
+	solver->assembleVertices(restVertices);
+
+	D3D11_BUFFER_DESC vertexDesc;
+	D3D11_SUBRESOURCE_DATA vertexData;
+
+	ZeroMemory(&vertexDesc, sizeof(D3D11_BUFFER_DESC));
+	ZeroMemory(&vertexData, sizeof(D3D11_SUBRESOURCE_DATA));
+
+	vertexDesc.BindFlags			= D3D11_BIND_VERTEX_BUFFER;
+	vertexDesc.CPUAccessFlags		= D3D11_CPU_ACCESS_WRITE;
+	vertexDesc.Usage				= D3D11_USAGE_DYNAMIC;
+	vertexDesc.ByteWidth			= sizeof(ClothVertex) * capacity;
+	vertexData.pSysMem				= restVertices;
+
+	HRESULT hr = device->CreateBuffer(&vertexDesc, &vertexData, &vertexBuffer);
+
+	free(restVertices);
+
+	if (!SUCCEEDED(hr))
+	{
+		vertexBuffer	= nullptr;
+		vertexCapacity	= 0;
+
+		throw("Vertex buffer cannot be created");
+	}
+
+	vertexCapacity = capacity;
+}
+
+// Simulate
+void ClothSet::simulate(ID3D11DeviceContext *context, double frameSeconds)
+{
+	if (!context || !vertexBuffer)
+		return;
+
+	int steps = scheduler.advance(frameSeconds);
+
+	for (int i = 0; i < steps; i++)
+		step();
+
+	uploadVertices(context, scheduler.alpha());
+}
+
+// Step
+void ClothSet::step()
+{
+	solver->anchorOn = anchorOn;
+	solver->timeStep = scheduler.stepTime;
+	solver->step();
+}
+
+// Upload vertices
+void ClothSet::uploadVertices(ID3D11DeviceContext* context, float alpha)
+{
+	D3D11_MAPPED_SUBRESOURCE mapped;
+
+	if (SUCCEEDED(context->Map(vertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+	{
+		solver->assembleVertices((ClothVertex*)mapped.pData, alpha);
+		context->Unmap(vertexBuffer, 0);
+	}
+}
+
+// Set solver mode
+void ClothSet::setSolverMode(ClothSolverMode mode)
+{
+	solver->setMode(mode);
+}
+
+// Cloth count
+int ClothSet::clothCount() const
+{
+	return solver->instanceCount();
+}
+
+// Render cloths
+void ClothSet::render(ID3D11DeviceContext *context)
+{
+	if (!context || !vertexBuffer || !inputLayout)
+		return;
+
+	// Set vertex layout
+	context->IASetInputLayout(inputLayout);
+
+	// Every cloth reads the one vertex buffer
+	ID3D11Buffer* vertexBuffers[] = {vertexBuffer};
+	UINT vertexStrides[] = {sizeof(ClothVertex)};
+	UINT vertexOffsets[] = {0};
+
+	context->IASetVertexBuffers(0, 1, vertexBuffers, vertexStrides, vertexOffsets);
+
+	// Set primitive topology for IA
+	context->IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	// Draw each cloth from its first particle, switching index buffers only between sizes
+	int boundGroup = -1;
+
+	for (int c = 0; c < solver->instanceCount(); c++)
+	{
+		const ClothSetInstance& instance = solver->getInstance(c);
+
+		if (instance.group != boundGroup)
+		{
+			context->IASetIndexBuffer(indexBuffers[instance.group], indexFormats[instance.group], 0);
+			boundGroup = instance.group;
+		}
+
+		context->DrawIndexed(solver->getTopology(instance.group)->totalIndices, 0, instance.particleOffset);
+	}
+}
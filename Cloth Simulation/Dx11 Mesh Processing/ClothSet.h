@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <D3DX11.h>
+#include <xnamath.h>
+
+#include "Source\CGBaseModel.h"
+#include "Source\CGVertexExt.h"
+#include "ClothSetSolver.h"
+#include "ClothScheduler.h"
+
+
+// Many grid cloths simulated together on the CPU and drawn from one vertex buffer.
+// Cloths of the same size share an index buffer and are drawn with their first
+// particle as the base vertex.
+class ClothSet : public CGBaseModel
+{
+private:
+	ClothSetSolver*				solver;
+
+	// Index buffer of each solver topology, and its format (16 bit for a small enough cloth)
+	std::vector<ID3D11Buffer*>	indexBuffers;
+	std::vector<DXGI_FORMAT>	indexFormats;
+
+	// Vertex buffer size in particles
+	int							vertexCapacity;
+
+	// Advance the simulation by one fixed step
+	void step();
+
+	// Upload the particles of every cloth, alpha of the way through the last step
+	void uploadVertices(ID3D11DeviceContext* context, float alpha);
+
+	// Recreate the vertex buffer for the particles of every cloth
+	void setupVertexBuffer(ID3D11Device *device);
+
+public:
+	// Constructor
+	ClothSet(ID3D11Device *device, ID3DBlob *vsBytecode, ClothWorkerPool *cpuPool);
+	// Destructor
+	~ClothSet();
+
+	// Add a w x h cloth with its rest state moved by origin - returns false on failure
+	bool addCloth(ID3D11Device *device, DWORD clothW, DWORD clothH, const ClothFloat3& origin);
+
+	// Run the simulation steps owed for frameSeconds of game time - call once per frame, not per render
+	void simulate(ID3D11DeviceContext *context, double frameSeconds);
+
+	// Render every cloth
+	void render(ID3D11DeviceContext *context);
+
+	// Select the constraint formulation of the solver
+	void setSolverMode(ClothSolverMode mode);
+
+	// Number of cloths in the set
+	int clothCount() const;
+
+	bool anchorOn;
+
+	// Fixed simulation step and catch-up limit
+	ClothScheduler scheduler;
+};
@@ -0,0 +1,453 @@
+#include "ClothSetSolver.h"
+#include "ClothFpContract.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+using namespace std;
+
+// Elements per worker chunk - the same sizes as ClothSolver
+static const int particleGrain		= 2048;
+static const int constraintGrain	= 2048;
+
+
+// Constructor
+ClothSetSolver::ClothSetSolver(ClothWorkerPool* workerPool)
+{
+	pool			= workerPool;
+	particles		= nullptr;
+	lambda			= nullptr;
+	lambdaCount		= 0;
+	lambdaCapacity	= 0;
+	constraintCount	= 0;
+	instanceGrain	= 1;
+
+	ClothIsa isa		= ClothKernels::bestIsa();
+	projectBatch		= ClothKernels::projectBatch(isa);
+	projectBatchXPBD	= ClothKernels::projectBatchXPBD(isa);
+	gridNormals			= ClothKernels::gridNormals(isa);
+
+	mode			= CLOTH_SOLVER_PBD;
+	anchorOn		= true;
+	lastAnchorOn	= true;
+	iterations	= 1;
+	timeStep	= 1.0f / 60.0f;
+	gravity		= ClothFloat3(0.0f, -9.81f, -9.81f);
+	damping		= 0.99f;
+	substeps	= 8;
+}
+
+// Destructor
+ClothSetSolver::~ClothSetSolver()
+{
+	for (size_t g = 0; g < topologies.size(); g++)
+	{
+		delete topologies[g];
+		free(compliance[g]);
+	}
+
+	free(lambda);
+	delete particles;
+}
+
+// Find group
+int ClothSetSolver::findGroup(DWORD w, DWORD h)
+{
+	for (size_t g = 0; g < topologies.size(); g++)
+	{
+		if (topologies[g]->w == w && topologies[g]->h == h)
+			return (int)g;
+	}
+
+	ClothTopology* topology = new ClothTopology(w, h, pool);
+
+	float* groupCompliance = (float*)calloc(topology->totalConstraints + 1, sizeof(float));
+
+	if (!groupCompliance)
+	{
+		delete topology;
+		throw("Cannot create cloth set topology");
+	}
+
+	topologies.push_back(topology);
+	compliance.push_back(groupCompliance);
+
+	return (int)topologies.size() - 1;
+}
+
+// Grow
+void ClothSetSolver::grow(int particleTotal, int multiplierTotal)
+{
+	if (!particles || particleTotal > particles->capacity)
+	{
+		int count		= particles ? particles->count : 0;
+		int capacity	= particles ? particles->capacity * 2 : 0;
+
+		// The cloths already in the set keep their state
+		ClothParticleStore* store = new ClothParticleStore(count, capacity > particleTotal ? capacity : particleTotal);
+
+		if (particles)
+			store->copy(particles);
+
+		delete particles;
+		particles = store;
+	}
+
+	// One more so the array is never empty
+	if (multiplierTotal + 1 > lambdaCapacity)
+	{
+		int capacity = lambdaCapacity * 2 > multiplierTotal + 1 ? lambdaCapacity * 2 : multiplierTotal + 1;
+
+		float* newLambda = (float*)calloc(capacity, sizeof(float));
+
+		if (!newLambda)
+			throw("Cannot create cloth set particles");
+
+		if (lambda)
+			memcpy(newLambda, lambda, sizeof(float) * lambdaCount);
+
+		free(lambda);
+		lambda			= newLambda;
+		lambdaCapacity	= capacity;
+	}
+}
+
+// Reserve
+void ClothSetSolver::reserve(int count, DWORD w, DWORD h)
+{
+	if (count <= 0)
+		return;
+
+	const ClothTopology* topology = topologies[findGroup(w, h)];
+
+	grow(particleCount() + count * topology->particleCount, lambdaCount + count * topology->totalConstraints);
+
+	instances.reserve(instances.size() + count);
+}
+
+// Add
+int ClothSetSolver::add(DWORD w, DWORD h, const ClothFloat3& origin)
+{
+	int group = findGroup(w, h);
+	const ClothTopology* topology = topologies[group];
+
+	int first	= particleCount();
+	int n		= topology->particleCount;
+
+	grow(first + n, lambdaCount + topology->totalConstraints);
+
+	// Rest state at the origin of this cloth
+	Particle* restState = (Particle*)malloc(sizeof(Particle) * n);
+
+	if (!restState)
+		throw("Cannot create cloth set particles");
+
+	topology->buildParticles(restState);
+
+	for (int i = 0; i < n; i++)
+	{
+		restState[i].vertex.pos.x	+= origin.x;
+		restState[i].vertex.pos.y	+= origin.y;
+		restState[i].vertex.pos.z	+= origin.z;
+		restState[i].prevPos		= restState[i].vertex.pos;
+	}
+
+	particles->count = first + n;
+	particles->load(restState, first, n);
+
+	ClothSetInstance instance;
+
+	instance.group			= group;
+	instance.particleOffset	= first;
+	instance.lambdaOffset	= lambdaCount;
+	instance.anchorOffset	= anchors.count();
+
+	// The new cloth's anchors go on the end of the set anchors
+	Anchor hanging[CLOTH_ANCHOR_COUNT];
+	int anchorParticles[CLOTH_ANCHOR_COUNT];
+	ClothFloat3 anchorTargets[CLOTH_ANCHOR_COUNT];
+
+	topology->buildAnchors(hanging, restState);
+
+	free(restState);
+
+	for (int i = 0; i < CLOTH_ANCHOR_COUNT; i++)
+	{
+		anchorParticles[i]	= first + (int)hanging[i].index;
+		anchorTargets[i]	= hanging[i].pos;
+
+		if (lastAnchorOn)
+			particles->pos[anchorParticles[i]].w = 0.0f;
+	}
+
+	anchors.append(anchorParticles, anchorTargets, CLOTH_ANCHOR_COUNT);
+
+	lambdaCount += topology->totalConstraints;
+
+	instances.push_back(instance);
+
+	// Enough cloths per chunk to fill a constraint chunk with the average cloth
+	constraintCount += topology->totalConstraints;
+
+	int clothConstraints = constraintCount / (int)instances.size();
+
+	instanceGrain = clothConstraints > 0 ? constraintGrain / clothConstraints : 1;
+
+	if (instanceGrain < 1)
+		instanceGrain = 1;
+
+	return (int)instances.size() - 1;
+}
+
+// Step
+void ClothSetSolver::step()
+{
+	if (!particles)
+		return;
+
+	int first, end;
+
+	anchors.publish(first, end);
+
+	// Anchored particles have zero inverse mass while pinned, so the constraints cannot drag them
+	if (anchorOn != lastAnchorOn)
+		anchors.setInvMass(particles->pos, anchorOn ? 0.0f : 1.0f);
+
+	lastAnchorOn = anchorOn;
+
+	saveStep();
+
+	if (mode == CLOTH_SOLVER_XPBD)
+	{
+		int n		= substeps > 0 ? substeps : 1;
+		float h		= timeStep / (float)n;
+		float k		= (damping < 1.0f && timeStep > 0.0f) ? powf(damping, h / timeStep) : 1.0f;
+
+		for (int s = 0; s < n; s++)
+		{
+			applyForces(h, k, (float)(s + 1) / (float)n);
+			solveConstraintsXPBD(h, iterations);
+		}
+
+		return;
+	}
+
+	applyForces(timeStep, damping, 1.0f);
+	solveConstraints(iterations);
+}
+
+// Forces pass - every cloth in one sweep over the store
+void ClothSetSolver::applyForces(float h, float k, float t)
+{
+	ClothParticleStore* p = particles;
+
+	ClothFloat3 a(gravity.x * h * h, gravity.y * h * h, gravity.z * h * h);
+
+	const ClothAnchors* pinned = anchorOn ? &anchors : nullptr;
+
+	pool->parallelFor(p->count, particleGrain, [p, a, k, pinned, t](int begin, int end)
+	{
+		ClothFloat4* pos		= p->pos;
+		ClothFloat4* prevPos	= p->prevPos;
+
+		for (int i = begin; i < end; i++)
+		{
+			float vx = (pos[i].x - prevPos[i].x) * k;
+			float vy = (pos[i].y - prevPos[i].y) * k;
+			float vz = (pos[i].z - prevPos[i].z) * k;
+
+			prevPos[i].x = pos[i].x;
+			prevPos[i].y = pos[i].y;
+			prevPos[i].z = pos[i].z;
+
+			pos[i].x += vx + a.x;
+			pos[i].y += vy + a.y;
+			pos[i].z += vz + a.z;
+		}
+
+		if (pinned)
+			pinned->pin(pos, begin, end, t);
+	});
+}
+
+// Save step
+void ClothSetSolver::saveStep()
+{
+	ClothParticleStore* p = particles;
+
+	pool->parallelFor(p->count, particleGrain, [p](int begin, int end)
+	{
+		p->saveStep(begin, end);
+	});
+}
+
+// Constraints pass - each cloth runs its batches in order, and the cloths never share
+// particles, so any split of the set between workers is safe and they need not wait for
+// each other between batches
+void ClothSetSolver::solveConstraints(int passes)
+{
+	ClothFloat4* pos					= particles->pos;
+	ClothProjectBatchFn kernel			= projectBatch;
+	const ClothSetInstance* instance	= instances.data();
+	ClothTopology* const* topology		= topologies.data();
+
+	pool->parallelFor((int)instances.size(), instanceGrain, [=](int begin, int end)
+	{
+		for (int c = begin; c < end; c++)
+		{
+			const ClothTopology* t	= topology[instance[c].group];
+			ClothFloat4* clothPos	= pos + instance[c].particleOffset;
+
+			for (int i = 0; i < passes; i++)
+			{
+				for (int k = 0; k < t->batchCount; k++)
+					kernel(clothPos, t->constraints + t->batchOffset[k], 0, t->batchSize[k], nullptr);
+			}
+		}
+	});
+}
+
+// XPBD constraints pass - the multipliers of each cloth start from zero every substep
+void ClothSetSolver::solveConstraintsXPBD(float h, int passes)
+{
+	ClothFloat4* pos					= particles->pos;
+	ClothProjectBatchXPBDFn kernel		= projectBatchXPBD;
+	const ClothSetInstance* instance	= instances.data();
+	ClothTopology* const* topology		= topologies.data();
+	float* const* alpha					= compliance.data();
+	float* multipliers					= lambda;
+	float alphaScale					= 1.0f / (h * h);
+
+	pool->parallelFor((int)instances.size(), instanceGrain, [=](int begin, int end)
+	{
+		for (int c = begin; c < end; c++)
+		{
+			const ClothTopology* t	= topology[instance[c].group];
+			ClothFloat4* clothPos	= pos + instance[c].particleOffset;
+			const float* clothAlpha	= alpha[instance[c].group];
+			float* clothLambda		= multipliers + instance[c].lambdaOffset;
+
+			memset(clothLambda, 0, sizeof(float) * t->totalConstraints);
+
+			for (int i = 0; i < passes; i++)
+			{
+				for (int k = 0; k < t->batchCount; k++)
+				{
+					int offset = t->batchOffset[k];
+
+					kernel(clothPos, t->constraints + offset, clothAlpha + offset, clothLambda + offset, alphaScale, 0, t->batchSize[k], nullptr);
+				}
+			}
+		}
+	});
+}
+
+// Assemble vertices
+void ClothSetSolver::assembleVertices(ClothVertex* vertices, float alpha) const
+{
+	if (!particles)
+		return;
+
+	const ClothParticleStore* p			= particles;
+	const ClothSetInstance* instance	= instances.data();
+	ClothTopology* const* topology		= topologies.data();
+	ClothGridNormalsFn kernel			= gridNormals;
+
+	// Whole cloths per chunk - the normals of a row need the rows either side of it
+	pool->parallelFor((int)instances.size(), instanceGrain, [=](int begin, int end)
+	{
+		for (int c = begin; c < end; c++)
+		{
+			const ClothTopology* t = topology[instance[c].group];
+
+			p->assembleGridVertices(vertices, instance[c].particleOffset, (int)t->w, (int)t->h, 0, (int)t->h, alpha, kernel);
+		}
+	});
+}
+
+// Set mode
+void ClothSetSolver::setMode(ClothSolverMode newMode)
+{
+	mode = newMode;
+}
+
+// Get mode
+ClothSolverMode ClothSetSolver::getMode() const
+{
+	return mode;
+}
+
+// Set compliance
+void ClothSetSolver::setCompliance(float value)
+{
+	for (size_t g = 0; g < topologies.size(); g++)
+	{
+		for (int i = 0; i < topologies[g]->totalConstraints; i++)
+			compliance[g][i] = value;
+	}
+}
+
+// Write anchor targets
+void ClothSetSolver::writeAnchorTargets(const ClothFloat3* targets, int first, int count)
+{
+	anchors.write(targets, first, count);
+}
+
+// Get anchors
+const ClothAnchors& ClothSetSolver::getAnchors() const
+{
+	return anchors;
+}
+
+// Instance count
+int ClothSetSolver::instanceCount() const
+{
+	return (int)instances.size();
+}
+
+// Group count
+int ClothSetSolver::groupCount() const
+{
+	return (int)topologies.size();
+}
+
+// Particle count
+int ClothSetSolver::particleCount() const
+{
+	return particles ? particles->count : 0;
+}
+
+// Instance
+const ClothSetInstance& ClothSetSolver::getInstance(int instance) const
+{
+	return instances[instance];
+}
+
+// Topology
+const ClothTopology* ClothSetSolver::getTopology(int group) const
+{
+	return topologies[group];
+}
+
+// Particles
+const ClothParticleStore* ClothSetSolver::getParticles() const
+{
+	return particles;
+}
+
+// Topology bytes
+size_t ClothSetSolver::topologyBytes() const
+{
+	size_t bytes = 0;
+
+	for (size_t g = 0; g < topologies.size(); g++)
+		bytes += topologies[g]->bytes() + sizeof(float) * topologies[g]->totalConstraints;
+
+	return bytes;
+}
+
+// Particle bytes
+size_t ClothSetSolver::particleBytes() const
+{
+	return particles ? (sizeof(ClothFloat4) * 3 + sizeof(ClothVertex)) * particles->count + sizeof(float) * lambdaCount : 0;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <vector>
+#include "ClothTypes.h"
+#include "ClothTopology.h"
+#include "ClothWorkerPool.h"
+#include "ClothParticleStore.h"
+#include "ClothKernels.h"
+#include "ClothAnchors.h"
+#include "ClothSolver.h"
+
+
+// One cloth of a set
+struct ClothSetInstance
+{
+	// Shared topology, first particle in the set store, first XPBD multiplier and first of
+	// its CLOTH_ANCHOR_COUNT anchors in the set anchors
+	int			group;
+	int			particleOffset;
+	int			lambdaOffset;
+	int			anchorOffset;
+};
+
+
+// CPU solver for many grid cloths at once. Cloths with the same w x h share one
+// topology (constraints, batches and indices), and the particles of every cloth
+// are packed into one store, so each pass is a single parallelFor over the whole
+// set instead of one per cloth - hundreds of small cloths keep every worker busy.
+// The cloths share no particles, so a worker runs every batch of every iteration
+// of its cloths in one go, while they are in its cache, with no wait between
+// batches. The store grows by doubling, so adding cloths one at a time costs
+// little more than reserving room for them first.
+class ClothSetSolver
+{
+private:
+	ClothWorkerPool*				pool;
+
+	// One topology and one XPBD compliance array per resolution
+	std::vector<ClothTopology*>		topologies;
+	std::vector<float*>				compliance;
+
+	std::vector<ClothSetInstance>	instances;
+
+	ClothParticleStore*				particles;
+	float*							lambda;
+	int								lambdaCount;
+	int								lambdaCapacity;
+
+	// Constraints of every cloth, for the chunk size
+	int								constraintCount;
+
+	// Anchors of every cloth, on the particles of the set store
+	ClothAnchors					anchors;
+	bool							lastAnchorOn;
+
+	// Cloths per worker chunk in the constraint passes
+	int								instanceGrain;
+
+	// Constraint projection kernels for the selected instruction set
+	ClothProjectBatchFn				projectBatch;
+	ClothProjectBatchXPBDFn			projectBatchXPBD;
+	ClothGridNormalsFn				gridNormals;
+
+	ClothSolverMode					mode;
+
+	// Topology of a resolution, created on first use
+	int findGroup(DWORD w, DWORD h);
+
+	// Make room for particleTotal particles and multiplierTotal XPBD multipliers, at least
+	// doubling whichever is too small
+	void grow(int particleTotal, int multiplierTotal);
+
+	// Passes - the forces pass pins the anchors t of the way to their targets, and the
+	// constraint passes run the given number of iterations
+	void applyForces(float h, float k, float t);
+	void saveStep();
+	void solveConstraints(int passes);
+	void solveConstraintsXPBD(float h, int passes);
+
+public:
+	// Constructor
+	ClothSetSolver(ClothWorkerPool* workerPool);
+	// Destructor
+	~ClothSetSolver();
+
+	// Add a w x h cloth with its rest state moved by origin and return its index
+	int add(DWORD w, DWORD h, const ClothFloat3& origin);
+
+	// Make room for count more w x h cloths, so adding them moves nothing
+	void reserve(int count, DWORD w, DWORD h);
+
+	// Advance every cloth by one step
+	void step();
+
+	// Write the particles of every cloth as render vertices with their normals, alpha of the way through the last step
+	void assembleVertices(ClothVertex* vertices, float alpha = 1.0f) const;
+
+	// Select the constraint formulation (defaults to PBD)
+	void setMode(ClothSolverMode newMode);
+	ClothSolverMode getMode() const;
+
+	// XPBD compliance of every constraint, in metres per newton
+	void setCompliance(float value);
+
+	// Write the targets of set anchors [first, first + count) for the next step, as in
+	// ClothSolver. Adding a cloth keeps the targets written before it.
+	void writeAnchorTargets(const ClothFloat3* targets, int first, int count);
+	const ClothAnchors& getAnchors() const;
+
+	// Accessors
+	int instanceCount() const;
+	int groupCount() const;
+	int particleCount() const;
+	const ClothSetInstance& getInstance(int instance) const;
+	const ClothTopology* getTopology(int group) const;
+	const ClothParticleStore* getParticles() const;
+
+	// Bytes of topology and particle data held by the set
+	size_t topologyBytes() const;
+	size_t particleBytes() const;
+
+	bool anchorOn;
+
+	// Same meaning as in ClothSolver
+	int iterations;
+	float timeStep;
+	ClothFloat3 gravity;
+	float damping;
+	int substeps;
+};
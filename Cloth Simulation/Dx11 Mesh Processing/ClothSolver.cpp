@@ -0,0 +1,1670 @@
+#include "ClothSolver.h"
+#include "ClothFpContract.h"
+#include "ClothMappedFile.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <string>
+
+using namespace std;
+
+// Elements per worker chunk - large enough to hide the scheduling cost.
+// Multiples of 16 keep every chunk but the last on the full width of the SIMD kernels.
+static const int particleGrain		= 2048;
+static const int constraintGrain	= 2048;
+
+// Settling also stops once a second of motion is under this fraction of the fastest second
+// and no more than this much slower than the second before, twice in a row
+static const float settleCalm		= 0.25f;
+static const float settleDecay		= 0.9f;
+static const int settleRun			= 2;
+
+// Rest state cache file layout - the header, the positions and the previous positions,
+// each part starting on a 64 byte boundary
+static const char restMagic[4]		= {'C', 'R', 'S', 'T'};
+static const int restVersion		= 1;
+static const size_t restAlign		= 64;
+
+
+#pragma region Helpers
+
+struct ClothRestHeader
+{
+	char				magic[4];
+	int					version;
+	unsigned long long	key;
+	int					particleCount;
+	int					steps;
+};
+
+static inline size_t restAlignUp(size_t offset)
+{
+	return (offset + restAlign - 1) / restAlign * restAlign;
+}
+
+// Cache file name of a rest state
+static string restCacheName(unsigned long long key)
+{
+	const char* digits = "0123456789abcdef";
+	string name = "cloth_rest_";
+
+	for (int shift = 60; shift >= 0; shift -= 4)
+		name += digits[(key >> shift) & 15];
+
+	return name + ".bin";
+}
+
+#pragma endregion
+
+
+// Constructor
+ClothSolver::ClothSolver(DWORD clothW, DWORD clothH, ClothWorkerPool* workerPool)
+{
+	pool		= workerPool;
+
+	setup(new ClothTopology(clothW, clothH, workerPool));
+}
+
+// Constructor
+ClothSolver::ClothSolver(ClothTopology* clothTopology, ClothWorkerPool* workerPool)
+{
+	pool		= workerPool;
+
+	setup(clothTopology);
+}
+
+// Setup
+void ClothSolver::setup(ClothTopology* clothTopology)
+{
+	topology	= clothTopology;
+	particles	= nullptr;
+	compliance	= nullptr;
+	lambda		= nullptr;
+
+	chunkResidual	= nullptr;
+	chunkCount		= 0;
+
+	tiles				= nullptr;
+	sleeping			= false;
+	lastAnchorOn		= true;
+	activeConstraints	= nullptr;
+	activeCompliance	= nullptr;
+	activeBatchSize		= nullptr;
+	activeStale			= false;
+	multigrid			= nullptr;
+	tetherAnchors		= nullptr;
+	tethers				= nullptr;
+	attachments			= false;
+	ground				= nullptr;
+	collider			= nullptr;
+	field				= nullptr;
+	selfCollision		= nullptr;
+	aerodynamics		= nullptr;
+	wind				= nullptr;
+	tearing				= nullptr;
+	tearStrain			= 0.0f;
+	picking				= nullptr;
+	hashing				= false;
+
+	dragging.triangle	= -1;
+
+	anchorOn	= true;
+	mode		= CLOTH_SOLVER_PBD;
+	iterations	= 1;
+	tolerance	= 0.0f;
+
+	stats.iterations		= 0;
+	stats.residualMax		= 0.0f;
+	stats.residualRMS		= 0.0f;
+	stats.awakeTiles		= 0;
+	stats.sleepingTiles		= 0;
+	stats.activeConstraints	= topology->totalConstraints;
+	stats.torn				= 0;
+	stats.stateHash			= 0;
+
+	// 60Hz steps, and the direction of the original compute shader force in g
+	timeStep	= 1.0f / 60.0f;
+	substeps	= 8;
+	gravity		= ClothFloat3(0.0f, -9.81f, -9.81f);
+	damping		= 0.99f;
+
+	// Sleep after half a second with the particles of a tile moving under 2cm/s (RMS)
+	tileSize		= 16;
+	sleepSpeed		= 0.02f;
+	sleepSteps		= 30;
+
+	selfThickness	= 0.0f;
+
+	// Sea level air, and the coefficients and weight of a light cotton flag
+	windOrigin		= ClothFloat3(0.0f, 0.0f, 0.0f);
+	airDensity		= 1.225f;
+	dragCoefficient	= 1.0f;
+	liftCoefficient	= 0.5f;
+	clothDensity	= 0.2f;
+
+	// A millimetre a second
+	settleSpeed		= 0.001f;
+
+	spareParticles	= 0;
+
+	setIsa(ClothKernels::bestIsa());
+
+	// Rest state is built in the GPU layout then split into the streams
+	Particle* restState = (Particle*)malloc(sizeof(Particle) * topology->particleCount);
+
+	if (!restState)
+	{
+		delete topology;
+		throw("Cannot create cloth solver particles");
+	}
+
+	topology->buildParticles(restState);
+
+	// The cloth hangs from the anchors of its topology until they are replaced
+	Anchor hanging[CLOTH_ANCHOR_COUNT];
+	int hangingParticles[CLOTH_ANCHOR_COUNT];
+	ClothFloat3 hangingTargets[CLOTH_ANCHOR_COUNT];
+
+	topology->buildAnchors(hanging, restState);
+
+	for (int i = 0; i < CLOTH_ANCHOR_COUNT; i++)
+	{
+		hangingParticles[i]	= (int)hanging[i].index;
+		hangingTargets[i]	= hanging[i].pos;
+	}
+
+	anchors.set(hangingParticles, hangingTargets, CLOTH_ANCHOR_COUNT);
+
+	try
+	{
+		particles = new ClothParticleStore(topology->particleCount);
+		particles->load(restState);
+		anchors.setInvMass(particles->pos, 0.0f);
+
+		compliance	= (float*)calloc(topology->totalConstraints + 1, sizeof(float));
+		lambda		= (float*)calloc(topology->totalConstraints + 1, sizeof(float));
+
+		// One residual slot per chunk of the largest batch
+		for (int k = 0; k < topology->batchCount; k++)
+		{
+			int batchChunks = (topology->batchSize[k] + constraintGrain - 1) / constraintGrain;
+
+			if (batchChunks > chunkCount)
+				chunkCount = batchChunks;
+		}
+
+		chunkResidual = (ClothResidual*)calloc(chunkCount + 1, sizeof(ClothResidual));
+
+		if (!compliance || !lambda || !chunkResidual)
+			throw("Cannot create cloth solver constraints");
+	}
+	catch (...)
+	{
+		free(restState);
+		free(compliance);
+		free(lambda);
+		free(chunkResidual);
+		delete particles;
+		delete topology;
+		throw;
+	}
+
+	free(restState);
+}
+
+// Destructor
+ClothSolver::~ClothSolver()
+{
+	free(compliance);
+	free(lambda);
+	free(chunkResidual);
+	free(activeConstraints);
+	free(activeCompliance);
+	free(activeBatchSize);
+	delete tiles;
+	delete multigrid;
+	delete selfCollision;
+	delete aerodynamics;
+	delete tearing;
+	delete picking;
+	free(tetherAnchors);
+	free(tethers);
+	delete particles;
+	delete topology;
+}
+
+// Step
+void ClothSolver::step()
+{
+	stats.iterations	= 0;
+	stats.residualMax	= 0.0f;
+	stats.residualRMS	= 0.0f;
+	stats.torn			= 0;
+
+	publishAnchors();
+
+	// Switching the anchors moves the whole cloth
+	if (anchorOn != lastAnchorOn)
+	{
+		if (sleeping)
+			tiles->wakeAll();
+
+		anchors.setInvMass(particles->pos, anchorOn ? 0.0f : 1.0f);
+	}
+
+	// A dragged triangle must be awake to move
+	if (sleeping && dragging.triangle >= 0)
+	{
+		for (int k = 0; k < 3; k++)
+			tiles->wake(topology->indices[dragging.triangle * 3 + k]);
+	}
+
+	// Air forces from the velocities before the step, which change little over it. They reach
+	// the sleeping tiles too - one the air would get moving within the step wakes, as force
+	// over mass is pressure over density.
+	if (aerodynamics)
+	{
+		computeAirForces(mode == CLOTH_SOLVER_XPBD ? timeStep / (float)(substeps > 0 ? substeps : 1) : timeStep);
+
+		if (sleeping && clothDensity > 0.0f && timeStep > 0.0f)
+			tiles->wakePushed(pool, aerodynamics->pressures(), sleepSpeed * clothDensity / timeStep);
+	}
+
+	if (sleeping)
+	{
+		if (tiles->refresh() || activeStale)
+			gatherActiveConstraints();
+
+		// A woken tile is unit mass again
+		if (anchorOn)
+			anchors.setInvMass(particles->pos, 0.0f);
+	}
+
+	lastAnchorOn = anchorOn;
+
+	saveStep();
+
+	if (mode == CLOTH_SOLVER_XPBD)
+	{
+		// Small steps - one or few iterations on each of several substeps converge
+		// faster than many iterations on one step, and lambda resets every substep
+		float h = timeStep / (float)(substeps > 0 ? substeps : 1);
+
+		// The air forces from the start of the step are applied in every substep
+		for (int s = 0; s < substeps; s++)
+		{
+			// The anchors move to their targets over the substeps
+			integrate(h, (float)(s + 1) / (float)substeps);
+
+			if (anchorOn && attachments)
+				applyAttachments();
+
+			memset(lambda, 0, sizeof(float) * topology->totalConstraints);
+
+			for (int i = 0; i < iterations; i++)
+			{
+				if (dragging.triangle >= 0)
+					applyDrag();
+
+				ClothResidual residual = solveConstraintsXPBD(h);
+
+				if (collider)
+					applyCollider();
+
+				if (field)
+					applyDistanceField();
+
+				if (recordPass(residual))
+					break;
+			}
+
+			if (selfCollision)
+				applySelfCollision();
+		}
+	}
+	else
+	{
+		applyForces();
+
+		for (int i = 0; i < iterations; i++)
+		{
+			// Long range stretch is removed on the coarse grids, the fine pass then smooths
+			if (multigrid)
+				multigrid->solve(particles->pos);
+
+			// Tethers bound the stretch of the far edge however few the iterations
+			if (anchorOn && attachments)
+				applyAttachments();
+
+			if (dragging.triangle >= 0)
+				applyDrag();
+
+			ClothResidual residual = solveConstraints();
+
+			// The constraints may have pulled particles into the mesh
+			if (collider)
+				applyCollider();
+
+			if (field)
+				applyDistanceField();
+
+			if (recordPass(residual))
+				break;
+		}
+
+		if (selfCollision)
+			applySelfCollision();
+	}
+
+	if (tearing)
+		tearConstraints();
+
+	// Fitted to the torn cloth, so the next query sees the tears
+	if (picking)
+		picking->refit(particles->pos);
+
+	// Put settled tiles to sleep and wake disturbed ones for the next step
+	if (sleeping && tiles->update(pool, sleepSpeed * timeStep, sleepSteps))
+		gatherActiveConstraints();
+
+	stats.awakeTiles		= sleeping ? tiles->awakeCount() : 0;
+	stats.sleepingTiles		= sleeping ? tiles->count() - stats.awakeTiles : 0;
+	stats.activeConstraints	= solvedConstraints();
+
+	stats.stateHash = hashing ? stateHash() : 0;
+}
+
+// Awake particles
+void ClothSolver::forAwakeParticles(int grain, const ClothTask& task)
+{
+	if (solvingActive())
+		tiles->forAwakeSpans(pool, task);
+	else
+		pool->parallelFor(particles->count, grain, task);
+}
+
+// Solving active
+bool ClothSolver::solvingActive() const
+{
+	return sleeping && tiles->anyAsleep();
+}
+
+// Solved constraints
+int ClothSolver::solvedConstraints() const
+{
+	if (!solvingActive())
+		return topology->totalConstraints;
+
+	int count = 0;
+
+	for (int k = 0; k < topology->batchCount; k++)
+		count += activeBatchSize[k];
+
+	return count;
+}
+
+// Gather active constraints - a constraint is solved while either end is in an awake tile
+void ClothSolver::gatherActiveConstraints()
+{
+	activeStale = false;
+
+	if (!solvingActive())
+		return;
+
+	const ClothTopology* t		= topology;
+	const ClothTiles* sleep		= tiles;
+	const float* alpha			= compliance;
+	Constraint* active			= activeConstraints;
+	float* activeAlpha			= activeCompliance;
+	int* activeSize				= activeBatchSize;
+
+	pool->parallelFor(topology->batchCount, 1, [=](int begin, int end)
+	{
+		for (int k = begin; k < end; k++)
+		{
+			int offset	= t->batchOffset[k];
+			int n		= 0;
+
+			for (int i = offset; i < offset + t->batchSize[k]; i++)
+			{
+				const Constraint& c = t->constraints[i];
+
+				if (sleep->isAwake(sleep->tileOf(c.start)) || sleep->isAwake(sleep->tileOf(c.end)))
+				{
+					active[offset + n]		= c;
+					activeAlpha[offset + n]	= alpha[i];
+					n++;
+				}
+			}
+
+			activeSize[k] = n;
+		}
+	});
+}
+
+// Record pass
+bool ClothSolver::recordPass(const ClothResidual& residual)
+{
+	stats.iterations++;
+	stats.residualMax = residual.maximum;
+
+	// Over the constraints the pass projected - the sleeping ones add nothing to the sum
+	int solved = solvedConstraints();
+
+	stats.residualRMS = solved ? sqrtf(residual.sumSquared / (float)solved) : 0.0f;
+
+	return tolerance > 0.0f && residual.maximum <= tolerance;
+}
+
+// Residual of a pass - each chunk slot holds the sum over the batches, folded in order
+// so the result does not depend on which thread ran which chunk
+ClothResidual ClothSolver::gatherResidual()
+{
+	ClothResidual total = {0.0f, 0.0f};
+
+	for (int i = 0; i < chunkCount; i++)
+	{
+		total.sumSquared += chunkResidual[i].sumSquared;
+
+		if (chunkResidual[i].maximum > total.maximum)
+			total.maximum = chunkResidual[i].maximum;
+
+		chunkResidual[i].sumSquared	= 0.0f;
+		chunkResidual[i].maximum	= 0.0f;
+	}
+
+	return total;
+}
+
+// Forces pass - matches cloth_forces_cs
+void ClothSolver::applyForces()
+{
+	ClothParticleStore* p = particles;
+
+	// Anchored particles have zero inverse mass while pinned, so the constraints cannot drag them
+	const ClothAnchors* pinned = anchorOn ? &anchors : nullptr;
+
+	float h = timeStep;
+	float k = damping;
+
+	ClothFloat3 a(gravity.x * h * h, gravity.y * h * h, gravity.z * h * h);
+
+	const ClothHeightfield* g = ground;
+
+	// Air forces from the velocities before this step (see step)
+	const ClothAerodynamics* air = aerodynamics;
+	float density = clothDensity;
+
+	forAwakeParticles(particleGrain, [p, a, k, g, air, h, density, pinned](int begin, int end)
+	{
+		ClothFloat4* pos		= p->pos;
+		ClothFloat4* prevPos	= p->prevPos;
+
+		for (int i = begin; i < end; i++)
+		{
+			// Displacement over the previous step, damped
+			float vx = (pos[i].x - prevPos[i].x) * k;
+			float vy = (pos[i].y - prevPos[i].y) * k;
+			float vz = (pos[i].z - prevPos[i].z) * k;
+
+			prevPos[i].x = pos[i].x;
+			prevPos[i].y = pos[i].y;
+			prevPos[i].z = pos[i].z;
+
+			pos[i].x += vx + a.x;
+			pos[i].y += vy + a.y;
+			pos[i].z += vz + a.z;
+		}
+
+		if (air)
+			air->displace(pos, h, density, begin, end);
+
+		// Ground contact while the chunk is still in cache
+		if (g)
+			g->collide(pos, prevPos, begin, end);
+
+		if (pinned)
+			pinned->pin(pos, begin, end, 1.0f);
+	});
+}
+
+// Save the step start for interpolated rendering
+void ClothSolver::saveStep()
+{
+	ClothParticleStore* p = particles;
+
+	forAwakeParticles(particleGrain, [p](int begin, int end)
+	{
+		p->saveStep(begin, end);
+	});
+}
+
+// Publish anchors
+void ClothSolver::publishAnchors()
+{
+	int first, end;
+
+	if (!anchors.publish(first, end) || !sleeping)
+		return;
+
+	// A sleeping anchor would never get to its new target
+	for (int a = first; a < end; a++)
+		tiles->wake(anchors.particleOf(a));
+}
+
+// Drag pass - the dragged point moves stiffness of the way to its target, spread over the
+// corners by their weights and inverse masses
+void ClothSolver::applyDrag()
+{
+	ClothFloat4* pos	= particles->pos;
+	const DWORD* corner	= topology->indices + dragging.triangle * 3;
+	float weight[3]		= {1.0f - dragging.u - dragging.v, dragging.u, dragging.v};
+
+	ClothFloat3 point(0.0f, 0.0f, 0.0f);
+	float denominator = 0.0f;
+
+	for (int k = 0; k < 3; k++)
+	{
+		const ClothFloat4& p = pos[corner[k]];
+
+		point.x += p.x * weight[k];
+		point.y += p.y * weight[k];
+		point.z += p.z * weight[k];
+
+		denominator += weight[k] * weight[k] * p.w;
+	}
+
+	// Every corner pinned
+	if (denominator <= 0.0f)
+		return;
+
+	float dx = dragging.target.x - point.x;
+	float dy = dragging.target.y - point.y;
+	float dz = dragging.target.z - point.z;
+
+	for (int k = 0; k < 3; k++)
+	{
+		ClothFloat4& p = pos[corner[k]];
+
+		float scale = dragging.stiffness * weight[k] * p.w / denominator;
+
+		p.x += dx * scale;
+		p.y += dy * scale;
+		p.z += dz * scale;
+	}
+}
+
+// Attachments pass - each particle against its nearest anchor
+void ClothSolver::applyAttachments()
+{
+	ClothFloat4* pos		= particles->pos;
+	ClothAttachFn kernel	= attach;
+	const int* anchor		= tetherAnchors;
+	const float* tether		= tethers;
+
+	forAwakeParticles(particleGrain, [=](int begin, int end)
+	{
+		kernel(pos, anchor, tether, begin, end);
+	});
+}
+
+// Collider pass
+void ClothSolver::applyCollider()
+{
+	ClothFloat4* pos				= particles->pos;
+	const ClothMeshCollider* mesh	= collider;
+
+	forAwakeParticles(particleGrain, [=](int begin, int end)
+	{
+		mesh->collide(pos, begin, end);
+	});
+}
+
+// Distance field pass
+void ClothSolver::applyDistanceField()
+{
+	ClothFloat4* pos				= particles->pos;
+	const ClothDistanceField* sdf	= field;
+
+	forAwakeParticles(particleGrain, [=](int begin, int end)
+	{
+		sdf->collide(pos, begin, end);
+	});
+}
+
+// Self collision pass
+void ClothSolver::applySelfCollision()
+{
+	ClothFloat4* pos				= particles->pos;
+	const ClothSelfCollision* self	= selfCollision;
+
+	selfCollision->build(pos);
+
+	forAwakeParticles(particleGrain, [=](int begin, int end)
+	{
+		self->collide(pos, begin, end);
+	});
+}
+
+// Air forces
+void ClothSolver::computeAirForces(float h)
+{
+	aerodynamics->computeForces(particles->pos, particles->prevPos, h, wind, windOrigin, airDensity, dragCoefficient, liftCoefficient, aero);
+}
+
+// Rest key - everything that decides where the cloth comes to rest, hashed in a fixed layout.
+// Tiles that fall asleep while settling stay where they stopped, so the sleeping thresholds
+// count too.
+unsigned long long ClothSolver::restKey() const
+{
+	const ClothTopology* t = topology;
+
+	vector<Particle> rest(t->particleCount);
+	vector<ClothFloat3> restPos(t->particleCount);
+
+	t->buildParticles(rest.data());
+
+	for (int i = 0; i < t->particleCount; i++)
+		restPos[i] = rest[i].vertex.pos;
+
+	unsigned long long key = ClothHash::xxh64(restPos.data(), sizeof(ClothFloat3) * restPos.size(), (unsigned long long)t->particleCount);
+
+	key = ClothHash::xxh64(t->constraints, sizeof(Constraint) * t->totalConstraints, key);
+	vector<int> anchored(anchors.count());
+
+	for (int a = 0; a < anchors.count(); a++)
+		anchored[a] = anchors.particleOf(a);
+
+	key = ClothHash::xxh64(anchored.data(), sizeof(int) * anchored.size(), key);
+	key = ClothHash::xxh64(anchors.targets(), sizeof(ClothFloat4) * anchors.count(), key);
+
+	if (mode == CLOTH_SOLVER_XPBD)
+		key = ClothHash::xxh64(compliance, sizeof(float) * t->totalConstraints, key);
+
+	struct
+	{
+		int		mode, iterations, substeps, multigridLevels, attachments, anchorOn, selfCollision, sleeping, tileSize, sleepSteps;
+		float	timeStep, gravityX, gravityY, gravityZ, damping, tolerance, selfThickness, settleSpeed, sleepSpeed;
+	}
+	parameters;
+
+	memset(&parameters, 0, sizeof(parameters));
+
+	parameters.mode				= (int)mode;
+	parameters.iterations		= iterations;
+	parameters.substeps			= mode == CLOTH_SOLVER_XPBD ? substeps : 0;
+	parameters.multigridLevels	= getMultigrid();
+	parameters.attachments		= attachments ? 1 : 0;
+	parameters.anchorOn			= anchorOn ? 1 : 0;
+	parameters.selfCollision	= selfCollision ? 1 : 0;
+	parameters.sleeping			= sleeping ? 1 : 0;
+	parameters.tileSize			= sleeping ? tileSize : 0;
+	parameters.sleepSteps		= sleeping ? sleepSteps : 0;
+	parameters.timeStep			= timeStep;
+	parameters.gravityX			= gravity.x;
+	parameters.gravityY			= gravity.y;
+	parameters.gravityZ			= gravity.z;
+	parameters.damping			= damping;
+	parameters.tolerance		= tolerance;
+	parameters.selfThickness	= selfCollision ? selfCollision->thickness : 0.0f;
+	parameters.settleSpeed		= settleSpeed;
+	parameters.sleepSpeed		= sleeping ? sleepSpeed : 0.0f;
+
+	return ClothHash::xxh64(&parameters, sizeof(parameters), key ^ (unsigned long long)restVersion);
+}
+
+// RMS move - each chunk sums its particles in parallel, then the chunks are summed in order
+float ClothSolver::rmsMove() const
+{
+	const ClothFloat4* pos		= particles->pos;
+	const ClothFloat4* lastPos	= particles->lastPos;
+	int count					= particles->count;
+
+	vector<float> chunkMove((count + particleGrain - 1) / particleGrain + 1, 0.0f);
+	float* move = chunkMove.data();
+
+	pool->parallelFor(count, particleGrain, [=](int begin, int end)
+	{
+		for (int first = begin; first < end; first += particleGrain)
+		{
+			int last	= first + particleGrain < end ? first + particleGrain : end;
+			float sum	= 0.0f;
+
+			for (int i = first; i < last; i++)
+			{
+				float dx = pos[i].x - lastPos[i].x, dy = pos[i].y - lastPos[i].y, dz = pos[i].z - lastPos[i].z;
+
+				sum += dx * dx + dy * dy + dz * dz;
+			}
+
+			move[first / particleGrain] = sum;
+		}
+	});
+
+	float sum = 0.0f;
+
+	for (size_t c = 0; c < chunkMove.size(); c++)
+		sum += chunkMove[c];
+
+	return count > 0 ? sqrtf(sum / (float)count) : 0.0f;
+}
+
+// Load rest state
+bool ClothSolver::loadRestState(const unsigned char* bytes, size_t size, unsigned long long key)
+{
+	if (!bytes || size < sizeof(ClothRestHeader))
+		return false;
+
+	const ClothRestHeader* header = (const ClothRestHeader*)bytes;
+	int count = particles->count;
+
+	if (memcmp(header->magic, restMagic, sizeof(restMagic)) != 0 || header->version != restVersion || header->key != key || header->particleCount != count)
+		return false;
+
+	size_t posOffset	= restAlignUp(sizeof(ClothRestHeader));
+	size_t prevOffset	= restAlignUp(posOffset + sizeof(ClothFloat4) * count);
+
+	if (size != prevOffset + sizeof(ClothFloat4) * count)
+		return false;
+
+	memcpy(particles->pos, bytes + posOffset, sizeof(ClothFloat4) * count);
+	memcpy(particles->prevPos, bytes + prevOffset, sizeof(ClothFloat4) * count);
+
+	// Only the positions are taken - the inverse masses come from this solver, with every
+	// particle free but the pinned anchors
+	for (int i = 0; i < count; i++)
+		particles->pos[i].w = 1.0f;
+
+	if (anchorOn)
+		anchors.setInvMass(particles->pos, 0.0f);
+
+	return true;
+}
+
+// Settle
+int ClothSolver::settle(const char* cacheDirectory, int maxSteps)
+{
+	// The key cannot cover objects the solver does not own, nor tears
+	bool cacheable = cacheDirectory && cacheDirectory[0] && !ground && !collider && !field && !wind && !tearing && dragging.triangle < 0 && topology->addedParticles() == 0;
+
+	unsigned long long key = cacheable ? restKey() : 0;
+	string path;
+
+	if (cacheable)
+	{
+		path = cacheDirectory;
+
+		if (path[path.size() - 1] != '/' && path[path.size() - 1] != '\\')
+			path += "/";
+
+		path += restCacheName(key);
+
+		ClothMappedFile cache;
+
+		// A state of another cloth, version or set of parameters, or a truncated one, is settled again
+		if (cache.open(path.c_str()) && loadRestState((const unsigned char*)cache.data(), cache.size(), key))
+		{
+			ClothParticleStore* p = particles;
+
+			// Nothing to blend from, and every tile has to look at its new state
+			p->saveStep(0, p->count);
+			wakeAll();
+
+			return 0;
+		}
+	}
+
+	// A second of steps at a time. The PBD passes leave the cloth jittering about its rest
+	// state however long it hangs, so it also counts as settled once the motion has died
+	// down and stopped dying down any further.
+	int window		= timeStep > 0.0f ? (int)(1.0f / timeStep + 0.5f) : 1;
+	int steps		= 0;
+	int calm		= 0;
+	float fastest	= 0.0f;
+	float previous	= FLT_MAX;
+
+	window = window < 1 ? 1 : window;
+
+	while (steps < maxSteps)
+	{
+		float sum	= 0.0f;
+		int n		= 0;
+
+		for (; n < window && steps < maxSteps; n++, steps++)
+		{
+			step();
+
+			sum += rmsMove();
+		}
+
+		float speed = timeStep > 0.0f ? sum / ((float)n * timeStep) : 0.0f;
+
+		fastest = speed > fastest ? speed : fastest;
+
+		if (speed <= settleSpeed)
+			break;
+
+		calm = (speed <= fastest * settleCalm && speed >= previous * settleDecay) ? calm + 1 : 0;
+
+		if (calm >= settleRun)
+			break;
+
+		previous = speed;
+	}
+
+	// The cache only saves time, so the settled state is kept even when it cannot be written
+	if (cacheable)
+	{
+		// Awake as a state read back is - a sleeping tile has no inverse mass
+		wakeAll();
+
+		if (anchorOn)
+			anchors.setInvMass(particles->pos, 0.0f);
+
+		int count = particles->count;
+
+		size_t posOffset	= restAlignUp(sizeof(ClothRestHeader));
+		size_t prevOffset	= restAlignUp(posOffset + sizeof(ClothFloat4) * count);
+
+		vector<unsigned char> image(prevOffset + sizeof(ClothFloat4) * count, 0);
+
+		ClothRestHeader header;
+
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, restMagic, sizeof(restMagic));
+
+		header.version			= restVersion;
+		header.key				= key;
+		header.particleCount	= count;
+		header.steps			= steps;
+
+		memcpy(image.data(), &header, sizeof(header));
+		memcpy(image.data() + posOffset, particles->pos, sizeof(ClothFloat4) * count);
+		memcpy(image.data() + prevOffset, particles->prevPos, sizeof(ClothFloat4) * count);
+
+		ClothMappedFile::write(path.c_str(), image.data(), image.size());
+	}
+
+	return steps;
+}
+
+// Tethers - shortest path from the nearest anchor over the rest lengths of the constraints
+// (Dijkstra from every anchor at once). On a flat grid this is the straight rest distance;
+// on a curved mesh it follows the surface, so a tether never pulls a fold straight. One
+// tether per particle, however many anchors there are.
+void ClothSolver::buildTethers()
+{
+	int count = topology->particleCount;
+
+	tetherAnchors	= (int*)malloc(sizeof(int) * count);
+	tethers			= (float*)malloc(sizeof(float) * count);
+
+	if (!tetherAnchors || !tethers)
+	{
+		free(tetherAnchors);
+		free(tethers);
+		tetherAnchors	= nullptr;
+		tethers			= nullptr;
+		throw("Cannot create cloth solver tethers");
+	}
+
+	// Constraint graph as compressed rows
+	vector<int> first(count + 1, 0);
+	vector<int> next(topology->totalConstraints * 2);
+	vector<float> length(topology->totalConstraints * 2);
+
+	for (int i = 0; i < topology->totalConstraints; i++)
+	{
+		first[topology->constraints[i].start + 1]++;
+		first[topology->constraints[i].end + 1]++;
+	}
+
+	for (int i = 0; i < count; i++)
+		first[i + 1] += first[i];
+
+	vector<int> fill(first.begin(), first.end() - 1);
+
+	for (int i = 0; i < topology->totalConstraints; i++)
+	{
+		const Constraint& c = topology->constraints[i];
+
+		next[fill[c.start]]		= c.end;
+		length[fill[c.start]++]	= c.length;
+		next[fill[c.end]]		= c.start;
+		length[fill[c.end]++]	= c.length;
+	}
+
+	int* nearest	= tetherAnchors;
+	float* distance	= tethers;
+
+	// Particles no anchor can reach are never pulled - they are tethered to themselves
+	for (int i = 0; i < count; i++)
+	{
+		nearest[i]	= i;
+		distance[i]	= FLT_MAX;
+	}
+
+	typedef pair<float, int> Entry;
+
+	priority_queue<Entry, vector<Entry>, greater<Entry> > open;
+
+	for (int a = 0; a < anchors.count(); a++)
+	{
+		int i = anchors.particleOf(a);
+
+		nearest[i]	= i;
+		distance[i]	= 0.0f;
+		open.push(Entry(0.0f, i));
+	}
+
+	while (!open.empty())
+	{
+		Entry e = open.top();
+		open.pop();
+
+		if (e.first > distance[e.second])
+			continue;
+
+		for (int k = first[e.second]; k < first[e.second + 1]; k++)
+		{
+			float d = e.first + length[k];
+
+			if (d < distance[next[k]])
+			{
+				distance[next[k]]	= d;
+				nearest[next[k]]	= nearest[e.second];
+				open.push(Entry(d, next[k]));
+			}
+		}
+	}
+}
+
+// Constraints pass - matches cloth_constraints_cs, one batch at a time
+ClothResidual ClothSolver::solveConstraints()
+{
+	ClothParticleStore* p		= particles;
+	ClothProjectBatchFn kernel	= projectBatch;
+	ClothResidual* residual		= chunkResidual;
+
+	const Constraint* constraints	= solvingActive() ? activeConstraints : topology->constraints;
+	const int* batchSize			= solvingActive() ? activeBatchSize : topology->batchSize;
+
+	for (int k = 0; k < topology->batchCount; k++)
+	{
+		const Constraint* batch = constraints + topology->batchOffset[k];
+
+		// No two constraints in a batch share a particle so the chunks never conflict.
+		// The pool runs the whole range in one call when it has no workers, so the chunks
+		// are split out again - each chunk sums its residual into its own slot.
+		pool->parallelFor(batchSize[k], constraintGrain, [p, batch, kernel, residual](int begin, int end)
+		{
+			for (int first = begin; first < end; first += constraintGrain)
+				kernel(p->pos, batch, first, first + constraintGrain < end ? first + constraintGrain : end, residual + first / constraintGrain);
+		});
+	}
+
+	return gatherResidual();
+}
+
+// XPBD integration pass - position Verlet over a substep of length h, with the anchors t of
+// the way to their targets
+void ClothSolver::integrate(float h, float t)
+{
+	ClothParticleStore* p = particles;
+
+	const ClothAnchors* pinned = anchorOn ? &anchors : nullptr;
+
+	ClothFloat3 a(gravity.x * h * h, gravity.y * h * h, gravity.z * h * h);
+
+	// Damping is per step - spread it over the substeps
+	float k = (damping < 1.0f && timeStep > 0.0f) ? powf(damping, h / timeStep) : 1.0f;
+
+	const ClothHeightfield* g = ground;
+
+	// Air forces are computed once per step (see step)
+	const ClothAerodynamics* air = aerodynamics;
+	float density = clothDensity;
+
+	forAwakeParticles(particleGrain, [p, a, k, g, air, h, density, pinned, t](int begin, int end)
+	{
+		ClothFloat4* pos		= p->pos;
+		ClothFloat4* prevPos	= p->prevPos;
+
+		for (int i = begin; i < end; i++)
+		{
+			// Displacement over the previous substep, damped
+			float vx = (pos[i].x - prevPos[i].x) * k;
+			float vy = (pos[i].y - prevPos[i].y) * k;
+			float vz = (pos[i].z - prevPos[i].z) * k;
+
+			prevPos[i].x = pos[i].x;
+			prevPos[i].y = pos[i].y;
+			prevPos[i].z = pos[i].z;
+
+			pos[i].x += vx + a.x;
+			pos[i].y += vy + a.y;
+			pos[i].z += vz + a.z;
+		}
+
+		if (air)
+			air->displace(pos, h, density, begin, end);
+
+		// Ground contact while the chunk is still in cache
+		if (g)
+			g->collide(pos, prevPos, begin, end);
+
+		if (pinned)
+			pinned->pin(pos, begin, end, t);
+	});
+}
+
+// XPBD constraints pass
+ClothResidual ClothSolver::solveConstraintsXPBD(float h)
+{
+	ClothParticleStore* p			= particles;
+	ClothProjectBatchXPBDFn kernel	= projectBatchXPBD;
+	ClothResidual* residual			= chunkResidual;
+	float alphaScale				= 1.0f / (h * h);
+
+	const Constraint* constraints	= solvingActive() ? activeConstraints : topology->constraints;
+	const float* alpha				= solvingActive() ? activeCompliance : compliance;
+	const int* batchSize			= solvingActive() ? activeBatchSize : topology->batchSize;
+
+	for (int k = 0; k < topology->batchCount; k++)
+	{
+		int offset					= topology->batchOffset[k];
+		const Constraint* batch		= constraints + offset;
+		const float* batchAlpha		= alpha + offset;
+		float* batchLambda			= lambda + offset;
+
+		pool->parallelFor(batchSize[k], constraintGrain, [=](int begin, int end)
+		{
+			for (int first = begin; first < end; first += constraintGrain)
+				kernel(p->pos, batch, batchAlpha, batchLambda, alphaScale, first, first + constraintGrain < end ? first + constraintGrain : end, residual + first / constraintGrain);
+		});
+	}
+
+	return gatherResidual();
+}
+
+// Set ISA
+void ClothSolver::setIsa(ClothIsa newIsa)
+{
+	isa					= ClothKernels::isaSupported(newIsa) ? newIsa : ClothKernels::bestIsa();
+	projectBatch		= ClothKernels::projectBatch(isa);
+	projectBatchXPBD	= ClothKernels::projectBatchXPBD(isa);
+	attach				= ClothKernels::attach(isa);
+	gridNormals			= ClothKernels::gridNormals(isa);
+	aero				= ClothKernels::aero(isa);
+}
+
+// Get ISA
+ClothIsa ClothSolver::getIsa() const
+{
+	return isa;
+}
+
+// Set hashing
+void ClothSolver::setHashing(bool enabled)
+{
+	hashing = enabled;
+
+	stats.stateHash = hashing ? stateHash() : 0;
+}
+
+// Get hashing
+bool ClothSolver::getHashing() const
+{
+	return hashing;
+}
+
+// Stats
+ClothSolverStats ClothSolver::getStats() const
+{
+	return stats;
+}
+
+// Set mode
+void ClothSolver::setMode(ClothSolverMode newMode)
+{
+	mode = newMode;
+}
+
+// Get mode
+ClothSolverMode ClothSolver::getMode() const
+{
+	return mode;
+}
+
+// Set compliance
+void ClothSolver::setCompliance(float value)
+{
+	for (int i = 0; i < topology->totalConstraints; i++)
+		compliance[i] = value;
+
+	activeStale = true;
+}
+
+// Set compliance of one constraint
+void ClothSolver::setCompliance(int constraint, float value)
+{
+	if (constraint >= 0 && constraint < topology->totalConstraints)
+		compliance[constraint] = value;
+
+	activeStale = true;
+}
+
+// Set sleeping
+void ClothSolver::setSleeping(bool enabled)
+{
+	// The tiles only cover the particles the cloth started with
+	if (enabled && (tearing || topology->addedParticles() > 0))
+		return;
+
+	if (enabled && !tiles)
+	{
+		activeConstraints	= (Constraint*)malloc(sizeof(Constraint) * (topology->totalConstraints + 1));
+		activeCompliance	= (float*)malloc(sizeof(float) * (topology->totalConstraints + 1));
+		activeBatchSize		= (int*)malloc(sizeof(int) * (topology->batchCount + 1));
+
+		if (!activeConstraints || !activeCompliance || !activeBatchSize)
+			throw("Cannot create cloth solver tiles");
+
+		tiles = new ClothTiles(topology, particles, tileSize);
+	}
+
+	if (!enabled && tiles)
+	{
+		tiles->wakeAll();
+		tiles->refresh();
+	}
+
+	sleeping = enabled;
+}
+
+// Set multigrid
+bool ClothSolver::setMultigrid(int levels)
+{
+	delete multigrid;
+	multigrid = nullptr;
+
+	if (levels <= 0)
+		return true;
+
+	if (topology->w == 0 || topology->h == 0 || tearing || topology->addedParticles() > 0)
+		return false;
+
+	multigrid = new ClothMultigrid(topology->w, topology->h, levels, pool);
+
+	return true;
+}
+
+// Get multigrid
+int ClothSolver::getMultigrid() const
+{
+	return multigrid ? multigrid->levelCount() : 0;
+}
+
+// Set attachments
+void ClothSolver::setAttachments(bool enabled)
+{
+	if (enabled && (tearing || topology->addedParticles() > 0))
+		return;
+
+	if (enabled && !tethers)
+		buildTethers();
+
+	attachments = enabled;
+}
+
+// Get attachments
+bool ClothSolver::getAttachments() const
+{
+	return attachments;
+}
+
+// Set ground
+void ClothSolver::setGround(const ClothHeightfield* heightfield)
+{
+	ground = heightfield;
+
+	// Whatever was at rest may not be any more
+	if (sleeping)
+		tiles->wakeAll();
+}
+
+// Get ground
+const ClothHeightfield* ClothSolver::getGround() const
+{
+	return ground;
+}
+
+// Set collider
+void ClothSolver::setCollider(const ClothMeshCollider* meshCollider)
+{
+	collider = meshCollider;
+
+	// Whatever was at rest may not be any more
+	if (sleeping)
+		tiles->wakeAll();
+}
+
+// Get collider
+const ClothMeshCollider* ClothSolver::getCollider() const
+{
+	return collider;
+}
+
+// Set distance field
+void ClothSolver::setDistanceField(const ClothDistanceField* distanceField)
+{
+	field = distanceField;
+
+	// Whatever was at rest may not be any more
+	if (sleeping)
+		tiles->wakeAll();
+}
+
+// Get distance field
+const ClothDistanceField* ClothSolver::getDistanceField() const
+{
+	return field;
+}
+
+// Set self collision
+void ClothSolver::setSelfCollision(bool enabled)
+{
+	if (enabled && !selfCollision)
+		selfCollision = new ClothSelfCollision(topology, pool, selfThickness);
+
+	if (!enabled)
+	{
+		delete selfCollision;
+		selfCollision = nullptr;
+	}
+}
+
+// Get self collision
+bool ClothSolver::getSelfCollision() const
+{
+	return selfCollision != nullptr;
+}
+
+// Set wind
+void ClothSolver::setWind(const ClothWindField* windField)
+{
+	wind = windField;
+
+	// Whatever was at rest may not be any more
+	if (sleeping)
+		tiles->wakeAll();
+
+	if (wind && !aerodynamics)
+		aerodynamics = new ClothAerodynamics(topology, pool);
+
+	if (!wind)
+	{
+		delete aerodynamics;
+		aerodynamics = nullptr;
+	}
+}
+
+// Get wind
+const ClothWindField* ClothSolver::getWind() const
+{
+	return wind;
+}
+
+// Aerodynamic force
+ClothFloat3 ClothSolver::aerodynamicForce(int particle) const
+{
+	return aerodynamics ? aerodynamics->particleForce(particle) : ClothFloat3(0.0f, 0.0f, 0.0f);
+}
+
+// Set anchors
+bool ClothSolver::setAnchors(const int* particleIndices, const ClothFloat3* targets, int count)
+{
+	for (int a = 0; a < count; a++)
+	{
+		if (particleIndices[a] < 0 || particleIndices[a] >= particles->count)
+			return false;
+	}
+
+	vector<ClothFloat3> here;
+
+	if (!targets)
+	{
+		here.resize(count);
+
+		for (int a = 0; a < count; a++)
+		{
+			const ClothFloat4& pos = particles->pos[particleIndices[a]];
+
+			here[a] = ClothFloat3(pos.x, pos.y, pos.z);
+		}
+
+		targets = here.data();
+	}
+
+	// The old anchors are let go before the new ones are pinned
+	anchors.setInvMass(particles->pos, 1.0f);
+	anchors.set(particleIndices, targets, count);
+
+	if (anchorOn)
+		anchors.setInvMass(particles->pos, 0.0f);
+
+	if (sleeping)
+		tiles->wakeAll();
+
+	// The tethers run from the anchors
+	free(tetherAnchors);
+	free(tethers);
+	tetherAnchors	= nullptr;
+	tethers			= nullptr;
+
+	if (attachments)
+		buildTethers();
+
+	return true;
+}
+
+// Write anchor targets
+void ClothSolver::writeAnchorTargets(const ClothFloat3* targets, int first, int count)
+{
+	anchors.write(targets, first, count);
+}
+
+// Get anchors
+const ClothAnchors& ClothSolver::getAnchors() const
+{
+	return anchors;
+}
+
+// Set tearing
+bool ClothSolver::setTearing(float strain)
+{
+	if (strain <= 0.0f)
+	{
+		delete tearing;
+		tearing		= nullptr;
+		tearStrain	= 0.0f;
+
+		return true;
+	}
+
+	if (multigrid || attachments)
+		return false;
+
+	if (!tearing)
+	{
+		// The tiles are laid over the particles the cloth started with, and hold on to the store
+		setSleeping(false);
+
+		delete tiles;
+		tiles = nullptr;
+
+		free(activeConstraints);
+		free(activeCompliance);
+		free(activeBatchSize);
+
+		activeConstraints	= nullptr;
+		activeCompliance	= nullptr;
+		activeBatchSize		= nullptr;
+
+		// Tearing moves the constraints and indices about. A cached topology is copied out of
+		// its file, so nothing may keep pointers into it - the aerodynamics and picking read
+		// them through the topology, and the self collision keeps copies.
+		topology->makeWritable();
+
+		// Room for the particles the tears split off
+		int capacity = particles->count + (spareParticles > 0 ? spareParticles : particles->count);
+
+		if (particles->capacity < capacity)
+		{
+			ClothParticleStore* grown = new ClothParticleStore(particles->count, capacity);
+
+			grown->copy(particles);
+
+			delete particles;
+			particles = grown;
+		}
+
+		tearing = new ClothTearing(topology, pool);
+	}
+
+	tearStrain = strain;
+
+	return true;
+}
+
+// Get tearing
+float ClothSolver::getTearing() const
+{
+	return tearStrain;
+}
+
+// Take changed triangles
+bool ClothSolver::takeChangedTriangles(vector<ClothTriangleRange>& ranges)
+{
+	ranges.clear();
+
+	return tearing ? tearing->takeChangedTriangles(ranges) : false;
+}
+
+// Set picking
+void ClothSolver::setPicking(bool enabled)
+{
+	if (enabled && !picking)
+	{
+		picking = new ClothPicking(topology, pool);
+		picking->refit(particles->pos);
+	}
+
+	if (!enabled)
+	{
+		delete picking;
+		picking = nullptr;
+	}
+}
+
+// Get picking
+bool ClothSolver::getPicking() const
+{
+	return picking != nullptr;
+}
+
+// Intersect
+bool ClothSolver::intersect(const ClothRay* rays, int count, ClothRayHit* hits) const
+{
+	if (!picking)
+		return false;
+
+	picking->intersect(particles->pos, rays, count, hits);
+
+	return true;
+}
+
+// Drag
+void ClothSolver::drag(const ClothRayHit& hit, const ClothFloat3& target, float stiffness)
+{
+	if (hit.triangle < 0 || hit.triangle >= topology->totalIndices / 3)
+	{
+		release();
+		return;
+	}
+
+	dragging.triangle	= hit.triangle;
+	dragging.u			= hit.u;
+	dragging.v			= hit.v;
+	dragging.target		= target;
+	dragging.stiffness	= stiffness < 0.0f ? 0.0f : (stiffness > 1.0f ? 1.0f : stiffness);
+}
+
+// Release
+void ClothSolver::release()
+{
+	dragging.triangle = -1;
+}
+
+// Get drag
+const ClothDrag& ClothSolver::getDrag() const
+{
+	return dragging;
+}
+
+// Tear constraints
+void ClothSolver::tearConstraints()
+{
+	stats.torn = tearing->tear(particles, compliance, lambda, tearStrain);
+
+	if (stats.torn == 0)
+		return;
+
+	// Only the particles around the tears have new links and triangles
+	tearing->takeChangedParticles(tornParticles);
+
+	if (selfCollision)
+		selfCollision->followTears(topology, *tearing, tornParticles);
+
+	if (aerodynamics)
+		aerodynamics->followTears(*tearing, tornParticles);
+}
+
+// Get sleeping
+bool ClothSolver::getSleeping() const
+{
+	return sleeping;
+}
+
+// Wake
+void ClothSolver::wake(int particle)
+{
+	if (tiles)
+		tiles->wake(particle);
+}
+
+// Wake all
+void ClothSolver::wakeAll()
+{
+	if (tiles)
+		tiles->wakeAll();
+}
+
+// Tiles
+const ClothTiles* ClothSolver::getTiles() const
+{
+	return tiles;
+}
+
+// State hash - each chunk of particles is hashed on its own, then the chunk hashes in order
+unsigned long long ClothSolver::stateHash() const
+{
+	const ClothFloat4* pos		= particles->pos;
+	const ClothFloat4* prevPos	= particles->prevPos;
+	int count					= particles->count;
+
+	vector<unsigned long long> chunkHash((count + particleGrain - 1) / particleGrain + 1);
+	unsigned long long* hash = chunkHash.data();
+
+	pool->parallelFor(count, particleGrain, [=](int begin, int end)
+	{
+		// Chunks are split out again when the pool runs the whole range in one call
+		for (int first = begin; first < end; first += particleGrain)
+		{
+			int n = (first + particleGrain < end ? first + particleGrain : end) - first;
+
+			unsigned long long h = ClothHash::xxh64(pos + first, sizeof(ClothFloat4) * n, (unsigned long long)first);
+
+			hash[first / particleGrain] = ClothHash::xxh64(prevPos + first, sizeof(ClothFloat4) * n, h);
+		}
+	});
+
+	return ClothHash::xxh64(hash, sizeof(unsigned long long) * (chunkHash.size() - 1), (unsigned long long)count);
+}
+
+// Stretch error
+float ClothSolver::stretchError() const
+{
+	const ClothFloat4* pos = particles->pos;
+	double sum = 0.0;
+	int live = 0;
+
+	for (int i = 0; i < topology->totalConstraints; i++)
+	{
+		const Constraint& c = topology->constraints[i];
+
+		// Constraints removed by tearing have no length
+		if (c.length <= 0.0f)
+			continue;
+
+		live++;
+
+		float dx = pos[c.start].x - pos[c.end].x;
+		float dy = pos[c.start].y - pos[c.end].y;
+		float dz = pos[c.start].z - pos[c.end].z;
+
+		double strain = (sqrt(dx * dx + dy * dy + dz * dz) - c.length) / c.length;
+
+		sum += strain * strain;
+	}
+
+	return live ? (float)sqrt(sum / live) : 0.0f;
+}
+
+// Assemble vertices
+void ClothSolver::assembleVertices(ClothVertex* vertices, float alpha) const
+{
+	const ClothParticleStore* p = particles;
+
+	// Mesh cloths keep the normals they were imported with
+	if (topology->w == 0 || topology->h == 0)
+	{
+		pool->parallelFor(p->count, particleGrain, [p, vertices, alpha](int begin, int end)
+		{
+			p->assembleVertices(vertices, begin, end, alpha);
+		});
+
+		return;
+	}
+
+	int w						= (int)topology->w;
+	int h						= (int)topology->h;
+	int rowGrain				= particleGrain / w > 0 ? particleGrain / w : 1;
+	ClothGridNormalsFn kernel	= gridNormals;
+
+	pool->parallelFor(h, rowGrain, [=](int begin, int end)
+	{
+		p->assembleGridVertices(vertices, 0, w, h, begin, end, alpha, kernel);
+	});
+
+	// Particles torn off the grid take the normal of the grid particle they came from
+	if (p->count > w * h)
+	{
+		p->assembleVertices(vertices, w * h, p->count, alpha);
+
+		for (int i = w * h; i < p->count; i++)
+			vertices[i].normal = vertices[topology->originalParticle(i)].normal;
+	}
+}
+
+// Particles
+const ClothParticleStore* ClothSolver::getParticles() const
+{
+	return particles;
+}
+
+// Topology
+const ClothTopology* ClothSolver::getTopology() const
+{
+	return topology;
+}
+
+// Particle count
+int ClothSolver::particleCount() const
+{
+	return particles->count;
+}
@@ -0,0 +1,400 @@
+#pragma once
+
+#include <vector>
+#include "ClothTypes.h"
+#include "ClothTopology.h"
+#include "ClothWorkerPool.h"
+#include "ClothParticleStore.h"
+#include "ClothKernels.h"
+#include "ClothTiles.h"
+#include "ClothMultigrid.h"
+#include "ClothHeightfield.h"
+#include "ClothMeshCollider.h"
+#include "ClothDistanceField.h"
+#include "ClothSelfCollision.h"
+#include "ClothAerodynamics.h"
+#include "ClothWindField.h"
+#include "ClothTearing.h"
+#include "ClothAnchors.h"
+#include "ClothPicking.h"
+#include "ClothHash.h"
+
+
+// Constraint solver formulation
+enum ClothSolverMode
+{
+	// Same passes as the compute shaders - stiffness depends on the iteration count
+	CLOTH_SOLVER_PBD,
+
+	// Extended PBD - stiffness set by per-constraint compliance, time step split into substeps
+	CLOTH_SOLVER_XPBD
+};
+
+
+// Convergence of the last step
+struct ClothSolverStats
+{
+	// Constraint passes run (summed over the substeps in XPBD)
+	int		iterations;
+
+	// Violation |distance - rest length| measured during the last pass
+	float	residualMax;
+	float	residualRMS;
+
+	// Tiles after the last step (both 0 while sleeping is off) and constraints it solved
+	int		awakeTiles;
+	int		sleepingTiles;
+	int		activeConstraints;
+
+	// Constraints torn by the step
+	int		torn;
+
+	// Hash of the particle state after the step (0 while state hashing is off)
+	unsigned long long	stateHash;
+};
+
+
+// CPU cloth solver - runs the same passes as cloth_forces_cs and cloth_constraints_cs,
+// splitting each constraint batch across the worker pool.
+// Does not touch Direct3D so it can simulate without a device.
+//
+// A step gives the same bits whatever the thread count or instruction set. Every pass
+// splits its work into chunks of a fixed size, no two chunks of a pass write the same
+// particle, and sums over the chunks are folded in chunk order. The kernels of every
+// instruction set round exactly as the scalar ones do, and nothing fuses a multiply
+// and an add (see ClothFpContract.h). Only the residual RMS in the stats depends on
+// the kernel, which sums it a SIMD lane at a time - the early exit tests the largest
+// violation, which does not depend on the order it is found in.
+class ClothSolver
+{
+private:
+	ClothTopology*		topology;
+	ClothWorkerPool*	pool;
+
+	ClothParticleStore*	particles;
+
+	// Pinned particles and their targets - the three the cloth hangs from until replaced
+	ClothAnchors		anchors;
+
+	// Constraint projection kernels for the selected instruction set
+	ClothIsa				isa;
+	ClothProjectBatchFn		projectBatch;
+	ClothProjectBatchXPBDFn	projectBatchXPBD;
+	ClothAttachFn			attach;
+	ClothGridNormalsFn		gridNormals;
+	ClothAeroFn				aero;
+
+	// Hash the particles after every step
+	bool				hashing;
+
+	ClothSolverMode		mode;
+
+	// XPBD compliance (inverse stiffness) and force multipliers, indexed like the topology constraints
+	float*				compliance;
+	float*				lambda;
+
+	// Residual of each worker chunk, gathered after every pass
+	ClothResidual*		chunkResidual;
+	int					chunkCount;
+
+	ClothSolverStats	stats;
+
+	// Sleeping tiles (nullptr until sleeping is first enabled)
+	ClothTiles*			tiles;
+	bool				sleeping;
+	bool				lastAnchorOn;
+
+	// Constraints of the awake tiles, batched like the topology, and their compliance
+	Constraint*			activeConstraints;
+	float*				activeCompliance;
+	int*				activeBatchSize;
+	bool				activeStale;
+
+	// Coarse grid hierarchy solved before each PBD pass (nullptr while off)
+	ClothMultigrid*		multigrid;
+
+	// Nearest anchored particle of each particle over the cloth, and the longest allowed
+	// distance from it (nullptr until attachments are first enabled)
+	int*				tetherAnchors;
+	float*				tethers;
+	bool				attachments;
+
+	// Ground collided with during integration (not owned, nullptr for none)
+	const ClothHeightfield*	ground;
+
+	// Triangle mesh projected against after every constraint pass (not owned, nullptr for none)
+	const ClothMeshCollider*	collider;
+
+	// Signed distance field projected against after every constraint pass (not owned, nullptr for none)
+	const ClothDistanceField*	field;
+
+	// Spatial hash the cloth collides with itself through, rebuilt every step or substep (nullptr while off)
+	ClothSelfCollision*	selfCollision;
+
+	// Drag and lift of the air, and the wind it blows with (not owned) - both nullptr while off
+	ClothAerodynamics*		aerodynamics;
+	const ClothWindField*	wind;
+
+	// Tearing, the strain constraints tear at (nullptr and 0 while off), and the particles the
+	// last tears changed
+	ClothTearing*		tearing;
+	float				tearStrain;
+	std::vector<int>	tornParticles;
+
+	// Triangle tree for ray queries, refit after every step (nullptr while off)
+	ClothPicking*		picking;
+
+	// Point pulled towards a target in every constraint pass (triangle -1 while nothing is dragged)
+	ClothDrag			dragging;
+
+	// Rest state, anchors and particle streams setup - takes ownership of clothTopology
+	void setup(ClothTopology* clothTopology);
+
+	// Passes - the integration passes pin the anchors of each chunk while it is in cache
+	void applyForces();
+	void saveStep();
+	ClothResidual solveConstraints();
+
+	// Make the anchor targets written since the last step current, waking the tiles they move
+	void publishAnchors();
+
+	// Drag pass - moves the corners of the dragged triangle
+	void applyDrag();
+
+	// Long range attachment pass, and the tether lengths setup
+	void applyAttachments();
+	void buildTethers();
+
+	// Mesh collision passes
+	void applyCollider();
+	void applyDistanceField();
+
+	// Self collision pass - rebuilds the hash, then pushes the particles apart
+	void applySelfCollision();
+
+	// Air forces on the triangles from the particle velocities over the last h seconds, applied
+	// by the following integration passes
+	void computeAirForces(float h);
+
+	// Tearing pass - tears the overstretched constraints, then rebuilds what the tears changed
+	void tearConstraints();
+
+	// Key of the rest state - the topology, anchors and every parameter settling depends on
+	unsigned long long restKey() const;
+
+	// RMS distance the particles moved over the last step
+	float rmsMove() const;
+
+	// Load the particles from a rest state cache image - false if it is not one of this cloth
+	bool loadRestState(const unsigned char* bytes, size_t size, unsigned long long key);
+
+	// XPBD passes for a substep of length h, which ends t of the way through the step
+	void integrate(float h, float t);
+	ClothResidual solveConstraintsXPBD(float h);
+
+	// Run task over the particles of the awake tiles (every particle when none sleep)
+	void forAwakeParticles(int grain, const ClothTask& task);
+
+	// Whether the passes read the active constraint arrays
+	bool solvingActive() const;
+
+	// Constraints each pass projects - the active ones while any tile sleeps
+	int solvedConstraints() const;
+
+	// Gather the constraints touching an awake tile into the active arrays
+	void gatherActiveConstraints();
+
+	// Fold the chunk residuals of a pass and clear them
+	ClothResidual gatherResidual();
+
+	// Update the stats after a pass - true once the tolerance is met
+	bool recordPass(const ClothResidual& residual);
+
+public:
+	// Constructor - grid cloth
+	ClothSolver(DWORD clothW, DWORD clothH, ClothWorkerPool* workerPool);
+	// Constructor - any topology, which the solver takes ownership of
+	ClothSolver(ClothTopology* clothTopology, ClothWorkerPool* workerPool);
+	// Destructor
+	~ClothSolver();
+
+	// Advance the simulation by one step
+	void step();
+
+	// Write the particles as render vertices, in parallel. alpha blends from the
+	// state before the last step (0) to the current state (1). A grid cloth gets
+	// its normals from the blended positions in the same pass.
+	void assembleVertices(ClothVertex* vertices, float alpha = 1.0f) const;
+
+	// Select the instruction set of the constraint kernel (defaults to the best supported)
+	void setIsa(ClothIsa newIsa);
+	ClothIsa getIsa() const;
+
+	// State hashing - the state hash after every step is kept in the stats, to be logged and
+	// compared between runs (defaults to off)
+	void setHashing(bool enabled);
+	bool getHashing() const;
+
+	// Select the constraint formulation (defaults to PBD)
+	void setMode(ClothSolverMode newMode);
+	ClothSolverMode getMode() const;
+
+	// XPBD compliance in metres per newton - 0 is inextensible
+	void setCompliance(float value);
+	void setCompliance(int constraint, float value);
+
+	// Tile sleeping - settled regions stop being simulated until disturbed (defaults to off).
+	// A cloth that can tear or has torn does not sleep.
+	void setSleeping(bool enabled);
+	bool getSleeping() const;
+
+	// Multigrid - each PBD pass is preceded by a coarse to fine pass over up to levels coarser
+	// grids (0 turns it off). Grid cloths only - returns false for a mesh cloth, or one that can
+	// tear or has torn.
+	bool setMultigrid(int levels);
+	int getMultigrid() const;
+
+	// Long range attachments - while the anchors are on, no particle may get further from its
+	// nearest anchor than its rest distance across the cloth (defaults to off). Not for a cloth
+	// that can tear or has torn, which the tethers would hold together.
+	void setAttachments(bool enabled);
+	bool getAttachments() const;
+
+	// Collide with a heightfield in the integration pass - nullptr removes the ground.
+	// The heightfield is not copied and must outlive the solver or be removed first. Wakes
+	// every sleeping tile, as setCollider, setDistanceField and setWind do.
+	void setGround(const ClothHeightfield* heightfield);
+	const ClothHeightfield* getGround() const;
+
+	// Collide with a triangle mesh after every constraint pass - nullptr removes it.
+	// The collider is not copied and must outlive the solver or be removed first.
+	void setCollider(const ClothMeshCollider* meshCollider);
+	const ClothMeshCollider* getCollider() const;
+
+	// Collide with a baked distance field after every constraint pass - nullptr removes it.
+	// The field is not copied and must outlive the solver or be removed first.
+	void setDistanceField(const ClothDistanceField* distanceField);
+	const ClothDistanceField* getDistanceField() const;
+
+	// Self collision - after the constraint passes of every step (PBD) or substep (XPBD) the
+	// cloth is pushed apart wherever it came within selfThickness of itself (defaults to off)
+	void setSelfCollision(bool enabled);
+	bool getSelfCollision() const;
+
+	// Aerodynamic drag and lift on every triangle, against the air moving with the wind -
+	// nullptr turns them off. The field is not copied and must outlive the solver or be
+	// removed first; it is sampled at windOrigin + particle position. A sleeping tile also
+	// wakes whenever the air pushes one of its particles hard enough to reach sleepSpeed m/s
+	// within a step.
+	void setWind(const ClothWindField* windField);
+	const ClothWindField* getWind() const;
+
+	// Aerodynamic force on a particle at the start of the last step, in newtons (0 while off)
+	ClothFloat3 aerodynamicForce(int particle) const;
+
+	// Anchors - pin count particles to targets (where they are now when targets is nullptr),
+	// replacing the anchors the cloth hangs from. False when a particle is out of range.
+	bool setAnchors(const int* particleIndices, const ClothFloat3* targets, int count);
+
+	// Write the targets of anchors [first, first + count) in one batch - the next step moves
+	// the anchors to them, over its substeps in XPBD
+	void writeAnchorTargets(const ClothFloat3* targets, int first, int count);
+	const ClothAnchors& getAnchors() const;
+
+	// Tearing - after every step the constraints stretched past (1 + strain) times their rest
+	// length tear, splitting the cloth (0 turns it off, the tears made so far stay). Turns
+	// sleeping off, and returns false while multigrid or attachments are on, as the coarse
+	// grids and tethers would hold the tears together.
+	bool setTearing(float strain);
+	float getTearing() const;
+
+	// Ranges of triangles whose indices tearing changed since the last call, for the index buffer
+	// to be patched with a box each - false when none did
+	bool takeChangedTriangles(std::vector<ClothTriangleRange>& ranges);
+
+	// Picking - a tree over the triangles for ray queries, refit after every step (defaults to off)
+	void setPicking(bool enabled);
+	bool getPicking() const;
+
+	// Nearest hit of each of count rays against the cloth as it is after the last step, in
+	// parallel. False while picking is off.
+	bool intersect(const ClothRay* rays, int count, ClothRayHit* hits) const;
+
+	// Drag the point hit towards target, stiffness (0 to 1) of the way in every constraint pass,
+	// until released - call again to move the target. Anchored corners stay where they are.
+	void drag(const ClothRayHit& hit, const ClothFloat3& target, float stiffness = 0.5f);
+	void release();
+	const ClothDrag& getDrag() const;
+
+	// Settle the cloth where it hangs - step until the RMS speed of the particles over a second
+	// is under settleSpeed or has stopped falling, at most maxSteps. Given a cache directory the
+	// settled state is written there, named after a hash of the topology, anchors and parameters,
+	// and the next cloth settled with the same ones is read from the memory-mapped file without
+	// stepping.
+	// Grounds, colliders, wind, drags and tears are not part of the hash, so the cache is not used
+	// while one is set or tearing is on. Returns the steps run - 0 when the state came from the cache.
+	int settle(const char* cacheDirectory = nullptr, int maxSteps = 3600);
+
+	// Wake the region around a particle, e.g. after a collider touched it
+	void wake(int particle);
+	void wakeAll();
+
+	// Tiles with their sleep state and counters (nullptr until sleeping is first enabled)
+	const ClothTiles* getTiles() const;
+
+	// Iterations and residual of the last step
+	ClothSolverStats getStats() const;
+
+	// RMS relative stretch of the constraints (0 when every constraint is at rest length)
+	float stretchError() const;
+
+	// xxHash64 of the positions, inverse masses and previous positions of every particle -
+	// the same for the same state on any machine and thread count
+	unsigned long long stateHash() const;
+
+	// Accessors
+	const ClothParticleStore* getParticles() const;
+	const ClothTopology* getTopology() const;
+	int particleCount() const;
+
+	bool anchorOn;
+
+	// Maximum constraint passes per step (PBD) or per substep (XPBD)
+	int iterations;
+
+	// Stop iterating once the largest violation is at most this distance (0 runs every iteration)
+	float tolerance;
+
+	// Seconds simulated by each step and acceleration
+	float timeStep;
+	ClothFloat3 gravity;
+
+	// Fraction of the velocity kept each step (XPBD spreads it over the substeps)
+	float damping;
+
+	// XPBD only - substeps each step is split into
+	int substeps;
+
+	// Sleeping - particles per tile side (set before enabling), and a tile sleeps once the
+	// RMS speed of its particles stayed under sleepSpeed m/s for sleepSteps steps in a row
+	int tileSize;
+	float sleepSpeed;
+	int sleepSteps;
+
+	// Self collision thickness (set before enabling) - 0 uses half the mean rest length
+	float selfThickness;
+
+	// Aerodynamics - position of the cloth space origin in the wind field, air density in kg/m^3,
+	// drag and lift coefficients, and the cloth's mass per area in kg/m^2
+	ClothFloat3 windOrigin;
+	float airDensity;
+	float dragCoefficient;
+	float liftCoefficient;
+	float clothDensity;
+
+	// RMS speed in m/s under which settle considers the cloth at rest
+	float settleSpeed;
+
+	// Particles tearing may add (set before enabling) - 0 makes room for as many as the cloth has
+	int spareParticles;
+};
@@ -0,0 +1,521 @@
+#include "ClothTearing.h"
+#include "ClothFpContract.h"
+#include <algorithm>
+
+using namespace std;
+
+// Constraint slots per worker chunk of the scan
+static const int constraintGrain = 2048;
+
+// Unchanged triangles that may lie inside a changed range - fewer than this are cheaper to
+// upload again than to start another range for
+static const int rangeGap = 8;
+
+// Which way each triangle around a split particle goes
+static const char triangleStays		= 0;
+static const char triangleMoves		= 1;
+static const char triangleDropped	= 2;
+
+
+#pragma region Helpers
+
+// Replace the first from in list with to, or remove it when to is negative
+static void replaceEntry(vector<int>& list, int from, int to)
+{
+	vector<int>::iterator entry = find(list.begin(), list.end(), from);
+
+	if (entry == list.end())
+		return;
+
+	if (to >= 0)
+		*entry = to;
+	else
+		list.erase(entry);
+}
+
+static inline float sideOf(const ClothFloat4& p, const ClothFloat4& origin, const ClothFloat3& normal)
+{
+	return (p.x - origin.x) * normal.x + (p.y - origin.y) * normal.y + (p.z - origin.z) * normal.z;
+}
+
+#pragma endregion
+
+
+// Constructor
+ClothTearing::ClothTearing(ClothTopology* clothTopology, ClothWorkerPool* workerPool)
+{
+	topology		= clothTopology;
+	pool			= workerPool;
+	splits			= 0;
+	removals		= 0;
+
+	int count = topology->particleCount;
+
+	particleConstraints.resize(count);
+	particleTriangles.resize(count);
+	particleChanged.assign(count, 0);
+
+	for (int k = 0; k < topology->batchCount; k++)
+	{
+		int first	= topology->batchOffset[k];
+		int last	= first + topology->batchSize[k];
+
+		for (int s = first; s < last; s++)
+		{
+			particleConstraints[topology->constraints[s].start].push_back(s);
+			particleConstraints[topology->constraints[s].end].push_back(s);
+		}
+	}
+
+	for (int k = 0; k < topology->totalIndices; k++)
+		particleTriangles[topology->indices[k]].push_back(k / 3);
+
+	chunkTorn.resize((topology->totalConstraints + constraintGrain - 1) / constraintGrain + 1);
+}
+
+// Tear
+int ClothTearing::tear(ClothParticleStore* particles, float* compliance, float* lambda, float strain)
+{
+	const ClothFloat4* pos		= particles->pos;
+	const Constraint* slots		= topology->constraints;
+	vector<int>* found			= chunkTorn.data();
+	float limit					= (1.0f + strain) * (1.0f + strain);
+
+	// Scan every slot in parallel - the removed constraints past the live range of each
+	// batch have no length, so they never tear
+	pool->parallelFor(topology->totalConstraints, constraintGrain, [=](int begin, int end)
+	{
+		for (int first = begin; first < end; first += constraintGrain)
+		{
+			int last			= first + constraintGrain < end ? first + constraintGrain : end;
+			vector<int>& torn	= found[first / constraintGrain];
+
+			torn.clear();
+
+			for (int s = first; s < last; s++)
+			{
+				const Constraint& c = slots[s];
+
+				float dx = pos[c.end].x - pos[c.start].x;
+				float dy = pos[c.end].y - pos[c.start].y;
+				float dz = pos[c.end].z - pos[c.start].z;
+
+				if (dx * dx + dy * dy + dz * dz > c.length * c.length * limit)
+					torn.push_back(s);
+			}
+		}
+	});
+
+	// Last slot first, so a constraint swapped into a removed slot has been dealt with
+	// already. Each tear is checked again, as an earlier one may have let it go.
+	int torn = 0;
+
+	for (int chunk = (int)chunkTorn.size() - 1; chunk >= 0; chunk--)
+	{
+		for (int i = (int)chunkTorn[chunk].size() - 1; i >= 0; i--)
+		{
+			int s			= chunkTorn[chunk][i];
+			Constraint c	= topology->constraints[s];
+
+			float dx = pos[c.end].x - pos[c.start].x;
+			float dy = pos[c.end].y - pos[c.start].y;
+			float dz = pos[c.end].z - pos[c.start].z;
+
+			if (!(dx * dx + dy * dy + dz * dz > c.length * c.length * limit))
+				continue;
+
+			// Nothing more tears once there is no room for another particle
+			if (particles->count >= particles->capacity)
+				return torn;
+
+			if (!splitParticle(c.start, c.end, particles) && !splitParticle(c.end, c.start, particles))
+				removeConstraint(s, compliance, lambda);
+
+			torn++;
+		}
+
+		chunkTorn[chunk].clear();
+	}
+
+	return torn;
+}
+
+// Split particle
+bool ClothTearing::splitParticle(int a, int b, ClothParticleStore* particles)
+{
+	const ClothFloat4* pos = particles->pos;
+	ClothFloat3 normal(pos[b].x - pos[a].x, pos[b].y - pos[a].y, pos[b].z - pos[a].z);
+
+	// Triangles with their centre on the side of b move
+	const vector<int>& triangles = particleTriangles[a];
+	vector<char> moves(triangles.size(), triangleStays);
+	size_t moving = 0;
+
+	for (size_t t = 0; t < triangles.size(); t++)
+	{
+		const DWORD* corner = topology->indices + triangles[t] * 3;
+
+		ClothFloat4 centre((pos[corner[0]].x + pos[corner[1]].x + pos[corner[2]].x) / 3.0f,
+						(pos[corner[0]].y + pos[corner[1]].y + pos[corner[2]].y) / 3.0f,
+						(pos[corner[0]].z + pos[corner[1]].z + pos[corner[2]].z) / 3.0f, 0.0f);
+
+		moves[t] = sideOf(centre, pos[a], normal) > 0.0f ? triangleMoves : triangleStays;
+		moving += moves[t];
+	}
+
+	if (moving == 0 || moving == triangles.size())
+		return false;
+
+	// The tear runs between the two halves along edges with triangles on both sides. The edge
+	// keeps its constraint on the side that stays, so a moving triangle on it would be held by
+	// nothing - it is dropped.
+	for (size_t t = 0; t < triangles.size(); t++)
+	{
+		if (moves[t] != triangleMoves)
+			continue;
+
+		const DWORD* corner = topology->indices + triangles[t] * 3;
+
+		for (int k = 0; k < 3 && moves[t] == triangleMoves; k++)
+		{
+			if (corner[k] == (DWORD)a)
+				continue;
+
+			for (size_t u = 0; u < triangles.size(); u++)
+			{
+				if (moves[u] == triangleStays && hasCorner(triangles[u], corner[k]))
+					moves[t] = triangleDropped;
+			}
+		}
+	}
+
+	// A constraint along a triangle edge moves when every triangle on the edge moves - one on
+	// the tear stays. A constraint across the triangles goes with the side its far end is on.
+	const vector<int>& around = particleConstraints[a];
+	vector<char> follows(around.size(), 0);
+	size_t following = 0;
+
+	for (size_t i = 0; i < around.size(); i++)
+	{
+		const Constraint& c = topology->constraints[around[i]];
+
+		int other		= c.start == (unsigned int)a ? c.end : c.start;
+		bool moved		= false;
+		bool stayed		= false;
+
+		for (size_t t = 0; t < triangles.size(); t++)
+		{
+			if (moves[t] == triangleDropped || !hasCorner(triangles[t], other))
+				continue;
+
+			if (moves[t] == triangleMoves)
+				moved = true;
+			else
+				stayed = true;
+		}
+
+		if (moved || stayed)
+			follows[i] = moved && !stayed;
+		else
+			follows[i] = sideOf(pos[other], pos[a], normal) > 0.0f;
+
+		following += follows[i];
+	}
+
+	// Both halves must stay held by the cloth
+	if (following < 2 || following == around.size())
+		return false;
+
+	int split = particles->duplicate(a);
+
+	if (split < 0)
+		return false;
+
+	// Only the particle itself stays pinned when an anchor tears
+	particles->pos[split].w = 1.0f;
+
+	topology->addParticle(a);
+
+	particleConstraints.resize(split + 1);
+	particleTriangles.resize(split + 1);
+	particleChanged.resize(split + 1, 0);
+
+	touch(a);
+	touch(split);
+
+	vector<int> kept, dropped;
+
+	for (size_t t = 0; t < particleTriangles[a].size(); t++)
+	{
+		int triangle = particleTriangles[a][t];
+
+		if (moves[t] == triangleStays)
+		{
+			kept.push_back(triangle);
+			continue;
+		}
+
+		if (moves[t] == triangleDropped)
+		{
+			dropped.push_back(triangle);
+			continue;
+		}
+
+		DWORD* corner = topology->indices + triangle * 3;
+
+		for (int k = 0; k < 3; k++)
+		{
+			if (corner[k] == (DWORD)a)
+				corner[k] = (DWORD)split;
+		}
+
+		particleTriangles[split].push_back(triangle);
+
+		markChanged(triangle);
+	}
+
+	particleTriangles[a].swap(kept);
+	kept.clear();
+
+	for (size_t t = 0; t < dropped.size(); t++)
+		dropTriangle(dropped[t]);
+
+	for (size_t i = 0; i < particleConstraints[a].size(); i++)
+	{
+		int slot = particleConstraints[a][i];
+
+		if (!follows[i])
+		{
+			kept.push_back(slot);
+			continue;
+		}
+
+		Constraint& c = topology->constraints[slot];
+
+		if (c.start == (unsigned int)a)
+			c.start = split;
+		else
+			c.end = split;
+
+		touch(c.start == (unsigned int)split ? c.end : c.start);
+
+		particleConstraints[split].push_back(slot);
+	}
+
+	particleConstraints[a].swap(kept);
+
+	splits++;
+
+	return true;
+}
+
+// Remove constraint
+void ClothTearing::removeConstraint(int slot, float* compliance, float* lambda)
+{
+	int k		= batchOf(slot);
+	int last	= topology->batchOffset[k] + topology->batchSize[k] - 1;
+
+	Constraint removed = topology->constraints[slot];
+
+	replaceEntry(particleConstraints[removed.start], slot, -1);
+	replaceEntry(particleConstraints[removed.end], slot, -1);
+
+	touch(removed.start);
+	touch(removed.end);
+
+	// The triangles on the edge go with it - nothing would hold them together
+	vector<int> edge;
+
+	for (size_t t = 0; t < particleTriangles[removed.start].size(); t++)
+	{
+		if (hasCorner(particleTriangles[removed.start][t], removed.end))
+			edge.push_back(particleTriangles[removed.start][t]);
+	}
+
+	for (size_t t = 0; t < edge.size(); t++)
+		dropTriangle(edge[t]);
+
+	if (slot != last)
+	{
+		Constraint moved = topology->constraints[last];
+
+		topology->constraints[slot]	= moved;
+		compliance[slot]			= compliance[last];
+		lambda[slot]				= lambda[last];
+
+		replaceEntry(particleConstraints[moved.start], last, slot);
+		replaceEntry(particleConstraints[moved.end], last, slot);
+	}
+
+	topology->constraints[last].start	= removed.start;
+	topology->constraints[last].end		= removed.start;
+	topology->constraints[last].length	= 0.0f;
+	compliance[last]					= 0.0f;
+	lambda[last]						= 0.0f;
+
+	topology->batchSize[k]--;
+
+	removals++;
+}
+
+// Drop triangle - collapsed onto one corner, so it is neither drawn nor caught by the air
+void ClothTearing::dropTriangle(int t)
+{
+	DWORD* corner = topology->indices + t * 3;
+
+	for (int k = 0; k < 3; k++)
+	{
+		replaceEntry(particleTriangles[corner[k]], t, -1);
+		touch(corner[k]);
+	}
+
+	corner[1] = corner[0];
+	corner[2] = corner[0];
+
+	markChanged(t);
+}
+
+// Mark changed
+void ClothTearing::markChanged(int t)
+{
+	changedTriangles.push_back(t);
+
+	const DWORD* corner = topology->indices + t * 3;
+
+	for (int k = 0; k < 3; k++)
+		touch(corner[k]);
+}
+
+// Touch
+void ClothTearing::touch(int particle)
+{
+	if (particleChanged[particle])
+		return;
+
+	particleChanged[particle] = 1;
+	changedParticles.push_back(particle);
+}
+
+// Batch of a slot
+int ClothTearing::batchOf(int slot) const
+{
+	int k = topology->batchCount - 1;
+
+	while (k > 0 && topology->batchOffset[k] > slot)
+		k--;
+
+	return k;
+}
+
+// Has corner
+bool ClothTearing::hasCorner(int t, int particle) const
+{
+	const DWORD* corner = topology->indices + t * 3;
+
+	return corner[0] == (DWORD)particle || corner[1] == (DWORD)particle || corner[2] == (DWORD)particle;
+}
+
+// Take changed triangles
+bool ClothTearing::takeChangedTriangles(vector<ClothTriangleRange>& ranges)
+{
+	ranges.clear();
+
+	if (changedTriangles.empty())
+		return false;
+
+	sort(changedTriangles.begin(), changedTriangles.end());
+
+	for (size_t i = 0; i < changedTriangles.size(); i++)
+	{
+		int t = changedTriangles[i];
+
+		if (ranges.empty() || t >= ranges.back().end + rangeGap)
+		{
+			ClothTriangleRange range = { t, t + 1 };
+			ranges.push_back(range);
+		}
+		else
+		{
+			ranges.back().end = max(ranges.back().end, t + 1);
+		}
+	}
+
+	changedTriangles.clear();
+
+	// Too many ranges - the narrowest gaps are closed, the first of those as wide as the widest
+	// to close going when several are
+	if (ranges.size() > CLOTH_TEAR_RANGES)
+	{
+		int closing = (int)ranges.size() - CLOTH_TEAR_RANGES;
+
+		vector<int> gaps(ranges.size() - 1);
+
+		for (size_t i = 0; i + 1 < ranges.size(); i++)
+			gaps[i] = ranges[i + 1].first - ranges[i].end;
+
+		nth_element(gaps.begin(), gaps.begin() + (closing - 1), gaps.end());
+
+		int widest		= gaps[closing - 1];
+		int narrower	= 0;
+
+		for (int g = 0; g < closing; g++)
+			narrower += gaps[g] < widest;
+
+		int asWide	= closing - narrower;
+		size_t kept	= 0;
+
+		for (size_t i = 1; i < ranges.size(); i++)
+		{
+			int gap = ranges[i].first - ranges[i - 1].end;
+
+			if (gap < widest || (gap == widest && asWide-- > 0))
+				ranges[kept].end = ranges[i].end;
+			else
+				ranges[++kept] = ranges[i];
+		}
+
+		ranges.resize(kept + 1);
+	}
+
+	return true;
+}
+
+// Take changed particles
+bool ClothTearing::takeChangedParticles(vector<int>& particles)
+{
+	particles.clear();
+
+	if (changedParticles.empty())
+		return false;
+
+	particles.swap(changedParticles);
+
+	for (size_t i = 0; i < particles.size(); i++)
+		particleChanged[particles[i]] = 0;
+
+	return true;
+}
+
+// Triangles around
+const vector<int>& ClothTearing::trianglesAround(int particle) const
+{
+	return particleTriangles[particle];
+}
+
+// Constraints around
+const vector<int>& ClothTearing::constraintsAround(int particle) const
+{
+	return particleConstraints[particle];
+}
+
+// Split count
+int ClothTearing::splitCount() const
+{
+	return splits;
+}
+
+// Removed count
+int ClothTearing::removedCount() const
+{
+	return removals;
+}
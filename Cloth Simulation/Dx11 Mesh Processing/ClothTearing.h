@@ -0,0 +1,115 @@
+#pragma once
+
+#include <vector>
+#include "ClothTypes.h"
+#include "ClothTopology.h"
+#include "ClothWorkerPool.h"
+#include "ClothParticleStore.h"
+
+
+// Most ranges the changed triangles are handed back in - past that the closest are joined
+#define CLOTH_TEAR_RANGES 256
+
+
+// Triangles [first, end) of an index list
+struct ClothTriangleRange
+{
+	int		first;
+	int		end;
+};
+
+
+// Tearing for the CPU solver. After a step every constraint stretched past its rest
+// length by more than the strain tears: one of its particles is split in two along
+// the plane through it square to the constraint, and the triangles and constraints
+// on the far side move to the new particle, which starts as a copy of the old one.
+// The triangles on the two edges the tear runs along are dropped, as their edge
+// constraints stay on the near side. When neither end can be split (every triangle
+// around it is on one side) the constraint is removed instead, with the triangles on it.
+//
+// Only the particles, triangles and constraints around a tear are touched. Each
+// particle keeps the constraint slots and triangles around it, and each batch keeps
+// its live constraints at its front - a removed constraint is swapped with the last
+// live one of its batch, leaving a zero length constraint of a particle to itself
+// outside the live range. A constraint moved to a new particle stays in its batch,
+// which the new particle has no other constraint in. New particles are appended to
+// the topology and the particle store, which must have room for them.
+//
+// The triangles a tear changes are handed back as a short list of ranges for the
+// index buffer to be patched with. A tear along a row of a grid laid out in strips
+// changes a few triangles in every strip, so the ranges are kept apart unless only a
+// few unchanged triangles lie between them.
+class ClothTearing
+{
+private:
+	ClothTopology*		topology;
+	ClothWorkerPool*	pool;
+
+	// Constraint slots and triangles around each particle
+	std::vector<std::vector<int>>	particleConstraints;
+	std::vector<std::vector<int>>	particleTriangles;
+
+	// Constraints found stretched past the strain by each worker chunk of the last scan
+	std::vector<std::vector<int>>	chunkTorn;
+
+	// Triangles whose indices changed since they were last taken, in the order they changed
+	std::vector<int>	changedTriangles;
+
+	// Particles whose triangles or constraints changed since they were last taken, and
+	// whether each particle is among them
+	std::vector<int>	changedParticles;
+	std::vector<char>	particleChanged;
+
+	// Particles split and constraints removed so far
+	int					splits;
+	int					removals;
+
+	// Batch of a constraint slot
+	int batchOf(int slot) const;
+
+	// Whether triangle t has particle as a corner
+	bool hasCorner(int t, int particle) const;
+
+	// Add triangle t to the changed triangles, and its corners to the changed particles
+	void markChanged(int t);
+
+	// Add particle to the changed particles
+	void touch(int particle);
+
+	// Collapse triangle t onto its first corner and forget it
+	void dropTriangle(int t);
+
+	// Split particle a, moving the triangles and constraints on the side of b to a new
+	// particle - false if a cannot be split that way or the store is full
+	bool splitParticle(int a, int b, ClothParticleStore* particles);
+
+	// Remove the constraint in slot, moving the last live constraint of its batch (and its
+	// compliance and multiplier) into it
+	void removeConstraint(int slot, float* compliance, float* lambda);
+
+public:
+	// Constructor - constraints and triangles around each particle of the topology, which must
+	// be writable and outlive this
+	ClothTearing(ClothTopology* clothTopology, ClothWorkerPool* workerPool);
+
+	// Tear every constraint stretched past (1 + strain) times its rest length. compliance and
+	// lambda are indexed like the constraints and follow them. Returns the constraints torn.
+	int tear(ClothParticleStore* particles, float* compliance, float* lambda, float strain);
+
+	// Ranges of triangles whose indices changed since the last call, in order and apart, with
+	// no more than CLOTH_TEAR_RANGES of them - false when none did
+	bool takeChangedTriangles(std::vector<ClothTriangleRange>& ranges);
+
+	// Particles whose triangles or constraints changed since the last call, the new ones
+	// included, in the order they changed - false when none did
+	bool takeChangedParticles(std::vector<int>& particles);
+
+	// Triangles and live constraint slots around a particle, in no particular order. The
+	// triangles dropped by a tear are around no particle.
+	const std::vector<int>& trianglesAround(int particle) const;
+	const std::vector<int>& constraintsAround(int particle) const;
+
+	// Accessors
+	int splitCount() const;
+	int removedCount() const;
+};
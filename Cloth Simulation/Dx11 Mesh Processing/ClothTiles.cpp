@@ -0,0 +1,412 @@
+#include "ClothTiles.h"
+#include "ClothFpContract.h"
+#include <algorithm>
+
+using namespace std;
+
+// Tiles per worker chunk
+static const int tileGrain = 4;
+
+
+// Constructor
+ClothTiles::ClothTiles(const ClothTopology* topology, ClothParticleStore* particleStore, int tileSize)
+{
+	particles = particleStore;
+
+	if (tileSize < 1)
+		tileSize = 1;
+
+	if (topology->w > 0 && topology->h > 0)
+		buildGridSpans(topology->w, topology->h, tileSize);
+	else
+		buildRunSpans(topology->particleCount, tileSize * tileSize);
+
+	buildNeighbours(topology);
+
+	awake.assign(tileCount, 1);
+	moving.assign(tileCount, 0);
+	pushed.assign(tileCount, 0);
+	quietSteps.assign(tileCount, 0);
+	motion.assign(tileCount, 0.0f);
+	awakeSteps.assign(tileCount, 0);
+	asleepSteps.assign(tileCount, 0);
+
+	rebuildLists();
+}
+
+// Grid spans - one span per row of each square tile
+void ClothTiles::buildGridSpans(int w, int h, int tileSize)
+{
+	int tilesX = (w + tileSize - 1) / tileSize;
+	int tilesY = (h + tileSize - 1) / tileSize;
+
+	tileCount = tilesX * tilesY;
+
+	particleTile.resize(w * h);
+	spanFirst.resize(tileCount + 1);
+
+	for (int ty = 0; ty < tilesY; ty++)
+	{
+		for (int tx = 0; tx < tilesX; tx++)
+		{
+			int tile	= ty * tilesX + tx;
+			int x0		= tx * tileSize;
+			int x1		= x0 + tileSize < w ? x0 + tileSize : w;
+			int y0		= ty * tileSize;
+			int y1		= y0 + tileSize < h ? y0 + tileSize : h;
+
+			spanFirst[tile] = (int)spans.size();
+
+			for (int y = y0; y < y1; y++)
+			{
+				ClothSpan span = {y * w + x0, y * w + x1};
+
+				spans.push_back(span);
+
+				for (int i = span.begin; i < span.end; i++)
+					particleTile[i] = tile;
+			}
+		}
+	}
+
+	spanFirst[tileCount] = (int)spans.size();
+}
+
+// Run spans - consecutive particles, which are close together in an optimised mesh
+void ClothTiles::buildRunSpans(int particleCount, int tileParticles)
+{
+	tileCount = (particleCount + tileParticles - 1) / tileParticles;
+
+	particleTile.resize(particleCount);
+	spanFirst.resize(tileCount + 1);
+
+	for (int tile = 0; tile < tileCount; tile++)
+	{
+		int begin	= tile * tileParticles;
+		int end		= begin + tileParticles < particleCount ? begin + tileParticles : particleCount;
+
+		ClothSpan span = {begin, end};
+
+		spanFirst[tile] = tile;
+		spans.push_back(span);
+
+		for (int i = begin; i < end; i++)
+			particleTile[i] = tile;
+	}
+
+	spanFirst[tileCount] = tileCount;
+}
+
+// Neighbours - tiles sharing a constraint
+void ClothTiles::buildNeighbours(const ClothTopology* topology)
+{
+	vector<pair<int, int> > links;
+
+	for (int i = 0; i < topology->totalConstraints; i++)
+	{
+		int a = particleTile[topology->constraints[i].start];
+		int b = particleTile[topology->constraints[i].end];
+
+		if (a != b)
+		{
+			links.push_back(make_pair(a, b));
+			links.push_back(make_pair(b, a));
+		}
+	}
+
+	sort(links.begin(), links.end());
+	links.erase(unique(links.begin(), links.end()), links.end());
+
+	neighbourFirst.assign(tileCount + 1, 0);
+	neighbours.resize(links.size());
+
+	for (size_t i = 0; i < links.size(); i++)
+	{
+		neighbourFirst[links[i].first + 1]++;
+		neighbours[i] = links[i].second;
+	}
+
+	for (int t = 0; t < tileCount; t++)
+		neighbourFirst[t + 1] += neighbourFirst[t];
+}
+
+// Rebuild lists
+void ClothTiles::rebuildLists()
+{
+	awakeList.clear();
+
+	for (int t = 0; t < tileCount; t++)
+	{
+		if (awake[t])
+			awakeList.push_back(t);
+	}
+
+	changed = false;
+}
+
+// Awake spans
+void ClothTiles::forAwakeSpans(ClothWorkerPool* pool, const ClothTask& task) const
+{
+	const int* tiles		= awakeList.data();
+	const int* first		= spanFirst.data();
+	const ClothSpan* span	= spans.data();
+
+	pool->parallelFor((int)awakeList.size(), tileGrain, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			for (int s = first[tiles[i]]; s < first[tiles[i] + 1]; s++)
+				task(span[s].begin, span[s].end);
+		}
+	});
+}
+
+// Update
+bool ClothTiles::update(ClothWorkerPool* pool, float threshold, int stepsToSleep)
+{
+	refresh();
+
+	// Mean squared distance moved by the particles of each awake tile since the step
+	// started - the kinetic energy per particle up to a constant. The mean rather than
+	// the largest so solver noise on a few particles does not keep a settled tile awake.
+	const int* tiles			= awakeList.data();
+	const int* first			= spanFirst.data();
+	const ClothSpan* span		= spans.data();
+	const ClothFloat4* pos		= particles->pos;
+	const ClothFloat4* lastPos	= particles->lastPos;
+	float* tileMotion			= motion.data();
+
+	pool->parallelFor((int)awakeList.size(), tileGrain, [=](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			float sum	= 0.0f;
+			int n		= 0;
+
+			for (int s = first[tiles[i]]; s < first[tiles[i] + 1]; s++)
+			{
+				for (int p = span[s].begin; p < span[s].end; p++)
+				{
+					float dx = pos[p].x - lastPos[p].x;
+					float dy = pos[p].y - lastPos[p].y;
+					float dz = pos[p].z - lastPos[p].z;
+
+					sum += dx * dx + dy * dy + dz * dz;
+				}
+
+				n += span[s].end - span[s].begin;
+			}
+
+			tileMotion[tiles[i]] = n ? sum / (float)n : 0.0f;
+		}
+	});
+
+	float threshold2 = threshold * threshold;
+
+	for (size_t i = 0; i < awakeList.size(); i++)
+	{
+		int t = awakeList[i];
+
+		moving[t]		= motion[t] > threshold2;
+		quietSteps[t]	= moving[t] ? 0 : quietSteps[t] + 1;
+	}
+
+	for (size_t i = 0; i < awakeList.size(); i++)
+	{
+		int t = awakeList[i];
+		bool neighbourMoving = false;
+
+		for (int k = neighbourFirst[t]; k < neighbourFirst[t + 1]; k++)
+		{
+			int n = neighbours[k];
+
+			neighbourMoving = neighbourMoving || (awake[n] && moving[n]);
+
+			// A moving tile wakes its neighbours before it pulls against them
+			if (moving[t] && !awake[n])
+				wakeTile(n);
+		}
+
+		// Only sleep once the tiles around are still too
+		if (quietSteps[t] >= stepsToSleep && !neighbourMoving)
+			sleep(t);
+	}
+
+	for (int t = 0; t < tileCount; t++)
+	{
+		moving[t] = 0;
+
+		if (awake[t])
+			awakeSteps[t]++;
+		else
+			asleepSteps[t]++;
+	}
+
+	return refresh();
+}
+
+// Sleep - the particles lose their velocity and become immovable, so constraints
+// from awake neighbours treat the tile as a fixed support rather than dragging it
+void ClothTiles::sleep(int tile)
+{
+	for (int s = spanFirst[tile]; s < spanFirst[tile + 1]; s++)
+	{
+		for (int p = spans[s].begin; p < spans[s].end; p++)
+		{
+			particles->pos[p].w = 0.0f;
+
+			particles->prevPos[p].x = particles->pos[p].x;
+			particles->prevPos[p].y = particles->pos[p].y;
+			particles->prevPos[p].z = particles->pos[p].z;
+
+			particles->lastPos[p] = particles->pos[p];
+		}
+	}
+
+	awake[tile]			= 0;
+	quietSteps[tile]	= 0;
+	changed				= true;
+}
+
+// Wake tile
+void ClothTiles::wakeTile(int tile)
+{
+	quietSteps[tile] = 0;
+
+	if (awake[tile])
+		return;
+
+	// Unit mass again - the solver pins the anchors again every step
+	for (int s = spanFirst[tile]; s < spanFirst[tile + 1]; s++)
+	{
+		for (int p = spans[s].begin; p < spans[s].end; p++)
+			particles->pos[p].w = 1.0f;
+	}
+
+	awake[tile]	= 1;
+	changed		= true;
+}
+
+// Wake
+void ClothTiles::wake(int particle)
+{
+	if (particle >= 0 && particle < (int)particleTile.size())
+		wakeTile(particleTile[particle]);
+}
+
+// Wake all
+void ClothTiles::wakeAll()
+{
+	for (int t = 0; t < tileCount; t++)
+		wakeTile(t);
+}
+
+// Wake pushed - the tiles are tested in parallel and woken in order
+bool ClothTiles::wakePushed(ClothWorkerPool* pool, const ClothFloat4* push, float limit)
+{
+	if (!anyAsleep())
+		return false;
+
+	const char* tileAwake	= awake.data();
+	const int* first		= spanFirst.data();
+	const ClothSpan* span	= spans.data();
+	char* tilePushed		= pushed.data();
+	float limit2			= limit * limit;
+
+	pool->parallelFor(tileCount, tileGrain, [=](int begin, int end)
+	{
+		for (int t = begin; t < end; t++)
+		{
+			tilePushed[t] = 0;
+
+			if (tileAwake[t])
+				continue;
+
+			for (int s = first[t]; s < first[t + 1] && !tilePushed[t]; s++)
+			{
+				for (int p = span[s].begin; p < span[s].end; p++)
+				{
+					if (push[p].x * push[p].x + push[p].y * push[p].y + push[p].z * push[p].z > limit2)
+					{
+						tilePushed[t] = 1;
+						break;
+					}
+				}
+			}
+		}
+	});
+
+	bool woke = false;
+
+	for (int t = 0; t < tileCount; t++)
+	{
+		if (pushed[t])
+		{
+			wakeTile(t);
+			woke = true;
+		}
+	}
+
+	return woke;
+}
+
+// Refresh
+bool ClothTiles::refresh()
+{
+	if (!changed)
+		return false;
+
+	rebuildLists();
+
+	return true;
+}
+
+// Any asleep
+bool ClothTiles::anyAsleep() const
+{
+	return awakeCount() < tileCount;
+}
+
+// Count
+int ClothTiles::count() const
+{
+	return tileCount;
+}
+
+// Tile of a particle
+int ClothTiles::tileOf(int particle) const
+{
+	return particleTile[particle];
+}
+
+// Awake
+bool ClothTiles::isAwake(int tile) const
+{
+	return awake[tile] != 0;
+}
+
+// Awake count
+int ClothTiles::awakeCount() const
+{
+	if (!changed)
+		return (int)awakeList.size();
+
+	int n = 0;
+
+	for (int t = 0; t < tileCount; t++)
+		n += awake[t];
+
+	return n;
+}
+
+// Steps awake
+int ClothTiles::stepsAwake(int tile) const
+{
+	return awakeSteps[tile];
+}
+
+// Steps asleep
+int ClothTiles::stepsAsleep(int tile) const
+{
+	return asleepSteps[tile];
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vector>
+#include "ClothTypes.h"
+#include "ClothTopology.h"
+#include "ClothWorkerPool.h"
+#include "ClothParticleStore.h"
+
+
+// Contiguous particles [begin, end) inside a tile
+struct ClothSpan
+{
+	int begin;
+	int end;
+};
+
+
+// Tile level sleeping for the CPU solver. A grid cloth is cut into square tiles
+// (a mesh cloth into runs of consecutive particles). Tiles that barely move for a
+// number of steps go to sleep and are skipped by the solver passes, with their
+// particles pinned in place. A sleeping tile wakes when a neighbouring tile starts
+// moving, when a force on one of its particles would get it moving, or on an explicit
+// wake (anchors, colliders).
+class ClothTiles
+{
+private:
+	ClothParticleStore*	particles;
+
+	int					tileCount;
+
+	// Tile of each particle
+	std::vector<int>	particleTile;
+
+	// Particle spans of each tile, and tiles joined to it by a constraint (compressed rows)
+	std::vector<int>		spanFirst;
+	std::vector<ClothSpan>	spans;
+	std::vector<int>		neighbourFirst;
+	std::vector<int>		neighbours;
+
+	// Per tile state
+	std::vector<char>	awake;
+	std::vector<char>	moving;
+	std::vector<char>	pushed;
+	std::vector<int>	quietSteps;
+	std::vector<float>	motion;
+
+	// Per tile counters
+	std::vector<int>	awakeSteps;
+	std::vector<int>	asleepSteps;
+
+	// Awake tiles
+	std::vector<int>	awakeList;
+
+	// Whether the lists need rebuilding
+	bool				changed;
+
+	// Spans setup
+	void buildGridSpans(int w, int h, int tileSize);
+	void buildRunSpans(int particleCount, int tileParticles);
+
+	// Neighbours setup
+	void buildNeighbours(const ClothTopology* topology);
+
+	// Rebuild the awake list
+	void rebuildLists();
+
+	// Put a tile to sleep
+	void sleep(int tile);
+
+	// Wake a tile
+	void wakeTile(int tile);
+
+public:
+	// Constructor - tileSize x tileSize particles per tile on a grid, tileSize squared particles per tile on a mesh
+	ClothTiles(const ClothTopology* topology, ClothParticleStore* particleStore, int tileSize);
+
+	// Run task over the spans of the awake tiles in parallel
+	void forAwakeSpans(ClothWorkerPool* pool, const ClothTask& task) const;
+
+	// Measure how far the awake particles went since the step started, then update the
+	// sleep state. A tile is still while the RMS distance its particles moved is at most
+	// threshold. Returns true when a tile fell asleep or woke up.
+	bool update(ClothWorkerPool* pool, float threshold, int stepsToSleep);
+
+	// Wake the tile of a particle, or every tile
+	void wake(int particle);
+	void wakeAll();
+
+	// Wake the sleeping tiles with a particle whose push (xyz, indexed like the particles) is
+	// longer than limit - true when any woke
+	bool wakePushed(ClothWorkerPool* pool, const ClothFloat4* push, float limit);
+
+	// Rebuild the awake lists after tiles were woken - true when anything changed
+	bool refresh();
+
+	// Whether any tile is asleep
+	bool anyAsleep() const;
+
+	// Accessors
+	int count() const;
+	int tileOf(int particle) const;
+	bool isAwake(int tile) const;
+	int awakeCount() const;
+
+	// Steps each tile has spent awake and asleep
+	int stepsAwake(int tile) const;
+	int stepsAsleep(int tile) const;
+};
@@ -0,0 +1,736 @@
+#include "ClothTopology.h"
+#include "ClothFpContract.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "ClothGraphColouring.h"
+#include "ClothIndexOptimiser.h"
+
+using namespace std;
+
+// Cache file layout - the header, the batch sizes and offsets, the constraints and the
+// indices, each part starting on a 64 byte boundary. Version 2 lays the indices out in cache
+// ordered strips.
+static const char gridMagic[4]	= {'C', 'G', 'R', 'D'};
+static const int gridVersion	= 2;
+static const size_t gridAlign	= 64;
+
+// Particles per worker chunk when building a grid
+static const int gridGrain		= 4096;
+
+// Colours of every particle, packed as XMCOLOR packs them - opaque green, and no specular
+static const uint32_t particleDiffuse	= 0xFF00FF00;
+static const uint32_t particleSpecular	= 0x00000000;
+
+
+#pragma region Helpers
+
+struct ClothGridHeader
+{
+	char			magic[4];
+	int				version;
+	unsigned int	w, h;
+	int				particleCount;
+	int				totalConstraints;
+	int				totalIndices;
+	int				batchCount;
+};
+
+// Length of a rest offset between two particles
+static inline float restLength(float dx, float dy, float dz)
+{
+	return sqrtf(dx * dx + dy * dy + dz * dz);
+}
+
+static inline size_t gridAlignUp(size_t offset)
+{
+	return (offset + gridAlign - 1) / gridAlign * gridAlign;
+}
+
+// Offsets of the parts of a cache image
+static void gridLayout(int batchCount, int totalConstraints, int totalIndices, size_t& sizeOffset, size_t& batchOffset, size_t& constraintOffset, size_t& indexOffset, size_t& total)
+{
+	sizeOffset			= gridAlignUp(sizeof(ClothGridHeader));
+	batchOffset			= gridAlignUp(sizeOffset + sizeof(int) * batchCount);
+	constraintOffset	= gridAlignUp(batchOffset + sizeof(int) * batchCount);
+	indexOffset			= gridAlignUp(constraintOffset + sizeof(Constraint) * (size_t)totalConstraints);
+	total				= indexOffset + sizeof(DWORD) * (size_t)totalIndices;
+}
+
+// Rows of a grid per worker chunk
+static inline int gridRows(DWORD w)
+{
+	int rows = gridGrain / int(w);
+
+	return rows > 1 ? rows : 1;
+}
+
+// Cache file name of a grid
+static string gridCacheName(DWORD w, DWORD h)
+{
+	return "cloth_grid_" + to_string((long long)w) + "x" + to_string((long long)h) + ".bin";
+}
+
+#pragma endregion
+
+
+// Constructor
+ClothTopology::ClothTopology(DWORD clothW, DWORD clothH, ClothWorkerPool* pool, const char* cacheDirectory)
+{
+	w = clothW;
+	h = clothH;
+
+	meshRest			= nullptr;
+	batchSize			= nullptr;
+	batchOffset			= nullptr;
+	constraints			= nullptr;
+	indices				= nullptr;
+	cached				= false;
+
+	particleCount		= w * h;
+	totalConstraints	= ((((w - 2) * 4) + 5) * (h - 1)) + (w - 1);
+	totalIndices		= (w - 1) * (h - 1) * 6;
+	batchCount			= CLOTH_BATCH_COUNT;
+
+	string path;
+
+	if (cacheDirectory && cacheDirectory[0])
+	{
+		path = cacheDirectory;
+
+		if (path[path.size() - 1] != '/' && path[path.size() - 1] != '\\')
+			path += "/";
+
+		path += gridCacheName(w, h);
+
+		// A cache of another version, or a truncated one, is built again
+		cached = cache.open(path.c_str()) && attach((const unsigned char*)cache.data(), cache.size());
+
+		if (cached)
+			return;
+
+		cache.close();
+	}
+
+	batchSize			= (int*)malloc(sizeof(int) * batchCount);
+	batchOffset			= (int*)malloc(sizeof(int) * batchCount);
+	constraints			= (Constraint*)malloc(sizeof(Constraint) * totalConstraints);
+	indices				= (DWORD*)malloc(sizeof(DWORD) * totalIndices);
+
+	if (!batchSize || !batchOffset || !constraints || !indices)
+	{
+		dispose();
+		throw("Cannot create cloth topology buffers");
+	}
+
+	buildConstraints(pool);
+	buildIndices(pool);
+
+	// The cache only saves time, so the grid is used even when it cannot be written
+	if (!path.empty())
+		writeCache(path.c_str());
+}
+
+// Constructor
+ClothTopology::ClothTopology(const ClothFloat3* positions, const ClothFloat3* normals, const ClothFloat2* texCoords, int vertexCount, const DWORD* triangles, int triangleCount, ClothWorkerPool* pool)
+{
+	reset();
+
+	try
+	{
+		buildMesh(positions, normals, texCoords, vertexCount, triangles, triangleCount, pool);
+	}
+	catch (...)
+	{
+		dispose();
+		throw;
+	}
+}
+
+// Destructor
+ClothTopology::~ClothTopology()
+{
+	dispose();
+}
+
+// Reset
+void ClothTopology::reset()
+{
+	w = 0;
+	h = 0;
+
+	meshRest			= nullptr;
+	batchSize			= nullptr;
+	batchOffset			= nullptr;
+	constraints			= nullptr;
+	indices				= nullptr;
+	cached				= false;
+
+	particleCount		= 0;
+	totalConstraints	= 0;
+	totalIndices		= 0;
+	batchCount			= 0;
+}
+
+// Dispose
+void ClothTopology::dispose()
+{
+	free(meshRest);
+
+	// Mapped buffers go with the view
+	if (!cached)
+	{
+		free(batchSize);
+		free(batchOffset);
+		free(constraints);
+		free(indices);
+	}
+
+	cache.close();
+	cached		= false;
+
+	meshRest	= nullptr;
+	batchSize	= nullptr;
+	batchOffset	= nullptr;
+	constraints	= nullptr;
+	indices		= nullptr;
+}
+
+// Particles setup
+void ClothTopology::buildParticles(Particle* particles) const
+{
+	int added = (int)splitSource.size();
+	int first = particleCount - added;
+
+	if (meshRest)
+		memcpy(particles, meshRest, sizeof(Particle) * first);
+	else
+	{
+		Particle *vptr = particles;
+
+		for (int j=0; j<int(h); ++j)
+		{
+			for (int i = 0; i < int(w); ++i, ++vptr)
+			{
+				vptr->vertex.pos			= ClothFloat3( ((float)i / (float)(w-1)), 0, ((float)j / (float)(h-1)));
+				vptr->prevPos				= vptr->vertex.pos;
+				vptr->vertex.normal			= ClothFloat3(0, 0, 1);
+				vptr->vertex.texCoord		= ClothFloat2((float)i / (float)(w-1), (float)j/(float)(h-1));
+
+				vptr->vertex.matDiffuse		= particleDiffuse;
+				vptr->vertex.matSpecular	= particleSpecular;
+			}
+		}
+	}
+
+	// Torn off particles, each after the one it was split from
+	for (int k = 0; k < added; k++)
+		particles[first + k] = particles[splitSource[k]];
+}
+
+// Anchors setup
+void ClothTopology::buildAnchors(Anchor* anchors, const Particle* particles) const
+{
+	if (meshRest)
+	{
+		// Hang a mesh from its top edge - the left and right ends and the particle nearest the middle
+		float minX = particles[0].vertex.pos.x, maxX = minX;
+		float minY = particles[0].vertex.pos.y, maxY = minY;
+
+		for (int i = 1; i < particleCount; i++)
+		{
+			minX = min(minX, particles[i].vertex.pos.x);
+			maxX = max(maxX, particles[i].vertex.pos.x);
+			minY = min(minY, particles[i].vertex.pos.y);
+			maxY = max(maxY, particles[i].vertex.pos.y);
+		}
+
+		float top		= maxY - (maxY - minY) * 0.001f;
+		float middle	= (minX + maxX) * 0.5f;
+
+		int left = -1, right = -1, centre = -1;
+
+		for (int i = 0; i < particleCount; i++)
+		{
+			float x = particles[i].vertex.pos.x;
+
+			if (particles[i].vertex.pos.y < top)
+				continue;
+
+			if (left < 0 || x < particles[left].vertex.pos.x)
+				left = i;
+
+			if (right < 0 || x > particles[right].vertex.pos.x)
+				right = i;
+
+			if (centre < 0 || fabsf(x - middle) < fabsf(particles[centre].vertex.pos.x - middle))
+				centre = i;
+		}
+
+		anchors[0].index = left;
+		anchors[1].index = centre;
+		anchors[2].index = right;
+	}
+	else
+	{
+		// Anchors index setup
+		anchors[0].index = 0;
+		anchors[1].index = (DWORD)(w/2);
+		anchors[2].index = w-1;
+	}
+
+	// Anchors position setup
+	for(int i = 0; i<CLOTH_ANCHOR_COUNT; i++)
+		anchors[i].pos = particles[anchors[i].index].vertex.pos;
+}
+
+// Bytes
+size_t ClothTopology::bytes() const
+{
+	return sizeof(ClothTopology) + sizeof(Constraint) * totalConstraints + sizeof(DWORD) * totalIndices + sizeof(int) * (2 * batchCount + splitSource.size());
+}
+
+// Make writable
+void ClothTopology::makeWritable()
+{
+	if (!cached)
+		return;
+
+	int* ownSize				= (int*)malloc(sizeof(int) * batchCount);
+	int* ownOffset				= (int*)malloc(sizeof(int) * batchCount);
+	Constraint* ownConstraints	= (Constraint*)malloc(sizeof(Constraint) * totalConstraints);
+	DWORD* ownIndices			= (DWORD*)malloc(sizeof(DWORD) * totalIndices);
+
+	if (!ownSize || !ownOffset || !ownConstraints || !ownIndices)
+	{
+		free(ownSize);
+		free(ownOffset);
+		free(ownConstraints);
+		free(ownIndices);
+		throw("Cannot create cloth topology buffers");
+	}
+
+	memcpy(ownSize, batchSize, sizeof(int) * batchCount);
+	memcpy(ownOffset, batchOffset, sizeof(int) * batchCount);
+	memcpy(ownConstraints, constraints, sizeof(Constraint) * totalConstraints);
+	memcpy(ownIndices, indices, sizeof(DWORD) * totalIndices);
+
+	batchSize	= ownSize;
+	batchOffset	= ownOffset;
+	constraints	= ownConstraints;
+	indices		= ownIndices;
+
+	cache.close();
+	cached = false;
+}
+
+// Add particle
+int ClothTopology::addParticle(int source)
+{
+	splitSource.push_back(source);
+
+	return particleCount++;
+}
+
+// Added particles
+int ClothTopology::addedParticles() const
+{
+	return (int)splitSource.size();
+}
+
+// Original particle
+int ClothTopology::originalParticle(int particle) const
+{
+	int first = particleCount - (int)splitSource.size();
+
+	while (particle >= first)
+		particle = splitSource[particle - first];
+
+	return particle;
+}
+
+// Is cached
+bool ClothTopology::isCached() const
+{
+	return cached;
+}
+
+// Attach
+bool ClothTopology::attach(const unsigned char* bytes, size_t size)
+{
+	if (!bytes || size < sizeof(ClothGridHeader))
+		return false;
+
+	const ClothGridHeader* header = (const ClothGridHeader*)bytes;
+
+	if (memcmp(header->magic, gridMagic, sizeof(gridMagic)) != 0 || header->version != gridVersion || header->w != w || header->h != h)
+		return false;
+
+	if (header->particleCount != particleCount || header->totalConstraints != totalConstraints || header->totalIndices != totalIndices || header->batchCount != batchCount)
+		return false;
+
+	size_t sizeOffset, batchStart, constraintOffset, indexOffset, total;
+
+	gridLayout(batchCount, totalConstraints, totalIndices, sizeOffset, batchStart, constraintOffset, indexOffset, total);
+
+	if (size != total)
+		return false;
+
+	// The batches must tile the constraints - the constraints and indices themselves are
+	// not read, so mapping costs nothing until they are used
+	const int* sizes	= (const int*)(bytes + sizeOffset);
+	const int* offsets	= (const int*)(bytes + batchStart);
+	int next			= 0;
+
+	for (int k = 0; k < batchCount; k++)
+	{
+		if (sizes[k] < 0 || offsets[k] != next)
+			return false;
+
+		next += sizes[k];
+	}
+
+	if (next != totalConstraints)
+		return false;
+
+	batchSize	= (int*)sizes;
+	batchOffset	= (int*)offsets;
+	constraints	= (Constraint*)(bytes + constraintOffset);
+	indices		= (DWORD*)(bytes + indexOffset);
+
+	return true;
+}
+
+// Write cache
+void ClothTopology::writeCache(const char* path) const
+{
+	size_t sizeOffset, batchStart, constraintOffset, indexOffset, total;
+
+	gridLayout(batchCount, totalConstraints, totalIndices, sizeOffset, batchStart, constraintOffset, indexOffset, total);
+
+	vector<unsigned char> image(total, 0);
+
+	ClothGridHeader header;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, gridMagic, sizeof(gridMagic));
+
+	header.version			= gridVersion;
+	header.w				= w;
+	header.h				= h;
+	header.particleCount	= particleCount;
+	header.totalConstraints	= totalConstraints;
+	header.totalIndices		= totalIndices;
+	header.batchCount		= batchCount;
+
+	memcpy(image.data(), &header, sizeof(header));
+	memcpy(image.data() + sizeOffset, batchSize, sizeof(int) * batchCount);
+	memcpy(image.data() + batchStart, batchOffset, sizeof(int) * batchCount);
+	memcpy(image.data() + constraintOffset, constraints, sizeof(Constraint) * (size_t)totalConstraints);
+	memcpy(image.data() + indexOffset, indices, sizeof(DWORD) * (size_t)totalIndices);
+
+	ClothMappedFile::write(path, image.data(), image.size());
+}
+
+// Batch constraints setup
+void ClothTopology::buildConstraints(ClothWorkerPool* pool)
+{
+	// Horizontal constraints of each batch in every row - they alternate with the particle
+	// index, which gives every row as many of each whether w is even or odd
+	int width		= int(w);
+	int rowOdd		= width / 2;
+	int rowEven		= (width - 1) / 2;
+
+	// Batch sizes setup - the vertical and shear batches alternate with the row
+	batchSize[0] = h * rowOdd;							// Horizontal Even
+	batchSize[1] = h * rowEven;							// Horizontal Odd
+	batchSize[2] = (h / 2) * w;							// Vertical Even
+	batchSize[3] = ((h - 1) / 2) * w;					// Vertical Odd
+	batchSize[4] = (h / 2) * (w - 1);					// Diagonal Even
+	batchSize[5] = ((h - 1) / 2) * (w - 1);				// Diagonal Odd
+	batchSize[6] = batchSize[4];
+	batchSize[7] = batchSize[5];
+
+	batchOffset[0] = 0;
+
+	for (int k = 1; k < batchCount; k++)
+		batchOffset[k] = batchOffset[k-1] + batchSize[k-1];
+
+	// Rest positions along each axis, as buildParticles lays them out
+	vector<float> restX(w), restZ(h);
+
+	for (int i = 0; i < int(w); i++)
+		restX[i] = (float)i / (float)(w-1);
+
+	for (int j = 0; j < int(h); j++)
+		restZ[j] = (float)j / (float)(h-1);
+
+	const float* x		= restX.data();
+	const float* z		= restZ.data();
+	const int* offset	= batchOffset;
+	Constraint* out		= constraints;
+
+	// Every row knows where its constraints go in each batch, so the rows are filled in parallel
+	ClothTask fillRows = [=](int begin, int end)
+	{
+		for (int j = begin; j < end; j++)
+		{
+			// Vertical boolean
+			bool oddVert = (j & 1) != 0;
+
+			// Rows above in the same vertical and diagonal batches
+			int rowsAbove = (j - 1) / 2;
+
+			// Next free slot in each batch
+			int constraintBatch[CLOTH_BATCH_COUNT];
+
+			constraintBatch[0] = offset[0] + j * rowOdd;
+			constraintBatch[1] = offset[1] + j * rowEven;
+			constraintBatch[2] = offset[2] + rowsAbove * width;
+			constraintBatch[3] = offset[3] + rowsAbove * width;
+			constraintBatch[4] = offset[4] + rowsAbove * (width - 1);
+			constraintBatch[5] = offset[5] + rowsAbove * (width - 1);
+			constraintBatch[6] = offset[6] + rowsAbove * (width - 1);
+			constraintBatch[7] = offset[7] + rowsAbove * (width - 1);
+
+			for (int i = 0; i < width; i++)
+			{
+				int index = (j * width) + i;
+				int constraintI;
+
+				// Horizontal boolean
+				bool oddHori = (index & 1) != 0;
+
+				// Horizontal constraints
+				if(i)
+				{
+					constraintI = constraintBatch[oddHori ? 0 : 1]++;
+
+					// Horizontal structured constraint
+					out[constraintI].start	= index - 1;
+					out[constraintI].end	= index;
+					out[constraintI].length	= restLength(x[i] - x[i-1], 0.0f, 0.0f);
+
+					// Up and left shear constraints
+					if(j)
+					{
+						constraintI = constraintBatch[oddVert ? 4 : 5]++;
+
+						out[constraintI].start	= index - (width+1);
+						out[constraintI].end	= index;
+						out[constraintI].length	= restLength(x[i] - x[i-1], 0.0f, z[j] - z[j-1]);
+					}
+				}
+
+				// Vertical constraints
+				if(j)
+				{
+					constraintI = constraintBatch[oddVert ? 2 : 3]++;
+
+					// Vertical structured constraint
+					out[constraintI].start	= index - width;
+					out[constraintI].end	= index;
+					out[constraintI].length	= restLength(0.0f, 0.0f, z[j] - z[j-1]);
+
+					// Up and right shear constraint
+					if(i < width - 1)
+					{
+						constraintI = constraintBatch[oddVert ? 6 : 7]++;
+
+						out[constraintI].start	= index - (width-1);
+						out[constraintI].end	= index;
+						out[constraintI].length	= restLength(x[i] - x[i+1], 0.0f, z[j] - z[j-1]);
+					}
+				}
+			}
+		}
+	};
+
+	if (pool)
+		pool->parallelFor(int(h), gridRows(w), fillRows);
+	else
+		fillRows(0, int(h));
+}
+
+// Indices setup
+void ClothTopology::buildIndices(ClothWorkerPool* pool)
+{
+	ClothIndexOptimiser::gridIndices(w, h, indices, pool);
+}
+
+#pragma region Mesh
+
+// Triangle edge with the vertex opposite it, sorted so shared edges are adjacent
+struct MeshEdge
+{
+	unsigned int a, b;
+	unsigned int opposite;
+
+	bool operator<(const MeshEdge& e) const
+	{
+		return a < e.a || (a == e.a && b < e.b);
+	}
+};
+
+static MeshEdge meshEdge(int v1, int v2, int opposite)
+{
+	MeshEdge e;
+
+	e.a			= (unsigned int)min(v1, v2);
+	e.b			= (unsigned int)max(v1, v2);
+	e.opposite	= (unsigned int)opposite;
+
+	return e;
+}
+
+static float restDistance(const Particle* particles, unsigned int i, unsigned int j)
+{
+	return restLength(	particles[i].vertex.pos.x - particles[j].vertex.pos.x,
+						particles[i].vertex.pos.y - particles[j].vertex.pos.y,
+						particles[i].vertex.pos.z - particles[j].vertex.pos.z);
+}
+
+static bool constraintLess(const Constraint& c1, const Constraint& c2)
+{
+	return c1.start < c2.start || (c1.start == c2.start && c1.end < c2.end);
+}
+
+static bool constraintEqual(const Constraint& c1, const Constraint& c2)
+{
+	return c1.start == c2.start && c1.end == c2.end;
+}
+
+// Mesh setup
+void ClothTopology::buildMesh(const ClothFloat3* positions, const ClothFloat3* normals, const ClothFloat2* texCoords, int vertexCount, const DWORD* triangles, int triangleCount, ClothWorkerPool* pool)
+{
+	if (!positions || !triangles || vertexCount <= 0 || triangleCount <= 0)
+		throw("Invalid mesh for cloth topology");
+
+	particleCount			= vertexCount;
+	totalIndices			= triangleCount * 3;
+
+	for (int k = 0; k < totalIndices; k++)
+	{
+		if (triangles[k] >= (DWORD)particleCount)
+			throw("Invalid mesh for cloth topology");
+	}
+
+	meshRest	= (Particle*)malloc(sizeof(Particle) * particleCount);
+	indices		= (DWORD*)malloc(sizeof(DWORD) * totalIndices);
+
+	if (!meshRest || !indices)
+		throw("Cannot create cloth topology buffers");
+
+	// Rest state from the mesh vertices
+	for (int i = 0; i < particleCount; i++)
+	{
+		Particle* vptr = meshRest + i;
+
+		vptr->vertex.pos			= positions[i];
+		vptr->prevPos				= vptr->vertex.pos;
+		vptr->vertex.normal			= normals ? normals[i] : ClothFloat3(0, 0, 1);
+		vptr->vertex.texCoord		= texCoords ? texCoords[i] : ClothFloat2(0, 0);
+
+		vptr->vertex.matDiffuse		= particleDiffuse;
+		vptr->vertex.matSpecular	= particleSpecular;
+	}
+
+	// Triangle indices, reordered for the vertex cache
+	memcpy(indices, triangles, sizeof(DWORD) * totalIndices);
+
+	ClothIndexOptimiser::optimiseVertexCache(indices, totalIndices, particleCount);
+
+	// Every triangle edge, grouped so edges shared by two triangles are neighbours
+	vector<MeshEdge> edges(triangleCount * 3);
+
+	for (int f = 0; f < triangleCount; f++)
+	{
+		const DWORD* v = triangles + f * 3;
+
+		edges[f * 3]		= meshEdge(v[0], v[1], v[2]);
+		edges[f * 3 + 1]	= meshEdge(v[1], v[2], v[0]);
+		edges[f * 3 + 2]	= meshEdge(v[2], v[0], v[1]);
+	}
+
+	sort(edges.begin(), edges.end());
+
+	// Edge constraints for every triangle edge. Shear constraints join the opposite
+	// vertices of two triangles whose shared edge is the longest edge of both - the
+	// diagonal of a quad - so they match the grid's diagonal pairs.
+	vector<Constraint> meshConstraints;
+	meshConstraints.reserve(edges.size());
+
+	for (size_t e = 0; e < edges.size(); )
+	{
+		size_t last = e + 1;
+
+		while (last < edges.size() && edges[last].a == edges[e].a && edges[last].b == edges[e].b)
+			last++;
+
+		Constraint c;
+
+		c.start		= edges[e].a;
+		c.end		= edges[e].b;
+		c.length	= restDistance(meshRest, c.start, c.end);
+
+		if (c.start != c.end)
+			meshConstraints.push_back(c);
+
+		if (last - e == 2)
+		{
+			unsigned int o1 = edges[e].opposite;
+			unsigned int o2 = edges[e + 1].opposite;
+
+			bool diagonal =	c.length >= restDistance(meshRest, c.start, o1) && c.length >= restDistance(meshRest, c.end, o1) &&
+							c.length >= restDistance(meshRest, c.start, o2) && c.length >= restDistance(meshRest, c.end, o2);
+
+			if (diagonal && o1 != o2)
+			{
+				Constraint shear;
+
+				shear.start		= min(o1, o2);
+				shear.end		= max(o1, o2);
+				shear.length	= restDistance(meshRest, shear.start, shear.end);
+
+				meshConstraints.push_back(shear);
+			}
+		}
+
+		e = last;
+	}
+
+	// Shear constraints can duplicate edges on irregular meshes
+	sort(meshConstraints.begin(), meshConstraints.end(), constraintLess);
+	meshConstraints.erase(unique(meshConstraints.begin(), meshConstraints.end(), constraintEqual), meshConstraints.end());
+
+	totalConstraints = (int)meshConstraints.size();
+
+	// Colour the constraint graph into batches
+	vector<int> colours(totalConstraints);
+
+	batchCount = ClothGraphColouring::colour(meshConstraints.data(), totalConstraints, particleCount, colours.data(), pool);
+
+	batchSize	= (int*)calloc(max(batchCount, 1), sizeof(int));
+	batchOffset	= (int*)calloc(max(batchCount, 1), sizeof(int));
+	constraints	= (Constraint*)malloc(sizeof(Constraint) * max(totalConstraints, 1));
+
+	if (!batchSize || !batchOffset || !constraints)
+		throw("Cannot create cloth topology buffers");
+
+	for (int i = 0; i < totalConstraints; i++)
+		batchSize[colours[i]]++;
+
+	for (int k = 1; k < batchCount; k++)
+		batchOffset[k] = batchOffset[k-1] + batchSize[k-1];
+
+	// Scatter into batches - each batch stays sorted by particle for locality
+	vector<int> next(batchOffset, batchOffset + batchCount);
+
+	for (int i = 0; i < totalConstraints; i++)
+		constraints[next[colours[i]]++] = meshConstraints[i];
+}
+
+#pragma endregion
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <vector>
+#include "ClothTypes.h"
+#include "ClothWorkerPool.h"
+#include "ClothMappedFile.h"
+
+class CGPolyMesh;
+
+
+// Number of constraint batches for the grid layout
+#define CLOTH_BATCH_COUNT 8
+
+// Number of anchors the cloth hangs from
+#define CLOTH_ANCHOR_COUNT 3
+
+
+// Constraints, batches and triangle indices for a w x h cloth grid or a triangle mesh.
+// No two constraints in the same batch share a particle, so every batch can be
+// solved in parallel (one GPU thread or one CPU worker chunk per constraint).
+//
+// Given a cache directory a grid is written there as one file per size, and the next
+// grid of the same size is mapped from it instead of built - the batches, constraints
+// and indices are then used straight from the mapping, which is read only. Reading the
+// file cold from the disk costs about what building the grid does, so the cache pays off
+// once the file is in the operating system's file cache.
+class ClothTopology
+{
+private:
+	// Rest state of a mesh cloth (nullptr for a grid)
+	Particle*	meshRest;
+
+	// Cache file a grid was mapped from
+	ClothMappedFile	cache;
+	bool		cached;
+
+	// Particle each particle added by tearing was split from, in the order they were added
+	std::vector<int>	splitSource;
+
+public:
+	// Dimensions of the cloth (0 for a mesh cloth)
+	DWORD		w, h;
+
+	int			particleCount;
+	int			totalConstraints;
+	int			totalIndices;
+
+	// Number, size and first constraint of each batch
+	int			batchCount;
+	int*		batchSize;
+	int*		batchOffset;
+
+	Constraint*	constraints;
+	DWORD*		indices;
+
+	// Constructor - grid cloth with the fixed even/odd batches, from the cache in cacheDirectory
+	// when it holds this size. pool may be nullptr to build on the calling thread.
+	ClothTopology(DWORD clothW, DWORD clothH, ClothWorkerPool* pool = nullptr, const char* cacheDirectory = nullptr);
+	// Constructor - edge and shear constraints of a triangle mesh, graph coloured into batches.
+	// pool may be nullptr to colour on the calling thread. Defined with the other CGPolyMesh
+	// constructors in ClothMeshImport.cpp, which only the renderer builds.
+	ClothTopology(CGPolyMesh* mesh, ClothWorkerPool* pool = nullptr);
+	// Constructor - the same from vertexCount vertices and triangleCount triangles of three
+	// indices each (normals and texCoords may be nullptr)
+	ClothTopology(const ClothFloat3* positions, const ClothFloat3* normals, const ClothFloat2* texCoords, int vertexCount, const DWORD* triangles, int triangleCount,
+		ClothWorkerPool* pool = nullptr);
+	// Destructor
+	~ClothTopology();
+
+	// Fill the particles with the rest state (flat for a grid, the mesh vertices otherwise) -
+	// a particle added by tearing rests where the particle it was split from does
+	void buildParticles(Particle* particles) const;
+
+	// Fill the anchors from the rest state of the particles
+	void buildAnchors(Anchor* anchors, const Particle* particles) const;
+
+	// Bytes held by the constraints, batches and indices
+	size_t bytes() const;
+
+	// Whether the grid was mapped from the cache instead of built
+	bool isCached() const;
+
+	// Copy a grid mapped from the cache into buffers of its own, so it can be changed
+	void makeWritable();
+
+	// Add a particle split from source by tearing - returns its index
+	int addParticle(int source);
+
+	// Particles added by tearing, and the grid or mesh particle a particle was first split from
+	// (the particle itself if it was not added)
+	int addedParticles() const;
+	int originalParticle(int particle) const;
+
+private:
+	// Batch constraints setup - every row straight from its index, so rows fill in parallel
+	void buildConstraints(ClothWorkerPool* pool);
+
+	// Triangle indices setup - in cache ordered strips (see ClothIndexOptimiser)
+	void buildIndices(ClothWorkerPool* pool);
+
+	// Mesh rest state, constraints and indices setup
+	void buildMesh(const ClothFloat3* positions, const ClothFloat3* normals, const ClothFloat2* texCoords, int vertexCount, const DWORD* triangles, int triangleCount,
+		ClothWorkerPool* pool);
+
+	// Empty every member, with no buffers
+	void reset();
+
+	// Point the batches, constraints and indices into a cache image - false if it is not of this grid
+	bool attach(const unsigned char* bytes, size_t size);
+
+	// Write the grid to a cache file
+	void writeCache(const char* path) const;
+
+	// Free every buffer
+	void dispose();
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+
+
+// The solver core builds without Direct3D. Its types are plain, laid out as the xnamath
+// and CGVertexExt types the renderer uses, so arrays of them can be handed across as they are.
+
+// 32 bit unsigned integers under their Windows names - the same types windows.h declares,
+// so the two can be included together
+#if defined(_WIN32)
+	typedef unsigned long	DWORD;
+	typedef unsigned short	WORD;
+#else
+	typedef uint32_t		DWORD;
+	typedef uint16_t		WORD;
+#endif
+
+// Vectors, as XMFLOAT2, XMFLOAT3 and XMFLOAT4 (the constructors leave them uninitialised)
+struct ClothFloat2
+{
+	float x, y;
+
+	ClothFloat2() {}
+	ClothFloat2(float _x, float _y) : x(_x), y(_y) {}
+};
+
+struct ClothFloat3
+{
+	float x, y, z;
+
+	ClothFloat3() {}
+	ClothFloat3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+};
+
+struct ClothFloat4
+{
+	float x, y, z, w;
+
+	ClothFloat4() {}
+	ClothFloat4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+};
+
+// Render vertex, as CGVertexExt - the colours are packed as XMCOLOR packs them (A8R8G8B8)
+struct ClothVertex
+{
+	ClothFloat3	pos;
+	ClothFloat3	normal;
+	uint32_t	matDiffuse;
+	uint32_t	matSpecular;
+	ClothFloat2	texCoord;
+};
+
+// Structure for the particle
+struct Particle
+{
+	ClothVertex vertex;
+	ClothFloat3 prevPos;
+};
+
+struct Constraint
+{
+	// Start and end vertex of the constraint
+	unsigned int start;
+	unsigned int end;
+
+	// Length of the constraint
+	float length;
+};
+
+struct Anchor
+{
+	// Anchor index
+	uint32_t index;
+
+	// Position of the anchor
+	ClothFloat3 pos;
+};
+
+// Bounding volume hierarchy node - an interior node (count 0) has its children at
+// first and first + 1, a leaf holds the triangles [first, first + count)
+struct ClothBvhNode
+{
+	ClothFloat3	lower;
+	int			first;
+	ClothFloat3	upper;
+	int			count;
+};
@@ -0,0 +1,331 @@
+#include "ClothWindField.h"
+#include "ClothFpContract.h"
+#include <math.h>
+
+using namespace std;
+
+// Samples per worker chunk of an advance
+static const int sampleGrain	= 4096;
+
+// Most samples a field may hold
+static const long long maxSamples	= 1 << 24;
+
+// Shortest wavelength of the turbulence in cells - shorter waves would alias between samples
+static const float shortestWave	= 4.0f;
+
+static const float pi			= 3.14159265f;
+
+
+#pragma region Helpers
+
+// Repeatable pseudo random number in [0, 1) - rand() differs between C runtimes
+static float windNoise(unsigned int& seed)
+{
+	seed = seed * 1664525u + 1013904223u;
+
+	return (float)(seed >> 8) / 16777216.0f;
+}
+
+// Random unit vector
+static ClothFloat3 windDirection(unsigned int& seed)
+{
+	// Uniform over the sphere - uniform height and angle around the axis
+	float y		= windNoise(seed) * 2.0f - 1.0f;
+	float angle	= windNoise(seed) * 2.0f * pi;
+	float r		= sqrtf(1.0f - y * y);
+
+	return ClothFloat3(r * cosf(angle), y, r * sinf(angle));
+}
+
+#pragma endregion
+
+
+// Constructor
+ClothWindField::ClothWindField(const ClothFloat3& boxLower, const ClothFloat3& boxUpper, float cellSpacing, ClothWorkerPool* workerPool, int waves, unsigned int seed)
+{
+	if (cellSpacing <= 0.0f || waves < 1 || boxUpper.x < boxLower.x || boxUpper.y < boxLower.y || boxUpper.z < boxLower.z)
+		throw("Invalid parameters for cloth wind field instantiation");
+
+	pool		= workerPool;
+	lower		= boxLower;
+	cellSize	= cellSpacing;
+	waveCount	= waves;
+	time		= 0.0f;
+
+	baseWind	= ClothFloat3(0.0f, 0.0f, 0.0f);
+	turbulence	= 0.0f;
+
+	// At least two samples along each axis so every lookup has a cell
+	float extentX = boxUpper.x - boxLower.x, extentY = boxUpper.y - boxLower.y, extentZ = boxUpper.z - boxLower.z;
+
+	sizeX = (int)ceilf(extentX / cellSize) + 1;
+	sizeY = (int)ceilf(extentY / cellSize) + 1;
+	sizeZ = (int)ceilf(extentZ / cellSize) + 1;
+
+	sizeX = sizeX < 2 ? 2 : sizeX;
+	sizeY = sizeY < 2 ? 2 : sizeY;
+	sizeZ = sizeZ < 2 ? 2 : sizeZ;
+
+	if ((long long)sizeX * sizeY * sizeZ > maxSamples)
+		throw("Cloth wind field is too finely sampled");
+
+	sampleCount = sizeX * sizeY * sizeZ;
+
+	// Wave numbers spaced evenly in log from one wave across the box to the shortest wave
+	float extent = extentX > extentY ? extentX : extentY;
+	extent = extent > extentZ ? extent : extentZ;
+
+	float kLow	= 2.0f * pi / (extent > cellSize * shortestWave ? extent : cellSize * shortestWave);
+	float kHigh	= 2.0f * pi / (cellSize * shortestWave);
+
+	waveNumber.resize(waveCount);
+	waveAmplitude.resize(waveCount);
+	phaseCos.resize(waveCount);
+	phaseSin.resize(waveCount);
+
+	float totalEnergy = 0.0f;
+
+	for (int m = 0; m < waveCount; m++)
+	{
+		float k = waveCount > 1 ? kLow * powf(kHigh / kLow, (float)m / (float)(waveCount - 1)) : kLow;
+
+		ClothFloat3 direction = windDirection(seed);
+
+		// Amplitude across the direction of travel, from any other direction not parallel to it
+		ClothFloat3 across;
+		float length = 0.0f;
+
+		while (length < 0.1f)
+		{
+			ClothFloat3 other = windDirection(seed);
+
+			across = ClothFloat3(direction.y * other.z - direction.z * other.y, direction.z * other.x - direction.x * other.z, direction.x * other.y - direction.y * other.x);
+			length = sqrtf(across.x * across.x + across.y * across.y + across.z * across.z);
+		}
+
+		// Energy k^-5/3 per unit wave number, and the waves cover a band in proportion to k
+		float energy = powf(k, -2.0f / 3.0f);
+		float amplitude = sqrtf(energy) / length;
+
+		waveNumber[m]		= ClothFloat3(direction.x * k, direction.y * k, direction.z * k);
+		waveAmplitude[m]	= ClothFloat3(across.x * amplitude, across.y * amplitude, across.z * amplitude);
+
+		totalEnergy += energy;
+
+		float phase = windNoise(seed) * 2.0f * pi;
+
+		phaseCos[m] = cosf(phase);
+		phaseSin[m] = sinf(phase);
+	}
+
+	// A wave of amplitude a has an RMS speed of a / sqrt(2), so unit RMS speed needs energies summing to 2
+	float normalise = sqrtf(2.0f / totalEnergy);
+
+	for (int m = 0; m < waveCount; m++)
+	{
+		waveAmplitude[m].x *= normalise;
+		waveAmplitude[m].y *= normalise;
+		waveAmplitude[m].z *= normalise;
+	}
+
+	// Phase of every wave at every sample
+	basis.resize((size_t)sampleCount * waveCount * 2);
+	velocity.resize(sampleCount);
+
+	float* b = basis.data();
+	const ClothFloat3* kv = waveNumber.data();
+	int sx = sizeX, sy = sizeY, wc = waveCount;
+	ClothFloat3 corner = lower;
+	float spacing = cellSize;
+
+	ClothTask task = [=](int begin, int end)
+	{
+		for (int s = begin; s < end; s++)
+		{
+			float x = corner.x + (float)(s % sx) * spacing;
+			float y = corner.y + (float)((s / sx) % sy) * spacing;
+			float z = corner.z + (float)(s / (sx * sy)) * spacing;
+
+			float* sample = b + (size_t)s * wc * 2;
+
+			for (int m = 0; m < wc; m++)
+			{
+				float phase = kv[m].x * x + kv[m].y * y + kv[m].z * z;
+
+				sample[m * 2]		= cosf(phase);
+				sample[m * 2 + 1]	= sinf(phase);
+			}
+		}
+	};
+
+	if (pool)
+		pool->parallelFor(sampleCount, sampleGrain, task);
+	else
+		task(0, sampleCount);
+
+	evaluate();
+}
+
+// Advance
+void ClothWindField::advance(float dt)
+{
+	time += dt;
+
+	for (int m = 0; m < waveCount; m++)
+	{
+		const ClothFloat3& k = waveNumber[m];
+
+		// Eddies of size 1 / k turn over in about 1 / (k u) for turbulent speed u, and
+		// the base wind carries the whole pattern downwind
+		float speed		= sqrtf(k.x * k.x + k.y * k.y + k.z * k.z);
+		float frequency	= speed * turbulence + (k.x * baseWind.x + k.y * baseWind.y + k.z * baseWind.z);
+		float angle		= frequency * dt;
+
+		// Turn the phase on, renormalised so rounding cannot grow or shrink the wave over many frames
+		float c = cosf(angle), s = sinf(angle);
+		float pc = phaseCos[m] * c - phaseSin[m] * s;
+		float ps = phaseSin[m] * c + phaseCos[m] * s;
+		float length = sqrtf(pc * pc + ps * ps);
+
+		phaseCos[m] = pc / length;
+		phaseSin[m] = ps / length;
+	}
+
+	evaluate();
+}
+
+// Evaluate
+void ClothWindField::evaluate()
+{
+	// Re(e^(i k.x) e^(-i phase)) = cos(k.x) cos(phase) + sin(k.x) sin(phase), so each
+	// wave adds its cosine and sine basis scaled by these two vectors
+	vector<ClothFloat4> weights(waveCount * 2);
+
+	for (int m = 0; m < waveCount; m++)
+	{
+		const ClothFloat3& a = waveAmplitude[m];
+
+		float c = phaseCos[m] * turbulence;
+		float s = phaseSin[m] * turbulence;
+
+		weights[m * 2]		= ClothFloat4(a.x * c, a.y * c, a.z * c, 0.0f);
+		weights[m * 2 + 1]	= ClothFloat4(a.x * s, a.y * s, a.z * s, 0.0f);
+	}
+
+	const float* b = basis.data();
+	const ClothFloat4* wt = weights.data();
+	ClothFloat4* v = velocity.data();
+	int wc = waveCount;
+	ClothFloat3 base = baseWind;
+
+	ClothTask task = [=](int begin, int end)
+	{
+		for (int s = begin; s < end; s++)
+		{
+			const float* sample = b + (size_t)s * wc * 2;
+
+			float vx = base.x, vy = base.y, vz = base.z;
+
+			for (int m = 0; m < wc * 2; m++)
+			{
+				vx += sample[m] * wt[m].x;
+				vy += sample[m] * wt[m].y;
+				vz += sample[m] * wt[m].z;
+			}
+
+			v[s] = ClothFloat4(vx, vy, vz, 0.0f);
+		}
+	};
+
+	if (pool)
+		pool->parallelFor(sampleCount, sampleGrain, task);
+	else
+		task(0, sampleCount);
+}
+
+// Sample
+ClothFloat3 ClothWindField::sample(const ClothFloat3& p) const
+{
+	float inv = 1.0f / cellSize;
+
+	// Grid coordinates clamped to the box, and the cell holding them
+	float gx = (p.x - lower.x) * inv, gy = (p.y - lower.y) * inv, gz = (p.z - lower.z) * inv;
+
+	gx = gx < 0.0f ? 0.0f : (gx > (float)(sizeX - 1) ? (float)(sizeX - 1) : gx);
+	gy = gy < 0.0f ? 0.0f : (gy > (float)(sizeY - 1) ? (float)(sizeY - 1) : gy);
+	gz = gz < 0.0f ? 0.0f : (gz > (float)(sizeZ - 1) ? (float)(sizeZ - 1) : gz);
+
+	int cx = (int)gx, cy = (int)gy, cz = (int)gz;
+
+	cx = cx > sizeX - 2 ? sizeX - 2 : cx;
+	cy = cy > sizeY - 2 ? sizeY - 2 : cy;
+	cz = cz > sizeZ - 2 ? sizeZ - 2 : cz;
+
+	float fx = gx - (float)cx, fy = gy - (float)cy, fz = gz - (float)cz;
+
+	int rowStride = sizeX, sliceStride = sizeX * sizeY;
+	const ClothFloat4* c = velocity.data() + cx + cy * rowStride + cz * sliceStride;
+
+	ClothFloat3 result;
+	float* out = (float*)&result;
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const float* v = (const float*)c + axis;
+
+		// Corners are 4 floats apart along x
+		float v00 = v[0] + (v[4] - v[0]) * fx;
+		float v10 = v[rowStride * 4] + (v[rowStride * 4 + 4] - v[rowStride * 4]) * fx;
+		float v01 = v[sliceStride * 4] + (v[sliceStride * 4 + 4] - v[sliceStride * 4]) * fx;
+		float v11 = v[(rowStride + sliceStride) * 4] + (v[(rowStride + sliceStride) * 4 + 4] - v[(rowStride + sliceStride) * 4]) * fx;
+
+		float v0 = v00 + (v10 - v00) * fy;
+		float v1 = v01 + (v11 - v01) * fy;
+
+		out[axis] = v0 + (v1 - v0) * fz;
+	}
+
+	return result;
+}
+
+// Samples
+const ClothFloat4* ClothWindField::samples() const
+{
+	return velocity.data();
+}
+
+// Corner
+ClothFloat3 ClothWindField::corner() const
+{
+	return lower;
+}
+
+// Spacing
+float ClothWindField::spacing() const
+{
+	return cellSize;
+}
+
+// Samples X
+int ClothWindField::samplesX() const
+{
+	return sizeX;
+}
+
+// Samples Y
+int ClothWindField::samplesY() const
+{
+	return sizeY;
+}
+
+// Samples Z
+int ClothWindField::samplesZ() const
+{
+	return sizeZ;
+}
+
+// Elapsed
+float ClothWindField::elapsed() const
+{
+	return time;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include "ClothTypes.h"
+#include "ClothWorkerPool.h"
+
+
+// Wind velocity over a box of the scene, shared by everything blown about in it -
+// the CPU cloth, and through CGWindVolume the grass and snow shaders. The wind is
+// a steady base wind plus turbulence made of a few travelling plane waves, each
+// transverse to its direction of travel so the turbulence has no divergence.
+// Longer waves are stronger, as in a Kolmogorov spectrum, and the waves are carried
+// along by the base wind.
+//
+// The waves are evaluated on a grid of samples once, as the cosine and sine of the
+// phase of every wave at every sample. Each advance then only turns the phase of
+// every wave on and sums the waves at every sample, in parallel - no trigonometry
+// per sample. Between samples the velocity is trilinear.
+class ClothWindField
+{
+private:
+	ClothWorkerPool*		pool;
+
+	// Grid corner, spacing and samples along each axis
+	ClothFloat3				lower;
+	float					cellSize;
+	int						sizeX, sizeY, sizeZ;
+	int						sampleCount;
+
+	// Wave numbers and amplitude directions (transverse to the wave number, scaled by
+	// the share of the turbulence the wave carries)
+	int							waveCount;
+	std::vector<ClothFloat3>	waveNumber;
+	std::vector<ClothFloat3>	waveAmplitude;
+
+	// Current phase of each wave as a unit cosine and sine pair, turned on every advance
+	std::vector<float>		phaseCos, phaseSin;
+
+	// Cosine and sine of the wave number dotted with the sample position, waveCount pairs per sample
+	std::vector<float>		basis;
+
+	// Velocity of each sample (w unused), x fastest then y then z
+	std::vector<ClothFloat4>	velocity;
+
+	// Seconds simulated so far
+	float					time;
+
+	// Sum the waves at every sample into velocity
+	void evaluate();
+
+public:
+	// Constructor - samples every cellSize over the box [boxLower, boxUpper] and waves
+	// chosen from seed. pool may be nullptr to advance on the calling thread.
+	ClothWindField(const ClothFloat3& boxLower, const ClothFloat3& boxUpper, float cellSpacing, ClothWorkerPool* workerPool = nullptr, int waves = 8, unsigned int seed = 1);
+
+	// Move the turbulence on by dt seconds and update the samples
+	void advance(float dt);
+
+	// Wind velocity at p in m/s - outside the box the velocity at the nearest face is used
+	ClothFloat3 sample(const ClothFloat3& p) const;
+
+	// Sample velocities for upload (w unused), x fastest then y then z
+	const ClothFloat4* samples() const;
+
+	// Accessors
+	ClothFloat3 corner() const;
+	float spacing() const;
+	int samplesX() const;
+	int samplesY() const;
+	int samplesZ() const;
+	float elapsed() const;
+
+	// Mean wind in m/s, and the RMS speed of the turbulence on top of it
+	ClothFloat3 baseWind;
+	float turbulence;
+};
@@ -0,0 +1,151 @@
+#include "ClothWorkerPool.h"
+#include "ClothFpContract.h"
+
+using namespace std;
+
+// Number of polls a thread makes before blocking on a condition variable.
+// Passes are launched back to back during a step so a short spin avoids most sleeps.
+static const int spinCount = 2048;
+
+// Constructor
+ClothWorkerPool::ClothWorkerPool(int numThreads)
+{
+	task			= nullptr;
+	taskCount		= 0;
+	taskGrain		= 1;
+	nextChunk		= 0;
+	activeWorkers	= 0;
+	generation		= 0;
+	shutdown		= false;
+
+	if (numThreads <= 0)
+		numThreads = (int)thread::hardware_concurrency();
+
+	// The calling thread takes part in every parallelFor so it needs one less worker
+	for (int i = 1; i < numThreads; i++)
+		workers.push_back(thread(&ClothWorkerPool::workerLoop, this));
+}
+
+// Destructor
+ClothWorkerPool::~ClothWorkerPool()
+{
+	{
+		lock_guard<std::mutex> lock(mutex);
+
+		shutdown = true;
+		generation++;
+	}
+
+	workReady.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+// Thread count
+int ClothWorkerPool::threadCount() const
+{
+	return (int)workers.size() + 1;
+}
+
+// Parallel for
+void ClothWorkerPool::parallelFor(int count, int grain, const ClothTask& rangeTask)
+{
+	if (count <= 0)
+		return;
+
+	if (grain < 1)
+		grain = 1;
+
+	// Not worth waking the workers for a single chunk
+	if (workers.empty() || count <= grain)
+	{
+		rangeTask(0, count);
+		return;
+	}
+
+	// Publish the job
+	{
+		lock_guard<std::mutex> lock(mutex);
+
+		task			= &rangeTask;
+		taskCount		= count;
+		taskGrain		= grain;
+		nextChunk		= 0;
+		activeWorkers	= (int)workers.size();
+		generation++;
+	}
+
+	workReady.notify_all();
+
+	// Work on the job alongside the workers
+	runChunks();
+
+	// Wait for the remaining workers to finish their chunks
+	for (int spin = 0; spin < spinCount && activeWorkers > 0; spin++)
+		this_thread::yield();
+
+	if (activeWorkers > 0)
+	{
+		unique_lock<std::mutex> lock(mutex);
+
+		while (activeWorkers > 0)
+			workDone.wait(lock);
+	}
+
+	task = nullptr;
+}
+
+// Run chunks
+void ClothWorkerPool::runChunks()
+{
+	for (;;)
+	{
+		int begin = nextChunk.fetch_add(1) * taskGrain;
+
+		if (begin >= taskCount)
+			break;
+
+		int end = begin + taskGrain;
+
+		if (end > taskCount)
+			end = taskCount;
+
+		(*task)(begin, end);
+	}
+}
+
+// Worker loop
+void ClothWorkerPool::workerLoop()
+{
+	unsigned int seen = 0;
+
+	for (;;)
+	{
+		// Wait for the next job
+		for (int spin = 0; spin < spinCount && generation == seen; spin++)
+			this_thread::yield();
+
+		if (generation == seen)
+		{
+			unique_lock<std::mutex> lock(mutex);
+
+			while (generation == seen)
+				workReady.wait(lock);
+		}
+
+		seen = generation;
+
+		if (shutdown)
+			return;
+
+		runChunks();
+
+		// Last worker out wakes the caller
+		if (--activeWorkers == 0)
+		{
+			lock_guard<std::mutex> lock(mutex);
+			workDone.notify_one();
+		}
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+
+// Range task run by the worker pool - processes the elements [begin, end)
+typedef std::function<void (int begin, int end)> ClothTask;
+
+
+// Persistent pool of worker threads for the CPU cloth solver.
+// parallelFor only returns once every chunk has been processed, so consecutive
+// calls act as a barrier between dependent passes (e.g. constraint batches).
+class ClothWorkerPool
+{
+private:
+	std::vector<std::thread>	workers;
+
+	std::mutex					mutex;
+	std::condition_variable		workReady;
+	std::condition_variable		workDone;
+
+	// Current job
+	const ClothTask*			task;
+	int							taskCount;
+	int							taskGrain;
+
+	std::atomic<int>			nextChunk;
+	std::atomic<int>			activeWorkers;
+	std::atomic<unsigned int>	generation;
+	bool						shutdown;
+
+	// Worker thread entry point
+	void workerLoop();
+
+	// Claim and run chunks of the current job until none are left
+	void runChunks();
+
+public:
+	// Constructor - 0 threads uses every hardware thread
+	ClothWorkerPool(int numThreads = 0);
+	// Destructor
+	~ClothWorkerPool();
+
+	// Number of threads taking part in a parallelFor (workers plus the caller)
+	int threadCount() const;
+
+	// Run task over [0, count) in chunks of grain elements on all threads
+	void parallelFor(int count, int grain, const ClothTask& task);
+};
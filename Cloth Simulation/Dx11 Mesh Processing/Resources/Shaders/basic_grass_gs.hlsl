@@ -13,11 +13,35 @@ cbuffer camera : register(b0) {
 	float3				eyePos;
 };
 
-cbuffer environment : register(b1) {
+// Wind volume shared with the CPU cloth (see CGWindVolume) - velocity in m/s at each sample
+cbuffer windVolume : register(b1) {
 
-	float				windPhase;
+	float3				windLower;
+	float				windInvCellSize;
+	uint3				windSize;
 };
 
+Texture3D<float4>		windField : register(t0);
+
+
+// Trilinear wind velocity at p, clamped to the volume.  Zero when no volume is bound.
+float3 windAt(float3 p) {
+
+	if (windSize.x < 2 || windSize.y < 2 || windSize.z < 2)
+		return float3(0.0, 0.0, 0.0);
+
+	float3 g = clamp((p - windLower) * windInvCellSize, float3(0.0, 0.0, 0.0), float3(windSize - 1));
+	int3 c = min(int3(g), int3(windSize) - 2);
+	float3 f = g - float3(c);
+
+	float3 v00 = lerp(windField.Load(int4(c, 0)).xyz, windField.Load(int4(c + int3(1, 0, 0), 0)).xyz, f.x);
+	float3 v10 = lerp(windField.Load(int4(c + int3(0, 1, 0), 0)).xyz, windField.Load(int4(c + int3(1, 1, 0), 0)).xyz, f.x);
+	float3 v01 = lerp(windField.Load(int4(c + int3(0, 0, 1), 0)).xyz, windField.Load(int4(c + int3(1, 0, 1), 0)).xyz, f.x);
+	float3 v11 = lerp(windField.Load(int4(c + int3(0, 1, 1), 0)).xyz, windField.Load(int4(c + int3(1, 1, 1), 0)).xyz, f.x);
+
+	return lerp(lerp(v00, v10, f.y), lerp(v01, v11, f.y), f.z);
+}
+
 
 //--------------------------------------------------------------------------------------
 // Input / Output structures
@@ -47,22 +71,26 @@ void geometryShader(
 {
 	outputVertexPacket outputVertex;
 	
+	// Bend the blade downwind - lighter blades bend further
+	float3 wind = windAt(gIn[0].pos);
+	float bend = 1.0-gIn[0].weight;
+
 	outputVertex.colour = gIn[0].colour;
 	outputVertex.posH = mul(float4(gIn[0].pos, 1.0), viewProjMatrix);
 	lStream.Append(outputVertex);
 	
-	outputVertex.posH = mul(float4(gIn[0].pos + float3(windPhase*0.01*(1.0-gIn[0].weight), 0.2, 0.0), 1.0), viewProjMatrix);
+	outputVertex.posH = mul(float4(gIn[0].pos + float3(wind.x*0.01*bend, 0.2, wind.z*0.01*bend), 1.0), viewProjMatrix);
 	lStream.Append(outputVertex);
 	
-	outputVertex.posH = mul(float4(gIn[0].pos + float3(windPhase*0.04*(1.0-gIn[0].weight), 0.5, 0.0), 1.0), viewProjMatrix);
+	outputVertex.posH = mul(float4(gIn[0].pos + float3(wind.x*0.04*bend, 0.5, wind.z*0.04*bend), 1.0), viewProjMatrix);
 	lStream.Append(outputVertex);
 	
 	lStream.RestartStrip();
 	
-	outputVertex.posH = mul(float4(gIn[0].pos + float3(windPhase*0.01*(1.0-gIn[0].weight), 0.2, 0.0), 1.0), viewProjMatrix);
+	outputVertex.posH = mul(float4(gIn[0].pos + float3(wind.x*0.01*bend, 0.2, wind.z*0.01*bend), 1.0), viewProjMatrix);
 	lStream.Append(outputVertex);
 	
-	outputVertex.posH = mul(float4(gIn[0].pos + float3(windPhase*0.01*(1.0-gIn[0].weight)+0.01, 0.25, 0.1), 1.0), viewProjMatrix);
+	outputVertex.posH = mul(float4(gIn[0].pos + float3(wind.x*0.01*bend+0.01, 0.25, wind.z*0.01*bend+0.1), 1.0), viewProjMatrix);
 	lStream.Append(outputVertex);
 	
 	
@@ -21,6 +21,24 @@ struct Constraint
 };
 StructuredBuffer<Constraint> constraints : register(t0);
 
+// Anchor of each particle (0xFFFFFFFF for none)
+StructuredBuffer<uint> anchorSlots : register(t2);
+
+// Set once per fixed step by the scheduler (see Cloth::step)
+cbuffer clothStep : register(b0)
+{
+	float4		gravity;
+	float		timeStep;
+	float		damping;
+	uint		anchorOn;
+};
+
+// Inverse mass - pinned anchors do not move, every other particle is unit mass
+float inverseMass(uint index)
+{
+	return (anchorOn && anchorSlots[index] != 0xFFFFFFFF) ? 0.0 : 1.0;
+}
+
 [numthreads(1, 1, 1)]
 void main( uint3 DTid : SV_DispatchThreadID )
 {
@@ -28,14 +46,20 @@ void main( uint3 DTid : SV_DispatchThreadID )
 	Particle particleOne = particles[constraints[DTid.x].start];
 	Particle particleTwo = particles[constraints[DTid.x].end];
 
+	float wOne = inverseMass(constraints[DTid.x].start);
+	float wTwo = inverseMass(constraints[DTid.x].end);
+
+	if (wOne + wTwo == 0)
+		return;
+
 	// Find the delta of the particles
 	float3 delta = particleOne.pos - particleTwo.pos;
 
 	// Get the distance between the particles
 	float distance = length(delta);
 	float stretching = 1 - constraints[DTid.x].length / distance;
-	delta *= stretching;
+	delta *= stretching / (wOne + wTwo);
 
-	particles[constraints[DTid.x].start].pos -= (delta * 0.5);
-	particles[constraints[DTid.x].end].pos += (delta * 0.5);
+	particles[constraints[DTid.x].start].pos -= (delta * wOne);
+	particles[constraints[DTid.x].end].pos += (delta * wTwo);
 }
\ No newline at end of file
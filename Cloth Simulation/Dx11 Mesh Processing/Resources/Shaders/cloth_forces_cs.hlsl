@@ -12,13 +12,18 @@ struct Particle
 };
 RWStructuredBuffer<Particle> particles	: register(u0);
 
-struct Anchor
-{
-	uint index;
+// Target of each anchor, and the anchor of each particle (0xFFFFFFFF for none)
+StructuredBuffer<float4> anchorTargets	: register(t1);
+StructuredBuffer<uint> anchorSlots		: register(t2);
 
-	float3 pos;
+// Set once per fixed step by the scheduler (see Cloth::step)
+cbuffer clothStep : register(b0)
+{
+	float4		gravity;
+	float		timeStep;
+	float		damping;
+	uint		anchorOn;
 };
-StructuredBuffer<Anchor> anchors : register(t1);
 
 [numthreads(1, 1, 1)]
 void main( uint3 DTid : SV_DispatchThreadID )
@@ -29,13 +34,18 @@ void main( uint3 DTid : SV_DispatchThreadID )
 
 	particles[DTid.x].pos = pos;*/
 
-	float3 force = float3(0, -1.0, -1.0);
-	float3 velocity = ((particles[DTid.x].pos * 2) - particles[DTid.x].prevPos);
+	// Position Verlet - displacement over the last step, damped, plus gravity over this one
+	float3 velocity = (particles[DTid.x].pos - particles[DTid.x].prevPos) * damping;
 
-	float3 nextPos = (velocity * 0.001) + 0.5 * (force * 0.001);
+	float3 nextPos = velocity + gravity.xyz * (timeStep * timeStep);
 
 	particles[DTid.x].prevPos = particles[DTid.x].pos;
 
 	particles[DTid.x].pos += nextPos;
 
+	// Pin anchored particles to their targets
+	uint slot = anchorSlots[DTid.x];
+
+	if (anchorOn && slot != 0xFFFFFFFF)
+		particles[DTid.x].pos = anchorTargets[slot].xyz;
 }
\ No newline at end of file
@@ -17,8 +17,42 @@ cbuffer snowSystemUpdateConstants : register (b5) {
 	
 	// Pesudo-random number in the range [0, 8) to determine the initial particle type.  Again, only a single new particle likely in every update cycle  (see above)
 	uint		randomFlakeType;
+
+	// Fraction of the way each update moves a flake's velocity to the wind velocity times windScale (0 ignores the wind)
+	float		windResponse;
+	float		windScale;
+};
+
+
+// Wind volume shared with the CPU cloth (see CGWindVolume) - velocity in m/s at each sample
+cbuffer windVolume : register (b6) {
+
+	float3		windLower;
+	float		windInvCellSize;
+	uint3		windSize;
 };
 
+Texture3D<float4>	windField : register(t0);
+
+
+// Trilinear wind velocity at p, clamped to the volume.  Zero when no volume is bound.
+float3 windAt(float3 p) {
+
+	if (windSize.x < 2 || windSize.y < 2 || windSize.z < 2)
+		return float3(0.0, 0.0, 0.0);
+
+	float3 g = clamp((p - windLower) * windInvCellSize, float3(0.0, 0.0, 0.0), float3(windSize - 1));
+	int3 c = min(int3(g), int3(windSize) - 2);
+	float3 f = g - float3(c);
+
+	float3 v00 = lerp(windField.Load(int4(c, 0)).xyz, windField.Load(int4(c + int3(1, 0, 0), 0)).xyz, f.x);
+	float3 v10 = lerp(windField.Load(int4(c + int3(0, 1, 0), 0)).xyz, windField.Load(int4(c + int3(1, 1, 0), 0)).xyz, f.x);
+	float3 v01 = lerp(windField.Load(int4(c + int3(0, 0, 1), 0)).xyz, windField.Load(int4(c + int3(1, 0, 1), 0)).xyz, f.x);
+	float3 v11 = lerp(windField.Load(int4(c + int3(0, 1, 1), 0)).xyz, windField.Load(int4(c + int3(1, 1, 1), 0)).xyz, f.x);
+
+	return lerp(lerp(v00, v10, f.y), lerp(v01, v11, f.y), f.z);
+}
+
 
 
 //--------------------------------------------------------------------------------------
@@ -94,6 +128,11 @@ void geometryShader(
 
 			outputParticle.pos = inputParticle[0].pos + (inputParticle[0].velocity * 0.05);
 			outputParticle.velocity = inputParticle[0].velocity + gravity.xyz;
+
+			// Drift towards the wind
+			if (windResponse > 0.0)
+				outputParticle.velocity += (windAt(inputParticle[0].pos) * windScale - outputParticle.velocity) * windResponse;
+
 			outputParticle.weight = inputParticle[0].weight;
 			outputParticle.age = inputParticle[0].age - ageDelta;
 			outputParticle.theta = inputParticle[0].theta + (inputParticle[0].angularVelocity * 0.25);
@@ -7,6 +7,7 @@ CGBaseModel::CGBaseModel() {
 	vertexBuffer = nullptr;
 	indexBuffer = nullptr;
 	inputLayout = nullptr;
+	indexFormat = DXGI_FORMAT_R32_UINT;
 }
 
 
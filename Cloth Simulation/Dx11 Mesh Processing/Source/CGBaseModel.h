@@ -14,6 +14,8 @@ protected:
 	ID3D11Buffer					*indexBuffer;
 	ID3D11InputLayout				*inputLayout;
 
+	DXGI_FORMAT						indexFormat; // R32_UINT unless the model was built with 16 bit indices
+
 public:
 
 	CGBaseModel();
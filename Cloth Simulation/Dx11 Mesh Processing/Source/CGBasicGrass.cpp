@@ -1,6 +1,7 @@
 
 #include "CGBasicGrass.h"
 #include <iostream>
+#include "CGWindVolume.h"
 
 using namespace std;
 
@@ -23,7 +24,7 @@ HRESULT CGBasicGrassVertex::createInputLayout(ID3D11Device *device, ID3DBlob *sh
 
 
 
-CGBasicGrass::CGBasicGrass(ID3D11Device *device, ID3DBlob *vsBytecode, DWORD numPoints, DWORD terrainWidth, DWORD terrainHeight) {
+CGBasicGrass::CGBasicGrass(ID3D11Device *device, ID3DBlob *vsBytecode, DWORD numPoints, DWORD terrainWidth, DWORD terrainHeight, FLOAT baseHeight) {
 
 	// Setup grass model buffers
 	CGBasicGrassVertex *vertices = nullptr;
@@ -31,6 +32,7 @@ CGBasicGrass::CGBasicGrass(ID3D11Device *device, ID3DBlob *vsBytecode, DWORD num
 	indexBuffer = nullptr;
 	inputLayout = nullptr;
 	numBlades = 0;
+	windVolume = nullptr;
 
 	try
 	{
@@ -64,7 +66,7 @@ CGBasicGrass::CGBasicGrass(ID3D11Device *device, ID3DBlob *vsBytecode, DWORD num
 			// set position
 			vptr->pos.x = x;
 			vptr->pos.z = z;
-			vptr->pos.y = 0.1f * (z * sinf(x) + x * cosf(z));
+			vptr->pos.y = baseHeight + 0.1f * (z * sinf(x) + x * cosf(z));
 
 			// set colour
 			vptr->colour = XMCOLOR(0.0f, 0.5f, 0.2f, 1.0f);
@@ -122,6 +124,12 @@ CGBasicGrass::CGBasicGrass(ID3D11Device *device, ID3DBlob *vsBytecode, DWORD num
 }
 
 
+void CGBasicGrass::setWind(CGWindVolume *volume) {
+
+	windVolume = volume;
+}
+
+
 void CGBasicGrass::render(ID3D11DeviceContext *context) {
 
 	// validate basic grass model before rendering
@@ -141,6 +149,10 @@ void CGBasicGrass::render(ID3D11DeviceContext *context) {
 	// Set primitive topology for IA
 	context->IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY_POINTLIST);
 
+	// Bind wind volume for the GS
+	if (windVolume)
+		windVolume->bindGS(context, 1, 0);
+
 	// Draw grass model
 	context->Draw(numBlades, 0);
 }
@@ -6,6 +6,9 @@
 #include "CGBaseModel.h"
 
 
+class CGWindVolume;
+
+
 //
 // Grass vertex structure
 //
@@ -24,9 +27,16 @@ class CGBasicGrass : public CGBaseModel {
 
 	DWORD				numBlades;
 
+	// Wind the blades bend in (not owned)
+	CGWindVolume		*windVolume;
+
 public:
 
-	CGBasicGrass(ID3D11Device *device, ID3DBlob *vsBytecode, DWORD numPoints, DWORD terrainWidth, DWORD terrainHeight);
+	// Blades on a basic terrain of terrainWidth x terrainHeight samples placed baseHeight up from the origin
+	CGBasicGrass(ID3D11Device *device, ID3DBlob *vsBytecode, DWORD numPoints, DWORD terrainWidth, DWORD terrainHeight, FLOAT baseHeight = 0.0f);
+
+	// Bend the blades in the wind held by volume (nullptr leaves them upright) - bound to the GS as b1 and t0
+	void setWind(CGWindVolume *volume);
 
 	void render(ID3D11DeviceContext *context);
 };
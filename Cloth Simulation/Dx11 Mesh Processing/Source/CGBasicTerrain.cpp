@@ -2,6 +2,7 @@
 #include "CGBasicTerrain.h"
 #include <iostream>
 #include "CGVertexExt.h"
+#include "buffers.h"
 
 using namespace std;
 
@@ -96,26 +97,8 @@ CGBasicTerrain::CGBasicTerrain(ID3D11Device *device, ID3DBlob *vsBytecode, DWORD
 			}
 		}
 
-		// Setup index values
-		DWORD *iptr = indices;
-		for (DWORD j=0; j<h-1; ++j) {
-
-			for (DWORD i=0; i<w-1; ++i, iptr+=6) {
-
-				DWORD a = w * j + i;
-				DWORD b = a + w;
-				DWORD c = b + 1;
-				DWORD d = a + 1;
-
-				iptr[0] = a;
-				iptr[1] = b;
-				iptr[2] = d;
-
-				iptr[3] = b;
-				iptr[4] = c;
-				iptr[5] = d;
-			}
-		}
+		// Setup index values - cache ordered strips, as the cloth grid uses
+		ClothIndexOptimiser::gridIndices(w, h, indices);
 
 
 		// Setup vertex buffer
@@ -136,19 +119,8 @@ CGBasicTerrain::CGBasicTerrain(ID3D11Device *device, ID3DBlob *vsBytecode, DWORD
 			throw("Vertex buffer cannot be created");
 
 
-		// Setup index buffer
-		D3D11_BUFFER_DESC indexDesc;
-		D3D11_SUBRESOURCE_DATA indexData;
-
-		ZeroMemory(&indexDesc, sizeof(D3D11_BUFFER_DESC));
-		ZeroMemory(&indexData, sizeof(D3D11_SUBRESOURCE_DATA));
-
-		indexDesc.Usage = D3D11_USAGE_IMMUTABLE;
-		indexDesc.ByteWidth = sizeof(DWORD) * (w-1) * (h-1) * 6;
-		indexDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-		indexData.pSysMem = indices;
-
-		hr = device->CreateBuffer(&indexDesc, &indexData, &indexBuffer);
+		// Setup index buffer (16 bit when the terrain has few enough vertices)
+		hr = createIndexBuffer(device, indices, (w-1) * (h-1) * 6, w * h, D3D11_USAGE_IMMUTABLE, &indexBuffer, &indexFormat);
 
 		if (!SUCCEEDED(hr))
 			throw("Index buffer cannot be created");
@@ -192,6 +164,12 @@ CGBasicTerrain::CGBasicTerrain(ID3D11Device *device, ID3DBlob *vsBytecode, DWORD
 }
 
 
+float CGBasicTerrain::height(float x, float z) {
+
+	return T(x, z);
+}
+
+
 void CGBasicTerrain::render(ID3D11DeviceContext *context) {
 
 	// validate basic terrain model before rendering (see notes in constructor)
@@ -207,7 +185,7 @@ void CGBasicTerrain::render(ID3D11DeviceContext *context) {
 	UINT vertexOffsets[] = {0};
 
 	context->IASetVertexBuffers(0, 1, vertexBuffers, vertexStrides, vertexOffsets);
-	context->IASetIndexBuffer(indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+	context->IASetIndexBuffer(indexBuffer, indexFormat, 0);
 
 	// Set primitive topology for IA
 	context->IASetPrimitiveTopology(D3D10_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
@@ -15,4 +15,7 @@ public:
 	CGBasicTerrain(ID3D11Device *device, ID3DBlob *vsBytecode, DWORD newTerrainWidth, DWORD newTerrainHeight);
 
 	void render(ID3D11DeviceContext *context);
+
+	// Height of the terrain surface at (x, z) - the kernel the mesh is built from, for collision
+	static float height(float x, float z);
 };
@@ -6,6 +6,7 @@
 #include "CGOutputMergerStage.h"
 #include "HLSLFactory.h"
 #include "buffers.h"
+#include "CGWindVolume.h"
 
 
 using namespace std;
@@ -134,6 +135,7 @@ CGSnowParticleSystem::CGSnowParticleSystem(ID3D11Device *device, ID3D11DeviceCon
 	firstRun = true;
 	sourceBuffer = Pb1;
 	resultBuffer = Pb2;
+	windVolume = nullptr;
 }
 
 
@@ -155,6 +157,15 @@ void CGSnowParticleSystem::setCameraProjectionState(CXMMATRIX _projMatrix, const
 }
 
 
+void CGSnowParticleSystem::setWind(CGWindVolume *volume, const FLOAT response, const FLOAT scale) {
+
+	windVolume = volume;
+
+	snowSystemUpdateConstantsBuffer->windResponse = volume ? response : 0.0f;
+	snowSystemUpdateConstantsBuffer->windScale = scale;
+}
+
+
 void CGSnowParticleSystem::render(ID3D11DeviceContext *context) {
 
 	// Set random number values in snowSystemUpdateConstantsBuffer
@@ -196,6 +207,10 @@ void CGSnowParticleSystem::render(ID3D11DeviceContext *context) {
 	ID3D11Buffer* gsUpdatePhaseCBuffers[] = {snowSystemUpdateConstants_cbuffer};
 	context->GSSetConstantBuffers(5, 1, gsUpdatePhaseCBuffers);
 
+	// Bind wind volume for the update GS
+	if (windVolume)
+		windVolume->bindGS(context, 6, 0);
+
 	// Bind update pipeline
 	updatePipeline->applyPipeline(context);
 
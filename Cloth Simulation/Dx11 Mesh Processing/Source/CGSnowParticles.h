@@ -10,6 +10,7 @@
 class CGPipeline;
 class CGRasteriserStage;
 class CGOutputMergerStage;
+class CGWindVolume;
 
 
 // Implement particle system to run on the GPU in DirectX 11 using the GS and SO stages.
@@ -58,7 +59,11 @@ _DECLSPEC_ALIGN_16_ struct snowSystemUpdateConstantsStruct {
 	
 	// Pesudo-random number in the range [0, 8) to determine the initial particle type (so snowflakes 'live' for different lengths of time).  Again, only a single new particle likely in every update cycle  (see above)
 	UINT			randomFlakeType;
-	UINT			_py, _pz, _pw;
+
+	// Fraction of the way each update moves a flake's velocity to the wind velocity (in m/s) times windScale - 0 ignores the wind
+	FLOAT			windResponse;
+	FLOAT			windScale;
+	UINT			_pw;
 
 	snowSystemUpdateConstantsStruct() {
 
@@ -122,6 +127,9 @@ class CGSnowParticleSystem : public CGBaseModel {
 
 	ID3D11Buffer						*sourceBuffer, *resultBuffer;
 
+	// Wind the flakes drift in (not owned)
+	CGWindVolume						*windVolume;
+
 	
 
 #pragma region Private interface
@@ -139,6 +147,10 @@ public:
 	void setCameraViewMatrix(CXMMATRIX _viewMatrix);
 	void setCameraProjectionState(CXMMATRIX _projMatrix, const FLOAT _nearPlaneDist, const float _farPlaneDist);
 
+	// Drift the flakes in the wind held by volume (nullptr for none) - each update moves a flake's velocity
+	// response of the way to the wind velocity times scale (the flakes' distance per update per m/s)
+	void setWind(CGWindVolume *volume, const FLOAT response = 0.02f, const FLOAT scale = 0.0002f);
+
 	//void render(ID3D11DeviceContext *context) {};
 	void render(ID3D11DeviceContext *context);
 };
@@ -0,0 +1,171 @@
+
+#include "CGWindVolume.h"
+#include <iostream>
+#include <new>
+#include "buffers.h"
+
+
+using namespace std;
+
+
+CGWindVolume::CGWindVolume(ID3D11Device *device, const ClothWindField *field) {
+
+	windTexture = nullptr;
+	windSRV = nullptr;
+	windVolumeBuffer = nullptr;
+	windVolume_cbuffer = nullptr;
+	sizeX = sizeY = sizeZ = 0;
+
+	try
+	{
+		if (!device || !field)
+			throw("Invalid parameters for wind volume instantiation");
+
+		sizeX = (UINT)field->samplesX();
+		sizeY = (UINT)field->samplesY();
+		sizeZ = (UINT)field->samplesZ();
+
+		// Setup dynamic 3D texture - rewritten from the CPU every frame
+		D3D11_TEXTURE3D_DESC texDesc;
+		D3D11_SUBRESOURCE_DATA texData;
+
+		ZeroMemory(&texDesc, sizeof(D3D11_TEXTURE3D_DESC));
+		ZeroMemory(&texData, sizeof(D3D11_SUBRESOURCE_DATA));
+
+		texDesc.Width = sizeX;
+		texDesc.Height = sizeY;
+		texDesc.Depth = sizeZ;
+		texDesc.MipLevels = 1;
+		texDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+		texDesc.Usage = D3D11_USAGE_DYNAMIC;
+		texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		texDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+		// ClothWindField samples are tightly packed x fastest then y then z
+		texData.pSysMem = field->samples();
+		texData.SysMemPitch = sizeX * sizeof(ClothFloat4);
+		texData.SysMemSlicePitch = sizeX * sizeY * sizeof(ClothFloat4);
+
+		HRESULT hr = device->CreateTexture3D(&texDesc, &texData, &windTexture);
+
+		if (!SUCCEEDED(hr))
+			throw("Wind volume texture cannot be created");
+
+		hr = device->CreateShaderResourceView(windTexture, nullptr, &windSRV);
+
+		if (!SUCCEEDED(hr))
+			throw("Wind volume resource view cannot be created");
+
+		// Setup cbuffer describing the volume
+		windVolumeBuffer = (windVolumeStruct*)_aligned_malloc(sizeof(windVolumeStruct), 16);
+
+		if (!windVolumeBuffer)
+			throw("Cannot create wind volume constants");
+
+		new (windVolumeBuffer)windVolumeStruct();
+
+		ClothFloat3 corner = field->corner();
+
+		windVolumeBuffer->lowerCorner = XMFLOAT3(corner.x, corner.y, corner.z);
+		windVolumeBuffer->invCellSize = 1.0f / field->spacing();
+		windVolumeBuffer->sizeX = sizeX;
+		windVolumeBuffer->sizeY = sizeY;
+		windVolumeBuffer->sizeZ = sizeZ;
+
+		hr = createCBuffer(device, windVolumeBuffer, &windVolume_cbuffer);
+
+		if (!SUCCEEDED(hr))
+			throw("Wind volume cbuffer cannot be created");
+	}
+	catch (char *err)
+	{
+		cout << "Wind volume could not be instantiated due to:\n";
+		cout << err << endl << endl;
+
+		if (windVolume_cbuffer)
+			windVolume_cbuffer->Release();
+
+		if (windVolumeBuffer)
+			_aligned_free(windVolumeBuffer);
+
+		if (windSRV)
+			windSRV->Release();
+
+		if (windTexture)
+			windTexture->Release();
+
+		windVolume_cbuffer = nullptr;
+		windVolumeBuffer = nullptr;
+		windSRV = nullptr;
+		windTexture = nullptr;
+	}
+}
+
+
+CGWindVolume::~CGWindVolume() {
+
+	if (windVolume_cbuffer)
+		windVolume_cbuffer->Release();
+
+	if (windVolumeBuffer)
+		_aligned_free(windVolumeBuffer);
+
+	if (windSRV)
+		windSRV->Release();
+
+	if (windTexture)
+		windTexture->Release();
+}
+
+
+void CGWindVolume::update(ID3D11DeviceContext *context, const ClothWindField *field) {
+
+	if (!context || !field || !isValid())
+		return;
+
+	// A field of another size would not fit the texture
+	if ((UINT)field->samplesX() != sizeX || (UINT)field->samplesY() != sizeY || (UINT)field->samplesZ() != sizeZ)
+		return;
+
+	D3D11_MAPPED_SUBRESOURCE res;
+
+	HRESULT hr = context->Map(windTexture, 0, D3D11_MAP_WRITE_DISCARD, 0, &res);
+
+	if (!SUCCEEDED(hr))
+		return;
+
+	// The driver may pad each row and slice, so copy a row at a time
+	const ClothFloat4 *src = field->samples();
+	size_t rowBytes = sizeX * sizeof(ClothFloat4);
+
+	for (UINT z = 0; z < sizeZ; ++z) {
+
+		for (UINT y = 0; y < sizeY; ++y) {
+
+			BYTE *dest = (BYTE*)res.pData + z * res.DepthPitch + y * res.RowPitch;
+
+			memcpy(dest, src + (z * sizeY + y) * sizeX, rowBytes);
+		}
+	}
+
+	context->Unmap(windTexture, 0);
+}
+
+
+void CGWindVolume::bindGS(ID3D11DeviceContext *context, UINT cbufferSlot, UINT textureSlot) {
+
+	if (!context || !isValid())
+		return;
+
+	ID3D11Buffer* cbuffers[] = {windVolume_cbuffer};
+	context->GSSetConstantBuffers(cbufferSlot, 1, cbuffers);
+
+	ID3D11ShaderResourceView* srvs[] = {windSRV};
+	context->GSSetShaderResources(textureSlot, 1, srvs);
+}
+
+
+bool CGWindVolume::isValid() const {
+
+	return windTexture && windSRV && windVolume_cbuffer;
+}
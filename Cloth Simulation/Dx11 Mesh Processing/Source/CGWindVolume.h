@@ -0,0 +1,58 @@
+#pragma once
+
+#include <D3DX11.h>
+#include <xnamath.h>
+#include "ClothWindField.h"
+
+
+// Constant buffer (system memory) model describing where the wind volume lies in the scene
+
+_DECLSPEC_ALIGN_16_ struct windVolumeStruct {
+
+	XMFLOAT3					lowerCorner;
+	FLOAT						invCellSize;
+
+	// Samples along x, y and z
+	UINT						sizeX, sizeY, sizeZ;
+	UINT						_pw; // padding
+
+	windVolumeStruct() {
+
+		ZeroMemory(this, sizeof(windVolumeStruct));
+		invCellSize = 1.0f;
+	}
+};
+
+
+// GPU copy of a ClothWindField for the shaders of the scene that are blown about by the same
+// wind as the CPU cloth (CGBasicGrass, CGSnowParticleSystem).  The samples are held in a dynamic
+// 3D texture re-uploaded by update() after every ClothWindField::advance.  Shaders read it as
+// Texture3D<float4> and interpolate between the 8 samples around a point themselves, so no
+// sampler state needs to be bound alongside it.
+
+class CGWindVolume {
+
+	UINT								sizeX, sizeY, sizeZ;
+
+	ID3D11Texture3D						*windTexture;
+	ID3D11ShaderResourceView			*windSRV;
+
+	windVolumeStruct					*windVolumeBuffer;
+	ID3D11Buffer						*windVolume_cbuffer;
+
+public:
+
+	// Create the texture and cbuffer to hold field - a field of the same size can be uploaded afterwards
+	CGWindVolume(ID3D11Device *device, const ClothWindField *field);
+
+	~CGWindVolume();
+
+	// Upload the current samples of field
+	void update(ID3D11DeviceContext *context, const ClothWindField *field);
+
+	// Bind the volume cbuffer and samples to the geometry shader stage
+	void bindGS(ID3D11DeviceContext *context, UINT cbufferSlot, UINT textureSlot);
+
+	// Whether the GPU resources were created
+	bool isValid() const;
+};
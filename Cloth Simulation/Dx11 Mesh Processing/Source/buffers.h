@@ -3,6 +3,7 @@
 
 #include <D3DX11.h>
 #include <xnamath.h>
+#include "ClothIndexOptimiser.h"
 
 
 // templated function to map constant buffers or 1D resources that are created as dynamnic buffers with CPU write access
@@ -42,6 +43,43 @@ HRESULT createCBuffer(ID3D11Device *device, T *srcBuffer, ID3D11Buffer **cBuffer
 	return hr;
 }
 
+// create an index buffer from a 32 bit index list over vertexCount vertices - the indices are narrowed to 16 bits when they fit, and format gets the one used
+inline HRESULT createIndexBuffer(ID3D11Device *device, const DWORD *indices, UINT indexCount, UINT vertexCount, D3D11_USAGE usage, ID3D11Buffer **indexBuffer, DXGI_FORMAT *format) {
+
+	bool narrow = ClothIndexOptimiser::fitsShortIndices((int)vertexCount);
+	WORD *shortIndices = nullptr;
+
+	if (narrow) {
+
+		shortIndices = (WORD*)malloc(sizeof(WORD) * indexCount);
+
+		if (!shortIndices)
+			return E_OUTOFMEMORY;
+
+		ClothIndexOptimiser::narrowIndices(indices, (int)indexCount, shortIndices);
+	}
+
+	D3D11_BUFFER_DESC indexDesc;
+	D3D11_SUBRESOURCE_DATA indexData;
+
+	ZeroMemory(&indexDesc, sizeof(D3D11_BUFFER_DESC));
+	ZeroMemory(&indexData, sizeof(D3D11_SUBRESOURCE_DATA));
+
+	indexDesc.Usage = usage;
+	indexDesc.ByteWidth = (narrow ? sizeof(WORD) : sizeof(DWORD)) * indexCount;
+	indexDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	indexData.pSysMem = narrow ? (const void*)shortIndices : (const void*)indices;
+
+	HRESULT hr = device->CreateBuffer(&indexDesc, &indexData, indexBuffer);
+
+	free(shortIndices);
+
+	if (SUCCEEDED(hr))
+		*format = narrow ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+
+	return hr;
+}
+
 
 
 
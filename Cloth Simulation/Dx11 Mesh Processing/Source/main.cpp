@@ -9,6 +9,7 @@
 #include <new>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <time.h>
 #include <iostream>
@@ -24,13 +25,17 @@
 #include "CGOutputMergerStage.h"
 #include "buffers.h"
 #include "CGModelInstance.h"
-//#include "CGBasicTerrain.h"
+#include "CGBasicTerrain.h"
 #include "CGSnowParticles.h"
+#include "CGBasicGrass.h"
+#include "CGWindVolume.h"
 #include <CoreStructures\CoreStructures.h>
 #include <CGModel\CGModel.h>
 #include <Importers\CGImporters.h>
 
 #include "Cloth.h"
+#include "ClothSet.h"
+#include "ClothBenchmark.h"
 
 using namespace std;
 
@@ -89,6 +94,17 @@ CGPipeline						*basicTexturePipeline = nullptr; // Pipeline for snowy surface r
 
 // Cloth
 Cloth* cloth = nullptr;
+ClothWorkerPool* clothPool = nullptr; // Only created when simulating the cloth on the CPU (-cpu)
+ClothSet* clothSet = nullptr; // Row of flags sharing one solver (-flags <n>)
+ClothHeightfield* clothGround = nullptr; // Terrain the CPU cloth lands on (-ground)
+ClothMeshCollider* clothProp = nullptr; // Imported mesh the CPU cloth drapes over (-prop <file>)
+ClothDistanceField* clothPropField = nullptr; // The same mesh baked into a distance field instead (-prop <file> -sdf)
+ClothWindField* clothWind = nullptr; // Turbulent wind the CPU cloth flaps in (-wind)
+CGWindVolume* windVolume = nullptr; // GPU copy of clothWind the snow and grass are blown about by
+CGBasicGrass* grass = nullptr; // Grass on the terrain, bending in the wind (-wind -ground)
+CGPipeline* grassPipeline = nullptr;
+FILE* clothHashLog = nullptr; // State hash of every CPU cloth step (-hashlog)
+vector<ClothFloat3> clothRail; // Targets of the anchors along the swaying top edge (-rail)
 
 //
 // Declare function prototypes
@@ -96,6 +112,7 @@ Cloth* cloth = nullptr;
 int WINAPI WinMain(HINSTANCE h_instance, HINSTANCE h_prev_instance, LPSTR lp_cmd_line, int show_cmd);
 LRESULT CALLBACK WinProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam);
 void renderScene(void);
+void cursorRay(LPARAM lparam, ClothFloat3& origin, ClothFloat3& direction);
 
 
 // ------------------------------
@@ -141,6 +158,34 @@ int WINAPI WinMain(HINSTANCE h_instance, HINSTANCE h_prev_instance, LPSTR lp_cmd
 	srand( (unsigned)time( NULL ) );
 	rand();
 
+	// Headless benchmark run - no window or device is created
+	if (lp_cmd_line && strstr(lp_cmd_line, "-benchmark")) {
+
+		ClothBenchmark::run(stdout);
+		fflush(NULL);
+
+		if (consoleSetup==TRUE) {
+
+			cout << "\nPress any key to continue...";
+			_getch();
+
+			FreeConsole();
+		}
+
+		if (stdinFile)
+			fclose(stdinFile);
+
+		if (stdoutFile)
+			fclose(stdoutFile);
+
+		if (stderrFile)
+			fclose(stderrFile);
+
+		CoUninitialize();
+
+		return 0;
+	}
+
 #pragma endregion
 
 
@@ -433,10 +478,252 @@ int WINAPI WinMain(HINSTANCE h_instance, HINSTANCE h_prev_instance, LPSTR lp_cmd
 	cam = new CGPivotCamera(-0.1f, 0.31f, 5.9f);
 
 	// Setup models
-	cloth = new Cloth(device, vsExtBytecode, 16, 16);
+	if (lp_cmd_line && strstr(lp_cmd_line, "-cpu"))
+		clothPool = new ClothWorkerPool();
+
+	// -gpucheck steps a grid cloth on the compute shaders and on the CPU solver side by side, and
+	// writes how far apart their particles drift to the console
+	if (lp_cmd_line && strstr(lp_cmd_line, "-gpucheck")) {
+
+		ClothWorkerPool* checkPool = clothPool ? clothPool : new ClothWorkerPool();
+
+		if (!Cloth::compareSolvers(device, context, vsExtBytecode, 64, 64, checkPool, 600, stdout))
+			cout << "The GPU check needs both the compute shaders and the CPU solver" << endl;
+
+		fflush(stdout);
+
+		if (checkPool != clothPool)
+			delete checkPool;
+	}
+
+	// -mesh <file> hangs an imported OBJ or GSF mesh instead of the grid
+	const char* meshArg = lp_cmd_line ? strstr(lp_cmd_line, "-mesh ") : nullptr;
+
+	if (meshArg) {
+
+		char meshPath[MAX_PATH] = {0};
+		wchar_t meshFile[MAX_PATH] = {0};
+
+		sscanf_s(meshArg + 6, "%259s", meshPath, (unsigned)_countof(meshPath));
+		mbstowcs_s(nullptr, meshFile, meshPath, _TRUNCATE);
+
+		CGModel *clothModel = new CGModel();
+
+		CG_IMPORT_RESULT result = (strstr(meshPath, ".gsf") || strstr(meshPath, ".GSF")) ? importGSF(meshFile, clothModel) : importOBJ(meshFile, clothModel);
+
+		// The cloth copies the mesh so the model is only needed here
+		if (result == CG_IMPORT_OK && clothModel->getMeshAtIndex(0))
+			cloth = new Cloth(device, vsExtBytecode, clothModel->getMeshAtIndex(0), clothPool);
+		else
+			cout << "Cannot import cloth mesh " << meshPath << endl;
+
+		clothModel->release();
+	}
+
+	// -topocache maps the grid topology from Resources, where it is written on the first run.
+	// Off by default - read cold from the disk a large grid takes about as long as building it.
+	if (!cloth)
+		cloth = new Cloth(device, vsExtBytecode, 16, 16, clothPool, (lp_cmd_line && strstr(lp_cmd_line, "-topocache")) ? "Resources" : nullptr);
+
+	// -xpbd switches the CPU solver to XPBD substepping
+	if (lp_cmd_line && strstr(lp_cmd_line, "-xpbd") && !cloth->setSolverMode(CLOTH_SOLVER_XPBD))
+		cout << "XPBD needs the CPU solver (-cpu)" << endl;
+
+	// -multigrid adds the coarse grid passes to the CPU solver
+	if (lp_cmd_line && strstr(lp_cmd_line, "-multigrid") && !cloth->setMultigrid(8))
+		cout << "Multigrid needs the CPU solver (-cpu) and a grid cloth" << endl;
+
+	// -attach tethers every particle to the anchors
+	if (lp_cmd_line && strstr(lp_cmd_line, "-attach") && !cloth->setAttachments(true))
+		cout << "Attachments need the CPU solver (-cpu)" << endl;
+
+	// -tear lets the cloth tear where stretched half again its rest length
+	if (lp_cmd_line && strstr(lp_cmd_line, "-tear") && !cloth->setTearing(0.5f))
+		cout << "Tearing needs the CPU solver (-cpu), without -multigrid or -attach" << endl;
+
+	// -rail pins the whole top row of the grid to a rail that sways from side to side
+	if (lp_cmd_line && strstr(lp_cmd_line, "-rail")) {
+
+		if (meshArg) {
+
+			cout << "The rail needs the grid cloth" << endl;
+
+		} else {
+
+			int topRow[16];
+
+			for (int i = 0; i < 16; i++)
+				topRow[i] = i;
+
+			cloth->setAnchors(topRow, nullptr, 16);
+			clothRail.resize(16);
+		}
+	}
+
+	// -self keeps the cloth from passing through itself
+	if (lp_cmd_line && strstr(lp_cmd_line, "-self") && !cloth->setSelfCollision(true))
+		cout << "Self collision needs the CPU solver (-cpu)" << endl;
+
+	// -hashlog writes the state hash of every CPU solver step to cloth_hashes.txt, to compare
+	// runs on other machines or thread counts step by step
+	if (lp_cmd_line && strstr(lp_cmd_line, "-hashlog")) {
+
+		fopen_s(&clothHashLog, "cloth_hashes.txt", "w");
+
+		if (clothHashLog && !cloth->setHashLog(clothHashLog))
+			cout << "The hash log needs the CPU solver (-cpu)" << endl;
+	}
+
 	// Setup scene objects
 	basicScene.push_back(new CGModelInstance(cloth, XMFLOAT3(-0.5f, 0.0f, -0.5f), XMFLOAT3(0.0f, 0.0f, 0.0f)));
 
+	// -wind blows across the cloth with some turbulence, over a box of the scene around it
+	if (lp_cmd_line && strstr(lp_cmd_line, "-wind")) {
+
+		clothWind = new ClothWindField(ClothFloat3(-4.0f, -2.0f, -4.0f), ClothFloat3(4.0f, 4.0f, 4.0f), 0.25f, clothPool);
+		clothWind->baseWind = ClothFloat3(4.0f, 0.0f, 1.0f);
+		clothWind->turbulence = 1.5f;
+
+		// The cloth instance is placed at (-0.5, 0, -0.5) in the scene
+		if (!cloth->setWind(clothWind, ClothFloat3(-0.5f, 0.0f, -0.5f)))
+			cout << "Wind needs the CPU solver (-cpu)" << endl;
+	}
+
+	// -ground adds the basic terrain below the cloth, which lands on it once the anchors are released
+	if (lp_cmd_line && strstr(lp_cmd_line, "-ground")) {
+
+		basicScene.push_back(new CGModelInstance(new CGBasicTerrain(device, vsExtBytecode, 64, 64), XMFLOAT3(0.0f, -1.5f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f)));
+
+		// Terrain heights baked over its 32 x 32 extent, placed relative to the cloth instance
+		clothGround = new ClothHeightfield(CGBasicTerrain::height, -16.0f, -16.0f, 16.0f, 16.0f, 0.25f);
+		clothGround->origin = ClothFloat3(0.5f, -1.5f, 0.5f);
+
+		if (!cloth->setGround(clothGround))
+			cout << "Ground collision needs the CPU solver (-cpu)" << endl;
+	}
+
+	// The snow, and the grass on the terrain when there is one, blow about in the same wind as the
+	// cloth - the field is copied to the GPU after every advance
+	if (clothWind) {
+
+		windVolume = new CGWindVolume(device, clothWind);
+
+		snowSystem = new CGSnowParticleSystem(device, context, 256, 65536, 8.0f, defaultRSStage, disabledOMStage, defaultRSStage, blendOMStage);
+		snowSystem->setWind(windVolume);
+
+		if (clothGround) {
+
+			ID3DBlob *grassBytecode = nullptr;
+
+			grassPipeline = new CGPipeline(device, "Resources\\Shaders\\basic_grass_vs.hlsl", "Resources\\Shaders\\basic_grass_gs.hlsl", "Resources\\Shaders\\basic_grass_ps.hlsl", nullptr, defaultRSStage, defaultOMStage, &grassBytecode);
+
+			// Rooted on the terrain, which is placed 1.5 below the scene origin
+			grass = new CGBasicGrass(device, grassBytecode, 20000, 64, 64, -1.5f);
+			grass->setWind(windVolume);
+
+			if (grassBytecode)
+				grassBytecode->Release();
+		}
+	}
+
+	// -prop <file> puts an imported OBJ or GSF mesh under the cloth for it to drape over. Only the
+	// cloth collides with it - the prop itself is not drawn. -sdf collides with a distance field
+	// of the mesh instead, baked on the first run and read from Resources afterwards.
+	const char* propArg = lp_cmd_line ? strstr(lp_cmd_line, "-prop ") : nullptr;
+
+	if (propArg && !clothPool) {
+
+		cout << "Mesh collision needs the CPU solver (-cpu)" << endl;
+	}
+	else if (propArg) {
+
+		char propPath[MAX_PATH] = {0};
+		wchar_t propFile[MAX_PATH] = {0};
+
+		sscanf_s(propArg + 6, "%259s", propPath, (unsigned)_countof(propPath));
+		mbstowcs_s(nullptr, propFile, propPath, _TRUNCATE);
+
+		CGModel *propModel = new CGModel();
+
+		CG_IMPORT_RESULT result = (strstr(propPath, ".gsf") || strstr(propPath, ".GSF")) ? importGSF(propFile, propModel) : importOBJ(propFile, propModel);
+		CGPolyMesh *propMesh = (result == CG_IMPORT_OK) ? propModel->getMeshAtIndex(0) : nullptr;
+
+		if (propMesh && propMesh->vertexCount() > 0 && propMesh->vertexArray()) {
+
+			// Scale the prop to 0.6 across and centre it under the cloth, its top 0.3 below
+			CoreStructures::GUVector4 *V = propMesh->vertexArray();
+			ClothFloat3 lower(V[0].x, V[0].y, V[0].z), upper(V[0].x, V[0].y, V[0].z);
+
+			for (int i = 1; i < propMesh->vertexCount(); i++) {
+
+				lower = ClothFloat3(min(lower.x, V[i].x), min(lower.y, V[i].y), min(lower.z, V[i].z));
+				upper = ClothFloat3(max(upper.x, V[i].x), max(upper.y, V[i].y), max(upper.z, V[i].z));
+			}
+
+			float extent	= max(upper.x - lower.x, upper.z - lower.z);
+			float scale		= extent > 0.0f ? 0.6f / extent : 1.0f;
+
+			ClothFloat3 origin(0.5f - 0.5f * (lower.x + upper.x) * scale, -0.3f - upper.y * scale, 0.5f - 0.5f * (lower.z + upper.z) * scale);
+
+			// The collider and field copy the triangles so the model is only needed here
+			if (lp_cmd_line && strstr(lp_cmd_line, "-sdf")) {
+
+				clothPropField = new ClothDistanceField(propMesh, origin, scale, 128, clothPool, "Resources");
+
+				if (!cloth->setDistanceField(clothPropField))
+					cout << "Mesh collision needs the CPU solver (-cpu)" << endl;
+			}
+			else {
+
+				clothProp = new ClothMeshCollider(propMesh, origin, scale, clothPool);
+
+				if (!cloth->setCollider(clothProp))
+					cout << "Mesh collision needs the CPU solver (-cpu)" << endl;
+			}
+		}
+		else
+			cout << "Cannot import prop mesh " << propPath << endl;
+
+		propModel->release();
+	}
+
+	// -settle starts the cloth at rest instead of flat - settled on the first run and read from
+	// the cache in Resources afterwards, unless a ground, prop or wind is set
+	if (lp_cmd_line && strstr(lp_cmd_line, "-settle")) {
+
+		int settleSteps = 0;
+
+		if (!cloth->settle("Resources", &settleSteps))
+			cout << "Settling needs the CPU solver (-cpu)" << endl;
+		else if (settleSteps == 0)
+			cout << "Cloth rest state read from the cache" << endl;
+		else
+			cout << "Cloth settled in " << settleSteps << " steps" << endl;
+	}
+
+	// -flags <n> hangs n small cloths behind the main one, simulated together on the CPU
+	const char* flagsArg = lp_cmd_line ? strstr(lp_cmd_line, "-flags ") : nullptr;
+	int flagCount = 0;
+
+	if (flagsArg && sscanf_s(flagsArg + 7, "%d", &flagCount) == 1 && flagCount > 0) {
+
+		if (!clothPool)
+			clothPool = new ClothWorkerPool();
+
+		clothSet = new ClothSet(device, vsExtBytecode, clothPool);
+
+		// Square grid of flags, 1.5 units apart
+		int columns = (int)ceilf(sqrtf((float)flagCount));
+
+		for (int i = 0; i < flagCount; i++)
+			clothSet->addCloth(device, 16, 16, ClothFloat3(1.5f * (float)(i % columns - columns / 2), 0.0f, 2.0f + 1.5f * (float)(i / columns)));
+
+		if (lp_cmd_line && strstr(lp_cmd_line, "-xpbd"))
+			clothSet->setSolverMode(CLOTH_SOLVER_XPBD);
+
+		basicScene.push_back(new CGModelInstance(clothSet, XMFLOAT3(-0.5f, 0.0f, -0.5f), XMFLOAT3(0.0f, 0.0f, 0.0f)));
+	}
+
 
 #pragma region Main event loop
 
@@ -459,6 +746,35 @@ int WINAPI WinMain(HINSTANCE h_instance, HINSTANCE h_prev_instance, LPSTR lp_cmd
 				mainClock->tick();
 			else
 				mainClock = new CGClock();
+
+			// Move the wind on before the cloth steps in it
+			if (clothWind)
+				clothWind->advance((float)mainClock->gameTimeDelta());
+
+			if (windVolume)
+				windVolume->update(context, clothWind);
+
+			// Sway the rail - every target in one write, picked up by the next step
+			if (cloth && !clothRail.empty()) {
+
+				float sway = 0.25f * sinf((float)mainClock->gameTimeElapsed() * 2.0f);
+
+				for (int i = 0; i < (int)clothRail.size(); i++) {
+
+					ClothFloat3 rest = cloth->anchorRest(i);
+
+					clothRail[i] = ClothFloat3(rest.x + sway, rest.y, rest.z);
+				}
+
+				cloth->writeAnchorTargets(clothRail.data(), 0, (int)clothRail.size());
+			}
+
+			// Simulate - the cloth steps at a fixed rate however often the scene is rendered
+			if (cloth)
+				cloth->simulate(context, mainClock->gameTimeDelta());
+
+			if (clothSet)
+				clothSet->simulate(context, mainClock->gameTimeDelta());
 			
 			// Display
 			renderScene();
@@ -496,6 +812,44 @@ int WINAPI WinMain(HINSTANCE h_instance, HINSTANCE h_prev_instance, LPSTR lp_cmd
 		fclose(stderrFile);
 
 
+	// The solvers hand their work to the pool, so they go before it
+	if (clothSet)
+		delete clothSet;
+
+	if (cloth)
+		delete cloth;
+
+	// Stop the cloth worker threads
+	if (clothPool)
+		delete clothPool;
+
+	if (clothGround)
+		delete clothGround;
+
+	if (clothProp)
+		delete clothProp;
+
+	if (clothPropField)
+		delete clothPropField;
+
+	if (grass)
+		delete grass;
+
+	if (grassPipeline)
+		delete grassPipeline;
+
+	if (snowSystem)
+		delete snowSystem;
+
+	if (windVolume)
+		delete windVolume;
+
+	if (clothWind)
+		delete clothWind;
+
+	if (clothHashLog)
+		fclose(clothHashLog);
+
 	// Shutdown COM
 	CoUninitialize();
 
@@ -509,6 +863,8 @@ LRESULT CALLBACK WinProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
 {
 	static BOOL			mDown = FALSE;
 	static POINT		cPos, currentPos;
+	static BOOL			rDown = FALSE; // Dragging the cloth with the right button
+	static ClothRayHit	clothHit;
 
 	switch(msg) {
 
@@ -550,6 +906,15 @@ LRESULT CALLBACK WinProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
 
 				renderScene();
 			}
+
+			// The grabbed point follows the cursor at the depth it was picked at
+			if (rDown) {
+
+				ClothFloat3 origin, direction;
+
+				cursorRay(lparam, origin, direction);
+				cloth->drag(clothHit, ClothFloat3(origin.x + direction.x * clothHit.t, origin.y + direction.y * clothHit.t, origin.z + direction.z * clothHit.t));
+			}
 			break;
 
 
@@ -566,6 +931,36 @@ LRESULT CALLBACK WinProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
 			break;
 
 
+		case WM_RBUTTONDOWN:
+
+			// Grab the cloth under the cursor (CPU solver only)
+			if (cloth) {
+
+				ClothFloat3 origin, direction;
+
+				cursorRay(lparam, origin, direction);
+
+				if (cloth->pick(origin, direction, clothHit) && clothHit.triangle >= 0) {
+
+					SetCapture(hwnd);
+					rDown = TRUE;
+				}
+			}
+			break;
+
+
+		case WM_RBUTTONUP:
+
+			if (rDown) {
+
+				cloth->release();
+
+				rDown = FALSE;
+				ReleaseCapture();
+			}
+			break;
+
+
 		case WM_MOUSEWHEEL:
 			
 			if ((short)HIWORD(wparam)<0)
@@ -587,6 +982,9 @@ LRESULT CALLBACK WinProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
 
 				case VK_SPACE:
 					cloth->anchorOn = !cloth->anchorOn;
+
+					if (clothSet)
+						clothSet->anchorOn = cloth->anchorOn;
 					break;
 
 				default:
@@ -606,6 +1004,31 @@ LRESULT CALLBACK WinProc(HWND hwnd, UINT msg, WPARAM wparam, LPARAM lparam)
 }
 
 
+// Ray through the cursor from the near plane to the far plane, in the space of the cloth instance
+void cursorRay(LPARAM lparam, ClothFloat3& origin, ClothFloat3& direction)
+{
+	XMMATRIX viewMatrix = cam->dxViewTransform();
+	XMMATRIX projectionMatrix = XMMatrixPerspectiveFovLH(3.142f * 0.5f, (float)width/(float)height, 0.1f, 500.0f);
+
+	// The cloth instance is placed at (-0.5, 0, -0.5) in the scene
+	XMMATRIX worldMatrix = XMMatrixTranslation(-0.5f, 0.0f, -0.5f);
+
+	float x = (float)(short)LOWORD(lparam);
+	float y = (float)(short)HIWORD(lparam);
+
+	XMVECTOR nearPoint = XMVector3Unproject(XMVectorSet(x, y, 0.0f, 1.0f), 0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f, projectionMatrix, viewMatrix, worldMatrix);
+	XMVECTOR farPoint = XMVector3Unproject(XMVectorSet(x, y, 1.0f, 1.0f), 0.0f, 0.0f, (float)width, (float)height, 0.0f, 1.0f, projectionMatrix, viewMatrix, worldMatrix);
+
+	XMFLOAT3 nearStored, rayStored;
+
+	XMStoreFloat3(&nearStored, nearPoint);
+	XMStoreFloat3(&rayStored, XMVectorSubtract(farPoint, nearPoint));
+
+	origin		= ClothFloat3(nearStored.x, nearStored.y, nearStored.z);
+	direction	= ClothFloat3(rayStored.x, rayStored.y, rayStored.z);
+}
+
+
 void renderScene(void) 
 {
 
@@ -664,6 +1087,30 @@ void renderScene(void)
 	context->PSSetSamplers(0, 1, &linearSampler);
 
 	basicScene[0]->render(context);
+
+	// Flags and terrain share the cloth texture
+	for (size_t i = 1; i < basicScene.size(); i++) {
+
+		basicScene[i]->setupCBuffer(context, worldTransform_cbuffer);
+		basicScene[i]->render(context);
+	}
+
+	// Grass in the wind - the blades are built in the GS, which reads the camera
+	if (grass) {
+
+		context->GSSetConstantBuffers(0, 1, &camera_cbuffer);
+
+		grassPipeline->applyPipeline(context);
+		grass->render(context);
+	}
+
+	// Snow last, as it is blended over the rest of the scene
+	if (snowSystem) {
+
+		snowSystem->setCameraViewMatrix(viewMatrix);
+		snowSystem->setCameraProjectionState(projectionMatrix, 0.1f, 500.0f);
+		snowSystem->render(context);
+	}
 	
 
 